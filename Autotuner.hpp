@@ -0,0 +1,198 @@
+#pragma once
+// Calibration of the granular step size and the terrain/rover coupling
+// interval. Short trial segments are run from the same checkpoint with
+// candidate settings; a candidate passes if the bed stays stable (bounded
+// sphere overlap), the coupling does not create energy, and the wheel loads
+// follow those of a reference segment run with the current settings. The
+// cheapest passing candidate wins.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "HostParallel.hpp"
+#include "HostSpatial.hpp"
+
+// What a trial segment reports back. Plain data so a forked trial can hand
+// it over through shared memory.
+struct TrialReport {
+    static constexpr unsigned int max_samples = 256;
+
+    uint32_t completed;    // 0 if the trial failed or produced non-finite values
+    uint32_t num_samples;  // entries of load_trace in use
+    double sim_seconds;    // simulated time
+    double wall_seconds;   // wall time of the time loop
+    double max_overlap;    // deepest sphere-sphere overlap at the end, over the diameter
+    double energy_drift;   // coupling energy drift over the work exchanged
+    double load_trace[max_samples][3];  // total wheel force at equally spaced times
+};
+
+struct TuningCriteria {
+    double max_overlap = 0.05;
+    double max_energy_drift = 0.05;
+    double max_force_deviation = 0.1;
+};
+
+struct TuningCandidate {
+    double step_size;
+    unsigned int coupling_interval;
+};
+
+// Deepest overlap between spheres of the given radius, over the diameter
+inline double maxRelativeOverlap(const std::vector<Vec3f>& pos, float radius) {
+    if (pos.empty())
+        return 0;
+    float diameter = 2 * radius;
+    CellGrid grid;
+    grid.build(pos, diameter);
+    float min_d2 = parallelMax(pos.size(), -diameter * diameter, [&](size_t i) {
+        float closest = diameter * diameter;
+        grid.forEachCandidate(pos[i], [&](uint32_t j) {
+            if (j != i)
+                closest = std::min(closest, dist2(pos[i], pos[j]));
+        });
+        return -closest;
+    });
+    return std::max(0.0, (diameter - std::sqrt((double)-min_d2)) / diameter);
+}
+
+// RMS difference of two load traces over the RMS of the reference
+inline double forceDeviation(const TrialReport& trial, const TrialReport& reference) {
+    unsigned int n = std::min(trial.num_samples, reference.num_samples);
+    if (n == 0)
+        return INFINITY;
+    double diff = 0, norm = 0;
+    for (unsigned int k = 0; k < n; k++) {
+        for (int d = 0; d < 3; d++) {
+            double a = trial.load_trace[k][d], b = reference.load_trace[k][d];
+            diff += (a - b) * (a - b);
+            norm += b * b;
+        }
+    }
+    return std::sqrt(diff / std::max(norm, 1e-300));
+}
+
+class CouplingAutotuner {
+  public:
+    struct Result {
+        TuningCandidate candidate;
+        TrialReport report;
+        double force_deviation;
+        bool passed;
+    };
+
+    CouplingAutotuner(double base_step_size, unsigned int base_interval, const TuningCriteria& criteria)
+        : m_base{base_step_size, base_interval}, m_criteria(criteria) {}
+
+    // Candidate grid: step size multipliers of the base step, and intervals
+    void setStepMultipliers(const std::vector<double>& multipliers) { m_step_multipliers = multipliers; }
+    void setIntervals(const std::vector<unsigned int>& intervals) { m_intervals = intervals; }
+
+    // Run the reference and then the grid, smallest candidates first. A
+    // failed candidate prunes the larger intervals at its step size, and a
+    // step size that fails at its smallest interval ends the search.
+    // evaluate() runs one trial and returns false if it could not be run.
+    bool run(const std::function<bool(const TuningCandidate&, TrialReport&)>& evaluate) {
+        m_results.clear();
+        Result reference = trial(m_base, evaluate, nullptr);
+        if (!reference.report.completed)
+            return false;
+        reference.force_deviation = 0;
+        reference.passed = true;
+        m_results.push_back(reference);
+
+        for (double multiplier : m_step_multipliers) {
+            bool any_passed = false;
+            for (unsigned int interval : m_intervals) {
+                TuningCandidate candidate = {m_base.step_size * multiplier, interval};
+                if (multiplier == 1 && interval == m_base.coupling_interval)
+                    continue;
+                Result result = trial(candidate, evaluate, &m_results[0].report);
+                m_results.push_back(result);
+                if (!result.passed)
+                    break;
+                any_passed = true;
+            }
+            if (!any_passed && multiplier > 1)
+                break;
+        }
+        return true;
+    }
+
+    const std::vector<Result>& results() const { return m_results; }
+
+    // Cheapest passing result (the reference if nothing else passed)
+    const Result& best() const {
+        size_t best = 0;
+        for (size_t i = 1; i < m_results.size(); i++)
+            if (m_results[i].passed && cost(m_results[i]) < cost(m_results[best]))
+                best = i;
+        return m_results[best];
+    }
+
+    double speedup() const { return cost(m_results[0]) / cost(best()); }
+
+    void printReport(FILE* out = stdout) const {
+        std::fprintf(out, "Calibration (max overlap %g, max energy drift %g, max force deviation %g):\n",
+                     m_criteria.max_overlap, m_criteria.max_energy_drift, m_criteria.max_force_deviation);
+        std::fprintf(out, "  %11s %8s %10s %10s %10s %12s\n", "step_size", "interval", "overlap", "drift",
+                     "force dev", "wall/sim");
+        for (const Result& r : m_results) {
+            std::fprintf(out, "  %11.3e %8u %10.3e %10.3e %10.3e %12.3f%s\n", r.candidate.step_size,
+                         r.candidate.coupling_interval, r.report.max_overlap, r.report.energy_drift, r.force_deviation,
+                         cost(r), r.passed ? "" : "  fail");
+        }
+        const Result& b = best();
+        std::fprintf(out, "  best: step_size %g, coupling_interval %u, speedup %.2fx\n", b.candidate.step_size,
+                     b.candidate.coupling_interval, speedup());
+    }
+
+    // Write the chosen settings as JSON keys to merge into the run's file
+    bool writeSettings(const std::string& filename, const std::string& predictor) const {
+        FILE* out = std::fopen(filename.c_str(), "w");
+        if (!out)
+            return false;
+        const Result& b = best();
+        std::fprintf(out,
+                     "{\n  \"step_size\": %.9g,\n  \"coupling_interval\": %u,\n  \"coupling_predictor\": \"%s\",\n"
+                     "  \"calibration\": {\n    \"speedup\": %.4g,\n    \"max_overlap\": %.4g,\n"
+                     "    \"energy_drift\": %.4g,\n    \"force_deviation\": %.4g,\n    \"reference_step_size\": %.9g,\n"
+                     "    \"reference_coupling_interval\": %u\n  }\n}\n",
+                     b.candidate.step_size, b.candidate.coupling_interval, predictor.c_str(), speedup(),
+                     b.report.max_overlap, b.report.energy_drift, b.force_deviation, m_base.step_size,
+                     m_base.coupling_interval);
+        return std::fclose(out) == 0;
+    }
+
+  private:
+    static double cost(const Result& r) {
+        return r.report.sim_seconds > 0 ? r.report.wall_seconds / r.report.sim_seconds : INFINITY;
+    }
+
+    Result trial(const TuningCandidate& candidate,
+                 const std::function<bool(const TuningCandidate&, TrialReport&)>& evaluate,
+                 const TrialReport* reference) {
+        Result result;
+        result.candidate = candidate;
+        result.report = TrialReport();
+        bool ran = evaluate(candidate, result.report);
+        const TrialReport& r = result.report;
+        result.force_deviation = reference && ran ? forceDeviation(r, *reference) : 0;
+        result.passed = ran && r.completed && std::isfinite(r.max_overlap) && r.max_overlap <= m_criteria.max_overlap &&
+                        std::abs(r.energy_drift) <= m_criteria.max_energy_drift &&
+                        result.force_deviation <= m_criteria.max_force_deviation;
+        if (!ran)
+            result.report.completed = 0;
+        return result;
+    }
+
+    TuningCandidate m_base;
+    TuningCriteria m_criteria;
+    std::vector<double> m_step_multipliers = {1, 2, 4, 8, 16};
+    std::vector<unsigned int> m_intervals = {1, 2, 4, 8, 16, 32, 64};
+    std::vector<Result> m_results;
+};
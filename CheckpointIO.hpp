@@ -0,0 +1,47 @@
+#pragma once
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "HostSpatial.hpp"
+
+// Host-side reader/writer for the particle checkpoints written by
+// ChSystemGpu::WriteFile in CSV mode: a header line, then one particle per
+// line starting with x,y,z. Extra columns are ignored when reading.
+inline bool readCheckpointCSV(const std::string& filename, std::vector<Vec3f>& pos) {
+    std::ifstream in(filename);
+    if (!in.is_open())
+        return false;
+    pos.clear();
+    std::string line;
+    std::getline(in, line);  // skip the header
+    while (std::getline(in, line)) {
+        const char* s = line.c_str();
+        char* end;
+        Vec3f p;
+        p.x = std::strtof(s, &end);
+        if (end == s)
+            continue;
+        p.y = std::strtof(end + 1, &end);
+        p.z = std::strtof(end + 1, &end);
+        pos.push_back(p);
+    }
+    return true;
+}
+
+// Write positions (and |v| when velocities are given) in the same layout
+inline bool writeCheckpointCSV(const std::string& filename,
+                               const std::vector<Vec3f>& pos,
+                               const std::vector<Vec3f>* vel = nullptr) {
+    FILE* out = std::fopen(filename.c_str(), "w");
+    if (!out)
+        return false;
+    std::fprintf(out, "x,y,z,absv\n");
+    for (size_t i = 0; i < pos.size(); i++) {
+        float absv = vel ? length((*vel)[i]) : 0.f;
+        std::fprintf(out, "%.6g,%.6g,%.6g,%.6g\n", pos[i].x, pos[i].y, pos[i].z, absv);
+    }
+    return std::fclose(out) == 0;
+}
@@ -0,0 +1,438 @@
+#pragma once
+// Validation of particle checkpoints: count and bounds, particles outside
+// the box or non-finite, the minimum pair separation against the sphere
+// diameter (through a cell list, in parallel), packing fraction by depth
+// and free-surface height statistics. Large CSV checkpoints are parsed in
+// parallel from a memory map.
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "HostParallel.hpp"
+#include "HostSpatial.hpp"
+#include "LazyFrames.hpp"
+#include "MultiresSnapshot.hpp"
+#include "Polydisperse.hpp"
+
+// Decimal float as written by WriteFile ([-]digits[.digits][e[-]digits]).
+// Anything else (inf, nan, hex) goes through strtof. Advances s past it.
+inline float parseFloatFast(const char*& s, const char* end) {
+    const char* start = s;
+    bool negative = false;
+    if (s < end && (*s == '-' || *s == '+'))
+        negative = *s++ == '-';
+    uint64_t mantissa = 0;
+    int exponent = 0, digits = 0;
+    bool any = false;
+    for (; s < end && *s >= '0' && *s <= '9'; s++, any = true) {
+        if (digits < 19) {
+            mantissa = mantissa * 10 + (*s - '0');
+            if (mantissa)
+                digits++;
+        } else {
+            exponent++;
+        }
+    }
+    if (s < end && *s == '.') {
+        for (s++; s < end && *s >= '0' && *s <= '9'; s++, any = true) {
+            if (digits < 19) {
+                mantissa = mantissa * 10 + (*s - '0');
+                exponent--;
+                if (mantissa)
+                    digits++;
+            }
+        }
+    }
+    if (any && s < end && (*s == 'e' || *s == 'E')) {
+        const char* e = s + 1;
+        bool e_negative = false;
+        if (e < end && (*e == '-' || *e == '+'))
+            e_negative = *e++ == '-';
+        int value = 0;
+        bool e_any = false;
+        for (; e < end && *e >= '0' && *e <= '9'; e++, e_any = true)
+            value = std::min(value * 10 + (*e - '0'), 1000);
+        if (e_any) {
+            exponent += e_negative ? -value : value;
+            s = e;
+        }
+    }
+    if (!any) {
+        // not a plain decimal: let the C library have it
+        char buffer[64];
+        size_t n = std::min<size_t>(sizeof(buffer) - 1, end - start);
+        std::memcpy(buffer, start, n);
+        buffer[n] = 0;
+        char* stop;
+        float value = std::strtof(buffer, &stop);
+        s = start + (stop - buffer);
+        return value;
+    }
+    double value = (double)mantissa;
+    if (exponent != 0)
+        value *= std::pow(10.0, exponent);
+    return (float)(negative ? -value : value);
+}
+
+// Read the x,y,z columns of a CSV checkpoint, parsing chunks of the file on
+// all host threads. radius, when given, gets the "r" column of
+// polydisperse checkpoints, or stays empty when there is none.
+inline bool readCheckpointCSVParallel(const std::string& filename,
+                                      std::vector<Vec3f>& pos,
+                                      std::vector<float>* radius = nullptr) {
+    if (radius)
+        radius->clear();
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        return false;
+    }
+    size_t size = (size_t)st.st_size;
+    pos.clear();
+    if (size == 0) {
+        close(fd);
+        return true;
+    }
+    void* map = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+        return false;
+    madvise(map, size, MADV_SEQUENTIAL);
+    const char* data = static_cast<const char*>(map);
+    const char* data_end = data + size;
+    const char* body = static_cast<const char*>(std::memchr(data, '\n', size));  // skip the header
+    body = body ? body + 1 : data_end;
+    int radius_column = -1;
+    if (radius) {
+        std::string header(data, body - data);
+        std::stringstream names(header);
+        std::string name;
+        for (int column = 0; std::getline(names, name, ','); column++) {
+            while (!name.empty() && (name.back() == '\n' || name.back() == '\r'))
+                name.pop_back();
+            if (name == "r" && column >= 3)
+                radius_column = column;
+        }
+    }
+
+    // chunks start after a newline; count the lines of each, then parse
+    // into place
+    unsigned int num_chunks = hostThreadCount() * 4;
+    std::vector<const char*> starts(num_chunks + 1, data_end);
+    size_t body_size = data_end - body;
+    for (unsigned int c = 0; c < num_chunks; c++) {
+        const char* p = body + body_size * c / num_chunks;
+        if (p != body) {
+            const char* nl = static_cast<const char*>(std::memchr(p - 1, '\n', data_end - (p - 1)));
+            p = nl ? nl + 1 : data_end;
+        }
+        starts[c] = p;
+    }
+    std::vector<size_t> lines(num_chunks + 1, 0);
+    parallelFor(num_chunks, [&](size_t c) {
+        size_t count = 0;
+        for (const char* p = starts[c]; p < starts[c + 1];) {
+            const char* nl = static_cast<const char*>(std::memchr(p, '\n', starts[c + 1] - p));
+            const char* line_end = nl ? nl : starts[c + 1];
+            if (line_end > p && ((*p >= '0' && *p <= '9') || *p == '-' || *p == '+' || *p == '.'))
+                count++;
+            p = line_end + 1;
+        }
+        lines[c + 1] = count;
+    });
+    for (unsigned int c = 0; c < num_chunks; c++)
+        lines[c + 1] += lines[c];
+    pos.resize(lines[num_chunks]);
+    if (radius_column >= 0)
+        radius->resize(pos.size());
+    parallelFor(num_chunks, [&](size_t c) {
+        size_t k = lines[c];
+        for (const char* p = starts[c]; p < starts[c + 1];) {
+            const char* nl = static_cast<const char*>(std::memchr(p, '\n', starts[c + 1] - p));
+            const char* line_end = nl ? nl : starts[c + 1];
+            if (line_end > p && ((*p >= '0' && *p <= '9') || *p == '-' || *p == '+' || *p == '.')) {
+                const char* s = p;
+                Vec3f& v = pos[k++];
+                v.x = parseFloatFast(s, line_end);
+                s += s < line_end;
+                v.y = parseFloatFast(s, line_end);
+                s += s < line_end;
+                v.z = parseFloatFast(s, line_end);
+                if (radius_column >= 0) {
+                    for (int column = 2; column < radius_column && s < line_end; s++)
+                        column += *s == ',';
+                    (*radius)[k - 1] = parseFloatFast(s, line_end);
+                }
+            }
+            p = line_end + 1;
+        }
+    });
+    munmap(map, size);
+    return true;
+}
+
+// Particle positions from a CSV checkpoint, a lazy checkpoint (.bin) or a
+// multiresolution snapshot (.mrs), told apart by their first bytes. Lazy
+// checkpoints also fill vel, when given, and CSV checkpoints with an "r"
+// column fill radius; the others leave them empty.
+inline bool readAnyCheckpoint(const std::string& filename,
+                              std::vector<Vec3f>& pos,
+                              std::vector<Vec3f>* vel = nullptr,
+                              std::vector<float>* radius = nullptr) {
+    if (vel)
+        vel->clear();
+    if (radius)
+        radius->clear();
+    char magic[8] = {};
+    FILE* in = std::fopen(filename.c_str(), "rb");
+    if (!in)
+        return false;
+    size_t got = std::fread(magic, 1, sizeof(magic), in);
+    std::fclose(in);
+    if (got == sizeof(magic) && std::memcmp(magic, LazyCheckpoint::magic(), 8) == 0) {
+        LazyCheckpoint state;
+        if (!state.read(filename))
+            return false;
+        pos.resize(state.numParticles());
+        for (size_t i = 0; i < pos.size(); i++)
+            pos[i] = {state.pos[3 * i], state.pos[3 * i + 1], state.pos[3 * i + 2]};
+        if (vel) {
+            vel->resize(pos.size());
+            for (size_t i = 0; i < pos.size(); i++)
+                (*vel)[i] = {state.vel[3 * i], state.vel[3 * i + 1], state.vel[3 * i + 2]};
+        }
+        return true;
+    }
+    if (got == sizeof(magic) && std::memcmp(magic, "RVMRES1", 8) == 0) {
+        MultiresHeader header;
+        std::vector<uint64_t> level_counts;
+        std::vector<MultiresRecord> records;
+        if (!readMultiresSnapshot(filename, 0, header, level_counts, records))
+            return false;
+        pos.resize(records.size());
+        for (size_t i = 0; i < records.size(); i++)
+            pos[records[i].id < pos.size() ? records[i].id : i] = {records[i].pos[0], records[i].pos[1],
+                                                                   records[i].pos[2]};
+        return true;
+    }
+    if (got >= 4 && std::memcmp(magic, "PAR1", 4) == 0)
+        return false;  // Parquet frames are for analysis, not read back here
+    return readCheckpointCSVParallel(filename, pos, radius);
+}
+
+struct InspectSettings {
+    float sphere_radius = 1;
+    float box[3] = {400, 200, 50};  // full extents, centred on the origin
+    float tolerance = 0.05f;        // allowed overlap or wall penetration, as a share of the diameter
+    float depth_bin = 4;            // thickness of the packing fraction bins
+    float column = 4;               // edge of the free-surface columns (xy)
+};
+
+struct CheckpointReport {
+    size_t count = 0;
+    size_t non_finite = 0;
+    Vec3f lo = {0, 0, 0}, hi = {0, 0, 0};
+    size_t outside_box = 0;  // penetrating a wall by more than the tolerance
+
+    // closest pair relative to its contact distance r_i + r_j, within the
+    // search radius (contact plus half the smallest radius), or -1
+    double min_separation = -1;
+    double min_contact = 0;  // r_i + r_j of that pair
+    uint32_t min_pair[2] = {0, 0};
+    size_t overlapping_pairs = 0;  // closer than contact by more than the tolerance
+
+    std::vector<double> packing;  // by depth bin, from the box floor up
+
+    size_t columns = 0, empty_columns = 0;
+    double surface_mean = 0, surface_std = 0, surface_min = 0, surface_max = 0;
+    double surface_p05 = 0, surface_p50 = 0, surface_p95 = 0;
+
+    bool violations() const { return non_finite > 0 || outside_box > 0 || overlapping_pairs > 0; }
+};
+
+// all_radii, when not empty, gives each particle its own radius (polydisperse
+// checkpoints); otherwise all have s.sphere_radius. Tolerances are shares of
+// the smaller diameter of a pair.
+inline CheckpointReport inspectCheckpoint(const std::vector<Vec3f>& all,
+                                          const InspectSettings& s,
+                                          const std::vector<float>& all_radii = {}) {
+    CheckpointReport report;
+    report.count = all.size();
+    const bool polydisperse = !all_radii.empty();
+
+    // non-finite positions are counted and left out of everything else
+    std::vector<Vec3f> finite_copy;
+    std::vector<float> finite_radii;
+    std::vector<uint32_t> finite_index;  // into all, when some are dropped
+    size_t non_finite = 0;
+    for (const Vec3f& p : all)
+        non_finite += !(std::isfinite(p.x) && std::isfinite(p.y) && std::isfinite(p.z));
+    if (non_finite > 0) {
+        for (size_t i = 0; i < all.size(); i++)
+            if (std::isfinite(all[i].x) && std::isfinite(all[i].y) && std::isfinite(all[i].z)) {
+                finite_copy.push_back(all[i]);
+                finite_index.push_back((uint32_t)i);
+                if (polydisperse)
+                    finite_radii.push_back(all_radii[i]);
+            }
+    }
+    const std::vector<Vec3f>& pos = non_finite > 0 ? finite_copy : all;
+    const std::vector<float>& radii = non_finite > 0 ? finite_radii : all_radii;
+    auto radiusOf = [&](size_t i) { return polydisperse ? radii[i] : s.sphere_radius; };
+    report.non_finite = non_finite;
+    if (pos.empty())
+        return report;
+    computeBounds(pos, report.lo, report.hi);
+
+    std::vector<size_t> outside(hostThreadCount(), 0);
+    parallelForChunks(pos.size(), [&](size_t begin, size_t end, unsigned int tid) {
+        size_t n = 0;
+        for (size_t i = begin; i < end; i++) {
+            const float c[3] = {pos[i].x, pos[i].y, pos[i].z};
+            const float r = radiusOf(i), slack = s.tolerance * 2 * r;
+            for (int k = 0; k < 3; k++)
+                if (std::abs(c[k]) > s.box[k] / 2 - r + slack) {
+                    n++;
+                    break;
+                }
+        }
+        outside[tid] = n;
+    });
+    for (size_t n : outside)
+        report.outside_box += n;
+
+    // closest pair and overlaps, each pair seen once: j > i in one cell
+    // list, or the size-binned half list for polydisperse beds. The closest
+    // pair is the one with the smallest distance over contact distance.
+    const float r_min = polydisperse ? *std::min_element(radii.begin(), radii.end()) : s.sphere_radius;
+    const float skin = 0.5f * r_min;  // 1.25 diameters for equal spheres
+    CellGrid grid;
+    SizeBinnedGrid binned;
+    if (polydisperse)
+        binned.build(pos, radii, skin);
+    else
+        grid.build(pos, 2 * s.sphere_radius + skin);
+    struct Closest {
+        float ratio2;  // (distance / contact)^2
+        uint32_t i, j;
+        size_t overlaps;
+    };
+    const float far = 2;
+    std::vector<Closest> closest(hostThreadCount(), {far, 0, 0, 0});
+    parallelForChunks(pos.size(), [&](size_t begin, size_t end, unsigned int tid) {
+        Closest local = {far, 0, 0, 0};
+        for (size_t i = begin; i < end; i++) {
+            const Vec3f& p = pos[i];
+            const float ri = radiusOf(i);
+            auto pair = [&](uint32_t j, float d2) {
+                float rj = radiusOf(j), contact = ri + rj;
+                float limit = contact - s.tolerance * 2 * std::min(ri, rj);
+                float reach = contact + skin;
+                if (d2 >= reach * reach)
+                    return;
+                if (d2 < limit * limit)
+                    local.overlaps++;
+                float ratio2 = d2 / (contact * contact);
+                if (ratio2 < local.ratio2)
+                    local = {ratio2, (uint32_t)i, j, local.overlaps};
+            };
+            if (polydisperse)
+                binned.forEachPairOf(pos, radii, (uint32_t)i, skin, pair);
+            else
+                grid.forEachCandidate(p, [&](uint32_t j) {
+                    if (j > i)
+                        pair(j, dist2(p, pos[j]));
+                });
+        }
+        closest[tid] = local;
+    });
+    Closest best = {far, 0, 0, 0};
+    for (const Closest& c : closest) {
+        report.overlapping_pairs += c.overlaps;
+        if (c.ratio2 < best.ratio2)
+            best = c;
+    }
+    if (best.ratio2 < far) {
+        report.min_contact = radiusOf(best.i) + radiusOf(best.j);
+        report.min_separation = std::sqrt(best.ratio2) * report.min_contact;
+        report.min_pair[0] = finite_index.empty() ? best.i : finite_index[best.i];
+        report.min_pair[1] = finite_index.empty() ? best.j : finite_index[best.j];
+    }
+
+    // packing fraction by depth: sphere volume by centre over the bin volume
+    const float floor_z = -s.box[2] / 2;
+    size_t num_bins = (size_t)std::max(1.f, std::ceil(s.box[2] / s.depth_bin));
+    std::vector<std::vector<double>> bins(hostThreadCount(), std::vector<double>(num_bins, 0));
+    parallelForChunks(pos.size(), [&](size_t begin, size_t end, unsigned int tid) {
+        for (size_t i = begin; i < end; i++) {
+            long b = (long)std::floor((pos[i].z - floor_z) / s.depth_bin);
+            double r = radiusOf(i);
+            bins[tid][std::min<long>(std::max<long>(b, 0), (long)num_bins - 1)] += 4. / 3. * M_PI * r * r * r;
+        }
+    });
+    double bin_volume = (double)s.box[0] * s.box[1] * s.depth_bin;
+    report.packing.assign(num_bins, 0);
+    for (size_t b = 0; b < num_bins; b++) {
+        double volume = 0;
+        for (const auto& t : bins)
+            volume += t[b];
+        report.packing[b] = volume / bin_volume;
+    }
+
+    // free surface: top of the highest sphere in each xy column
+    int nx = std::max(1, (int)std::ceil(s.box[0] / s.column));
+    int ny = std::max(1, (int)std::ceil(s.box[1] / s.column));
+    const float lowest = -std::numeric_limits<float>::infinity();
+    std::vector<std::vector<float>> tops(hostThreadCount(), std::vector<float>((size_t)nx * ny, lowest));
+    parallelForChunks(pos.size(), [&](size_t begin, size_t end, unsigned int tid) {
+        std::vector<float>& top = tops[tid];
+        for (size_t i = begin; i < end; i++) {
+            int cx = std::min(std::max((int)((pos[i].x + s.box[0] / 2) / s.column), 0), nx - 1);
+            int cy = std::min(std::max((int)((pos[i].y + s.box[1] / 2) / s.column), 0), ny - 1);
+            float& t = top[(size_t)cy * nx + cx];
+            t = std::max(t, pos[i].z + radiusOf(i));
+        }
+    });
+    std::vector<float> heights;
+    for (size_t c = 0; c < (size_t)nx * ny; c++) {
+        float t = lowest;
+        for (const auto& top : tops)
+            t = std::max(t, top[c]);
+        if (t > lowest)
+            heights.push_back(t);
+    }
+    report.columns = (size_t)nx * ny;
+    report.empty_columns = report.columns - heights.size();
+    if (!heights.empty()) {
+        double sum = 0, sum2 = 0;
+        for (float h : heights) {
+            sum += h;
+            sum2 += (double)h * h;
+        }
+        report.surface_mean = sum / heights.size();
+        report.surface_std = std::sqrt(std::max(0., sum2 / heights.size() - report.surface_mean * report.surface_mean));
+        std::sort(heights.begin(), heights.end());
+        auto percentile = [&](double q) { return heights[(size_t)std::round(q * (heights.size() - 1))]; };
+        report.surface_min = heights.front();
+        report.surface_max = heights.back();
+        report.surface_p05 = percentile(0.05);
+        report.surface_p50 = percentile(0.5);
+        report.surface_p95 = percentile(0.95);
+    }
+    return report;
+}
@@ -0,0 +1,413 @@
+#pragma once
+// Transforms over particle checkpoints for building composite beds: crop by
+// box or heightfield, affine transforms, radius rescaling, merging with
+// overlap removal, stacking, random subsampling, and wrapping and tiling
+// along a periodic x. Each runs over blocks
+// of particles on all host threads. Beds are written in any checkpoint
+// format the host tools read, picked by file extension.
+
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "CheckpointInspect.hpp"
+#include "ColumnarExport.hpp"
+#include "HostParallel.hpp"
+#include "HostSpatial.hpp"
+#include "LazyFrames.hpp"
+#include "MultiresSnapshot.hpp"
+
+struct ParticleBed {
+    std::vector<Vec3f> pos;
+    std::vector<Vec3f> vel;     // empty when the source has no velocities
+    std::vector<float> radii;   // per particle, empty when all have radius
+    float radius = 1;
+
+    size_t size() const { return pos.size(); }
+    bool polydisperse() const { return !radii.empty(); }
+    float radiusOf(size_t i) const { return radii.empty() ? radius : radii[i]; }
+};
+
+// radius is the sphere radius of monodisperse checkpoints
+inline bool readBed(const std::string& filename, float radius, ParticleBed& bed) {
+    bed.radius = radius;
+    return readAnyCheckpoint(filename, bed.pos, &bed.vel, &bed.radii);
+}
+
+// Keep the particles with keep[i] != 0, in order
+inline void compactBed(ParticleBed& bed, const std::vector<uint8_t>& keep) {
+    unsigned int num_threads = hostThreadCount();
+    std::vector<size_t> offset(num_threads + 1, 0);
+    parallelForChunks(bed.size(), [&](size_t begin, size_t end, unsigned int tid) {
+        size_t n = 0;
+        for (size_t i = begin; i < end; i++)
+            n += keep[i] != 0;
+        offset[tid + 1] = n;
+    });
+    for (unsigned int t = 0; t < num_threads; t++)
+        offset[t + 1] += offset[t];
+    ParticleBed kept;
+    kept.radius = bed.radius;
+    kept.pos.resize(offset[num_threads]);
+    kept.vel.resize(bed.vel.empty() ? 0 : kept.pos.size());
+    kept.radii.resize(bed.radii.empty() ? 0 : kept.pos.size());
+    parallelForChunks(bed.size(), [&](size_t begin, size_t end, unsigned int tid) {
+        size_t k = offset[tid];
+        for (size_t i = begin; i < end; i++) {
+            if (!keep[i])
+                continue;
+            kept.pos[k] = bed.pos[i];
+            if (!bed.vel.empty())
+                kept.vel[k] = bed.vel[i];
+            if (!bed.radii.empty())
+                kept.radii[k] = bed.radii[i];
+            k++;
+        }
+    });
+    bed = std::move(kept);
+}
+
+template <typename F>
+void keepIf(ParticleBed& bed, F&& pred) {
+    std::vector<uint8_t> keep(bed.size());
+    parallelFor(bed.size(), [&](size_t i) { keep[i] = pred(bed.pos[i]) ? 1 : 0; });
+    compactBed(bed, keep);
+}
+
+// Keep centres inside [lo, hi]
+inline void cropBox(ParticleBed& bed, const Vec3f& lo, const Vec3f& hi) {
+    keepIf(bed, [&](const Vec3f& p) {
+        return p.x >= lo.x && p.x <= hi.x && p.y >= lo.y && p.y <= hi.y && p.z >= lo.z && p.z <= hi.z;
+    });
+}
+
+// Surface height on a regular xy grid centred on the origin, sampled
+// bilinearly and clamped at the edges. A periodic_x field repeats along x
+// with period size_x, its last column matching the first.
+struct Heightfield {
+    int nx = 1, ny = 1;
+    float size_x = 0, size_y = 0;
+    std::vector<float> heights = {0};  // row-major, y rows of x samples
+    bool periodic_x = false;
+
+    float sample(float x, float y) const {
+        if (periodic_x)
+            x = periodicBoxX(size_x).wrap(x);
+        float fx = nx > 1 ? (x / size_x + 0.5f) * (nx - 1) : 0;
+        float fy = ny > 1 ? (y / size_y + 0.5f) * (ny - 1) : 0;
+        fx = std::min(std::max(fx, 0.f), (float)(nx - 1));
+        fy = std::min(std::max(fy, 0.f), (float)(ny - 1));
+        int x0 = std::min((int)fx, nx - 1), y0 = std::min((int)fy, ny - 1);
+        int x1 = std::min(x0 + 1, nx - 1), y1 = std::min(y0 + 1, ny - 1);
+        float tx = fx - x0, ty = fy - y0;
+        float a = heights[(size_t)y0 * nx + x0] * (1 - tx) + heights[(size_t)y0 * nx + x1] * tx;
+        float b = heights[(size_t)y1 * nx + x0] * (1 - tx) + heights[(size_t)y1 * nx + x1] * tx;
+        return a * (1 - ty) + b * ty;
+    }
+};
+
+// A CSV of heights, one row per y sample from -size_y/2 to size_y/2, each
+// row the x samples from -size_x/2 to size_x/2
+inline bool loadHeightfield(const std::string& filename, float size_x, float size_y, Heightfield& field) {
+    std::ifstream in(filename);
+    if (!in.is_open())
+        return false;
+    field = Heightfield();
+    field.heights.clear();
+    field.size_x = size_x;
+    field.size_y = size_y;
+    std::string line;
+    int rows = 0, cols = -1;
+    while (std::getline(in, line)) {
+        std::stringstream row(line);
+        std::string cell;
+        int n = 0;
+        while (std::getline(row, cell, ',')) {
+            field.heights.push_back(std::strtof(cell.c_str(), nullptr));
+            n++;
+        }
+        if (n == 0)
+            continue;
+        if (cols >= 0 && n != cols)
+            return false;
+        cols = n;
+        rows++;
+    }
+    if (rows == 0)
+        return false;
+    field.nx = cols;
+    field.ny = rows;
+    return true;
+}
+
+// The inverse of loadHeightfield
+inline bool writeHeightfield(const std::string& filename, const Heightfield& field) {
+    FILE* out = std::fopen(filename.c_str(), "w");
+    if (!out)
+        return false;
+    bool ok = true;
+    for (int y = 0; y < field.ny && ok; y++)
+        for (int x = 0; x < field.nx && ok; x++)
+            ok = std::fprintf(out, x + 1 < field.nx ? "%.6g," : "%.6g\n", field.heights[(size_t)y * field.nx + x]) > 0;
+    return std::fclose(out) == 0 && ok;
+}
+
+// Keep particles whose top is at or below the surface
+inline void cropBelow(ParticleBed& bed, const Heightfield& field) {
+    std::vector<uint8_t> keep(bed.size());
+    parallelFor(bed.size(), [&](size_t i) {
+        const Vec3f& p = bed.pos[i];
+        keep[i] = p.z + bed.radiusOf(i) <= field.sample(p.x, p.y) ? 1 : 0;
+    });
+    compactBed(bed, keep);
+}
+
+// p' = m p + t, with velocities rotated by m; m is row-major
+inline void applyAffine(ParticleBed& bed, const float m[9], const Vec3f& t) {
+    auto apply = [m](const Vec3f& p) {
+        return Vec3f{m[0] * p.x + m[1] * p.y + m[2] * p.z, m[3] * p.x + m[4] * p.y + m[5] * p.z,
+                     m[6] * p.x + m[7] * p.y + m[8] * p.z};
+    };
+    parallelFor(bed.size(), [&](size_t i) {
+        bed.pos[i] = apply(bed.pos[i]) + t;
+        if (!bed.vel.empty())
+            bed.vel[i] = apply(bed.vel[i]);
+    });
+}
+
+inline void translateBed(ParticleBed& bed, const Vec3f& t) {
+    const float identity[9] = {1, 0, 0, 0, 1, 0, 0, 0, 1};
+    applyAffine(bed, identity, t);
+}
+
+// Rotation about the vertical axis through the origin
+inline void rotateBedZ(ParticleBed& bed, float degrees) {
+    float a = degrees * (float)M_PI / 180.f;
+    const float m[9] = {std::cos(a), -std::sin(a), 0, std::sin(a), std::cos(a), 0, 0, 0, 1};
+    applyAffine(bed, m, {0, 0, 0});
+}
+
+// New sphere radius (of polydisperse beds: the reference radius, with every
+// radius scaled alike), with positions and velocities scaled about origin by
+// the same factor so the packing is unchanged
+inline void scaleRadius(ParticleBed& bed, float radius, const Vec3f& origin) {
+    float s = radius / bed.radius;
+    const float m[9] = {s, 0, 0, 0, s, 0, 0, 0, s};
+    applyAffine(bed, m, origin - origin * s);
+    bed.radius = radius;
+    for (float& r : bed.radii)
+        r *= s;
+}
+
+// Append the particles of other that do not overlap bed by more than
+// tolerance diameters; returns how many were dropped. Both beds must be
+// monodisperse with the same radius.
+inline size_t mergeBeds(ParticleBed& bed, const ParticleBed& other, float tolerance) {
+    float d = 2 * bed.radius;
+    float limit2 = (d * (1 - tolerance)) * (d * (1 - tolerance));
+    HashedCellGrid grid;
+    grid.build(bed.pos, d);
+    std::vector<uint8_t> keep(other.size());
+    parallelFor(other.size(), [&](size_t i) {
+        bool free = true;
+        grid.forEachCandidate(other.pos[i],
+                              [&](uint32_t j) { free = free && dist2(other.pos[i], bed.pos[j]) >= limit2; });
+        keep[i] = free ? 1 : 0;
+    });
+    ParticleBed added = other;
+    added.radius = bed.radius;
+    compactBed(added, keep);
+
+    size_t old_size = bed.size();
+    if (bed.vel.empty() != added.vel.empty()) {
+        // one side has velocities: the other's are zero
+        if (bed.vel.empty())
+            bed.vel.assign(old_size, {0, 0, 0});
+        else
+            added.vel.assign(added.size(), {0, 0, 0});
+    }
+    bed.pos.insert(bed.pos.end(), added.pos.begin(), added.pos.end());
+    bed.vel.insert(bed.vel.end(), added.vel.begin(), added.vel.end());
+    return other.size() - added.size();
+}
+
+// Place other on top of bed, its lowest spheres resting on the highest of
+// bed (plus gap), then merge
+inline size_t stackBeds(ParticleBed& bed, ParticleBed other, float gap, float tolerance) {
+    if (!bed.pos.empty() && !other.pos.empty()) {
+        Vec3f lo, hi, other_lo, other_hi;
+        computeBounds(bed.pos, lo, hi);
+        computeBounds(other.pos, other_lo, other_hi);
+        translateBed(other, {0, 0, hi.z + 2 * bed.radius + gap - other_lo.z});
+    }
+    return mergeBeds(bed, other, tolerance);
+}
+
+// Fold x into the period
+inline void wrapBedX(ParticleBed& bed, const PeriodicX& periodic) {
+    parallelFor(bed.size(), [&](size_t i) { bed.pos[i].x = periodic.wrap(bed.pos[i].x); });
+}
+
+// count copies of the bed placed period apart along x, the row centred where
+// the bed was. A bed wrapped into a periodic bin of that length tiles into
+// a longer box without a seam.
+inline void tileBedX(ParticleBed& bed, float period, int count) {
+    if (count <= 1)
+        return;
+    size_t n = bed.size();
+    bed.pos.resize(n * count);
+    bed.vel.resize(bed.vel.empty() ? 0 : n * count);
+    bed.radii.resize(bed.radii.empty() ? 0 : n * count);
+    // copies first, then the originals moved to the first place in the row
+    parallelFor(n * (count - 1), [&](size_t c) {
+        size_t i = c % n, k = c + n;
+        bed.pos[k] = {bed.pos[i].x + period * (float)(k / n), bed.pos[i].y, bed.pos[i].z};
+        if (!bed.vel.empty())
+            bed.vel[k] = bed.vel[i];
+        if (!bed.radii.empty())
+            bed.radii[k] = bed.radii[i];
+    });
+    translateBed(bed, {-period * (count - 1) / 2.f, 0, 0});
+}
+
+// Wrap the bed into the period, then drop the particles near its high end
+// that overlap, by more than tolerance of the sum of radii, the images of
+// particles near its low end; returns how many were dropped. Beds cut from
+// a longer box overlap there once the period is closed.
+inline size_t removeSeamOverlaps(ParticleBed& bed, const PeriodicX& periodic, float tolerance) {
+    if (!periodic.enabled() || bed.pos.empty())
+        return 0;
+    wrapBedX(bed, periodic);
+    float r_max = bed.radius;
+    for (float r : bed.radii)
+        r_max = std::max(r_max, r);
+    float reach = 2 * r_max;
+    float hi = periodic.lo + periodic.length;
+    std::vector<Vec3f> images;
+    std::vector<uint32_t> image_of;
+    periodicImages(bed.pos, periodic, reach, images, image_of);
+    HashedCellGrid grid;
+    grid.build(images, reach);
+    std::vector<uint8_t> keep(bed.size());
+    parallelFor(bed.size(), [&](size_t i) {
+        bool free = true;
+        if (bed.pos[i].x >= hi - reach) {
+            // only the images past the high end, of particles near the low one
+            grid.forEachCandidate(bed.pos[i], [&](uint32_t k) {
+                float limit = (bed.radiusOf(i) + bed.radiusOf(image_of[k])) * (1 - tolerance);
+                free = free && !(images[k].x >= hi && dist2(bed.pos[i], images[k]) < limit * limit);
+            });
+        }
+        keep[i] = free ? 1 : 0;
+    });
+    size_t old_size = bed.size();
+    compactBed(bed, keep);
+    return old_size - bed.size();
+}
+
+// Keep each particle with the given probability, decided by a hash of its
+// index so the result does not depend on the thread count
+inline void subsampleBed(ParticleBed& bed, double fraction, uint64_t seed) {
+    std::vector<uint8_t> keep(bed.size());
+    uint64_t threshold = fraction >= 1 ? ~uint64_t(0) : (uint64_t)(std::max(0.0, fraction) * 18446744073709551616.0);
+    parallelFor(bed.size(), [&](size_t i) {
+        // splitmix64 finaliser
+        uint64_t z = (uint64_t)i + seed * 0x9E3779B97F4A7C15ULL + 0x9E3779B97F4A7C15ULL;
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+        z ^= z >> 31;
+        keep[i] = fraction >= 1 || z < threshold ? 1 : 0;
+    });
+    compactBed(bed, keep);
+}
+
+// CSV in the layout of writeCheckpointCSV, blocks formatted on all host
+// threads and written in order. Per-particle radii, when given, go in an
+// extra "r" column.
+inline bool writeCheckpointCSVParallel(const std::string& filename,
+                                       const std::vector<Vec3f>& pos,
+                                       const std::vector<Vec3f>* vel = nullptr,
+                                       const std::vector<float>* radius = nullptr) {
+    FILE* out = std::fopen(filename.c_str(), "w");
+    if (!out)
+        return false;
+    bool ok = std::fputs(radius ? "x,y,z,absv,r\n" : "x,y,z,absv\n", out) >= 0;
+    const size_t block = 1 << 16;
+    size_t num_blocks = (pos.size() + block - 1) / block;
+    std::vector<std::string> text(hostThreadCount());
+    for (size_t first = 0; first < num_blocks && ok; first += text.size()) {
+        size_t count = std::min(text.size(), num_blocks - first);
+        parallelFor(count, [&](size_t b) {
+            std::string& s = text[b];
+            s.clear();
+            char line[96];
+            size_t end = std::min(pos.size(), (first + b + 1) * block);
+            for (size_t i = (first + b) * block; i < end; i++) {
+                float absv = vel ? length((*vel)[i]) : 0.f;
+                int n = std::snprintf(line, sizeof(line), "%.6g,%.6g,%.6g,%.6g", pos[i].x, pos[i].y, pos[i].z, absv);
+                if (radius)
+                    n += std::snprintf(line + n, sizeof(line) - n, ",%.6g", (*radius)[i]);
+                line[n++] = '\n';
+                s.append(line, n);
+            }
+        });
+        for (size_t b = 0; b < count && ok; b++)
+            ok = std::fwrite(text[b].data(), 1, text[b].size(), out) == text[b].size();
+    }
+    return std::fclose(out) == 0 && ok;
+}
+
+inline bool hasExtension(const std::string& filename, const std::string& extension) {
+    return filename.size() >= extension.size() &&
+           filename.compare(filename.size() - extension.size(), extension.size(), extension) == 0;
+}
+
+// .mrs multiresolution snapshot, .parquet frame (id, x, y, z, absv, plus r
+// when polydisperse), .bin lazy checkpoint (particles only), anything else
+// CSV. Multiresolution snapshots and lazy checkpoints have no radius, so
+// polydisperse beds can only go to CSV and Parquet.
+inline bool writeBed(const std::string& filename, const ParticleBed& bed) {
+    const std::vector<Vec3f>* vel = bed.vel.empty() ? nullptr : &bed.vel;
+    bool no_radius = hasExtension(filename, ".mrs") || hasExtension(filename, ".bin");
+    if (bed.polydisperse() && no_radius)
+        return false;
+    if (hasExtension(filename, ".mrs"))
+        return writeMultiresSnapshot(filename, bed.pos);
+    if (hasExtension(filename, ".parquet")) {
+        std::vector<int32_t> ids(bed.size());
+        std::vector<float> absv(bed.size(), 0.f);
+        parallelFor(bed.size(), [&](size_t i) {
+            ids[i] = (int32_t)i;
+            if (vel)
+                absv[i] = length(bed.vel[i]);
+        });
+        const Vec3f* p = bed.pos.data();
+        std::vector<ParquetColumn> columns = {
+            {"id", ParquetColumn::INT32, ParquetColumn::DELTA_BINARY_PACKED, ids.data(), sizeof(int32_t)},
+            {"x", ParquetColumn::FLOAT, ParquetColumn::PLAIN, p ? &p->x : nullptr, sizeof(Vec3f)},
+            {"y", ParquetColumn::FLOAT, ParquetColumn::PLAIN, p ? &p->y : nullptr, sizeof(Vec3f)},
+            {"z", ParquetColumn::FLOAT, ParquetColumn::PLAIN, p ? &p->z : nullptr, sizeof(Vec3f)},
+            {"absv", ParquetColumn::FLOAT, ParquetColumn::PLAIN, absv.data(), sizeof(float)}};
+        if (bed.polydisperse())
+            columns.push_back({"r", ParquetColumn::FLOAT, ParquetColumn::PLAIN, bed.radii.data(), sizeof(float)});
+        return writeParquet(filename, bed.size(), columns);
+    }
+    if (hasExtension(filename, ".bin")) {
+        LazyCheckpoint state;
+        state.pos.resize(3 * bed.size());
+        state.vel.assign(3 * bed.size(), 0.f);
+        state.ang_vel.assign(3 * bed.size(), 0.f);
+        for (size_t i = 0; i < bed.size(); i++) {
+            std::memcpy(&state.pos[3 * i], &bed.pos[i], sizeof(Vec3f));
+            if (vel)
+                std::memcpy(&state.vel[3 * i], &bed.vel[i], sizeof(Vec3f));
+        }
+        return state.write(filename);
+    }
+    return writeCheckpointCSVParallel(filename, bed.pos, vel, bed.polydisperse() ? &bed.radii : nullptr);
+}
@@ -0,0 +1,224 @@
+#pragma once
+// Coarse graining of the far field of a particle bed: outside a corridor
+// along the wheel path, fine particles are replaced by fewer spheres of
+// `factor` times the radius, of the same material, packed to the packing
+// fraction of the fine bed so the bulk density is unchanged.
+//
+// The coarse spheres sit on a lattice of square layers (in-layer spacing
+// 2.02 R as PDLayerSampler_BOX uses), alternate layers shifted by half a
+// spacing, with the layer spacing chosen to match the fine packing. Each
+// lattice site owns a cell of volume spacing^2 * layer spacing and takes the
+// fine particles whose centres fall in it; a site with at least half a
+// coarse sphere of solid volume becomes one coarse sphere, so the solid
+// volume is conserved to within the rounding at the free surface. Sites
+// whose cells reach into the corridor or whose spheres would leave the bed
+// footprint keep their particles fine. Fine particles at the corridor edge
+// that overlap a coarse sphere are absorbed into it.
+
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <limits>
+#include <string>
+#include <vector>
+
+#include "CheckpointTransform.hpp"
+#include "ColumnarExport.hpp"
+#include "HostParallel.hpp"
+#include "HostSpatial.hpp"
+
+struct CoarseGrainSettings {
+    // particles stay fine in x0 <= x <= x1, y0 <= y <= y1
+    float corridor_x[2] = {-std::numeric_limits<float>::infinity(), std::numeric_limits<float>::infinity()};
+    float corridor_y[2] = {-50, 50};
+    float factor = 2;         // coarse radius / fine radius
+    float packing = 0;        // fine packing fraction to match; 0 measures it from the bed
+    float tolerance = 0.05f;  // fine-coarse overlap left at the corridor edge, in fine diameters
+};
+
+struct CoarseGrainResult {
+    ParticleBed bed;               // the kept fine particles, then the coarse ones
+    std::vector<int64_t> mapping;  // output index of each input particle, -1 if dropped
+    size_t fine_kept = 0;
+    size_t coarse = 0;
+    size_t replaced = 0;  // fine particles represented by coarse ones
+    size_t absorbed = 0;  // of those, overlapping ones at the corridor edge
+    size_t dropped = 0;   // in surface cells too empty for a coarse sphere
+    float packing_fine = 0, packing_coarse = 0;
+    float spacing = 0, layer_spacing = 0;
+    double volume_replaced = 0, volume_coarse = 0;  // solid volume in and out of the coarse region
+};
+
+// Packing fraction of a monodisperse bed: its solid volume over the volume
+// under the free surface, taken as the top of the highest sphere in each
+// xy column of two diameters
+inline float measureBedPacking(const std::vector<Vec3f>& pos, float r) {
+    if (pos.empty())
+        return 0;
+    Vec3f lo, hi;
+    computeBounds(pos, lo, hi);
+    float column = 4 * r;
+    int nx = std::max(1, (int)std::ceil((hi.x - lo.x + 2 * r) / column));
+    int ny = std::max(1, (int)std::ceil((hi.y - lo.y + 2 * r) / column));
+    float floor_z = lo.z - r;
+    std::vector<float> tops((size_t)nx * ny, floor_z);
+    for (const Vec3f& p : pos) {
+        int cx = std::min((int)((p.x - lo.x + r) / column), nx - 1);
+        int cy = std::min((int)((p.y - lo.y + r) / column), ny - 1);
+        float& t = tops[(size_t)cy * nx + cx];
+        t = std::max(t, p.z + r);
+    }
+    // edge columns only partly cover the footprint
+    double volume = 0;
+    for (int cy = 0; cy < ny; cy++)
+        for (int cx = 0; cx < nx; cx++) {
+            double w = std::min(column, hi.x - lo.x + 2 * r - cx * column);
+            double h = std::min(column, hi.y - lo.y + 2 * r - cy * column);
+            volume += w * h * (tops[(size_t)cy * nx + cx] - floor_z);
+        }
+    return volume > 0 ? (float)(pos.size() * (4. / 3. * M_PI * r * r * r) / volume) : 0;
+}
+
+inline CoarseGrainResult coarseGrain(const ParticleBed& fine, const CoarseGrainSettings& s) {
+    CoarseGrainResult result;
+    const std::vector<Vec3f>& pos = fine.pos;
+    result.mapping.assign(pos.size(), -1);
+    result.bed.radius = fine.radius;
+    if (pos.empty())
+        return result;
+
+    const float r = fine.radius, R = s.factor * r;
+    const double v_fine = 4. / 3. * M_PI * r * r * r, v_coarse = v_fine * s.factor * s.factor * s.factor;
+    result.packing_fine = s.packing > 0 ? s.packing : measureBedPacking(pos, r);
+    const float a = 2.02f * R;
+    float c = result.packing_fine > 0 ? (float)(v_coarse / (result.packing_fine * a * a)) : a;
+    c = std::max(c, a / std::sqrt(2.f));  // neighbours in the next layer at a apart
+    result.spacing = a;
+    result.layer_spacing = c;
+    result.packing_coarse = (float)(v_coarse / ((double)a * a * c));
+
+    // lattice: site (i, j) of layer k at origin + (i a + o, j a + o, k c),
+    // o = a / 2 in odd layers; i and j are stored from -1
+    Vec3f lo, hi;
+    computeBounds(pos, lo, hi);
+    const Vec3f origin = {lo.x - r + R, lo.y - r + R, lo.z - r + R};
+    const int ni = (int)((hi.x + r - origin.x) / a) + 3;
+    const int nj = (int)((hi.y + r - origin.y) / a) + 3;
+    const int nk = (int)((hi.z - origin.z) / c + 0.5f) + 1;
+    const size_t num_sites = (size_t)ni * nj * nk;
+    const uint32_t none = ~uint32_t(0);
+    auto sitePos = [&](size_t site) {
+        int i = (int)(site % ni) - 1, j = (int)(site / ni % nj) - 1, k = (int)(site / ((size_t)ni * nj));
+        float o = (k & 1) ? a / 2 : 0;
+        return Vec3f{origin.x + i * a + o, origin.y + j * a + o, origin.z + k * c};
+    };
+    auto eligible = [&](const Vec3f& q) {
+        // the site's cell stays clear of the corridor and its sphere inside the footprint
+        bool clear = q.x + a / 2 < s.corridor_x[0] || q.x - a / 2 > s.corridor_x[1] ||
+                     q.y + a / 2 < s.corridor_y[0] || q.y - a / 2 > s.corridor_y[1];
+        float slack = 0.01f * R;
+        return clear && q.x - R >= lo.x - r - slack && q.x + R <= hi.x + r + slack && q.y - R >= lo.y - r - slack &&
+               q.y + R <= hi.y + r + slack;
+    };
+
+    std::vector<uint32_t> site_of(pos.size());
+    parallelFor(pos.size(), [&](size_t p) {
+        int k = std::min(std::max((int)std::floor((pos[p].z - origin.z) / c + 0.5f), 0), nk - 1);
+        float o = (k & 1) ? a / 2 : 0;
+        int i = std::min(std::max((int)std::floor((pos[p].x - origin.x - o) / a + 0.5f) + 1, 0), ni - 1);
+        int j = std::min(std::max((int)std::floor((pos[p].y - origin.y - o) / a + 0.5f) + 1, 0), nj - 1);
+        size_t site = ((size_t)k * nj + j) * ni + i;
+        site_of[p] = eligible(sitePos(site)) ? (uint32_t)site : none;
+    });
+
+    // sites with enough solid volume become coarse spheres
+    std::vector<uint32_t> count(num_sites, 0);
+    for (uint32_t site : site_of)
+        if (site != none)
+            count[site]++;
+    const uint32_t min_count = (uint32_t)std::ceil(0.5 * v_coarse / v_fine);
+    std::vector<uint32_t> coarse_of(num_sites, none);
+    std::vector<Vec3f> coarse_pos;
+    for (size_t site = 0; site < num_sites; site++) {
+        if (count[site] >= std::max(1u, min_count)) {
+            coarse_of[site] = (uint32_t)coarse_pos.size();
+            coarse_pos.push_back(sitePos(site));
+        }
+    }
+
+    // fine particles outside eligible sites stay, unless they overlap a
+    // coarse sphere at the corridor edge
+    HashedCellGrid grid;
+    grid.build(coarse_pos, R + r);
+    const float limit = R + r - s.tolerance * 2 * r;
+    std::vector<uint8_t> keep(pos.size(), 0);
+    std::vector<uint32_t> absorbed_by(pos.size(), none);
+    parallelFor(pos.size(), [&](size_t p) {
+        if (site_of[p] != none)
+            return;
+        uint32_t into = none;
+        grid.forEachCandidate(pos[p], [&](uint32_t q) {
+            if (into == none && dist2(pos[p], coarse_pos[q]) < limit * limit)
+                into = q;
+        });
+        if (into == none)
+            keep[p] = 1;
+        else
+            absorbed_by[p] = into;
+    });
+
+    ParticleBed kept = fine;
+    kept.radii.clear();
+    compactBed(kept, keep);
+    result.fine_kept = kept.size();
+    result.coarse = coarse_pos.size();
+    result.bed.pos = std::move(kept.pos);
+    result.bed.pos.insert(result.bed.pos.end(), coarse_pos.begin(), coarse_pos.end());
+    if (!kept.vel.empty()) {
+        result.bed.vel = std::move(kept.vel);
+        result.bed.vel.resize(result.bed.pos.size(), {0, 0, 0});
+    }
+    result.bed.radii.assign(result.fine_kept, r);
+    result.bed.radii.resize(result.bed.pos.size(), R);
+
+    size_t next_fine = 0;
+    for (size_t p = 0; p < pos.size(); p++) {
+        if (keep[p]) {
+            result.mapping[p] = (int64_t)next_fine++;
+        } else if (absorbed_by[p] != none) {
+            result.mapping[p] = (int64_t)(result.fine_kept + absorbed_by[p]);
+            result.absorbed++;
+        } else if (coarse_of[site_of[p]] != none) {
+            result.mapping[p] = (int64_t)(result.fine_kept + coarse_of[site_of[p]]);
+        } else {
+            result.dropped++;
+        }
+    }
+    result.replaced = pos.size() - result.fine_kept - result.dropped;
+    result.volume_replaced = (result.replaced + result.dropped) * v_fine;
+    result.volume_coarse = result.coarse * v_coarse;
+    return result;
+}
+
+// Input particle to output particle, as CSV (input,output) or as Parquet
+// when the name ends in .parquet; -1 marks dropped particles
+inline bool writeCoarseMapping(const std::string& filename, const std::vector<int64_t>& mapping) {
+    if (hasExtension(filename, ".parquet")) {
+        std::vector<int32_t> input(mapping.size()), output(mapping.size());
+        parallelFor(mapping.size(), [&](size_t i) {
+            input[i] = (int32_t)i;
+            output[i] = (int32_t)mapping[i];
+        });
+        return writeParquet(
+            filename, mapping.size(),
+            {{"input", ParquetColumn::INT32, ParquetColumn::DELTA_BINARY_PACKED, input.data(), sizeof(int32_t)},
+             {"output", ParquetColumn::INT32, ParquetColumn::DELTA_BINARY_PACKED, output.data(), sizeof(int32_t)}});
+    }
+    FILE* out = std::fopen(filename.c_str(), "w");
+    if (!out)
+        return false;
+    bool ok = std::fputs("input,output\n", out) >= 0;
+    for (size_t i = 0; i < mapping.size() && ok; i++)
+        ok = std::fprintf(out, "%zu,%lld\n", i, (long long)mapping[i]) > 0;
+    return std::fclose(out) == 0 && ok;
+}
@@ -0,0 +1,618 @@
+#pragma once
+// Columnar output for dataframe tools (pandas, Polars, pyarrow), written
+// straight from the in-memory buffers without a text stage:
+//   - ArrowStreamWriter: Arrow IPC stream (.arrows) of int32, float64 and
+//     dictionary-encoded string columns, one record batch per append, so a
+//     reader can follow a running simulation;
+//   - writeParquet: an uncompressed Parquet file with one row group, float,
+//     double and int32 columns read through strided pointers (e.g. straight
+//     from an array of Vec3f), PLAIN or DELTA_BINARY_PACKED encoded.
+// Both formats are produced by hand (FlatBuffers metadata for Arrow, Thrift
+// compact metadata for Parquet), so no Arrow library is needed.
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "OutputFile.hpp"
+
+// Back-to-front FlatBuffers builder, enough for the Arrow IPC metadata.
+// Offsets returned by the create/end functions count from the buffer end.
+class FlatBuilder {
+  public:
+    typedef uint32_t Ref;
+
+    size_t size() const { return m_buf.size(); }
+
+    template <typename T>
+    void addScalar(int field, T value) {
+        prepend(&value, sizeof(T), sizeof(T));
+        m_fields.push_back({field, (uint32_t)size()});
+    }
+    void addRef(int field, Ref ref) {
+        prependRef(ref);
+        m_fields.push_back({field, (uint32_t)size()});
+    }
+
+    void startTable() {
+        m_fields.clear();
+        m_table_begin = (uint32_t)size();
+    }
+    Ref endTable() {
+        int32_t placeholder = 0;
+        prepend(&placeholder, 4, 4);
+        uint32_t table = (uint32_t)size();
+        int max_field = -1;
+        for (const auto& f : m_fields)
+            max_field = std::max(max_field, f.first);
+        std::vector<uint16_t> vtable(2 + max_field + 1, 0);
+        vtable[0] = (uint16_t)(vtable.size() * 2);
+        vtable[1] = (uint16_t)(table - m_table_begin);
+        for (const auto& f : m_fields)
+            vtable[2 + f.first] = (uint16_t)(table - f.second);
+        prepend(vtable.data(), vtable.size() * 2, 4);
+        int32_t soffset = (int32_t)(size() - table);  // vtable precedes the table
+        std::memcpy(&m_buf[m_buf.size() - table], &soffset, 4);
+        m_fields.clear();
+        return table;
+    }
+
+    Ref createString(const std::string& s) {
+        std::vector<uint8_t> bytes(s.begin(), s.end());
+        bytes.push_back(0);
+        alignFor(bytes.size() + 4, 4);
+        prepend(bytes.data(), bytes.size(), 1);
+        uint32_t length = (uint32_t)s.size();
+        prepend(&length, 4, 4);
+        return (Ref)size();
+    }
+
+    // Vector of structs (or scalars) given as raw bytes
+    Ref createStructVector(const void* data, size_t count, size_t struct_bytes, size_t align) {
+        alignFor(count * struct_bytes, std::max<size_t>(align, 4));  // elements aligned
+        prepend(data, count * struct_bytes, 1);
+        uint32_t length = (uint32_t)count;
+        prepend(&length, 4, 4);
+        return (Ref)size();
+    }
+
+    Ref createRefVector(const std::vector<Ref>& refs) {
+        for (size_t i = refs.size(); i-- > 0;)
+            prependRef(refs[i]);
+        uint32_t length = (uint32_t)refs.size();
+        prepend(&length, 4, 4);
+        return (Ref)size();
+    }
+
+    // Root offset in front; the result is 8-byte aligned in size
+    std::vector<uint8_t> finish(Ref root) {
+        alignFor(4, 8);
+        prependRef(root);
+        return std::vector<uint8_t>(m_buf.begin(), m_buf.end());
+    }
+
+  private:
+    // pad so that after prepending `bytes` the size is a multiple of align
+    void alignFor(size_t bytes, size_t align) {
+        static const uint8_t zeros[8] = {};
+        size_t pad = (align - (size() + bytes) % align) % align;
+        m_buf.insert(m_buf.begin(), zeros, zeros + pad);
+    }
+    void prepend(const void* data, size_t bytes, size_t align) {
+        alignFor(bytes, align);
+        const uint8_t* p = static_cast<const uint8_t*>(data);
+        m_buf.insert(m_buf.begin(), p, p + bytes);
+    }
+    void prependRef(Ref ref) {
+        alignFor(4, 4);
+        uint32_t offset = (uint32_t)(size() + 4 - ref);
+        prepend(&offset, 4, 4);
+    }
+
+    std::vector<uint8_t> m_buf;
+    std::vector<std::pair<int, uint32_t>> m_fields;
+    uint32_t m_table_begin = 0;
+};
+
+class ArrowStreamWriter {
+  public:
+    enum ColumnType { INT32, FLOAT64, DICTIONARY };
+
+    // Columns are declared before open(); a DICTIONARY column holds int32
+    // indices into its (fixed) list of strings
+    void addColumn(const std::string& name, ColumnType type, const std::vector<std::string>& dictionary = {}) {
+        m_columns.push_back({name, type, dictionary, {}});
+    }
+
+    bool open(const std::string& filename) {
+        m_rows = 0;
+        if (!m_out.open(filename))
+            return false;
+        bool ok = writeMessage(schemaMessage(), {});
+        int64_t id = 0;
+        for (const Column& column : m_columns)
+            if (column.type == DICTIONARY)
+                ok = ok && writeDictionary(id++, column.dictionary);
+        return ok;
+    }
+
+    // Append a value to a column; every column gets one value per row
+    void push(size_t column, double value) {
+        Column& c = m_columns[column];
+        if (c.type == FLOAT64) {
+            appendRaw(c.data, &value, 8);
+        } else {
+            int32_t v = (int32_t)value;
+            appendRaw(c.data, &v, 4);
+        }
+    }
+
+    // Write the rows appended since the last batch as one record batch
+    bool writeBatch() {
+        if (m_columns.empty())
+            return true;
+        const Column& first = m_columns[0];
+        int64_t rows = (int64_t)(first.data.size() / (first.type == FLOAT64 ? 8 : 4));
+        if (rows == 0)
+            return true;
+        std::vector<std::vector<uint8_t>> buffers;
+        std::vector<int64_t> lengths(m_columns.size(), rows);
+        for (Column& column : m_columns) {
+            buffers.push_back({});  // no validity bitmap: no nulls
+            buffers.push_back(std::move(column.data));
+            column.data.clear();
+        }
+        m_rows += rows;
+        std::vector<uint8_t> body;
+        std::vector<uint8_t> meta = recordBatchMessage(lengths, buffers, body, false, 0);
+        return writeMessage(meta, body);
+    }
+
+    // Flush, write the end-of-stream marker and close
+    bool close() {
+        if (!m_out.isOpen())
+            return true;
+        bool ok = writeBatch();
+        const uint32_t eos[2] = {0xffffffffu, 0};
+        ok = m_out.write(eos, sizeof(eos)) && ok;
+        return m_out.close() && ok;
+    }
+
+    size_t numColumns() const { return m_columns.size(); }
+    int64_t numRows() const { return m_rows; }
+
+  private:
+    struct Column {
+        std::string name;
+        ColumnType type;
+        std::vector<std::string> dictionary;
+        std::vector<uint8_t> data;
+    };
+
+    // Arrow format enums and union tags
+    enum : uint8_t { HEADER_SCHEMA = 1, HEADER_DICTIONARY_BATCH = 2, HEADER_RECORD_BATCH = 3 };
+    enum : uint8_t { TYPE_INT = 2, TYPE_FLOATING_POINT = 3, TYPE_UTF8 = 5 };
+    static constexpr int16_t metadata_v5 = 4;
+    static constexpr int16_t precision_double = 2;
+
+    static void appendRaw(std::vector<uint8_t>& out, const void* data, size_t bytes) {
+        const uint8_t* p = static_cast<const uint8_t*>(data);
+        out.insert(out.end(), p, p + bytes);
+    }
+
+    static FlatBuilder::Ref intType(FlatBuilder& b) {
+        b.startTable();
+        b.addScalar<int32_t>(0, 32);  // bitWidth
+        b.addScalar<uint8_t>(1, 1);   // is_signed
+        return b.endTable();
+    }
+
+    static std::vector<uint8_t> message(FlatBuilder& b, uint8_t header_type, FlatBuilder::Ref header, int64_t body) {
+        b.startTable();
+        b.addScalar<int64_t>(3, body);  // bodyLength
+        b.addRef(2, header);
+        b.addScalar<int16_t>(0, metadata_v5);
+        b.addScalar<uint8_t>(1, header_type);
+        return b.finish(b.endTable());
+    }
+
+    std::vector<uint8_t> schemaMessage() const {
+        FlatBuilder b;
+        std::vector<FlatBuilder::Ref> fields;
+        int64_t dictionary_id = 0;
+        for (const Column& column : m_columns) {
+            FlatBuilder::Ref name = b.createString(column.name);
+            FlatBuilder::Ref children = b.createRefVector({});
+            FlatBuilder::Ref type, encoding = 0;
+            uint8_t type_type;
+            if (column.type == FLOAT64) {
+                b.startTable();
+                b.addScalar<int16_t>(0, precision_double);
+                type = b.endTable();
+                type_type = TYPE_FLOATING_POINT;
+            } else if (column.type == INT32) {
+                type = intType(b);
+                type_type = TYPE_INT;
+            } else {
+                b.startTable();
+                type = b.endTable();  // Utf8 has no fields
+                type_type = TYPE_UTF8;
+                FlatBuilder::Ref index_type = intType(b);
+                b.startTable();
+                b.addScalar<int64_t>(0, dictionary_id++);
+                b.addRef(1, index_type);
+                encoding = b.endTable();
+            }
+            b.startTable();
+            b.addRef(0, name);
+            b.addRef(3, type);
+            if (encoding)
+                b.addRef(4, encoding);
+            b.addRef(5, children);
+            b.addScalar<uint8_t>(2, type_type);
+            b.addScalar<uint8_t>(1, 0);  // not nullable
+            fields.push_back(b.endTable());
+        }
+        FlatBuilder::Ref field_vector = b.createRefVector(fields);
+        b.startTable();
+        b.addRef(1, field_vector);
+        b.addScalar<int16_t>(0, 0);  // little endian
+        FlatBuilder::Ref schema = b.endTable();
+        return message(b, HEADER_SCHEMA, schema, 0);
+    }
+
+    // Lay the buffers out in body (8-byte aligned) and build the record
+    // batch metadata; with `dictionary` it is wrapped in a dictionary batch
+    std::vector<uint8_t> recordBatchMessage(const std::vector<int64_t>& lengths,
+                                            const std::vector<std::vector<uint8_t>>& buffers,
+                                            std::vector<uint8_t>& body,
+                                            bool dictionary,
+                                            int64_t dictionary_id) const {
+        std::vector<int64_t> nodes;  // length, null_count pairs
+        for (int64_t length : lengths) {
+            nodes.push_back(length);
+            nodes.push_back(0);
+        }
+        std::vector<int64_t> spans;  // offset, length pairs
+        for (const auto& buffer : buffers) {
+            spans.push_back((int64_t)body.size());
+            spans.push_back((int64_t)buffer.size());
+            body.insert(body.end(), buffer.begin(), buffer.end());
+            body.resize((body.size() + 7) & ~size_t(7), 0);
+        }
+        FlatBuilder b;
+        FlatBuilder::Ref buffer_vector = b.createStructVector(spans.data(), spans.size() / 2, 16, 8);
+        FlatBuilder::Ref node_vector = b.createStructVector(nodes.data(), nodes.size() / 2, 16, 8);
+        b.startTable();
+        b.addScalar<int64_t>(0, lengths.empty() ? 0 : lengths[0]);
+        b.addRef(1, node_vector);
+        b.addRef(2, buffer_vector);
+        FlatBuilder::Ref batch = b.endTable();
+        if (!dictionary)
+            return message(b, HEADER_RECORD_BATCH, batch, (int64_t)body.size());
+        b.startTable();
+        b.addScalar<int64_t>(0, dictionary_id);
+        b.addRef(1, batch);
+        return message(b, HEADER_DICTIONARY_BATCH, b.endTable(), (int64_t)body.size());
+    }
+
+    bool writeDictionary(int64_t id, const std::vector<std::string>& values) {
+        std::vector<std::vector<uint8_t>> buffers(3);
+        int32_t offset = 0;
+        appendRaw(buffers[1], &offset, 4);
+        for (const std::string& value : values) {
+            appendRaw(buffers[2], value.data(), value.size());
+            offset += (int32_t)value.size();
+            appendRaw(buffers[1], &offset, 4);
+        }
+        std::vector<uint8_t> body;
+        std::vector<uint8_t> meta = recordBatchMessage({(int64_t)values.size()}, buffers, body, true, id);
+        return writeMessage(meta, body);
+    }
+
+    // Encapsulated message: continuation marker, metadata size, metadata
+    // padded to 8 bytes, body
+    bool writeMessage(std::vector<uint8_t> meta, const std::vector<uint8_t>& body) {
+        meta.resize((meta.size() + 7) & ~size_t(7), 0);
+        const uint32_t prefix[2] = {0xffffffffu, (uint32_t)meta.size()};
+        return m_out.write(prefix, sizeof(prefix)) && m_out.write(meta.data(), meta.size()) &&
+               m_out.write(body.data(), body.size());
+    }
+
+    std::vector<Column> m_columns;
+    OutputFile m_out;
+    int64_t m_rows = 0;
+};
+
+// One Parquet column, read from `data` with a stride of `stride` bytes
+struct ParquetColumn {
+    enum Type { INT32 = 1, FLOAT = 4, DOUBLE = 5 };  // Parquet physical types
+    enum Encoding { PLAIN = 0, DELTA_BINARY_PACKED = 5 };
+
+    std::string name;
+    Type type;
+    Encoding encoding;
+    const void* data;
+    size_t stride;
+
+    size_t valueBytes() const { return type == DOUBLE ? 8 : 4; }
+};
+
+// Thrift compact protocol, write side
+class ThriftCompactWriter {
+  public:
+    enum : uint8_t { T_I32 = 5, T_I64 = 6, T_BINARY = 8, T_LIST = 9, T_STRUCT = 12 };
+
+    std::vector<uint8_t> bytes;
+
+    void fieldI32(int16_t id, int32_t value) {
+        fieldHeader(id, T_I32);
+        varint(zigzag(value));
+    }
+    void fieldI64(int16_t id, int64_t value) {
+        fieldHeader(id, T_I64);
+        varint(zigzag(value));
+    }
+    void fieldBinary(int16_t id, const void* data, size_t size) {
+        fieldHeader(id, T_BINARY);
+        varint(size);
+        const uint8_t* p = static_cast<const uint8_t*>(data);
+        bytes.insert(bytes.end(), p, p + size);
+    }
+    void fieldString(int16_t id, const std::string& s) { fieldBinary(id, s.data(), s.size()); }
+    void fieldList(int16_t id, uint8_t element_type, size_t size) {
+        fieldHeader(id, T_LIST);
+        listHeader(element_type, size);
+    }
+    void fieldStruct(int16_t id) {
+        fieldHeader(id, T_STRUCT);
+        beginStruct();
+    }
+    // Struct elements of a list are begun without a field header
+    void beginStruct() {
+        m_last.push_back(m_field);
+        m_field = 0;
+    }
+    void endStruct() {
+        bytes.push_back(0);
+        m_field = m_last.back();
+        m_last.pop_back();
+    }
+    void listHeader(uint8_t element_type, size_t size) {
+        if (size < 15) {
+            bytes.push_back((uint8_t)(size << 4 | element_type));
+        } else {
+            bytes.push_back(0xf0 | element_type);
+            varint(size);
+        }
+    }
+    // List elements
+    void i32(int32_t value) { varint(zigzag(value)); }
+    void string(const std::string& s) {
+        varint(s.size());
+        bytes.insert(bytes.end(), s.begin(), s.end());
+    }
+
+    static uint64_t zigzag(int64_t v) { return ((uint64_t)v << 1) ^ (uint64_t)(v >> 63); }
+    void varint(uint64_t v) {
+        while (v >= 0x80) {
+            bytes.push_back((uint8_t)(v | 0x80));
+            v >>= 7;
+        }
+        bytes.push_back((uint8_t)v);
+    }
+
+  private:
+    void fieldHeader(int16_t id, uint8_t type) {
+        if (id > m_field && id - m_field <= 15) {
+            bytes.push_back((uint8_t)((id - m_field) << 4 | type));
+        } else {
+            bytes.push_back(type);
+            varint(zigzag(id));
+        }
+        m_field = id;
+    }
+
+    int16_t m_field = 0;
+    std::vector<int16_t> m_last;
+};
+
+// DELTA_BINARY_PACKED: blocks of 128 deltas in 4 bit-packed miniblocks
+inline void encodeDeltaBinaryPacked(const int32_t* values, size_t count, std::vector<uint8_t>& out) {
+    constexpr size_t block = 128, miniblocks = 4, mini = block / miniblocks;
+    ThriftCompactWriter w;  // for its varints
+    w.varint(block);
+    w.varint(miniblocks);
+    w.varint(count);
+    w.varint(ThriftCompactWriter::zigzag(count ? values[0] : 0));
+    std::vector<int64_t> deltas(mini);
+    for (size_t start = 1; start < count; start += block) {
+        size_t n = std::min(block, count - start);
+        int64_t min_delta = INT64_MAX;
+        for (size_t i = 0; i < n; i++)
+            min_delta = std::min(min_delta, (int64_t)values[start + i] - values[start + i - 1]);
+        w.varint(ThriftCompactWriter::zigzag(min_delta));
+        size_t widths_at = w.bytes.size();
+        w.bytes.resize(widths_at + miniblocks, 0);
+        for (size_t m = 0; m * mini < n; m++) {
+            size_t m_n = std::min(mini, n - m * mini);
+            uint64_t max_value = 0;
+            for (size_t i = 0; i < mini; i++) {
+                size_t k = start + m * mini + i;
+                deltas[i] = i < m_n ? (int64_t)values[k] - values[k - 1] - min_delta : 0;
+                max_value = std::max(max_value, (uint64_t)deltas[i]);
+            }
+            int width = 0;
+            while (width < 64 && (max_value >> width) != 0)
+                width++;
+            w.bytes[widths_at + m] = (uint8_t)width;
+            // LSB-first bit packing of the 32 values
+            size_t bits_at = w.bytes.size();
+            w.bytes.resize(bits_at + width * mini / 8, 0);
+            for (size_t i = 0; i < mini; i++)
+                for (int bit = 0; bit < width; bit++)
+                    if ((uint64_t)deltas[i] >> bit & 1) {
+                        size_t pos = i * width + bit;
+                        w.bytes[bits_at + pos / 8] |= (uint8_t)(1u << (pos % 8));
+                    }
+        }
+    }
+    out.insert(out.end(), w.bytes.begin(), w.bytes.end());
+}
+
+// Write num_rows rows of the given columns as one row group, in data pages
+// of at most page_rows values
+inline bool writeParquet(const std::string& filename,
+                         size_t num_rows,
+                         const std::vector<ParquetColumn>& columns,
+                         size_t page_rows = 1 << 20) {
+    OutputFile out;
+    if (!out.open(filename) || !out.write("PAR1", 4))
+        return false;
+    uint64_t offset = 4;
+    bool ok = true;
+
+    struct ChunkInfo {
+        int64_t data_page_offset;
+        int64_t bytes;
+        std::vector<uint8_t> min, max;
+    };
+    std::vector<ChunkInfo> chunks;
+    std::vector<uint8_t> page;
+    for (const ParquetColumn& column : columns) {
+        ChunkInfo chunk = {(int64_t)offset, 0, {}, {}};
+        const uint8_t* src = static_cast<const uint8_t*>(column.data);
+        size_t width = column.valueBytes();
+        double lo = 0, hi = 0;
+        for (size_t first = 0; first < num_rows || (first == 0 && num_rows == 0); first += page_rows) {
+            size_t n = std::min(page_rows, num_rows - first);
+            page.clear();
+            if (column.encoding == ParquetColumn::DELTA_BINARY_PACKED) {
+                std::vector<int32_t> values(n);
+                for (size_t i = 0; i < n; i++)
+                    std::memcpy(&values[i], src + (first + i) * column.stride, 4);
+                encodeDeltaBinaryPacked(values.data(), n, page);
+            } else {
+                page.resize(n * width);
+                for (size_t i = 0; i < n; i++)
+                    std::memcpy(&page[i * width], src + (first + i) * column.stride, width);
+            }
+            for (size_t i = 0; i < n; i++) {
+                double v;
+                if (column.type == ParquetColumn::INT32) {
+                    int32_t x;
+                    std::memcpy(&x, src + (first + i) * column.stride, 4);
+                    v = x;
+                } else if (column.type == ParquetColumn::FLOAT) {
+                    float x;
+                    std::memcpy(&x, src + (first + i) * column.stride, 4);
+                    v = x;
+                } else {
+                    std::memcpy(&v, src + (first + i) * column.stride, 8);
+                }
+                if ((first == 0 && i == 0) || v < lo)
+                    lo = v;
+                if ((first == 0 && i == 0) || v > hi)
+                    hi = v;
+            }
+
+            ThriftCompactWriter header;
+            header.fieldI32(1, 0);  // DATA_PAGE
+            header.fieldI32(2, (int32_t)page.size());
+            header.fieldI32(3, (int32_t)page.size());
+            header.fieldStruct(5);  // DataPageHeader
+            header.fieldI32(1, (int32_t)n);
+            header.fieldI32(2, column.encoding);
+            header.fieldI32(3, 3);  // RLE levels (none present: required column)
+            header.fieldI32(4, 3);
+            header.endStruct();
+            header.bytes.push_back(0);
+            ok = ok && out.write(header.bytes.data(), header.bytes.size()) && out.write(page.data(), page.size());
+            offset += header.bytes.size() + page.size();
+            chunk.bytes += header.bytes.size() + page.size();
+            if (num_rows == 0)
+                break;
+        }
+        // min/max statistics in the column's plain encoding
+        chunk.min.resize(width);
+        chunk.max.resize(width);
+        if (column.type == ParquetColumn::INT32) {
+            int32_t l = (int32_t)lo, h = (int32_t)hi;
+            std::memcpy(chunk.min.data(), &l, 4);
+            std::memcpy(chunk.max.data(), &h, 4);
+        } else if (column.type == ParquetColumn::FLOAT) {
+            float l = (float)lo, h = (float)hi;
+            std::memcpy(chunk.min.data(), &l, 4);
+            std::memcpy(chunk.max.data(), &h, 4);
+        } else {
+            std::memcpy(chunk.min.data(), &lo, 8);
+            std::memcpy(chunk.max.data(), &hi, 8);
+        }
+        chunks.push_back(chunk);
+    }
+
+    ThriftCompactWriter meta;
+    meta.fieldI32(1, 1);  // version
+    meta.fieldList(2, ThriftCompactWriter::T_STRUCT, columns.size() + 1);
+    meta.beginStruct();  // root
+    meta.fieldString(4, "schema");
+    meta.fieldI32(5, (int32_t)columns.size());
+    meta.endStruct();
+    for (const ParquetColumn& column : columns) {
+        meta.beginStruct();
+        meta.fieldI32(1, column.type);
+        meta.fieldI32(3, 0);  // REQUIRED
+        meta.fieldString(4, column.name);
+        meta.endStruct();
+    }
+    meta.fieldI64(3, (int64_t)num_rows);
+    meta.fieldList(4, ThriftCompactWriter::T_STRUCT, 1);
+    meta.beginStruct();  // RowGroup
+    meta.fieldList(1, ThriftCompactWriter::T_STRUCT, columns.size());
+    int64_t total_bytes = 0;
+    for (size_t c = 0; c < columns.size(); c++) {
+        const ChunkInfo& chunk = chunks[c];
+        total_bytes += chunk.bytes;
+        meta.beginStruct();  // ColumnChunk
+        meta.fieldI64(2, chunk.data_page_offset);
+        meta.fieldStruct(3);  // ColumnMetaData
+        meta.fieldI32(1, columns[c].type);
+        meta.fieldList(2, ThriftCompactWriter::T_I32, 1);
+        meta.i32(columns[c].encoding);
+        meta.fieldList(3, ThriftCompactWriter::T_BINARY, 1);
+        meta.string(columns[c].name);
+        meta.fieldI32(4, 0);  // UNCOMPRESSED
+        meta.fieldI64(5, (int64_t)num_rows);
+        meta.fieldI64(6, chunk.bytes);
+        meta.fieldI64(7, chunk.bytes);
+        meta.fieldI64(9, chunk.data_page_offset);
+        if (num_rows > 0) {
+            meta.fieldStruct(12);  // Statistics
+            meta.fieldI64(3, 0);   // null_count
+            meta.fieldBinary(5, chunk.max.data(), chunk.max.size());
+            meta.fieldBinary(6, chunk.min.data(), chunk.min.size());
+            meta.endStruct();
+        }
+        meta.endStruct();
+        meta.endStruct();
+    }
+    meta.fieldI64(2, total_bytes);
+    meta.fieldI64(3, (int64_t)num_rows);
+    meta.endStruct();
+    meta.fieldString(6, "rovertest");  // created_by
+    // type-defined sort order, without which readers ignore min and max
+    meta.fieldList(7, ThriftCompactWriter::T_STRUCT, columns.size());
+    for (size_t c = 0; c < columns.size(); c++) {
+        meta.beginStruct();
+        meta.fieldStruct(1);
+        meta.endStruct();
+        meta.endStruct();
+    }
+    meta.bytes.push_back(0);
+
+    uint32_t meta_size = (uint32_t)meta.bytes.size();
+    ok = ok && out.write(meta.bytes.data(), meta.bytes.size()) && out.write(&meta_size, 4) && out.write("PAR1", 4);
+    return out.close() && ok;
+}
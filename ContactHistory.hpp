@@ -0,0 +1,263 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "HostParallel.hpp"
+#include "HostSpatial.hpp"
+
+// Tangential displacement history of persistent sphere-sphere contacts, as
+// needed on the host for CHGPU_FRICTION_MODE::MULTI_STEP.
+//
+// Open-addressed, linearly probed table keyed by the (i, j) pair. Keys live in
+// their own array so a probe walks 8 keys per cache line; the displacement and
+// the generation it was last seen in sit in a parallel value array. Lookups
+// and inserts are lock-free (a CAS claims an empty key slot) and may run from
+// many threads at once, provided each pair is updated by a single thread and
+// nothing calls reserve() or compact() concurrently.
+//
+// Contacts are never erased one at a time. A contact that was not acquired in
+// the previous step is broken, so acquiring it again restarts its history even
+// while its stale entry is still stored; compact() then drops all stale
+// entries in one pass when the table fills up.
+class ContactHistoryTable {
+  public:
+    struct Entry {
+        Vec3f displacement;
+        uint32_t generation;
+    };
+
+    explicit ContactHistoryTable(size_t expected_contacts = 1024) { allocate(capacityFor(expected_contacts)); }
+
+    // Key of an unordered particle pair
+    static uint64_t pairKey(uint32_t i, uint32_t j) {
+        return i < j ? (uint64_t)i << 32 | j : (uint64_t)j << 32 | i;
+    }
+
+    // Start a new step, contacts acquired from now on are stamped with it
+    void beginStep() {
+        m_generation++;
+        m_inserted_last_step = m_inserted.exchange(0, std::memory_order_relaxed);
+    }
+    uint32_t generation() const { return m_generation; }
+
+    // Find the history of (i, j), inserting a zero displacement if it is a new
+    // or re-formed contact, and stamp it with the current generation. Returns
+    // nullptr only if the table is full, which reserve() before the step
+    // prevents.
+    Entry* acquire(uint32_t i, uint32_t j, bool* inserted = nullptr) { return acquireKey(pairKey(i, j), inserted); }
+
+    // Same as acquire() but (i, j) and (j, i) are separate contacts. Solvers
+    // that evaluate every pair from both sides keep one history per side so
+    // each entry is only ever touched by the thread that owns row i.
+    Entry* acquireDirected(uint32_t i, uint32_t j, bool* inserted = nullptr) {
+        return acquireKey((uint64_t)i << 32 | j, inserted);
+    }
+
+    Entry* acquireKey(uint64_t key, bool* inserted = nullptr) {
+        size_t mask = m_capacity - 1;
+        for (size_t probe = 0, slot = hashSlot(key); probe < m_capacity; probe++, slot = (slot + 1) & mask) {
+            uint64_t current = m_keys[slot].load(std::memory_order_acquire);
+            if (current == empty_key) {
+                if (m_keys[slot].compare_exchange_strong(current, key, std::memory_order_acq_rel)) {
+                    m_values[slot] = {{0, 0, 0}, m_generation};
+                    m_size.fetch_add(1, std::memory_order_relaxed);
+                    m_inserted.fetch_add(1, std::memory_order_relaxed);
+                    if (inserted)
+                        *inserted = true;
+                    return &m_values[slot];
+                }
+                // another thread claimed the slot first, current holds its key
+            }
+            if (current == key) {
+                Entry& e = m_values[slot];
+                bool broken = e.generation + 1 < m_generation;
+                if (broken) {
+                    e.displacement = {0, 0, 0};
+                    m_inserted.fetch_add(1, std::memory_order_relaxed);
+                }
+                e.generation = m_generation;
+                if (inserted)
+                    *inserted = broken;
+                return &e;
+            }
+        }
+        return nullptr;
+    }
+
+    // History of (i, j) without inserting or stamping, nullptr if absent
+    const Entry* find(uint32_t i, uint32_t j) const {
+        uint64_t key = pairKey(i, j);
+        size_t mask = m_capacity - 1;
+        for (size_t probe = 0, slot = hashSlot(key); probe < m_capacity; probe++, slot = (slot + 1) & mask) {
+            uint64_t current = m_keys[slot].load(std::memory_order_acquire);
+            if (current == key)
+                return &m_values[slot];
+            if (current == empty_key)
+                return nullptr;
+        }
+        return nullptr;
+    }
+
+    // Make room for up to num_contacts live contacts at the target load factor
+    void reserve(size_t num_contacts) {
+        if (capacityFor(num_contacts) > m_capacity)
+            rehash(capacityFor(num_contacts), 0);
+    }
+
+    // True if another step forming twice as many new contacts as the last one
+    // could push the table past its maximum load factor, i.e. it is time to
+    // compact() before the next beginStep()
+    bool needsCompact() const { return size() + 2 * m_inserted_last_step > m_capacity * max_load; }
+
+    // Drop every contact not seen in the last max_age + 1 generations and
+    // rehash the survivors into a table sized for them. Call it between steps;
+    // returns the number of contacts dropped.
+    size_t compact(uint32_t max_age = 0) {
+        size_t before = size();
+        uint32_t oldest = m_generation >= max_age ? m_generation - max_age : 0;
+        size_t live = countIf([&](const Entry& e) { return e.generation >= oldest; });
+        rehash(capacityFor(live), oldest);
+        return before - size();
+    }
+
+    size_t size() const { return m_size.load(std::memory_order_relaxed); }
+    size_t capacity() const { return m_capacity; }
+    double loadFactor() const { return (double)size() / m_capacity; }
+    size_t memoryBytes() const { return (m_capacity + m_spare_capacity) * (sizeof(uint64_t) + sizeof(Entry)); }
+
+    // Call fn(i, j, entry) for every stored contact
+    template <typename F>
+    void forEach(F&& fn) const {
+        for (size_t slot = 0; slot < m_capacity; slot++) {
+            uint64_t key = m_keys[slot].load(std::memory_order_relaxed);
+            if (key != empty_key)
+                fn((uint32_t)(key >> 32), (uint32_t)key, m_values[slot]);
+        }
+    }
+
+    // A stored contact as it travels between tables
+    struct KeyedEntry {
+        uint64_t key;
+        Entry entry;
+    };
+
+    // Hand over the live contacts whose first particle i satisfies moving(i),
+    // e.g. when i moves to another process with its own table: they are
+    // appended to out and expired here, so a later acquire restarts them and
+    // compact() drops them. Call it between steps, after at least one
+    // beginStep().
+    template <typename P>
+    void extract(P&& moving, std::vector<KeyedEntry>& out) {
+        for (size_t slot = 0; slot < m_capacity; slot++) {
+            uint64_t key = m_keys[slot].load(std::memory_order_relaxed);
+            Entry& e = m_values[slot];
+            // contacts not seen in the last step are broken already
+            if (key == empty_key || e.generation < m_generation || !moving((uint32_t)(key >> 32)))
+                continue;
+            out.push_back({key, e});
+            e.generation = 0;
+        }
+    }
+
+    // Store contacts extracted from another table at the same generation,
+    // keeping their displacement and the generation they were last seen in
+    void insert(const std::vector<KeyedEntry>& entries) {
+        reserve(size() + entries.size());
+        size_t inserted = m_inserted.load(std::memory_order_relaxed);
+        for (const KeyedEntry& k : entries)
+            *acquireKey(k.key) = k.entry;
+        // moving entries does not form new contacts
+        m_inserted.store(inserted, std::memory_order_relaxed);
+    }
+
+  private:
+    static constexpr uint64_t empty_key = ~uint64_t(0);
+    // keep probes short: at most half the slots are in use after a rehash,
+    // and stale entries may fill the table up to max_load between compactions
+    static constexpr double target_load = 0.5;
+    static constexpr double max_load = 0.75;
+
+    static size_t capacityFor(size_t num_contacts) {
+        size_t capacity = 64;
+        while (capacity * target_load < num_contacts)
+            capacity *= 2;
+        return capacity;
+    }
+
+    size_t hashSlot(uint64_t key) const {
+        // Fibonacci hashing, the top bits are the best mixed
+        return (size_t)((key * 0x9E3779B97F4A7C15ULL) >> m_shift);
+    }
+
+    void allocate(size_t capacity) {
+        m_capacity = capacity;
+        m_shift = 64;
+        for (size_t c = capacity; c > 1; c >>= 1)
+            m_shift--;
+        if (m_spare_keys && m_spare_capacity == capacity) {
+            // reuse the arrays of the previous rehash, already faulted in
+            m_keys = std::move(m_spare_keys);
+            m_values = std::move(m_spare_values);
+        } else {
+            m_keys.reset(new std::atomic<uint64_t>[capacity]);
+            m_values.reset(new Entry[capacity]);
+        }
+        parallelFor(capacity, [&](size_t slot) { m_keys[slot].store(empty_key, std::memory_order_relaxed); });
+        m_size.store(0, std::memory_order_relaxed);
+    }
+
+    template <typename P>
+    size_t countIf(P&& pred) const {
+        std::vector<size_t> partial(hostThreadCount(), 0);
+        parallelForChunks(m_capacity, [&](size_t begin, size_t end, unsigned int tid) {
+            size_t count = 0;
+            for (size_t slot = begin; slot < end; slot++)
+                if (m_keys[slot].load(std::memory_order_relaxed) != empty_key && pred(m_values[slot]))
+                    count++;
+            partial[tid] = count;
+        });
+        size_t total = 0;
+        for (size_t c : partial)
+            total += c;
+        return total;
+    }
+
+    // Move the contacts seen at or after generation oldest into a fresh
+    // table of the given capacity, in parallel with the lock-free insert
+    void rehash(size_t capacity, uint32_t oldest) {
+        std::unique_ptr<std::atomic<uint64_t>[]> old_keys = std::move(m_keys);
+        std::unique_ptr<Entry[]> old_values = std::move(m_values);
+        size_t old_capacity = m_capacity;
+        size_t inserted = m_inserted.load(std::memory_order_relaxed);
+        allocate(capacity);
+        parallelFor(old_capacity, [&](size_t slot) {
+            uint64_t key = old_keys[slot].load(std::memory_order_relaxed);
+            if (key == empty_key || old_values[slot].generation < oldest)
+                return;
+            // reinsert, keeping the generation the contact was last seen in
+            Entry* e = acquireKey(key);
+            *e = old_values[slot];
+        });
+        // moving entries does not form new contacts
+        m_inserted.store(inserted, std::memory_order_relaxed);
+        m_spare_keys = std::move(old_keys);
+        m_spare_values = std::move(old_values);
+        m_spare_capacity = old_capacity;
+    }
+
+    uint32_t m_generation = 0;
+    size_t m_capacity = 0;
+    int m_shift = 64;
+    std::unique_ptr<std::atomic<uint64_t>[]> m_keys;
+    std::unique_ptr<Entry[]> m_values;
+    std::atomic<size_t> m_size{0};
+    std::atomic<size_t> m_inserted{0};
+    size_t m_inserted_last_step = 0;
+
+    size_t m_spare_capacity = 0;
+    std::unique_ptr<std::atomic<uint64_t>[]> m_spare_keys;
+    std::unique_ptr<Entry[]> m_spare_values;
+};
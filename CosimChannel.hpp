@@ -0,0 +1,391 @@
+#pragma once
+// Per-step exchange between a terrain process and a rover process: the rover
+// sends mesh poses and velocities, the terrain answers with the contact force
+// and torque on each mesh. Two transports are provided, a shared-memory
+// mailbox with futex wakeups and a Unix stream socket for when no shared
+// /dev/shm is available.
+
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "ShmSync.hpp"
+
+// Rigid state of one mesh, in the units and frames of ChSystemGpuMesh::ApplyMeshMotion
+struct CosimMeshState {
+    double pos[3];
+    double rot[4];  // e0..e3
+    double lin_vel[3];
+    double ang_vel[3];  // absolute frame
+};
+
+// Contact load on one mesh, as returned by ChSystemGpuMesh::CollectMeshContactForces
+struct CosimMeshLoad {
+    double force[3];
+    double torque[3];
+};
+
+enum CosimFlags : uint32_t {
+    COSIM_DONE = 1u << 0,               // last message, the peer should shut down
+    COSIM_QUERY_TERRAIN_TOP = 1u << 1,  // answer with the highest particle z in `value`
+};
+
+struct CosimHeader {
+    uint64_t step;
+    double time;
+    uint32_t flags;
+    uint32_t count;  // number of states or loads that follow
+    double value;
+};
+
+enum class CosimRole { TERRAIN, ROVER };
+
+// One endpoint of the channel. send/receive move a header plus `count`
+// fixed-size records and return false once the peer is gone.
+class CosimChannel {
+  public:
+    virtual ~CosimChannel() = default;
+    virtual const char* name() const = 0;
+
+    bool sendStates(const CosimHeader& header, const std::vector<CosimMeshState>& states) {
+        CosimHeader h = header;
+        h.count = (uint32_t)states.size();
+        return send(h, states.data(), states.size() * sizeof(CosimMeshState));
+    }
+    bool receiveStates(CosimHeader& header, std::vector<CosimMeshState>& states) {
+        return receive(header, states, sizeof(CosimMeshState));
+    }
+    bool sendLoads(const CosimHeader& header, const std::vector<CosimMeshLoad>& loads) {
+        CosimHeader h = header;
+        h.count = (uint32_t)loads.size();
+        return send(h, loads.data(), loads.size() * sizeof(CosimMeshLoad));
+    }
+    bool receiveLoads(CosimHeader& header, std::vector<CosimMeshLoad>& loads) {
+        return receive(header, loads, sizeof(CosimMeshLoad));
+    }
+
+  protected:
+    virtual bool send(const CosimHeader& header, const void* payload, size_t bytes) = 0;
+    virtual bool receiveHeader(CosimHeader& header) = 0;
+    virtual bool receivePayload(void* payload, size_t bytes) = 0;
+
+  private:
+    template <typename T>
+    bool receive(CosimHeader& header, std::vector<T>& records, size_t record_bytes) {
+        if (!receiveHeader(header))
+            return false;
+        records.resize(header.count);
+        return receivePayload(records.data(), header.count * record_bytes);
+    }
+};
+
+// Single-slot mailbox per direction in a named shared-memory segment. The
+// exchange is strictly request/response, so a writer never overwrites a
+// message the reader has not consumed. Readers spin briefly (only when there
+// is more than one CPU) before sleeping on the sequence word.
+class ShmCosimChannel : public CosimChannel {
+  public:
+    static constexpr uint64_t magic = 0x524f564552434f53ull;  // "ROVERCOS"
+
+    ShmCosimChannel(const std::string& segment, CosimRole role, size_t max_payload_bytes)
+        : m_segment(segment), m_role(role) {
+        m_spin = std::thread::hardware_concurrency() > 1 ? 20000 : 0;
+        size_t bytes = sizeof(Layout) + 2 * max_payload_bytes;
+        int fd;
+        if (role == CosimRole::TERRAIN) {
+            shm_unlink(segment.c_str());
+            fd = shm_open(segment.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+            if (fd < 0 || ftruncate(fd, bytes) != 0) {
+                if (fd >= 0)
+                    close(fd);
+                return;
+            }
+        } else {
+            fd = shm_open(segment.c_str(), O_RDWR, 0);
+            struct stat st;
+            if (fd < 0 || fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(Layout)) {
+                if (fd >= 0)
+                    close(fd);
+                return;
+            }
+            bytes = st.st_size;
+        }
+        void* p = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        close(fd);
+        if (p == MAP_FAILED)
+            return;
+        m_bytes = bytes;
+        m_layout = static_cast<Layout*>(p);
+        if (role == CosimRole::TERRAIN) {
+            m_layout->payload_bytes = max_payload_bytes;
+            m_layout->pid[0] = getpid();
+            m_layout->magic.store(magic, std::memory_order_release);
+        } else {
+            if (m_layout->magic.load(std::memory_order_acquire) != magic) {
+                munmap(p, bytes);
+                m_layout = nullptr;
+                return;
+            }
+            m_layout->pid[1] = getpid();
+        }
+    }
+
+    // Closing leaves the sequence words alone, so a message sent just
+    // before is still delivered; sleeping readers are only woken to see
+    // `closed`
+    ~ShmCosimChannel() override {
+        if (!m_layout)
+            return;
+        m_layout->closed.store(1);
+        for (auto& box : m_layout->box)
+            futexWake(&box.seq);
+        munmap(m_layout, m_bytes);
+        if (m_role == CosimRole::TERRAIN)
+            shm_unlink(m_segment.c_str());
+    }
+
+    bool valid() const { return m_layout != nullptr; }
+    const char* name() const override { return "shm"; }
+
+  protected:
+    bool send(const CosimHeader& header, const void* payload, size_t bytes) override {
+        if (bytes > m_layout->payload_bytes || m_layout->closed.load())
+            return false;
+        Mailbox& box = m_layout->box[outbox()];
+        box.header = header;
+        std::memcpy(payloadOf(outbox()), payload, bytes);
+        box.seq.fetch_add(1);  // seq_cst, pairs with the reader's `waiting` store
+        if (box.waiting.load())
+            futexWake(&box.seq);
+        return true;
+    }
+
+    bool receiveHeader(CosimHeader& header) override {
+        Mailbox& box = m_layout->box[inbox()];
+        uint32_t expected = m_received + 1;
+        if (!await(box, expected))
+            return false;
+        m_received = expected;
+        header = box.header;
+        return true;
+    }
+
+    bool receivePayload(void* payload, size_t bytes) override {
+        if (bytes > m_layout->payload_bytes)
+            return false;
+        std::memcpy(payload, payloadOf(inbox()), bytes);
+        return true;
+    }
+
+  private:
+    struct alignas(64) Mailbox {
+        std::atomic<uint32_t> seq;
+        std::atomic<uint32_t> waiting;
+        CosimHeader header;
+    };
+    struct Layout {
+        std::atomic<uint64_t> magic;
+        uint64_t payload_bytes;
+        pid_t pid[2];  // terrain, rover
+        std::atomic<uint32_t> closed;
+        Mailbox box[2];  // to terrain, to rover
+    };
+
+    int inbox() const { return m_role == CosimRole::TERRAIN ? 0 : 1; }
+    int outbox() const { return 1 - inbox(); }
+    char* payloadOf(int box) {
+        return reinterpret_cast<char*>(m_layout + 1) + box * m_layout->payload_bytes;
+    }
+
+    bool peerAlive() const {
+        pid_t peer = m_layout->pid[outbox()];
+        return !m_layout->closed.load() && (peer == 0 || kill(peer, 0) == 0 || errno != ESRCH);
+    }
+
+    // True once message `expected` is in the mailbox, even if the peer has
+    // closed since sending it; false if the peer is gone with none pending
+    bool await(Mailbox& box, uint32_t expected) {
+        for (int spin = 0; spin < m_spin; spin++) {
+            if (box.seq.load(std::memory_order_acquire) == expected)
+                return true;
+            cpuRelax();
+        }
+        const timespec timeout = {0, 100 * 1000 * 1000};
+        while (true) {
+            box.waiting.store(1);
+            uint32_t seq = box.seq.load();
+            if (seq == expected)
+                break;
+            if (!peerAlive()) {
+                box.waiting.store(0);
+                // a message may have landed between the two loads
+                return box.seq.load() == expected;
+            }
+            futexWait(&box.seq, seq, &timeout);
+        }
+        box.waiting.store(0);
+        return true;
+    }
+
+    std::string m_segment;
+    CosimRole m_role;
+    Layout* m_layout = nullptr;
+    size_t m_bytes = 0;
+    uint32_t m_received = 0;
+    int m_spin = 0;
+};
+
+// The same exchange over a Unix stream socket. The terrain side listens and
+// accepts one rover connection.
+class SocketCosimChannel : public CosimChannel {
+  public:
+    SocketCosimChannel(const std::string& path, CosimRole role, double connect_timeout = 60) {
+        sockaddr_un addr = {};
+        addr.sun_family = AF_UNIX;
+        if (path.size() >= sizeof(addr.sun_path))
+            return;
+        std::strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+        if (role == CosimRole::TERRAIN) {
+            int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+            unlink(path.c_str());
+            if (listener < 0)
+                return;
+            if (bind(listener, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == 0 && listen(listener, 1) == 0)
+                m_fd = accept(listener, nullptr, nullptr);
+            close(listener);
+            unlink(path.c_str());
+        } else {
+            auto deadline = std::chrono::steady_clock::now() + std::chrono::duration<double>(connect_timeout);
+            while (true) {
+                int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+                if (connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == 0) {
+                    m_fd = fd;
+                    break;
+                }
+                close(fd);
+                if (std::chrono::steady_clock::now() >= deadline)
+                    break;
+                std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            }
+        }
+    }
+
+    ~SocketCosimChannel() override {
+        if (m_fd >= 0)
+            close(m_fd);
+    }
+
+    bool valid() const { return m_fd >= 0; }
+    const char* name() const override { return "unix"; }
+
+  protected:
+    bool send(const CosimHeader& header, const void* payload, size_t bytes) override {
+        // one write per message so the peer wakes once
+        m_buffer.resize(sizeof(CosimHeader) + bytes);
+        std::memcpy(m_buffer.data(), &header, sizeof(CosimHeader));
+        std::memcpy(m_buffer.data() + sizeof(CosimHeader), payload, bytes);
+        return writeAll(m_buffer.data(), m_buffer.size());
+    }
+    bool receiveHeader(CosimHeader& header) override { return readAll(&header, sizeof(header)); }
+    bool receivePayload(void* payload, size_t bytes) override { return readAll(payload, bytes); }
+
+  private:
+    bool writeAll(const char* data, size_t len) {
+        while (len > 0) {
+            ssize_t n = ::send(m_fd, data, len, MSG_NOSIGNAL);
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n <= 0)
+                return false;
+            data += n;
+            len -= n;
+        }
+        return true;
+    }
+    bool readAll(void* dst, size_t len) {
+        char* data = static_cast<char*>(dst);
+        while (len > 0) {
+            ssize_t n = ::recv(m_fd, data, len, 0);
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n <= 0)
+                return false;
+            data += n;
+            len -= n;
+        }
+        return true;
+    }
+
+    int m_fd = -1;
+    std::vector<char> m_buffer;
+};
+
+// Open one end of a channel from a spec string:
+//   shm:<name>   shared-memory segment /dev/shm/<name>
+//   unix:<path>  Unix socket at <path>
+//   <name>       shared memory, falling back to the socket /tmp/<name>.sock
+//                when the segment cannot be created or found
+// The terrain side must be started first for shm; the rover waits up to
+// `timeout` seconds for it. Returns nullptr on failure.
+inline std::unique_ptr<CosimChannel> openCosimChannel(const std::string& spec,
+                                                      CosimRole role,
+                                                      unsigned int max_meshes,
+                                                      double timeout = 60) {
+    size_t max_payload = max_meshes * std::max(sizeof(CosimMeshState), sizeof(CosimMeshLoad));
+    bool want_shm = spec.compare(0, 4, "shm:") == 0;
+    bool want_unix = spec.compare(0, 5, "unix:") == 0;
+    std::string name = want_shm ? spec.substr(4) : want_unix ? spec.substr(5) : spec;
+    std::string segment = "/" + name;
+    std::string socket_path = want_unix ? name : "/tmp/" + name + ".sock";
+
+    auto tryShm = [&]() -> std::unique_ptr<CosimChannel> {
+        std::unique_ptr<ShmCosimChannel> channel(new ShmCosimChannel(segment, role, max_payload));
+        if (channel->valid())
+            return channel;
+        return nullptr;
+    };
+    auto trySocket = [&](double wait) -> std::unique_ptr<CosimChannel> {
+        std::unique_ptr<SocketCosimChannel> channel(new SocketCosimChannel(socket_path, role, wait));
+        if (channel->valid())
+            return channel;
+        return nullptr;
+    };
+
+    if (want_unix)
+        return trySocket(timeout);
+    if (role == CosimRole::TERRAIN) {
+        auto channel = tryShm();
+        if (channel || want_shm)
+            return channel;
+        return trySocket(timeout);
+    }
+
+    // Rover: poll for whichever endpoint the terrain side managed to open
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::duration<double>(timeout);
+    do {
+        if (auto channel = tryShm())
+            return channel;
+        if (!want_shm) {
+            if (auto channel = trySocket(0))
+                return channel;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    } while (std::chrono::steady_clock::now() < deadline);
+    return nullptr;
+}
@@ -0,0 +1,238 @@
+#pragma once
+// Extrapolation of the terrain loads on a mesh between co-simulation
+// exchanges, and a monitor of the energy the coupling adds or removes.
+//
+// Loads and velocities are generalised 6-vectors: force then torque, and
+// linear then angular velocity (absolute frame), as exchanged through
+// CosimChannel. A sample pairs the load the terrain returned with the mesh
+// state it was computed for.
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <string>
+
+enum class PredictorType {
+    HOLD,       // last load, held constant (the plain staggered scheme)
+    LINEAR,     // linear extrapolation in time from the last two loads
+    QUADRATIC,  // quadratic extrapolation in time from the last three loads
+    STIFFNESS   // load = f0 + k * (z - z0) + c * (v - v0), fitted online
+};
+
+inline bool parsePredictorType(const std::string& name, PredictorType& type) {
+    if (name == "hold")
+        type = PredictorType::HOLD;
+    else if (name == "linear")
+        type = PredictorType::LINEAR;
+    else if (name == "quadratic")
+        type = PredictorType::QUADRATIC;
+    else if (name == "stiffness")
+        type = PredictorType::STIFFNESS;
+    else
+        return false;
+    return true;
+}
+
+inline const char* predictorName(PredictorType type) {
+    switch (type) {
+        case PredictorType::LINEAR:
+            return "linear";
+        case PredictorType::QUADRATIC:
+            return "quadratic";
+        case PredictorType::STIFFNESS:
+            return "stiffness";
+        default:
+            return "hold";
+    }
+}
+
+class LoadPredictor {
+  public:
+    static constexpr size_t window = 8;
+
+    // forgetting: weight ratio between consecutive samples in the stiffness fit
+    explicit LoadPredictor(PredictorType type = PredictorType::HOLD, double forgetting = 0.7)
+        : m_type(type), m_forgetting(forgetting) {}
+
+    PredictorType type() const { return m_type; }
+    size_t numSamples() const { return m_count; }
+    void reset() { m_count = 0; }
+
+    // Load returned for the mesh state (height z, velocity vel) sent at `time`
+    void addSample(double time, const double load[6], double z, const double vel[6]) {
+        for (size_t k = std::min(m_count, window - 1); k > 0; k--)
+            m_history[k] = m_history[k - 1];
+        Sample& s = m_history[0];
+        s.time = time;
+        s.z = z;
+        for (int d = 0; d < 6; d++) {
+            s.load[d] = load[d];
+            s.vel[d] = vel[d];
+        }
+        m_count = std::min(m_count + 1, window);
+        if (m_type == PredictorType::STIFFNESS)
+            fit();
+    }
+
+    // Load at `time` for the current mesh state. Falls back to lower order
+    // predictors until enough samples have been seen.
+    void predict(double time, double z, const double vel[6], double load[6]) const {
+        if (m_count == 0) {
+            for (int d = 0; d < 6; d++)
+                load[d] = 0;
+            return;
+        }
+        const Sample& s0 = m_history[0];
+        PredictorType type = m_type;
+        if (type == PredictorType::STIFFNESS && m_count < 3)
+            type = PredictorType::LINEAR;
+        if (type == PredictorType::QUADRATIC && m_count < 3)
+            type = PredictorType::LINEAR;
+        if (type == PredictorType::LINEAR && m_count < 2)
+            type = PredictorType::HOLD;
+
+        switch (type) {
+            case PredictorType::HOLD:
+                for (int d = 0; d < 6; d++)
+                    load[d] = s0.load[d];
+                break;
+            case PredictorType::LINEAR: {
+                const Sample& s1 = m_history[1];
+                double a = (time - s0.time) / (s0.time - s1.time);
+                for (int d = 0; d < 6; d++)
+                    load[d] = s0.load[d] + a * (s0.load[d] - s1.load[d]);
+                break;
+            }
+            case PredictorType::QUADRATIC: {
+                // Lagrange basis through the last three samples
+                const Sample& s1 = m_history[1];
+                const Sample& s2 = m_history[2];
+                double t0 = s0.time, t1 = s1.time, t2 = s2.time;
+                double l0 = (time - t1) * (time - t2) / ((t0 - t1) * (t0 - t2));
+                double l1 = (time - t0) * (time - t2) / ((t1 - t0) * (t1 - t2));
+                double l2 = (time - t0) * (time - t1) / ((t2 - t0) * (t2 - t1));
+                for (int d = 0; d < 6; d++)
+                    load[d] = l0 * s0.load[d] + l1 * s1.load[d] + l2 * s2.load[d];
+                break;
+            }
+            case PredictorType::STIFFNESS:
+                for (int d = 0; d < 6; d++) {
+                    const Fit& f = m_fit[d];
+                    load[d] = f.mean_load + f.stiffness * (z - f.mean_z) + f.damping * (vel[d] - f.mean_vel);
+                }
+                break;
+        }
+    }
+
+    // Current fit of component d, for reporting
+    double stiffness(int d) const { return m_fit[d].stiffness; }
+    double damping(int d) const { return m_fit[d].damping; }
+
+  private:
+    struct Sample {
+        double time;
+        double z;
+        double load[6];
+        double vel[6];
+    };
+    struct Fit {
+        double mean_load = 0, mean_z = 0, mean_vel = 0;
+        double stiffness = 0, damping = 0;
+    };
+
+    // Exponentially weighted least squares of each load component against
+    // the mesh height and the matching velocity component, on centred data.
+    // A small ridge term keeps the 2x2 system solvable when the motion does
+    // not excite one of the regressors.
+    void fit() {
+        for (int d = 0; d < 6; d++) {
+            double sw = 0, mz = 0, mv = 0, mf = 0, w = 1;
+            for (size_t k = 0; k < m_count; k++, w *= m_forgetting) {
+                const Sample& s = m_history[k];
+                sw += w;
+                mz += w * s.z;
+                mv += w * s.vel[d];
+                mf += w * s.load[d];
+            }
+            mz /= sw;
+            mv /= sw;
+            mf /= sw;
+            double zz = 0, zv = 0, vv = 0, zf = 0, vf = 0;
+            w = 1;
+            for (size_t k = 0; k < m_count; k++, w *= m_forgetting) {
+                const Sample& s = m_history[k];
+                double dz = s.z - mz, dv = s.vel[d] - mv, df = s.load[d] - mf;
+                zz += w * dz * dz;
+                zv += w * dz * dv;
+                vv += w * dv * dv;
+                zf += w * dz * df;
+                vf += w * dv * df;
+            }
+            double ridge = 1e-6 * (zz + vv) + 1e-30;
+            zz += ridge;
+            vv += ridge;
+            double det = zz * vv - zv * zv;
+            Fit& f = m_fit[d];
+            f.mean_load = mf;
+            f.mean_z = mz;
+            f.mean_vel = mv;
+            f.stiffness = (vv * zf - zv * vf) / det;
+            f.damping = (zz * vf - zv * zf) / det;
+            if (f.damping > 0) {
+                // keep the model passive: a load that grows with the velocity
+                // would feed energy into the rover
+                f.damping = 0;
+                f.stiffness = zf / zz;
+            }
+        }
+    }
+
+    PredictorType m_type;
+    double m_forgetting;
+    Sample m_history[window];
+    size_t m_count = 0;
+    Fit m_fit[6];
+};
+
+// Energy balance across the coupling interface of one mesh. The rover side
+// integrates the power of the loads it actually applied; the terrain side
+// integrates the returned loads (trapezoidal between exchanges) over the
+// same motion. Their difference is energy created by the coupling scheme:
+// positive drift means the coupling injected energy into the rover.
+class CouplingEnergyMonitor {
+  public:
+    // One rover step of length dt with the applied load and the mesh velocity
+    void addRoverStep(const double applied[6], const double vel[6], double dt) {
+        for (int d = 0; d < 6; d++) {
+            m_rover_work += applied[d] * vel[d] * dt;
+            m_displacement[d] += vel[d] * dt;
+        }
+    }
+
+    // Load returned by the terrain at the end of the current exchange interval
+    void addExchange(const double load[6]) {
+        for (int d = 0; d < 6; d++) {
+            double previous = m_exchanges > 0 ? m_last_load[d] : load[d];
+            m_terrain_work += 0.5 * (previous + load[d]) * m_displacement[d];
+            m_displacement[d] = 0;
+            m_last_load[d] = load[d];
+        }
+        m_exchanges++;
+    }
+
+    double roverWork() const { return m_rover_work; }
+    double terrainWork() const { return m_terrain_work; }
+    double drift() const { return m_rover_work - m_terrain_work; }
+    // Drift relative to the work exchanged, with `scale` as a floor
+    double relativeDrift(double scale = 1e-12) const {
+        return drift() / std::max(std::abs(m_terrain_work), scale);
+    }
+    size_t numExchanges() const { return m_exchanges; }
+
+  private:
+    double m_rover_work = 0;
+    double m_terrain_work = 0;
+    double m_displacement[6] = {0, 0, 0, 0, 0, 0};
+    double m_last_load[6] = {0, 0, 0, 0, 0, 0};
+    size_t m_exchanges = 0;
+};
@@ -0,0 +1,235 @@
+#pragma once
+// High-rate capture of the rover state into an in-memory ring, written to
+// disk only around events. The ring holds the last `frames` snapshots (body
+// states, contact loads and optionally the particles near the rover); when a
+// trigger fires the recorder keeps `post_frames` more and then dumps the
+// whole ring, so every event file covers the lead-up and the aftermath.
+// Triggers: a contact force spike, a sudden pitch change, or a user event
+// (trigger() from the caller, or SIGUSR1 sent to the process).
+
+#include <signal.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "CosimChannel.hpp"
+
+// A value of 0 disables the recorder (fps) or the trigger. Read from the
+// run's JSON file under the keys below (e.g. "recorder_fps": 2000).
+struct RecorderSettings {
+    double fps = 0;                 // capture rate
+    unsigned int frames = 512;      // ring capacity
+    unsigned int post_frames = 128; // frames kept after a trigger
+    double force_spike = 4;         // total contact force over its running mean
+    double pitch_rate_deg = 90;     // chassis pitch rate (deg/s)
+    double roi_radius = 0;          // particles within this distance of the chassis (xy)
+    unsigned int roi_every = 10;    // capture particles every this many frames
+
+    bool set(const std::string& key, double value) {
+        if (key == "recorder_fps")
+            fps = value;
+        else if (key == "recorder_frames")
+            frames = (unsigned int)std::max(1., value);
+        else if (key == "recorder_post_frames")
+            post_frames = (unsigned int)std::max(0., value);
+        else if (key == "recorder_force_spike")
+            force_spike = value;
+        else if (key == "recorder_pitch_rate_deg")
+            pitch_rate_deg = value;
+        else if (key == "recorder_roi_radius")
+            roi_radius = value;
+        else if (key == "recorder_roi_every")
+            roi_every = (unsigned int)std::max(1., value);
+        else
+            return false;
+        return true;
+    }
+};
+
+class FlightRecorder {
+  public:
+    // num_bodies states per frame; event files are named <prefix>NNN_<reason>.csv
+    FlightRecorder(const RecorderSettings& settings, size_t num_bodies, const std::string& prefix)
+        : m_settings(settings), m_num_bodies(num_bodies), m_prefix(prefix) {
+        if (!enabled())
+            return;
+        size_t n = m_settings.frames;
+        m_times.resize(n);
+        m_states.resize(n * num_bodies);
+        m_loads.resize(n * num_bodies);
+        m_roi.resize(n);
+    }
+
+    bool enabled() const { return m_settings.fps > 0; }
+
+    // Steps between captures at the given step size
+    unsigned int captureSteps(double step_size) const {
+        return (unsigned int)std::max(1., std::round(1 / (m_settings.fps * step_size)));
+    }
+
+    // Whether the next capture should include the ROI particles
+    bool roiDue() const { return m_settings.roi_radius > 0 && m_captured % m_settings.roi_every == 0; }
+    double roiRadius() const { return m_settings.roi_radius; }
+
+    // Route SIGUSR1 to a user event at the next capture
+    static void installSignalHandler() {
+        signalFlag() = 0;
+        struct sigaction action = {};
+        action.sa_handler = [](int) { signalFlag() = 1; };
+        sigemptyset(&action.sa_mask);
+        action.sa_flags = SA_RESTART;
+        sigaction(SIGUSR1, &action, nullptr);
+    }
+
+    // User event, recorded at the next capture
+    void trigger(const std::string& reason) {
+        if (enabled() && m_pending.empty())
+            m_requested = reason;
+    }
+
+    // Record one frame. loads holds the first loads.size() bodies (the rest
+    // carry no load); roi the x,y,z of the captured particles, or nullptr.
+    void capture(double time,
+                 const std::vector<CosimMeshState>& states,
+                 const std::vector<CosimMeshLoad>& loads,
+                 double pitch_rad,
+                 const std::vector<float>* roi = nullptr) {
+        if (!enabled())
+            return;
+        size_t slot = m_captured % m_settings.frames;
+        m_times[slot] = time;
+        double force[3] = {0, 0, 0};
+        for (size_t b = 0; b < m_num_bodies; b++) {
+            m_states[slot * m_num_bodies + b] = b < states.size() ? states[b] : CosimMeshState();
+            m_loads[slot * m_num_bodies + b] = b < loads.size() ? loads[b] : CosimMeshLoad();
+            for (int k = 0; k < 3 && b < loads.size(); k++)
+                force[k] += loads[b].force[k];
+        }
+        if (roi)
+            m_roi[slot] = *roi;
+        else
+            m_roi[slot].clear();
+        m_captured++;
+
+        detect(time, std::sqrt(force[0] * force[0] + force[1] * force[1] + force[2] * force[2]), pitch_rad);
+
+        if (!m_pending.empty() && m_post_remaining-- == 0)
+            dump();
+    }
+
+    // Write an event still collecting its post-trigger frames
+    void flush() {
+        if (!m_pending.empty())
+            dump();
+    }
+
+    size_t numEvents() const { return m_events; }
+
+  private:
+    static volatile sig_atomic_t& signalFlag() {
+        static volatile sig_atomic_t flag = 0;
+        return flag;
+    }
+
+    void detect(double time, double force, double pitch) {
+        std::string reason = m_requested;
+        m_requested.clear();
+        if (signalFlag()) {
+            signalFlag() = 0;
+            reason = "signal";
+        }
+        // the running mean needs a quarter of the ring before spikes count
+        bool warmed_up = m_captured > m_settings.frames / 4;
+        if (reason.empty() && m_settings.force_spike > 0 && warmed_up &&
+            force > m_settings.force_spike * std::max(m_force_mean, 1e-30))
+            reason = "force_spike";
+        if (reason.empty() && m_settings.pitch_rate_deg > 0 && m_captured > 1 && time > m_last_time) {
+            double rate = std::abs(pitch - m_last_pitch) / (time - m_last_time) * 180 / M_PI;
+            if (rate > m_settings.pitch_rate_deg)
+                reason = "pitch";
+        }
+        m_force_mean = m_captured == 1 ? force : 0.98 * m_force_mean + 0.02 * force;
+        m_last_pitch = pitch;
+        m_last_time = time;
+
+        if (!reason.empty() && m_pending.empty()) {
+            m_pending = reason;
+            m_trigger_time = time;
+            m_post_remaining = m_settings.post_frames;
+        }
+    }
+
+    void dump() {
+        char filename[512];
+        std::snprintf(filename, sizeof(filename), "%s%03zu_%s.csv", m_prefix.c_str(), m_events, m_pending.c_str());
+        size_t count = std::min<size_t>(m_captured, m_settings.frames);
+        size_t first = m_captured - count;
+        FILE* out = std::fopen(filename, "w");
+        if (out) {
+            std::fprintf(out, "frame,t,body,x,y,z,e0,e1,e2,e3,vx,vy,vz,wx,wy,wz,fx,fy,fz,tx,ty,tz\n");
+            for (size_t f = first; f < m_captured; f++) {
+                size_t slot = f % m_settings.frames;
+                for (size_t b = 0; b < m_num_bodies; b++) {
+                    const CosimMeshState& s = m_states[slot * m_num_bodies + b];
+                    const CosimMeshLoad& l = m_loads[slot * m_num_bodies + b];
+                    std::fprintf(out,
+                                 "%zu,%.9g,%zu,%.9g,%.9g,%.9g,%.9g,%.9g,%.9g,%.9g,%.9g,%.9g,%.9g,%.9g,%.9g,%.9g,"
+                                 "%.9g,%.9g,%.9g,%.9g,%.9g,%.9g\n",
+                                 f - first, m_times[slot], b, s.pos[0], s.pos[1], s.pos[2], s.rot[0], s.rot[1],
+                                 s.rot[2], s.rot[3], s.lin_vel[0], s.lin_vel[1], s.lin_vel[2], s.ang_vel[0],
+                                 s.ang_vel[1], s.ang_vel[2], l.force[0], l.force[1], l.force[2], l.torque[0],
+                                 l.torque[1], l.torque[2]);
+                }
+            }
+            std::fclose(out);
+        }
+        size_t roi_points = 0;
+        for (size_t f = first; f < m_captured; f++)
+            roi_points += m_roi[f % m_settings.frames].size() / 3;
+        if (out && roi_points > 0) {
+            std::string roi_file = std::string(filename, std::strlen(filename) - 4) + "_particles.csv";
+            FILE* roi_out = std::fopen(roi_file.c_str(), "w");
+            if (roi_out) {
+                std::fprintf(roi_out, "frame,t,x,y,z\n");
+                for (size_t f = first; f < m_captured; f++) {
+                    const std::vector<float>& roi = m_roi[f % m_settings.frames];
+                    for (size_t i = 0; i + 2 < roi.size(); i += 3)
+                        std::fprintf(roi_out, "%zu,%.9g,%g,%g,%g\n", f - first, m_times[f % m_settings.frames],
+                                     roi[i], roi[i + 1], roi[i + 2]);
+                }
+                std::fclose(roi_out);
+            }
+        }
+        if (out)
+            printf("Flight recorder: %s at t = %.4f s, %zu frames (%zu particles) written to %s\n", m_pending.c_str(),
+                   m_trigger_time, count, roi_points, filename);
+        else
+            printf("ERROR writing flight recorder event %s\n", filename);
+        m_events++;
+        m_pending.clear();
+    }
+
+    RecorderSettings m_settings;
+    size_t m_num_bodies;
+    std::string m_prefix;
+
+    std::vector<double> m_times;
+    std::vector<CosimMeshState> m_states;
+    std::vector<CosimMeshLoad> m_loads;
+    std::vector<std::vector<float>> m_roi;
+    size_t m_captured = 0;
+
+    double m_force_mean = 0;
+    double m_last_pitch = 0;
+    double m_last_time = 0;
+
+    std::string m_requested;
+    std::string m_pending;
+    double m_trigger_time = 0;
+    unsigned int m_post_remaining = 0;
+    size_t m_events = 0;
+};
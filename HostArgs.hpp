@@ -0,0 +1,63 @@
+#pragma once
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "HostSpatial.hpp"
+
+// Command line of the host-side tools: positional arguments, "--name value"
+// options and "--name" switches (the names listed in flags)
+class HostArgs {
+  public:
+    HostArgs(int argc, char* argv[], const std::set<std::string>& flags = {}) {
+        for (int i = 1; i < argc; i++) {
+            std::string arg = argv[i];
+            if (arg.size() > 2 && arg.compare(0, 2, "--") == 0) {
+                std::string name = arg.substr(2);
+                if (flags.count(name) || i + 1 == argc) {
+                    m_options[name] = "1";
+                } else {
+                    m_options[name] = argv[++i];
+                }
+                m_ordered.emplace_back(name, m_options[name]);
+            } else {
+                m_positional.push_back(arg);
+            }
+        }
+    }
+
+    size_t numPositional() const { return m_positional.size(); }
+    const std::string& positional(size_t i) const { return m_positional.at(i); }
+
+    bool has(const std::string& name) const { return m_options.count(name) != 0; }
+    std::string getString(const std::string& name, const std::string& default_value) const {
+        auto it = m_options.find(name);
+        return it == m_options.end() ? default_value : it->second;
+    }
+    double getNumber(const std::string& name, double default_value) const {
+        auto it = m_options.find(name);
+        return it == m_options.end() ? default_value : std::atof(it->second.c_str());
+    }
+    // Every option in command line order, repeats included (for pipelines)
+    const std::vector<std::pair<std::string, std::string>>& ordered() const { return m_ordered; }
+
+    // "x,y,z"
+    Vec3f getVec3(const std::string& name, const Vec3f& default_value) const {
+        auto it = m_options.find(name);
+        Vec3f v = default_value;
+        if (it != m_options.end() && std::sscanf(it->second.c_str(), "%f,%f,%f", &v.x, &v.y, &v.z) != 3) {
+            printf("ERROR: --%s expects x,y,z\n", name.c_str());
+            exit(1);
+        }
+        return v;
+    }
+
+  private:
+    std::vector<std::string> m_positional;
+    std::map<std::string, std::string> m_options;
+    std::vector<std::pair<std::string, std::string>> m_ordered;
+};
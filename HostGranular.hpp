@@ -0,0 +1,477 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "ContactHistory.hpp"
+#include "HostJson.hpp"
+#include "HostMesh.hpp"
+#include "HostParallel.hpp"
+#include "HostSpatial.hpp"
+#include "NeighborList.hpp"
+#include "RockObstacles.hpp"
+
+// CPU reference granular solver for the host-side tools. It mirrors the
+// contact model of our ChSystemGpuMesh runs closely enough for validation and
+// CPU-only studies: Hooke contacts with a Hertzian sqrt(overlap / diameter)
+// multiplier, multi-step tangential history capped by Coulomb friction,
+// fixed box walls centered at the origin, rigid triangle meshes driven by
+// prescribed motion and static instanced rocks (RockObstacles.hpp). Cohesion
+// and adhesion are not modeled.
+//
+// With periodic_x the x walls are replaced by a periodic boundary: particles
+// leaving one end re-enter at the other, contacts reach across the seam, and
+// meshes see the image of each particle nearest to them, so a wheel can drive
+// any distance through a short bin. Rocks are not repeated.
+
+// Material and domain parameters, named as in ChGpuSimulationParameters
+struct GranularParams {
+    float sphere_radius = 1;
+    float sphere_density = 3;
+    float box_X = 400;
+    float box_Y = 200;
+    float box_Z = 50;
+    float step_size = 1e-7f;
+
+    float normalStiffS2S = 1e8f, normalStiffS2W = 1e8f, normalStiffS2M = 1e8f;
+    float normalDampS2S = 20000, normalDampS2W = 20000, normalDampS2M = 20000;
+    float tangentStiffS2S = 1e8f, tangentStiffS2W = 1e8f, tangentStiffS2M = 1e8f;
+    float tangentDampS2S = 100, tangentDampS2W = 100, tangentDampS2M = 100;
+    float static_friction_coeffS2S = 0.7f, static_friction_coeffS2W = 0.7f, static_friction_coeffS2M = 0.7f;
+
+    Vec3f gravity = {0, 0, -370};
+    bool periodic_x = false;  // periodic in x over the box length instead of x walls
+};
+
+// Read the fields of a rovertest JSON file that the host solver uses
+inline bool loadGranularParams(const std::string& json_file, GranularParams& params) {
+    HostJson json;
+    if (!json.parseFile(json_file))
+        return false;
+#define READ_PARAM(name) params.name = (float)json.getNumber(#name, params.name)
+    READ_PARAM(sphere_radius);
+    READ_PARAM(sphere_density);
+    READ_PARAM(box_X);
+    READ_PARAM(box_Y);
+    READ_PARAM(box_Z);
+    READ_PARAM(step_size);
+    READ_PARAM(normalStiffS2S);
+    READ_PARAM(normalStiffS2W);
+    READ_PARAM(normalStiffS2M);
+    READ_PARAM(normalDampS2S);
+    READ_PARAM(normalDampS2W);
+    READ_PARAM(normalDampS2M);
+    READ_PARAM(tangentStiffS2S);
+    READ_PARAM(tangentStiffS2W);
+    READ_PARAM(tangentStiffS2M);
+    READ_PARAM(tangentDampS2S);
+    READ_PARAM(tangentDampS2W);
+    READ_PARAM(tangentDampS2M);
+    READ_PARAM(static_friction_coeffS2S);
+    READ_PARAM(static_friction_coeffS2W);
+    READ_PARAM(static_friction_coeffS2M);
+#undef READ_PARAM
+    // true/false, or a number as the other keys are
+    params.periodic_x = json.getBool("periodic_x", params.periodic_x) || json.getNumber("periodic_x", 0) != 0;
+    return true;
+}
+
+// Coefficients of one contact type (sphere-sphere, -wall or -mesh)
+struct ContactCoefficients {
+    float kn, gn, kt, gt, mu;
+};
+
+// Force on a sphere of the given radius from one contact. n is the unit
+// normal pointing towards the sphere, delta the overlap and v_rel the velocity
+// of the sphere's contact point relative to the other body. history is the
+// tangential spring displacement, updated in place (nullptr: no tangential
+// spring). The tangential part of the force is returned in f_t for the torque.
+inline Vec3f contactForce(const ContactCoefficients& c,
+                          float radius,
+                          float m_eff,
+                          float dt,
+                          float delta,
+                          const Vec3f& n,
+                          const Vec3f& v_rel,
+                          Vec3f* history,
+                          Vec3f& f_t) {
+    float hertz = std::sqrt(delta / (2 * radius));
+    float v_n = dot(v_rel, n);
+    float f_n = std::max(0.f, hertz * (c.kn * delta - c.gn * m_eff * v_n));
+    Vec3f v_t = v_rel - v_n * n;
+
+    f_t = -hertz * c.gt * m_eff * v_t;
+    if (history) {
+        Vec3f& u = *history;
+        // keep the spring in the current tangent plane
+        u = u - dot(u, n) * n + dt * v_t;
+        f_t -= hertz * c.kt * u;
+    }
+    float f_t_mag = length(f_t);
+    float f_max = c.mu * f_n;
+    if (f_t_mag > f_max && f_t_mag > 0) {
+        f_t = f_t * (f_max / f_t_mag);
+        // sliding: shorten the spring to the Coulomb limit
+        if (history) {
+            float u_mag = length(*history);
+            if (u_mag > 0)
+                *history = *history * std::min(1.f, f_max / (hertz * c.kt * u_mag));
+        }
+    }
+    return f_n * n + f_t;
+}
+
+// Load on a rigid mesh from static rocks, each world vertex taken as a
+// sphere of radius skin. Vertex contacts get the normal and damping parts of
+// contactForce (no tangential spring). torque is about pose.pos.
+inline void meshRockLoad(const RockField& rocks,
+                         const std::vector<Vec3f>& world,
+                         const MeshPose& pose,
+                         const ContactCoefficients& c,
+                         float skin,
+                         float m_eff,
+                         float dt,
+                         Vec3f& force,
+                         Vec3f& torque) {
+    force = {0, 0, 0};
+    torque = {0, 0, 0};
+    for (const Vec3f& x : world) {
+        rocks.forEachContact(x, skin, [&](uint32_t, const Vec3f& point) {
+            Vec3f d = x - point;
+            float dist = length(d);
+            if (dist == 0)
+                return;
+            Vec3f n = d * (1 / dist);
+            Vec3f v = pose.lin_vel + cross(pose.ang_vel, x - pose.pos);
+            Vec3f f_t;
+            Vec3f f = contactForce(c, skin, m_eff, dt, skin - dist, n, v, nullptr, f_t);
+            force += f;
+            torque += cross(x - pose.pos, f);
+        });
+    }
+}
+
+// Particle state in structure-of-arrays form. id is the global particle id,
+// stable across reordering and across processes.
+struct ParticleArrays {
+    std::vector<uint32_t> id;
+    std::vector<Vec3f> pos;
+    std::vector<Vec3f> vel;
+    std::vector<Vec3f> omega;
+
+    size_t size() const { return pos.size(); }
+    void resize(size_t n) {
+        id.resize(n);
+        pos.resize(n);
+        vel.resize(n);
+        omega.resize(n);
+    }
+    void push(uint32_t i, const Vec3f& p, const Vec3f& v, const Vec3f& w) {
+        id.push_back(i);
+        pos.push_back(p);
+        vel.push_back(v);
+        omega.push_back(w);
+    }
+    // Overwrite particle k with particle k2 of other
+    void set(size_t k, const ParticleArrays& other, size_t k2) {
+        id[k] = other.id[k2];
+        pos[k] = other.pos[k2];
+        vel[k] = other.vel[k2];
+        omega[k] = other.omega[k2];
+    }
+};
+
+class HostGranularSolver {
+  public:
+    // History keys of wall and mesh contacts use these reserved "particle" ids
+    static constexpr uint32_t wall_id_base = 0xFFFFFFF0u;
+    static constexpr uint32_t mesh_id_base = 0xFFFFFF00u;
+    // and rock instances these, below the mesh ids
+    static constexpr uint32_t rock_id_base = 0xF0000000u;
+
+    HostGranularSolver(const GranularParams& params, float skin_fraction = 0.2f)
+        : m_params(params), m_list(params.sphere_radius, skin_fraction, false) {
+        float r = params.sphere_radius;
+        m_mass = params.sphere_density * (float)(4. / 3. * 3.14159265358979) * r * r * r;
+        m_inertia = 0.4f * m_mass * r * r;
+        m_s2s = {params.normalStiffS2S, params.normalDampS2S, params.tangentStiffS2S, params.tangentDampS2S,
+                 params.static_friction_coeffS2S};
+        m_s2w = {params.normalStiffS2W, params.normalDampS2W, params.tangentStiffS2W, params.tangentDampS2W,
+                 params.static_friction_coeffS2W};
+        m_s2m = {params.normalStiffS2M, params.normalDampS2M, params.tangentStiffS2M, params.tangentDampS2M,
+                 params.static_friction_coeffS2M};
+        if (params.periodic_x)
+            m_periodic = periodicBoxX(params.box_X);
+        m_list.setPeriodic(m_periodic);
+    }
+
+    // Add a rigid mesh (in its local frame), returns its index
+    size_t addMesh(const TriangleMesh& mesh) {
+        Mesh m;
+        m.local = mesh;
+        m.pose = {{0, 0, 0}, {1, 0, 0, 0}, {0, 0, 0}, {0, 0, 0}};
+        m_meshes.push_back(m);
+        return m_meshes.size() - 1;
+    }
+    size_t numMeshes() const { return m_meshes.size(); }
+    void setMeshPose(size_t mesh, const MeshPose& pose) { m_meshes[mesh].pose = pose; }
+    // Inactive meshes are skipped entirely and report zero loads
+    void setMeshActive(size_t mesh, bool active) { m_meshes[mesh].active = active; }
+    const MeshPose& getMeshPose(size_t mesh) const { return m_meshes[mesh].pose; }
+    // Contact force and torque (about the mesh position) from the last step
+    const Vec3f& getMeshForce(size_t mesh) const { return m_meshes[mesh].force; }
+    const Vec3f& getMeshTorque(size_t mesh) const { return m_meshes[mesh].torque; }
+
+    // Static rocks that particles and meshes collide with (nullptr: none).
+    // The field must outlive the solver; rock loads on meshes are included
+    // in getMeshForce and getMeshTorque.
+    void setRocks(const RockField* rocks) { m_rocks = rocks; }
+
+    // Tangential history of the contacts of the owned particles, keyed by
+    // particle id (directed: the first id is the particle the entry acts on)
+    ContactHistoryTable& history() { return m_history; }
+
+    // World-space bounds of a mesh at its current pose
+    void meshWorldBounds(size_t mesh, Vec3f& lo, Vec3f& hi) const {
+        updateWorldVertices(m_meshes[mesh]);
+        computeBounds(m_meshes[mesh].world, lo, hi);
+    }
+
+    // True if some particle has moved more than half the skin since the
+    // neighbour list was built
+    bool needsRebuild(const ParticleArrays& p) const {
+        return m_list.numBuilds() == 0 || p.size() != m_last_size || 2 * m_list.maxDisplacement(p.pos) > m_list.skin();
+    }
+    float maxDisplacement(const ParticleArrays& p) const { return m_list.maxDisplacement(p.pos); }
+
+    // Contact forces on particles [0, num_owned). Particles past num_owned are
+    // ghosts: they act on the owned particles but get no forces themselves.
+    // rebuild forces a neighbour list rebuild, required whenever particles
+    // were added, removed or reordered.
+    void computeForces(const ParticleArrays& p, size_t num_owned, bool rebuild) {
+        if (rebuild)
+            m_list.build(p.pos);
+        m_last_size = p.size();
+
+        if (m_history.needsCompact())
+            m_history.compact();
+        m_history.reserve(m_list.numPairs() / 2 + num_owned);
+        m_history.beginStep();
+
+        for (auto& m : m_meshes) {
+            if (!m.active)
+                continue;
+            updateWorldVertices(m);
+            computeBounds(m.world, m.lo, m.hi);
+        }
+
+        m_force.assign(num_owned, {0, 0, 0});
+        m_torque.assign(num_owned, {0, 0, 0});
+        unsigned int num_threads = hostThreadCount();
+        size_t num_meshes = m_meshes.size();
+        std::vector<Vec3f> mesh_partial(2 * num_meshes * num_threads, {0, 0, 0});
+
+        const float r = m_params.sphere_radius;
+        const float dt = m_params.step_size;
+        const float diameter2 = 4 * r * r;
+        const auto& offsets = m_list.offsets();
+        const auto& neighbors = m_list.neighbors();
+        const auto& order = m_list.order();
+
+        parallelForChunks(order.size(), [&](size_t begin, size_t end, unsigned int tid) {
+            Vec3f* partial = mesh_partial.data() + 2 * num_meshes * tid;
+            for (size_t row = begin; row < end; row++) {
+                uint32_t i = order[row];
+                if (i >= num_owned)
+                    continue;
+                Vec3f f = {0, 0, 0}, torque = {0, 0, 0}, f_t;
+
+                for (uint32_t k = offsets[row]; k < offsets[row + 1]; k++) {
+                    uint32_t j = neighbors[k];
+                    Vec3f d = m_periodic.delta(p.pos[i], p.pos[j]);
+                    float d2 = dot(d, d);
+                    if (d2 >= diameter2 || d2 == 0)
+                        continue;
+                    float dist = std::sqrt(d2);
+                    Vec3f n = d * (1 / dist);
+                    Vec3f v_rel = p.vel[i] + cross(p.omega[i], -r * n) - p.vel[j] - cross(p.omega[j], r * n);
+                    ContactHistoryTable::Entry* h = m_history.acquireDirected(p.id[i], p.id[j]);
+                    f += contactForce(m_s2s, r, m_mass / 2, dt, 2 * r - dist, n, v_rel,
+                                      h ? &h->displacement : nullptr, f_t);
+                    torque += cross(-r * n, f_t);
+                }
+
+                addWallForces(p, i, f, torque);
+                if (m_rocks)
+                    addRockForces(p, i, f, torque);
+
+                for (size_t m = 0; m < num_meshes; m++) {
+                    Vec3f f_mesh, contact_point;
+                    if (!m_meshes[m].active || !meshContact(m, p, i, f_mesh, torque, contact_point))
+                        continue;
+                    f += f_mesh;
+                    partial[2 * m] -= f_mesh;
+                    partial[2 * m + 1] -= cross(contact_point - m_meshes[m].pose.pos, f_mesh);
+                }
+
+                m_force[i] = f;
+                m_torque[i] = torque;
+            }
+        }, num_threads);
+
+        // sum the per-thread mesh loads in a fixed order
+        for (size_t m = 0; m < num_meshes; m++) {
+            m_meshes[m].force = {0, 0, 0};
+            m_meshes[m].torque = {0, 0, 0};
+            for (unsigned int t = 0; t < num_threads; t++) {
+                m_meshes[m].force += mesh_partial[2 * (num_meshes * t + m)];
+                m_meshes[m].torque += mesh_partial[2 * (num_meshes * t + m) + 1];
+            }
+        }
+        if (m_rocks) {
+            parallelFor(num_meshes, [&](size_t m) {
+                Mesh& mesh = m_meshes[m];
+                if (!mesh.active)
+                    return;
+                Vec3f force, torque;
+                meshRockLoad(*m_rocks, mesh.world, mesh.pose, m_s2m, r, m_mass, dt, force, torque);
+                mesh.force += force;
+                mesh.torque += torque;
+            });
+        }
+    }
+
+    // Semi-implicit Euler update of particles [0, num_owned) from the forces
+    // of the last computeForces(). A periodic x is wrapped into the box.
+    void integrate(ParticleArrays& p, size_t num_owned) {
+        const float dt = m_params.step_size;
+        const Vec3f g = m_params.gravity;
+        parallelFor(num_owned, [&](size_t i) {
+            p.vel[i] += dt * (m_force[i] * (1 / m_mass) + g);
+            p.omega[i] += dt * (1 / m_inertia) * m_torque[i];
+            p.pos[i] += dt * p.vel[i];
+            p.pos[i].x = m_periodic.wrap(p.pos[i].x);
+        });
+    }
+
+    // Advance all particles by one step
+    void step(ParticleArrays& p) {
+        computeForces(p, p.size(), needsRebuild(p));
+        integrate(p, p.size());
+    }
+
+    const GranularParams& params() const { return m_params; }
+    const VerletNeighborList& neighborList() const { return m_list; }
+    const PeriodicX& periodic() const { return m_periodic; }
+    const std::vector<Vec3f>& forces() const { return m_force; }
+    float particleMass() const { return m_mass; }
+
+  private:
+    struct Mesh {
+        TriangleMesh local;
+        MeshPose pose;
+        mutable std::vector<Vec3f> world;
+        Vec3f lo = {0, 0, 0}, hi = {0, 0, 0};
+        Vec3f force = {0, 0, 0}, torque = {0, 0, 0};
+        bool active = true;
+    };
+
+    static void updateWorldVertices(const Mesh& m) {
+        m.world.resize(m.local.vertices.size());
+        for (size_t v = 0; v < m.world.size(); v++)
+            m.world[v] = m.pose.pos + rotate(m.pose.rot, m.local.vertices[v]);
+    }
+
+    void addWallForces(const ParticleArrays& p, uint32_t i, Vec3f& f, Vec3f& torque) {
+        const float r = m_params.sphere_radius;
+        const float half[3] = {m_params.box_X / 2, m_params.box_Y / 2, m_params.box_Z / 2};
+        const float x[3] = {p.pos[i].x, p.pos[i].y, p.pos[i].z};
+        for (int axis = m_periodic.enabled() ? 1 : 0; axis < 3; axis++) {
+            for (int side = 0; side < 2; side++) {
+                // overlap with the wall at -half (side 0) or +half (side 1)
+                float delta = side == 0 ? r - (x[axis] + half[axis]) : r - (half[axis] - x[axis]);
+                if (delta <= 0)
+                    continue;
+                Vec3f n = {0, 0, 0};
+                (&n.x)[axis] = side == 0 ? 1.f : -1.f;
+                Vec3f v_rel = p.vel[i] + cross(p.omega[i], -r * n);
+                ContactHistoryTable::Entry* h = m_history.acquireDirected(p.id[i], wall_id_base + 2 * axis + side);
+                Vec3f f_t;
+                f += contactForce(m_s2w, r, m_mass, m_params.step_size, delta, n, v_rel,
+                                  h ? &h->displacement : nullptr, f_t);
+                torque += cross(-r * n, f_t);
+            }
+        }
+    }
+
+    // Contact with the closest point of each rock within the radius
+    void addRockForces(const ParticleArrays& p, uint32_t i, Vec3f& f, Vec3f& torque) {
+        const float r = m_params.sphere_radius;
+        m_rocks->forEachContact(p.pos[i], r, [&](uint32_t k, const Vec3f& point) {
+            Vec3f d = p.pos[i] - point;
+            float dist = length(d);
+            if (dist == 0)
+                return;
+            Vec3f n = d * (1 / dist);
+            Vec3f v_rel = p.vel[i] + cross(p.omega[i], -r * n);
+            ContactHistoryTable::Entry* h = m_history.acquireDirected(p.id[i], rock_id_base + k);
+            Vec3f f_t;
+            f += contactForce(m_s2m, r, m_mass, m_params.step_size, r - dist, n, v_rel, h ? &h->displacement : nullptr,
+                              f_t);
+            torque += cross(-r * n, f_t);
+        });
+    }
+
+    // Deepest contact of particle i (its image nearest the mesh) with mesh m,
+    // if any
+    bool meshContact(size_t m, const ParticleArrays& p, uint32_t i, Vec3f& f, Vec3f& torque, Vec3f& point) {
+        const Mesh& mesh = m_meshes[m];
+        const float r = m_params.sphere_radius;
+        const Vec3f x = m_periodic.nearestImage(p.pos[i], mesh.pose.pos);
+        if (x.x < mesh.lo.x - r || x.x > mesh.hi.x + r || x.y < mesh.lo.y - r || x.y > mesh.hi.y + r ||
+            x.z < mesh.lo.z - r || x.z > mesh.hi.z + r)
+            return false;
+
+        float best_d2 = r * r;
+        bool found = false;
+        const auto& idx = mesh.local.indices;
+        for (size_t t = 0; t + 2 < idx.size(); t += 3) {
+            Vec3f q = closestPointOnTriangle(x, mesh.world[idx[t]], mesh.world[idx[t + 1]], mesh.world[idx[t + 2]]);
+            float d2 = dist2(x, q);
+            if (d2 < best_d2 && d2 > 0) {
+                best_d2 = d2;
+                point = q;
+                found = true;
+            }
+        }
+        if (!found)
+            return false;
+
+        float dist = std::sqrt(best_d2);
+        Vec3f n = (x - point) * (1 / dist);
+        Vec3f v_mesh = mesh.pose.lin_vel + cross(mesh.pose.ang_vel, point - mesh.pose.pos);
+        Vec3f v_rel = p.vel[i] + cross(p.omega[i], -r * n) - v_mesh;
+        ContactHistoryTable::Entry* h = m_history.acquireDirected(p.id[i], mesh_id_base + (uint32_t)m);
+        Vec3f f_t;
+        f = contactForce(m_s2m, r, m_mass, m_params.step_size, r - dist, n, v_rel, h ? &h->displacement : nullptr,
+                         f_t);
+        torque += cross(-r * n, f_t);
+        return true;
+    }
+
+    GranularParams m_params;
+    float m_mass;
+    float m_inertia;
+    ContactCoefficients m_s2s, m_s2w, m_s2m;
+
+    PeriodicX m_periodic;
+    VerletNeighborList m_list;
+    size_t m_last_size = 0;
+    ContactHistoryTable m_history;
+    std::vector<Mesh> m_meshes;
+    const RockField* m_rocks = nullptr;
+    std::vector<Vec3f> m_force;
+    std::vector<Vec3f> m_torque;
+};
@@ -0,0 +1,146 @@
+#pragma once
+#include <cctype>
+#include <cstdlib>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <string>
+
+// Minimal JSON reader for the host-side tools, which cannot use the Chrono
+// parser. Values are flattened to strings under dotted keys: nested objects
+// give "outer.inner" and array elements "array.0", "array.1", ...
+class HostJson {
+  public:
+    bool parseFile(const std::string& filename) {
+        std::ifstream in(filename);
+        if (!in.is_open())
+            return false;
+        std::stringstream buffer;
+        buffer << in.rdbuf();
+        return parse(buffer.str());
+    }
+
+    bool parse(const std::string& text) {
+        m_text = text;
+        m_pos = 0;
+        m_values.clear();
+        skipSpace();
+        return parseValue("") && (skipSpace(), m_pos == m_text.size());
+    }
+
+    bool has(const std::string& key) const { return m_values.count(key) != 0; }
+
+    double getNumber(const std::string& key, double default_value) const {
+        auto it = m_values.find(key);
+        return it == m_values.end() ? default_value : std::atof(it->second.c_str());
+    }
+    std::string getString(const std::string& key, const std::string& default_value) const {
+        auto it = m_values.find(key);
+        return it == m_values.end() ? default_value : it->second;
+    }
+    bool getBool(const std::string& key, bool default_value) const {
+        auto it = m_values.find(key);
+        return it == m_values.end() ? default_value : it->second == "true";
+    }
+
+    const std::map<std::string, std::string>& values() const { return m_values; }
+
+  private:
+    void skipSpace() {
+        while (m_pos < m_text.size() && std::isspace((unsigned char)m_text[m_pos]))
+            m_pos++;
+    }
+
+    bool parseString(std::string& out) {
+        if (m_text[m_pos] != '"')
+            return false;
+        m_pos++;
+        out.clear();
+        while (m_pos < m_text.size() && m_text[m_pos] != '"') {
+            if (m_text[m_pos] == '\\' && m_pos + 1 < m_text.size())
+                m_pos++;
+            out += m_text[m_pos++];
+        }
+        if (m_pos >= m_text.size())
+            return false;
+        m_pos++;
+        return true;
+    }
+
+    bool parseValue(const std::string& key) {
+        if (m_pos >= m_text.size())
+            return false;
+        std::string prefix = key.empty() ? "" : key + ".";
+        char c = m_text[m_pos];
+        if (c == '{') {
+            m_pos++;
+            skipSpace();
+            if (m_pos < m_text.size() && m_text[m_pos] == '}') {
+                m_pos++;
+                return true;
+            }
+            while (true) {
+                std::string name;
+                skipSpace();
+                if (!parseString(name))
+                    return false;
+                skipSpace();
+                if (m_pos >= m_text.size() || m_text[m_pos++] != ':')
+                    return false;
+                skipSpace();
+                if (!parseValue(prefix + name))
+                    return false;
+                skipSpace();
+                if (m_pos >= m_text.size())
+                    return false;
+                if (m_text[m_pos] == '}') {
+                    m_pos++;
+                    return true;
+                }
+                if (m_text[m_pos++] != ',')
+                    return false;
+            }
+        }
+        if (c == '[') {
+            m_pos++;
+            skipSpace();
+            if (m_pos < m_text.size() && m_text[m_pos] == ']') {
+                m_pos++;
+                return true;
+            }
+            for (int index = 0;; index++) {
+                skipSpace();
+                if (!parseValue(prefix + std::to_string(index)))
+                    return false;
+                skipSpace();
+                if (m_pos >= m_text.size())
+                    return false;
+                if (m_text[m_pos] == ']') {
+                    m_pos++;
+                    return true;
+                }
+                if (m_text[m_pos++] != ',')
+                    return false;
+            }
+        }
+        std::string value;
+        if (c == '"') {
+            if (!parseString(value))
+                return false;
+        } else {
+            size_t start = m_pos;
+            while (m_pos < m_text.size() && m_text[m_pos] != ',' && m_text[m_pos] != '}' && m_text[m_pos] != ']' &&
+                   !std::isspace((unsigned char)m_text[m_pos]))
+                m_pos++;
+            value = m_text.substr(start, m_pos - start);
+            if (value.empty())
+                return false;
+        }
+        m_values[key] = value;
+        return true;
+    }
+
+    std::string m_text;
+    size_t m_pos = 0;
+    std::map<std::string, std::string> m_values;
+};
@@ -0,0 +1,137 @@
+#pragma once
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "HostSpatial.hpp"
+
+// Unit quaternion (w, x, y, z), same convention as chrono::ChQuaternion
+struct Quatf {
+    float w, x, y, z;
+};
+
+inline Vec3f rotate(const Quatf& q, const Vec3f& v) {
+    // v + 2 w (u x v) + 2 u x (u x v), u = vector part
+    Vec3f u = {q.x, q.y, q.z};
+    Vec3f t = 2.f * cross(u, v);
+    return v + q.w * t + cross(u, t);
+}
+
+inline Quatf multiply(const Quatf& a, const Quatf& b) {
+    return {a.w * b.w - a.x * b.x - a.y * b.y - a.z * b.z, a.w * b.x + a.x * b.w + a.y * b.z - a.z * b.y,
+            a.w * b.y - a.x * b.z + a.y * b.w + a.z * b.x, a.w * b.z + a.x * b.y - a.y * b.x + a.z * b.w};
+}
+
+inline Quatf quatFromAxisAngle(const Vec3f& axis, float angle) {
+    float s = std::sin(angle / 2) / length(axis);
+    return {std::cos(angle / 2), axis.x * s, axis.y * s, axis.z * s};
+}
+
+// Triangle soup in the mesh's local frame
+struct TriangleMesh {
+    std::vector<Vec3f> vertices;
+    std::vector<uint32_t> indices;  // 3 per triangle
+
+    size_t numTriangles() const { return indices.size() / 3; }
+};
+
+// Load the vertices and faces of a Wavefront OBJ file. Polygons are split
+// into triangle fans; normals, texture coordinates and materials are ignored.
+inline bool loadObjMesh(const std::string& filename, TriangleMesh& mesh) {
+    std::ifstream in(filename);
+    if (!in.is_open())
+        return false;
+    mesh.vertices.clear();
+    mesh.indices.clear();
+    std::string line;
+    while (std::getline(in, line)) {
+        if (line.size() > 2 && line[0] == 'v' && line[1] == ' ') {
+            Vec3f v;
+            if (std::sscanf(line.c_str() + 2, "%f %f %f", &v.x, &v.y, &v.z) == 3)
+                mesh.vertices.push_back(v);
+        } else if (line.size() > 2 && line[0] == 'f' && line[1] == ' ') {
+            std::istringstream face(line.substr(2));
+            std::string corner;
+            std::vector<uint32_t> poly;
+            while (face >> corner) {
+                // "v", "v/vt", "v//vn" or "v/vt/vn"; negative indices count from the end
+                long index = std::atol(corner.c_str());
+                poly.push_back((uint32_t)(index < 0 ? (long)mesh.vertices.size() + index : index - 1));
+            }
+            for (size_t k = 2; k < poly.size(); k++) {
+                mesh.indices.push_back(poly[0]);
+                mesh.indices.push_back(poly[k - 1]);
+                mesh.indices.push_back(poly[k]);
+            }
+        }
+    }
+    return true;
+}
+
+// Apply the same rotation/scaling matrix (row-major) and translation as
+// ChSystemGpuMesh::LoadMeshes does to its meshes
+inline void transformMesh(TriangleMesh& mesh, const float rotscale[9], const Vec3f& translation) {
+    for (auto& v : mesh.vertices) {
+        Vec3f p = v;
+        v = {rotscale[0] * p.x + rotscale[1] * p.y + rotscale[2] * p.z + translation.x,
+             rotscale[3] * p.x + rotscale[4] * p.y + rotscale[5] * p.z + translation.y,
+             rotscale[6] * p.x + rotscale[7] * p.y + rotscale[8] * p.z + translation.z};
+    }
+}
+
+// Vertices and triangles only, readable by loadObjMesh and ChTriangleMeshConnected
+inline bool writeObjMesh(const std::string& filename, const TriangleMesh& mesh) {
+    FILE* out = std::fopen(filename.c_str(), "w");
+    if (!out)
+        return false;
+    bool ok = true;
+    for (size_t i = 0; i < mesh.vertices.size() && ok; i++)
+        ok = std::fprintf(out, "v %.6f %.6f %.6f\n", mesh.vertices[i].x, mesh.vertices[i].y, mesh.vertices[i].z) > 0;
+    for (size_t t = 0; t < mesh.numTriangles() && ok; t++)
+        ok = std::fprintf(out, "f %u %u %u\n", mesh.indices[3 * t] + 1, mesh.indices[3 * t + 1] + 1,
+                          mesh.indices[3 * t + 2] + 1) > 0;
+    return std::fclose(out) == 0 && ok;
+}
+
+inline void meshBounds(const TriangleMesh& mesh, Vec3f& lo, Vec3f& hi) {
+    computeBounds(mesh.vertices, lo, hi);
+}
+
+// Rigid motion of a mesh, as passed to ChSystemGpuMesh::ApplyMeshMotion
+struct MeshPose {
+    Vec3f pos;
+    Quatf rot;
+    Vec3f lin_vel;
+    Vec3f ang_vel;  // in the absolute frame
+};
+
+// Closest point to p on triangle (a, b, c), from Ericson, Real-Time
+// Collision Detection, 5.1.5
+inline Vec3f closestPointOnTriangle(const Vec3f& p, const Vec3f& a, const Vec3f& b, const Vec3f& c) {
+    Vec3f ab = b - a, ac = c - a, ap = p - a;
+    float d1 = dot(ab, ap), d2 = dot(ac, ap);
+    if (d1 <= 0 && d2 <= 0)
+        return a;
+    Vec3f bp = p - b;
+    float d3 = dot(ab, bp), d4 = dot(ac, bp);
+    if (d3 >= 0 && d4 <= d3)
+        return b;
+    float vc = d1 * d4 - d3 * d2;
+    if (vc <= 0 && d1 >= 0 && d3 <= 0)
+        return a + (d1 / (d1 - d3)) * ab;
+    Vec3f cp = p - c;
+    float d5 = dot(ab, cp), d6 = dot(ac, cp);
+    if (d6 >= 0 && d5 <= d6)
+        return c;
+    float vb = d5 * d2 - d1 * d6;
+    if (vb <= 0 && d2 >= 0 && d6 <= 0)
+        return a + (d2 / (d2 - d6)) * ac;
+    float va = d3 * d6 - d5 * d4;
+    if (va <= 0 && (d4 - d3) >= 0 && (d5 - d6) >= 0)
+        return b + ((d4 - d3) / ((d4 - d3) + (d5 - d6))) * (c - b);
+    float denom = 1.f / (va + vb + vc);
+    return a + (vb * denom) * ab + (vc * denom) * ac;
+}
@@ -0,0 +1,82 @@
+#pragma once
+#include <algorithm>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+// Number of worker threads used by the host-side kernels. Defaults to the
+// hardware concurrency and can be overridden with ROVERTEST_NUM_THREADS or
+// setHostThreadCount().
+inline unsigned int& hostThreadCountRef() {
+    static unsigned int count = [] {
+        const char* env = std::getenv("ROVERTEST_NUM_THREADS");
+        int requested = env ? std::atoi(env) : 0;
+        if (requested > 0)
+            return (unsigned int)requested;
+        unsigned int hw = std::thread::hardware_concurrency();
+        return hw > 0 ? hw : 1u;
+    }();
+    return count;
+}
+
+inline unsigned int hostThreadCount() {
+    return hostThreadCountRef();
+}
+
+inline void setHostThreadCount(unsigned int count) {
+    hostThreadCountRef() = count > 0 ? count : 1;
+}
+
+// Bounds [begin, end) of chunk t when [0, n) is split into num_threads
+// contiguous chunks
+inline void chunkBounds(size_t n, unsigned int num_threads, unsigned int t, size_t& begin, size_t& end) {
+    size_t chunk = (n + num_threads - 1) / std::max(1u, num_threads);
+    begin = std::min(n, t * chunk);
+    end = std::min(n, begin + chunk);
+}
+
+// Split [0, n) into one contiguous chunk per thread and call
+// fn(begin, end, thread_id) on each chunk. Chunks are deterministic for a
+// given n and thread count so per-thread partial results can be combined in
+// a fixed order.
+template <typename F>
+void parallelForChunks(size_t n, F&& fn, unsigned int num_threads = hostThreadCount()) {
+    num_threads = (unsigned int)std::max<size_t>(1, std::min<size_t>(num_threads, n));
+    if (num_threads == 1) {
+        fn(size_t(0), n, 0u);
+        return;
+    }
+    std::vector<std::thread> workers;
+    workers.reserve(num_threads - 1);
+    size_t begin, end;
+    for (unsigned int t = 1; t < num_threads; t++) {
+        chunkBounds(n, num_threads, t, begin, end);
+        workers.emplace_back([&fn, begin, end, t] { fn(begin, end, t); });
+    }
+    chunkBounds(n, num_threads, 0, begin, end);
+    fn(begin, end, 0u);
+    for (auto& w : workers)
+        w.join();
+}
+
+// Call fn(i) for every i in [0, n) using all host threads
+template <typename F>
+void parallelFor(size_t n, F&& fn) {
+    parallelForChunks(n, [&fn](size_t begin, size_t end, unsigned int) {
+        for (size_t i = begin; i < end; i++)
+            fn(i);
+    });
+}
+
+// Parallel maximum of fn(i) over [0, n), or init if n == 0
+template <typename T, typename F>
+T parallelMax(size_t n, T init, F&& fn) {
+    std::vector<T> partial(hostThreadCount(), init);
+    parallelForChunks(n, [&](size_t begin, size_t end, unsigned int tid) {
+        T local = init;
+        for (size_t i = begin; i < end; i++)
+            local = std::max(local, fn(i));
+        partial[tid] = local;
+    });
+    return *std::max_element(partial.begin(), partial.end());
+}
@@ -0,0 +1,441 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "HostParallel.hpp"
+
+// Plain position type used by the host-side tools. Kept independent of
+// chrono::ChVector so the tools build without Chrono.
+struct Vec3f {
+    float x, y, z;
+};
+
+inline Vec3f operator+(const Vec3f& a, const Vec3f& b) { return {a.x + b.x, a.y + b.y, a.z + b.z}; }
+inline Vec3f operator-(const Vec3f& a, const Vec3f& b) { return {a.x - b.x, a.y - b.y, a.z - b.z}; }
+inline Vec3f operator-(const Vec3f& a) { return {-a.x, -a.y, -a.z}; }
+inline Vec3f operator*(const Vec3f& a, float s) { return {a.x * s, a.y * s, a.z * s}; }
+inline Vec3f operator*(float s, const Vec3f& a) { return {a.x * s, a.y * s, a.z * s}; }
+inline Vec3f& operator+=(Vec3f& a, const Vec3f& b) {
+    a.x += b.x;
+    a.y += b.y;
+    a.z += b.z;
+    return a;
+}
+inline Vec3f& operator-=(Vec3f& a, const Vec3f& b) {
+    a.x -= b.x;
+    a.y -= b.y;
+    a.z -= b.z;
+    return a;
+}
+inline float dot(const Vec3f& a, const Vec3f& b) { return a.x * b.x + a.y * b.y + a.z * b.z; }
+inline Vec3f cross(const Vec3f& a, const Vec3f& b) {
+    return {a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x};
+}
+inline float length(const Vec3f& a) { return std::sqrt(dot(a, a)); }
+
+inline float dist2(const Vec3f& a, const Vec3f& b) {
+    float dx = a.x - b.x;
+    float dy = a.y - b.y;
+    float dz = a.z - b.z;
+    return dx * dx + dy * dy + dz * dz;
+}
+
+// Periodic boundary along x: the domain [lo, lo + length) repeats, so x and
+// x + length are the same point. A length of 0 turns periodicity off, and
+// every member then reduces to the plain operation.
+struct PeriodicX {
+    float lo = 0, length = 0;
+
+    bool enabled() const { return length > 0; }
+
+    // x folded into [lo, lo + length)
+    float wrap(float x) const {
+        if (!enabled())
+            return x;
+        float u = std::fmod(x - lo, length);
+        if (u < 0)
+            u += length;
+        return u < length ? lo + u : lo;
+    }
+    // a - b the shortest way around in x
+    Vec3f delta(const Vec3f& a, const Vec3f& b) const {
+        Vec3f d = a - b;
+        if (enabled())
+            d.x -= length * std::round(d.x / length);
+        return d;
+    }
+    float dist2(const Vec3f& a, const Vec3f& b) const {
+        Vec3f d = delta(a, b);
+        return dot(d, d);
+    }
+    // The image of p closest to ref
+    Vec3f nearestImage(const Vec3f& p, const Vec3f& ref) const { return ref + delta(p, ref); }
+};
+
+// The period of a box of length box_x centred on the origin
+inline PeriodicX periodicBoxX(float box_x) { return {-box_x / 2, box_x}; }
+
+// Images of the points within margin of either end of a periodic domain,
+// shifted by one period past the other end, with the index of the point
+// each one copies. Appended to the points, they let any spatial index find
+// neighbours across the seam without knowing about periodicity.
+inline void periodicImages(const std::vector<Vec3f>& pos,
+                           const PeriodicX& periodic,
+                           float margin,
+                           std::vector<Vec3f>& images,
+                           std::vector<uint32_t>& image_of) {
+    images.clear();
+    image_of.clear();
+    if (!periodic.enabled())
+        return;
+    float hi = periodic.lo + periodic.length;
+    for (size_t i = 0; i < pos.size(); i++) {
+        float x = periodic.wrap(pos[i].x);
+        if (x < periodic.lo + margin) {
+            images.push_back({x + periodic.length, pos[i].y, pos[i].z});
+            image_of.push_back((uint32_t)i);
+        }
+        if (x >= hi - margin) {
+            images.push_back({x - periodic.length, pos[i].y, pos[i].z});
+            image_of.push_back((uint32_t)i);
+        }
+    }
+}
+
+// Spread the low 21 bits of v so that there are two zero bits between each
+inline uint64_t mortonSplit3(uint32_t v) {
+    uint64_t x = v & 0x1fffff;
+    x = (x | x << 32) & 0x1f00000000ffffULL;
+    x = (x | x << 16) & 0x1f0000ff0000ffULL;
+    x = (x | x << 8) & 0x100f00f00f00f00fULL;
+    x = (x | x << 4) & 0x10c30c30c30c30c3ULL;
+    x = (x | x << 2) & 0x1249249249249249ULL;
+    return x;
+}
+
+// 63-bit Morton (Z-order) key of a 3D integer coordinate
+inline uint64_t mortonEncode3(uint32_t x, uint32_t y, uint32_t z) {
+    return mortonSplit3(x) | (mortonSplit3(y) << 1) | (mortonSplit3(z) << 2);
+}
+
+// Axis aligned bounds of a point set
+inline void computeBounds(const std::vector<Vec3f>& pos, Vec3f& lo, Vec3f& hi) {
+    lo = {0, 0, 0};
+    hi = {0, 0, 0};
+    if (pos.empty())
+        return;
+    std::vector<Vec3f> los(hostThreadCount(), pos[0]);
+    std::vector<Vec3f> his(hostThreadCount(), pos[0]);
+    parallelForChunks(pos.size(), [&](size_t begin, size_t end, unsigned int tid) {
+        Vec3f l = pos[begin], h = pos[begin];
+        for (size_t i = begin; i < end; i++) {
+            l = {std::min(l.x, pos[i].x), std::min(l.y, pos[i].y), std::min(l.z, pos[i].z)};
+            h = {std::max(h.x, pos[i].x), std::max(h.y, pos[i].y), std::max(h.z, pos[i].z)};
+        }
+        los[tid] = l;
+        his[tid] = h;
+    });
+    lo = los[0];
+    hi = his[0];
+    for (size_t t = 1; t < los.size(); t++) {
+        lo = {std::min(lo.x, los[t].x), std::min(lo.y, los[t].y), std::min(lo.z, los[t].z)};
+        hi = {std::max(hi.x, his[t].x), std::max(hi.y, his[t].y), std::max(hi.z, his[t].z)};
+    }
+}
+
+// Particle indices sorted by the Morton key of the cell (of size cell_size)
+// containing each particle. Neighbouring particles end up close together in
+// the returned order, which keeps per-thread work spatially coherent.
+inline std::vector<uint32_t> mortonOrder(const std::vector<Vec3f>& pos, float cell_size) {
+    Vec3f lo, hi;
+    computeBounds(pos, lo, hi);
+    float inv = 1.f / cell_size;
+    uint32_t max_cell = (uint32_t)(std::max(hi.x - lo.x, std::max(hi.y - lo.y, hi.z - lo.z)) * inv);
+    int key_bits = 0;
+    while (key_bits < 63 && (max_cell >> (key_bits / 3)) != 0)
+        key_bits += 3;
+
+    std::vector<uint64_t> keys(pos.size());
+    parallelFor(pos.size(), [&](size_t i) {
+        uint32_t cx = (uint32_t)((pos[i].x - lo.x) * inv);
+        uint32_t cy = (uint32_t)((pos[i].y - lo.y) * inv);
+        uint32_t cz = (uint32_t)((pos[i].z - lo.z) * inv);
+        keys[i] = mortonEncode3(cx, cy, cz);
+    });
+
+    // LSD radix sort over only the key bits in use, 11 bits per pass
+    std::vector<uint32_t> order(pos.size()), tmp(pos.size());
+    for (size_t i = 0; i < order.size(); i++)
+        order[i] = (uint32_t)i;
+    constexpr int digit_bits = 11;
+    std::vector<size_t> count(size_t(1) << digit_bits);
+    for (int shift = 0; shift < key_bits; shift += digit_bits) {
+        std::fill(count.begin(), count.end(), 0);
+        for (uint32_t i : order)
+            count[(keys[i] >> shift) & (count.size() - 1)]++;
+        size_t sum = 0;
+        for (auto& c : count) {
+            size_t c_in = c;
+            c = sum;
+            sum += c_in;
+        }
+        for (uint32_t i : order)
+            tmp[count[(keys[i] >> shift) & (count.size() - 1)]++] = i;
+        order.swap(tmp);
+    }
+    return order;
+}
+
+// Uniform cell list over the bounds of a point set. Particles are bucketed
+// with a counting sort so the particles of cell c are
+// sorted[cell_start[c] .. cell_start[c + 1]).
+//
+// With a periodic x, the cells span the period instead (along x at least
+// cell_size wide, so a whole number of them fit) and the searches wrap
+// around its ends. Candidates may then be an image away from the query
+// point, so the caller's distance test must use PeriodicX::dist2.
+class CellGrid {
+  public:
+    void build(const std::vector<Vec3f>& pos, float cell_size, const PeriodicX& periodic = PeriodicX()) {
+        m_cell_size = cell_size;
+        m_inv_cell = 1.f / cell_size;
+        m_periodic = periodic;
+        Vec3f hi;
+        computeBounds(pos, m_origin, hi);
+        if (periodic.enabled()) {
+            m_origin.x = periodic.lo;
+            m_dims[0] = std::max(1, (int)(periodic.length * m_inv_cell));
+            m_inv_cell_x = m_dims[0] / periodic.length;
+        } else {
+            m_dims[0] = (int)((hi.x - m_origin.x) * m_inv_cell) + 1;
+            m_inv_cell_x = m_inv_cell;
+        }
+        m_dims[1] = (int)((hi.y - m_origin.y) * m_inv_cell) + 1;
+        m_dims[2] = (int)((hi.z - m_origin.z) * m_inv_cell) + 1;
+        size_t num_cells = (size_t)m_dims[0] * m_dims[1] * m_dims[2];
+
+        m_cell_of.resize(pos.size());
+        parallelFor(pos.size(), [&](size_t i) { m_cell_of[i] = (uint32_t)cellIndex(cellCoords(pos[i])); });
+
+        m_cell_start.assign(num_cells + 1, 0);
+        for (uint32_t c : m_cell_of)
+            m_cell_start[c + 1]++;
+        for (size_t c = 0; c < num_cells; c++)
+            m_cell_start[c + 1] += m_cell_start[c];
+
+        m_sorted.resize(pos.size());
+        std::vector<uint32_t> fill(m_cell_start.begin(), m_cell_start.end() - 1);
+        for (size_t i = 0; i < pos.size(); i++)
+            m_sorted[fill[m_cell_of[i]]++] = (uint32_t)i;
+    }
+
+    // Call fn(j) for every particle j in the 27 cells around p. The caller
+    // does the exact distance test; cell_size must be >= the search radius.
+    template <typename F>
+    void forEachCandidate(const Vec3f& p, F&& fn) const {
+        Cell c = cellCoords(p);
+        for (int z = std::max(0, c.z - 1); z <= std::min(m_dims[2] - 1, c.z + 1); z++) {
+            for (int y = std::max(0, c.y - 1); y <= std::min(m_dims[1] - 1, c.y + 1); y++) {
+                size_t row = cellIndex({0, y, z});
+                if (m_periodic.enabled()) {
+                    forEachInRow(row, c.x - 1, c.x + 1, fn);
+                    continue;
+                }
+                size_t first = row + std::max(0, c.x - 1);
+                size_t last = row + std::min(m_dims[0] - 1, c.x + 1);
+                // cells along x are contiguous in the sorted array
+                for (uint32_t k = m_cell_start[first]; k < m_cell_start[last + 1]; k++)
+                    fn(m_sorted[k]);
+            }
+        }
+    }
+
+    // Call fn(j) for every particle j in the cells overlapping the cube of
+    // half-width range around p
+    template <typename F>
+    void forEachInRange(const Vec3f& p, float range, F&& fn) const {
+        Cell lo = cellCoords({p.x - range, p.y - range, p.z - range});
+        Cell hi = cellCoords({p.x + range, p.y + range, p.z + range});
+        if (m_periodic.enabled()) {
+            // unwrapped x cells, folded into the row by forEachInRow
+            lo.x = (int)std::floor((p.x - range - m_origin.x) * m_inv_cell_x);
+            hi.x = (int)std::floor((p.x + range - m_origin.x) * m_inv_cell_x);
+        }
+        for (int z = lo.z; z <= hi.z; z++) {
+            for (int y = lo.y; y <= hi.y; y++) {
+                size_t row = cellIndex({0, y, z});
+                if (m_periodic.enabled()) {
+                    forEachInRow(row, lo.x, hi.x, fn);
+                    continue;
+                }
+                for (uint32_t k = m_cell_start[row + lo.x]; k < m_cell_start[row + hi.x + 1]; k++)
+                    fn(m_sorted[k]);
+            }
+        }
+    }
+
+    // Cells a build over these bounds would allocate
+    static size_t cellsFor(const Vec3f& lo, const Vec3f& hi, float cell_size) {
+        return (size_t)((hi.x - lo.x) / cell_size + 1) * (size_t)((hi.y - lo.y) / cell_size + 1) *
+               (size_t)((hi.z - lo.z) / cell_size + 1);
+    }
+
+    size_t numCells() const { return m_cell_start.empty() ? 0 : m_cell_start.size() - 1; }
+    size_t memoryBytes() const {
+        return (m_cell_start.capacity() + m_sorted.capacity() + m_cell_of.capacity()) * sizeof(uint32_t);
+    }
+    float cellSize() const { return m_cell_size; }
+    const PeriodicX& periodic() const { return m_periodic; }
+
+  private:
+    struct Cell {
+        int x, y, z;
+    };
+
+    // The cells x0 .. x1 of a row, folded into the period; each cell once,
+    // in at most two contiguous runs
+    template <typename F>
+    void forEachInRow(size_t row, int x0, int x1, F&& fn) const {
+        const int n = m_dims[0];
+        if (x1 - x0 + 1 >= n) {
+            x0 = 0;
+            x1 = n - 1;
+        } else {
+            x0 = ((x0 % n) + n) % n;
+            x1 = ((x1 % n) + n) % n;
+        }
+        auto run = [&](int a, int b) {
+            for (uint32_t k = m_cell_start[row + a]; k < m_cell_start[row + b + 1]; k++)
+                fn(m_sorted[k]);
+        };
+        if (x0 <= x1) {
+            run(x0, x1);
+        } else {
+            run(x0, n - 1);
+            run(0, x1);
+        }
+    }
+
+    Cell cellCoords(const Vec3f& p) const {
+        Cell c = {(int)((m_periodic.wrap(p.x) - m_origin.x) * m_inv_cell_x), (int)((p.y - m_origin.y) * m_inv_cell),
+                  (int)((p.z - m_origin.z) * m_inv_cell)};
+        c.x = std::min(std::max(c.x, 0), m_dims[0] - 1);
+        c.y = std::min(std::max(c.y, 0), m_dims[1] - 1);
+        c.z = std::min(std::max(c.z, 0), m_dims[2] - 1);
+        return c;
+    }
+    size_t cellIndex(const Cell& c) const { return ((size_t)c.z * m_dims[1] + c.y) * m_dims[0] + c.x; }
+
+    Vec3f m_origin = {0, 0, 0};
+    float m_cell_size = 1;
+    float m_inv_cell = 1;
+    float m_inv_cell_x = 1;
+    PeriodicX m_periodic;
+    int m_dims[3] = {0, 0, 0};
+    std::vector<uint32_t> m_cell_start;
+    std::vector<uint32_t> m_sorted;
+    std::vector<uint32_t> m_cell_of;
+};
+
+// Cell list over unbounded space: cells of size cell_size are hashed into a
+// power-of-two table of buckets (about one per particle), bucketed with a
+// counting sort like CellGrid. Memory follows the particle count rather
+// than the extent, so far-apart point sets cost nothing extra. Each entry
+// keeps its cell key, so cells sharing a bucket are told apart and every
+// particle is visited once.
+class HashedCellGrid {
+  public:
+    void build(const std::vector<Vec3f>& pos, float cell_size) {
+        m_cell_size = cell_size;
+        m_inv_cell = 1.f / cell_size;
+        size_t buckets = 1;
+        m_shift = 64;
+        while (buckets < pos.size()) {
+            buckets <<= 1;
+            m_shift--;
+        }
+
+        std::vector<uint64_t> key_of(pos.size());
+        std::vector<uint32_t> bucket_of(pos.size());
+        parallelFor(pos.size(), [&](size_t i) {
+            int c[3];
+            cellCoords(pos[i], c);
+            key_of[i] = cellKey(c[0], c[1], c[2]);
+            bucket_of[i] = bucket(key_of[i]);
+        });
+
+        m_bucket_start.assign(buckets + 1, 0);
+        for (uint32_t b : bucket_of)
+            m_bucket_start[b + 1]++;
+        for (size_t b = 0; b < buckets; b++)
+            m_bucket_start[b + 1] += m_bucket_start[b];
+
+        m_sorted.resize(pos.size());
+        m_sorted_key.resize(pos.size());
+        std::vector<uint32_t> fill(m_bucket_start.begin(), m_bucket_start.end() - 1);
+        for (size_t i = 0; i < pos.size(); i++) {
+            uint32_t k = fill[bucket_of[i]]++;
+            m_sorted[k] = (uint32_t)i;
+            m_sorted_key[k] = key_of[i];
+        }
+    }
+
+    // Call fn(j) for every particle j in the 27 cells around p; cell_size
+    // must be >= the search radius
+    template <typename F>
+    void forEachCandidate(const Vec3f& p, F&& fn) const {
+        forEachInRange(p, m_cell_size, fn);
+    }
+
+    // Call fn(j) for every particle j in the cells overlapping the cube of
+    // half-width range around p
+    template <typename F>
+    void forEachInRange(const Vec3f& p, float range, F&& fn) const {
+        if (m_sorted.empty())
+            return;
+        int lo[3], hi[3];
+        cellCoords({p.x - range, p.y - range, p.z - range}, lo);
+        cellCoords({p.x + range, p.y + range, p.z + range}, hi);
+        for (int z = lo[2]; z <= hi[2]; z++)
+            for (int y = lo[1]; y <= hi[1]; y++)
+                for (int x = lo[0]; x <= hi[0]; x++) {
+                    uint64_t key = cellKey(x, y, z);
+                    uint32_t b = bucket(key);
+                    for (uint32_t k = m_bucket_start[b]; k < m_bucket_start[b + 1]; k++)
+                        if (m_sorted_key[k] == key)
+                            fn(m_sorted[k]);
+                }
+    }
+
+    size_t memoryBytes() const {
+        return (m_bucket_start.capacity() + m_sorted.capacity()) * sizeof(uint32_t) +
+               m_sorted_key.capacity() * sizeof(uint64_t);
+    }
+    float cellSize() const { return m_cell_size; }
+
+  private:
+    void cellCoords(const Vec3f& p, int c[3]) const {
+        c[0] = (int)std::floor(p.x * m_inv_cell);
+        c[1] = (int)std::floor(p.y * m_inv_cell);
+        c[2] = (int)std::floor(p.z * m_inv_cell);
+    }
+    // the cell packed into 63 bits (21 per axis, wrapping beyond +-2^20 cells)
+    static uint64_t cellKey(int x, int y, int z) {
+        return ((uint64_t)(uint32_t)x & 0x1FFFFF) | (((uint64_t)(uint32_t)y & 0x1FFFFF) << 21) |
+               (((uint64_t)(uint32_t)z & 0x1FFFFF) << 42);
+    }
+    uint32_t bucket(uint64_t key) const {
+        // Fibonacci hashing as in ContactHistory
+        return m_shift == 64 ? 0 : (uint32_t)((key * 0x9E3779B97F4A7C15ULL) >> m_shift);
+    }
+
+    float m_cell_size = 1;
+    float m_inv_cell = 1;
+    int m_shift = 64;
+    std::vector<uint32_t> m_bucket_start;
+    std::vector<uint32_t> m_sorted;
+    std::vector<uint64_t> m_sorted_key;
+};
@@ -0,0 +1,221 @@
+#pragma once
+// Output governor for particle frames on a bandwidth-capped or throttled
+// filesystem. Each frame is written at the least reduced level that fits
+// the current allowance:
+//   - a bandwidth cap, as a token bucket filled at the target MB/s of wall
+//     time (bursts up to two seconds' worth);
+//   - the storage budget left, shared evenly over the frames left;
+//   - the measured writer throughput, so that writing never takes more than
+//     a set share of the wall time between frames.
+// Levels trade quantization (32, 16 or 8 bits per coordinate), decimation
+// (every k-th particle) and a region of interest around the rover. Rover
+// telemetry is not governed.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "HostSpatial.hpp"
+#include "OutputFile.hpp"
+
+// A value of 0 disables the limit. Read from the run's JSON file under the
+// keys below (e.g. "io_bandwidth_mb_s": 50).
+struct IoBudget {
+    double bandwidth_mb_s = 0;  // average particle output rate over wall time
+    double storage_mb = 0;      // particle output for the whole run
+    double max_wall_share = 0.2;  // share of the wall time spent writing
+    double roi_radius = 100;    // region of interest around the rover (xy)
+
+    bool enabled() const { return bandwidth_mb_s > 0 || storage_mb > 0; }
+
+    bool set(const std::string& key, double value) {
+        if (key == "io_bandwidth_mb_s")
+            bandwidth_mb_s = value;
+        else if (key == "io_storage_mb")
+            storage_mb = value;
+        else if (key == "io_max_wall_share")
+            max_wall_share = value;
+        else if (key == "io_roi_radius")
+            roi_radius = value;
+        else
+            return false;
+        return true;
+    }
+};
+
+struct ParticleOutputLevel {
+    unsigned int quant_bits;  // 32 (float), 16 or 8 bits per coordinate
+    unsigned int decimation;  // keep every k-th particle
+    double roi_radius;        // 0 for the whole bed
+};
+
+// Particle frame file: a fixed header, then the coordinates. Quantized
+// coordinates are unsigned integers over [box_min, box_max].
+struct ParticleFrameHeader {
+    char magic[8];  // "RVPART1"
+    uint64_t count;
+    uint32_t quant_bits;
+    uint32_t decimation;
+    float roi_center[2];
+    float roi_radius;
+    float box_min[3];
+    float box_max[3];
+};
+
+// Write the particles of one frame at the given level. Returns the bytes
+// written, or 0 on failure.
+inline size_t writeParticleFrame(const std::string& filename,
+                                 const std::vector<Vec3f>& pos,
+                                 const ParticleOutputLevel& level,
+                                 const float roi_center[2],
+                                 const float box_min[3],
+                                 const float box_max[3]) {
+    float r2 = (float)(level.roi_radius * level.roi_radius);
+    std::vector<Vec3f> kept;
+    kept.reserve(pos.size() / level.decimation + 1);
+    for (size_t i = 0; i < pos.size(); i += level.decimation) {
+        if (level.roi_radius > 0) {
+            float dx = pos[i].x - roi_center[0], dy = pos[i].y - roi_center[1];
+            if (dx * dx + dy * dy > r2)
+                continue;
+        }
+        kept.push_back(pos[i]);
+    }
+
+    ParticleFrameHeader header = {{'R', 'V', 'P', 'A', 'R', 'T', '1', 0},
+                                  kept.size(),
+                                  level.quant_bits,
+                                  level.decimation,
+                                  {roi_center[0], roi_center[1]},
+                                  (float)level.roi_radius,
+                                  {box_min[0], box_min[1], box_min[2]},
+                                  {box_max[0], box_max[1], box_max[2]}};
+    size_t bytes_per_coord = level.quant_bits / 8;
+    std::vector<unsigned char> data(kept.size() * 3 * bytes_per_coord);
+    if (level.quant_bits == 32) {
+        std::copy_n(reinterpret_cast<const unsigned char*>(kept.data()), data.size(), data.begin());
+    } else {
+        double top = (double)((1u << level.quant_bits) - 1);
+        for (size_t i = 0; i < kept.size(); i++) {
+            const float c[3] = {kept[i].x, kept[i].y, kept[i].z};
+            for (int k = 0; k < 3; k++) {
+                double u = (c[k] - box_min[k]) / std::max(1e-30f, box_max[k] - box_min[k]);
+                uint32_t q = (uint32_t)std::lround(std::max(0., std::min(1., u)) * top);
+                unsigned char* out = &data[(3 * i + k) * bytes_per_coord];
+                out[0] = (unsigned char)(q & 0xff);
+                if (bytes_per_coord > 1)
+                    out[1] = (unsigned char)(q >> 8);
+            }
+        }
+    }
+
+    OutputFile out;
+    if (!out.open(filename))
+        return 0;
+    bool ok = out.write(&header, sizeof(header)) && out.write(data.data(), data.size());
+    if (!out.close() || !ok)
+        return 0;
+    return sizeof(header) + data.size();
+}
+
+class OutputGovernor {
+  public:
+    // num_particles in the bed, total_frames the run will write, bed_area
+    // the xy area of the box (for the ROI share)
+    OutputGovernor(const IoBudget& budget, size_t num_particles, size_t total_frames, double bed_area)
+        : m_budget(budget), m_num_particles(num_particles), m_frames_left(total_frames), m_bed_area(bed_area) {
+        double r = budget.roi_radius;
+        m_levels = {{32, 1, 0}, {16, 1, 0}, {16, 2, 0}, {16, 1, r},     {16, 2, r},
+                    {8, 2, r},  {8, 4, r},  {8, 4, r / 2}, {8, 8, r / 2}};
+        m_frames_at.assign(m_levels.size(), 0);
+        m_tokens = 2 * budget.bandwidth_mb_s * 1e6;  // start with a full bucket
+        m_start = m_last = now();
+    }
+
+    // Level for the next frame, or nullptr to skip its particles
+    const ParticleOutputLevel* plan() {
+        double t = now();
+        double allowance = INFINITY;
+        if (m_budget.bandwidth_mb_s > 0) {
+            double rate = m_budget.bandwidth_mb_s * 1e6;
+            m_tokens = std::min(m_tokens + rate * (t - m_last), 2 * rate);
+            allowance = std::min(allowance, m_tokens);
+        }
+        if (m_budget.storage_mb > 0) {
+            double left = std::max(0., m_budget.storage_mb * 1e6 - m_bytes);
+            allowance = std::min(allowance, left / std::max<size_t>(1, m_frames_left));
+        }
+        if (m_budget.max_wall_share > 0 && m_throughput > 0 && m_frames > 0)
+            allowance = std::min(allowance, m_throughput * m_budget.max_wall_share * (t - m_last));
+        m_last = t;
+        if (m_frames_left > 0)
+            m_frames_left--;
+
+        for (size_t l = 0; l < m_levels.size(); l++) {
+            if (estimateBytes(m_levels[l]) <= allowance) {
+                m_current = l;
+                return &m_levels[l];
+            }
+        }
+        m_skipped++;
+        return nullptr;
+    }
+
+    // Report a write made at the level plan() returned
+    void recordWrite(size_t bytes, double seconds) {
+        m_bytes += bytes;
+        m_tokens -= bytes;
+        m_frames++;
+        m_frames_at[m_current]++;
+        if (seconds > 0) {
+            double throughput = bytes / seconds;
+            m_throughput = m_throughput > 0 ? 0.8 * m_throughput + 0.2 * throughput : throughput;
+        }
+        m_last = now();  // time spent writing does not earn bandwidth
+    }
+
+    double bytesWritten() const { return m_bytes; }
+
+    void printReport(FILE* out = stdout) const {
+        double wall = now() - m_start;
+        std::fprintf(out, "Particle output: %zu frames, %zu skipped, %.1f MB, %.2f MB/s average, writer %.1f MB/s\n",
+                     m_frames, m_skipped, m_bytes / 1e6, wall > 0 ? m_bytes / 1e6 / wall : 0.0, m_throughput / 1e6);
+        for (size_t l = 0; l < m_levels.size(); l++)
+            if (m_frames_at[l] > 0)
+                std::fprintf(out, "  %2u-bit, every %u, %s: %zu frames\n", m_levels[l].quant_bits,
+                             m_levels[l].decimation, m_levels[l].roi_radius > 0 ? "roi" : "whole bed",
+                             m_frames_at[l]);
+    }
+
+  private:
+    static double now() {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    double estimateBytes(const ParticleOutputLevel& level) const {
+        double share = 1;
+        if (level.roi_radius > 0 && m_bed_area > 0)
+            share = std::min(1., M_PI * level.roi_radius * level.roi_radius / m_bed_area);
+        double count = m_num_particles * share / level.decimation;
+        return sizeof(ParticleFrameHeader) + count * 3 * (level.quant_bits / 8);
+    }
+
+    IoBudget m_budget;
+    size_t m_num_particles;
+    size_t m_frames_left;
+    double m_bed_area;
+    std::vector<ParticleOutputLevel> m_levels;
+    std::vector<size_t> m_frames_at;
+    size_t m_current = 0;
+
+    double m_start, m_last;
+    double m_tokens = 0;
+    double m_bytes = 0;
+    double m_throughput = 0;
+    size_t m_frames = 0;
+    size_t m_skipped = 0;
+};
@@ -0,0 +1,167 @@
+#pragma once
+// Sparse full-state checkpoints for lazy frame output. Instead of every
+// particle frame, a run writes the complete coupled state every few frames:
+// particle positions and velocities, the rover bodies, and the coupling
+// predictors and energy monitors. Any frame can be regenerated later by
+// re-simulating the segment from the checkpoint before it; segments are
+// independent, so they can be regenerated in parallel.
+//
+// Files live in <output_dir>/lazy: stateNNNNNN.bin per checkpoint, named by
+// the frame it starts, and index.csv listing them in order.
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "CosimChannel.hpp"
+#include "OutputFile.hpp"
+
+enum LazyFlags : uint32_t {
+    LAZY_CHASSIS_FIXED = 1u << 0,      // chassis still held before release
+    LAZY_QUERY_TERRAIN_TOP = 1u << 1,  // terrain top query pending
+};
+
+struct LazyCheckpoint {
+    static const char* magic() { return "RVLAZY1"; }  // 8 bytes with the terminator
+
+    uint64_t step = 0;           // loop step the state is at (an exchange start)
+    float time = 0;              // loop time, exactly as accumulated by the loop
+    uint32_t frame = 0;          // frame number written at this step
+    uint32_t flags = 0;          // LazyFlags
+    double terrain_height_offset = 0;
+
+    std::vector<float> pos;      // x,y,z per particle
+    std::vector<float> vel;      // x,y,z per particle
+    std::vector<float> ang_vel;  // x,y,z per particle
+    std::vector<CosimMeshState> bodies;  // wheels, then the chassis
+    std::vector<char> coupling;  // predictor and monitor state, opaque here
+
+    size_t numParticles() const { return pos.size() / 3; }
+
+    bool write(const std::string& filename) const {
+        OutputFile out;
+        if (!out.open(filename))
+            return false;
+        uint64_t counts[5] = {numParticles(), bodies.size(), coupling.size(), 0, 0};
+        bool ok = out.write(magic(), 8) && put(out, step) && put(out, time) && put(out, frame) && put(out, flags) &&
+                  put(out, terrain_height_offset) && out.write(counts, sizeof(counts)) && putArray(out, pos) &&
+                  putArray(out, vel) && putArray(out, ang_vel) && putArray(out, bodies) && putArray(out, coupling);
+        return out.close() && ok;
+    }
+
+    bool read(const std::string& filename) {
+        FILE* in = std::fopen(filename.c_str(), "rb");
+        if (!in)
+            return false;
+        char file_magic[8];
+        uint64_t counts[5];
+        bool ok = std::fread(file_magic, sizeof(file_magic), 1, in) == 1 &&
+                  std::memcmp(file_magic, magic(), 8) == 0 && get(in, step) && get(in, time) &&
+                  get(in, frame) && get(in, flags) && get(in, terrain_height_offset) &&
+                  std::fread(counts, sizeof(counts), 1, in) == 1;
+        if (ok) {
+            pos.resize(counts[0] * 3);
+            vel.resize(counts[0] * 3);
+            ang_vel.resize(counts[0] * 3);
+            bodies.resize(counts[1]);
+            coupling.resize(counts[2]);
+            ok = getArray(in, pos) && getArray(in, vel) && getArray(in, ang_vel) && getArray(in, bodies) &&
+                 getArray(in, coupling);
+        }
+        std::fclose(in);
+        return ok;
+    }
+
+  private:
+    template <typename T>
+    static bool put(OutputFile& out, const T& value) {
+        return out.write(&value, sizeof(T));
+    }
+    template <typename T>
+    static bool get(FILE* in, T& value) {
+        return std::fread(&value, sizeof(T), 1, in) == 1;
+    }
+    template <typename T>
+    static bool putArray(OutputFile& out, const std::vector<T>& values) {
+        return out.write(values.data(), values.size() * sizeof(T));
+    }
+    template <typename T>
+    static bool getArray(FILE* in, std::vector<T>& values) {
+        return values.empty() || std::fread(values.data(), sizeof(T), values.size(), in) == values.size();
+    }
+};
+
+// One entry of index.csv: the checkpoint that starts a segment
+struct LazySegment {
+    uint64_t step;
+    double time;
+    uint32_t frame;
+    std::string file;  // relative to the lazy directory
+};
+
+inline std::string lazyCheckpointName(uint32_t frame) {
+    char name[32];
+    std::snprintf(name, sizeof(name), "state%06u.bin", frame);
+    return name;
+}
+
+inline bool appendLazyIndex(const std::string& lazy_dir, const LazySegment& segment) {
+    std::string filename = lazy_dir + "/index.csv";
+    bool fresh = !std::ifstream(filename).good();
+    FILE* out = std::fopen(filename.c_str(), "a");
+    if (!out)
+        return false;
+    if (fresh)
+        std::fprintf(out, "step,time,frame,file\n");
+    std::fprintf(out, "%llu,%.9g,%u,%s\n", (unsigned long long)segment.step, segment.time, segment.frame,
+                 segment.file.c_str());
+    return std::fclose(out) == 0;
+}
+
+inline bool readLazyIndex(const std::string& lazy_dir, std::vector<LazySegment>& segments) {
+    std::ifstream in(lazy_dir + "/index.csv");
+    if (!in.is_open())
+        return false;
+    segments.clear();
+    std::string line;
+    std::getline(in, line);  // skip the header
+    while (std::getline(in, line)) {
+        LazySegment segment;
+        unsigned long long step;
+        char file[256];
+        if (std::sscanf(line.c_str(), "%llu,%lf,%u,%255s", &step, &segment.time, &segment.frame, file) != 4)
+            continue;
+        segment.step = step;
+        segment.file = file;
+        segments.push_back(segment);
+    }
+    return !segments.empty();
+}
+
+// Frames [first, last] of each segment that overlap the requested frames.
+// A segment ends where the next one starts; the last one runs to the end of
+// the run, so its range is capped at `last_frame`.
+struct LazyJob {
+    size_t segment;
+    uint32_t first_frame;
+    uint32_t last_frame;
+};
+
+inline std::vector<LazyJob> planLazyJobs(const std::vector<LazySegment>& segments,
+                                         uint32_t first_frame,
+                                         uint32_t last_frame) {
+    std::vector<LazyJob> jobs;
+    for (size_t i = 0; i < segments.size(); i++) {
+        uint32_t begin = segments[i].frame;
+        uint32_t end = i + 1 < segments.size() ? segments[i + 1].frame - 1 : last_frame;
+        uint32_t a = std::max(begin, first_frame);
+        uint32_t b = std::min(end, last_frame);
+        if (a <= b)
+            jobs.push_back({i, a, b});
+    }
+    return jobs;
+}
@@ -0,0 +1,172 @@
+#pragma once
+// Multiresolution particle snapshots. Particles are stored in octree-level
+// order: level 0 holds one representative per occupied cell of a coarse
+// octree over the bed, and each later level holds one more per occupied
+// cell of an octree twice as fine, until the last level takes all the rest.
+// Any prefix of the file is a spatially even subsample of the frame, so a
+// viewer can read the first K bytes for a preview and stream in the rest.
+//
+// File layout: MultiresHeader, one uint64 count per level, then one
+// MultiresRecord per particle, level by level (Morton order within a level).
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "HostSpatial.hpp"
+#include "OutputFile.hpp"
+
+struct MultiresHeader {
+    char magic[8];  // "RVMRES1"
+    uint64_t count;
+    uint32_t num_levels;
+    uint32_t record_bytes;
+    float origin[3];    // low corner of the octree
+    float octree_size;  // edge of the root cell; level l cells are size / 2^(l + 1)
+};
+
+struct MultiresRecord {
+    float pos[3];
+    uint32_t id;  // index of the particle in the simulation
+};
+
+// Particle indices in level order, and the number of particles per level.
+// A level is added while it takes at most half of the particles left and
+// fewer than max_levels exist; the last level is everything remaining.
+inline void multiresOrder(const std::vector<Vec3f>& pos,
+                          unsigned int max_levels,
+                          Vec3f& origin,
+                          float& octree_size,
+                          std::vector<uint32_t>& order,
+                          std::vector<uint64_t>& level_counts) {
+    constexpr int key_bits = 16;  // per axis
+    Vec3f hi;
+    computeBounds(pos, origin, hi);
+    octree_size = std::max(hi.x - origin.x, std::max(hi.y - origin.y, hi.z - origin.z)) * (1 + 1e-6f) + 1e-30f;
+    float scale = (float)(1 << key_bits) / octree_size;
+
+    std::vector<std::pair<uint64_t, uint32_t>> keyed(pos.size());
+    parallelFor(pos.size(), [&](size_t i) {
+        uint32_t cx = (uint32_t)((pos[i].x - origin.x) * scale);
+        uint32_t cy = (uint32_t)((pos[i].y - origin.y) * scale);
+        uint32_t cz = (uint32_t)((pos[i].z - origin.z) * scale);
+        keyed[i] = {mortonEncode3(cx, cy, cz), (uint32_t)i};
+    });
+    std::sort(keyed.begin(), keyed.end());
+
+    order.clear();
+    order.reserve(pos.size());
+    level_counts.clear();
+    std::vector<char> taken(pos.size(), 0);
+    size_t left = pos.size();
+    for (int level = 0; level < key_bits && level_counts.size() + 1 < max_levels && left > 0; level++) {
+        int shift = 3 * (key_bits - level - 1);
+        // one particle per occupied cell, the free one nearest the middle of
+        // the cell's run in Morton order (roughly its centre)
+        std::vector<uint32_t> picks;
+        size_t begin = 0;
+        while (begin < keyed.size()) {
+            uint64_t cell = keyed[begin].first >> shift;
+            size_t end = begin + 1;
+            while (end < keyed.size() && (keyed[end].first >> shift) == cell)
+                end++;
+            size_t mid = (begin + end) / 2;
+            for (size_t d = 0; d <= end - begin; d++) {
+                if (mid + d < end && !taken[mid + d]) {
+                    picks.push_back((uint32_t)(mid + d));
+                    break;
+                }
+                if (mid >= begin + d && !taken[mid - d]) {
+                    picks.push_back((uint32_t)(mid - d));
+                    break;
+                }
+            }
+            begin = end;
+        }
+        if (picks.empty())
+            continue;
+        if (picks.size() > left / 2 && !level_counts.empty())
+            break;
+        for (uint32_t k : picks) {
+            taken[k] = 1;
+            order.push_back(keyed[k].second);
+        }
+        level_counts.push_back(picks.size());
+        left -= picks.size();
+    }
+    if (left > 0) {
+        for (size_t k = 0; k < keyed.size(); k++)
+            if (!taken[k])
+                order.push_back(keyed[k].second);
+        level_counts.push_back(left);
+    }
+}
+
+inline bool writeMultiresSnapshot(const std::string& filename,
+                                  const std::vector<Vec3f>& pos,
+                                  unsigned int max_levels = 12) {
+    Vec3f origin;
+    float octree_size;
+    std::vector<uint32_t> order;
+    std::vector<uint64_t> level_counts;
+    multiresOrder(pos, max_levels, origin, octree_size, order, level_counts);
+
+    MultiresHeader header = {{'R', 'V', 'M', 'R', 'E', 'S', '1', 0},
+                             pos.size(),
+                             (uint32_t)level_counts.size(),
+                             sizeof(MultiresRecord),
+                             {origin.x, origin.y, origin.z},
+                             octree_size};
+    std::vector<MultiresRecord> records(order.size());
+    for (size_t k = 0; k < order.size(); k++) {
+        const Vec3f& p = pos[order[k]];
+        records[k] = {{p.x, p.y, p.z}, order[k]};
+    }
+    OutputFile out;
+    if (!out.open(filename))
+        return false;
+    bool ok = out.write(&header, sizeof(header)) &&
+              out.write(level_counts.data(), level_counts.size() * sizeof(uint64_t)) &&
+              out.write(records.data(), records.size() * sizeof(MultiresRecord));
+    return out.close() && ok;
+}
+
+// Read the header, the level table and the records that fit in the first
+// max_bytes of the file (0 for all of them)
+inline bool readMultiresSnapshot(const std::string& filename,
+                                 size_t max_bytes,
+                                 MultiresHeader& header,
+                                 std::vector<uint64_t>& level_counts,
+                                 std::vector<MultiresRecord>& records) {
+    FILE* in = std::fopen(filename.c_str(), "rb");
+    if (!in)
+        return false;
+    bool ok = std::fread(&header, sizeof(header), 1, in) == 1 && std::memcmp(header.magic, "RVMRES1", 8) == 0 &&
+              header.record_bytes == sizeof(MultiresRecord) && header.num_levels < 64;
+    if (ok) {
+        level_counts.resize(header.num_levels);
+        ok = std::fread(level_counts.data(), sizeof(uint64_t), level_counts.size(), in) == level_counts.size();
+    }
+    if (ok) {
+        size_t prefix = sizeof(header) + level_counts.size() * sizeof(uint64_t);
+        size_t count = header.count;
+        if (max_bytes > 0)
+            count = std::min<size_t>(count, max_bytes > prefix ? (max_bytes - prefix) / sizeof(MultiresRecord) : 0);
+        records.resize(count);
+        ok = count == 0 || std::fread(records.data(), sizeof(MultiresRecord), count, in) == count;
+    }
+    std::fclose(in);
+    return ok;
+}
+
+// Bytes to read for levels [0, num_levels)
+inline size_t multiresLevelBytes(const std::vector<uint64_t>& level_counts, size_t num_levels) {
+    size_t bytes = sizeof(MultiresHeader) + level_counts.size() * sizeof(uint64_t);
+    for (size_t l = 0; l < std::min(num_levels, level_counts.size()); l++)
+        bytes += level_counts[l] * sizeof(MultiresRecord);
+    return bytes;
+}
@@ -0,0 +1,138 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+
+#include "HostParallel.hpp"
+#include "HostSpatial.hpp"
+
+// Verlet neighbour list for host-side contact evaluation (reference solvers,
+// analysis, validation). Pairs closer than 2 * sphere_radius + skin are stored
+// in CSR form with one row per particle, rows in the Morton order of the last
+// build: row k belongs to particle order()[k] and holds
+// neighbors()[offsets()[k] .. offsets()[k + 1]).
+//
+// The list stays valid until some particle has moved more than half the skin
+// since the last build, so update() only rebuilds when that happens instead of
+// redoing a cell-list search every step.
+//
+// With a periodic x (setPeriodic) pairs are found across the ends of the
+// period and all distances are minimum-image ones; positions may be wrapped
+// or not. The period must be longer than twice the search radius.
+class VerletNeighborList {
+  public:
+    // skin_fraction is the skin distance as a fraction of sphere_radius. With
+    // half_list each pair is stored once (in the row of the smaller index),
+    // otherwise in both rows, which lets force loops write only to row i.
+    VerletNeighborList(float sphere_radius, float skin_fraction = 0.2f, bool half_list = true)
+        : m_cutoff(2.f * sphere_radius), m_skin(skin_fraction * sphere_radius), m_half_list(half_list) {}
+
+    // Takes effect at the next build
+    void setPeriodic(const PeriodicX& periodic) { m_periodic = periodic; }
+    const PeriodicX& periodic() const { return m_periodic; }
+
+    // Rebuild the list if needed, returns true if it was rebuilt
+    bool update(const std::vector<Vec3f>& pos) {
+        m_num_updates++;
+        if (pos.size() != m_ref_pos.size() || 2.f * maxDisplacement(pos) > m_skin) {
+            build(pos);
+            return true;
+        }
+        return false;
+    }
+
+    // Unconditionally rebuild the list from the current positions
+    void build(const std::vector<Vec3f>& pos) {
+        size_t n = pos.size();
+        float radius = m_cutoff + m_skin;
+        float radius2 = radius * radius;
+
+        // Rows are laid out in Morton order, so each thread's chunk of rows
+        // covers a compact set of cells and is contiguous in the output
+        m_order = mortonOrder(pos, radius);
+        m_grid.build(pos, radius, m_periodic);
+
+        unsigned int num_threads = (unsigned int)std::max<size_t>(1, std::min<size_t>(hostThreadCount(), n));
+        std::vector<std::vector<uint32_t>> local(num_threads);
+        m_offsets.resize(n + 1);
+        m_offsets[0] = 0;
+        parallelForChunks(n, [&](size_t begin, size_t end, unsigned int tid) {
+            std::vector<uint32_t>& out = local[tid];
+            out.clear();
+            for (size_t k = begin; k < end; k++) {
+                uint32_t i = m_order[k];
+                m_grid.forEachCandidate(pos[i], [&](uint32_t j) {
+                    if (keepPair(i, j) && m_periodic.dist2(pos[i], pos[j]) < radius2)
+                        out.push_back(j);
+                });
+                // row end relative to the chunk, fixed up below
+                m_offsets[k + 1] = (uint32_t)out.size();
+            }
+        }, num_threads);
+
+        // Shift each chunk's offsets by the total size of the earlier chunks
+        // and concatenate the per-thread buffers
+        std::vector<size_t> base(num_threads + 1, 0);
+        for (unsigned int t = 0; t < num_threads; t++)
+            base[t + 1] = base[t] + local[t].size();
+        m_neighbors.resize(base[num_threads]);
+        parallelFor(num_threads, [&](size_t t) {
+            size_t begin, end;
+            chunkBounds(n, num_threads, (unsigned int)t, begin, end);
+            for (size_t k = begin; k < end; k++)
+                m_offsets[k + 1] += (uint32_t)base[t];
+            std::copy(local[t].begin(), local[t].end(), m_neighbors.begin() + base[t]);
+        });
+
+        m_ref_pos = pos;
+        m_num_builds++;
+    }
+
+    // Largest displacement of any particle since the last build
+    float maxDisplacement(const std::vector<Vec3f>& pos) const {
+        return std::sqrt(
+            parallelMax(pos.size(), 0.f, [&](size_t i) { return m_periodic.dist2(pos[i], m_ref_pos[i]); }));
+    }
+
+    // Call fn(i, j, dist2) for every listed pair currently within the contact
+    // cutoff of 2 * sphere_radius
+    template <typename F>
+    void forEachContact(const std::vector<Vec3f>& pos, F&& fn) const {
+        float cutoff2 = m_cutoff * m_cutoff;
+        for (size_t row = 0; row + 1 < m_offsets.size(); row++) {
+            uint32_t i = m_order[row];
+            for (uint32_t k = m_offsets[row]; k < m_offsets[row + 1]; k++) {
+                uint32_t j = m_neighbors[k];
+                float d2 = m_periodic.dist2(pos[i], pos[j]);
+                if (d2 < cutoff2)
+                    fn(i, j, d2);
+            }
+        }
+    }
+
+    const std::vector<uint32_t>& offsets() const { return m_offsets; }
+    const std::vector<uint32_t>& neighbors() const { return m_neighbors; }
+    // Particle of each CSR row (Morton order at the last build)
+    const std::vector<uint32_t>& order() const { return m_order; }
+    size_t numPairs() const { return m_neighbors.size(); }
+
+    float cutoff() const { return m_cutoff; }
+    float skin() const { return m_skin; }
+    unsigned int numBuilds() const { return m_num_builds; }
+    unsigned int numUpdates() const { return m_num_updates; }
+
+  private:
+    bool keepPair(uint32_t i, uint32_t j) const { return m_half_list ? j > i : j != i; }
+
+    float m_cutoff;
+    float m_skin;
+    bool m_half_list;
+    unsigned int m_num_builds = 0;
+    unsigned int m_num_updates = 0;
+
+    PeriodicX m_periodic;
+    CellGrid m_grid;
+    std::vector<Vec3f> m_ref_pos;
+    std::vector<uint32_t> m_order;
+    std::vector<uint32_t> m_offsets;
+    std::vector<uint32_t> m_neighbors;
+};
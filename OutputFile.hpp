@@ -0,0 +1,333 @@
+#pragma once
+// Sequential output files with a choice of backend:
+//   STDIO  - buffered FILE* writes through the page cache (the default);
+//   PWRITE - O_DIRECT pwrite of large aligned blocks, one at a time;
+//   URING  - the same blocks submitted through io_uring with registered
+//            buffers, several writes in flight.
+// The direct backends stage data in aligned blocks, pad the last block and
+// trim the file to its real size on close. If O_DIRECT is refused (e.g. on
+// tmpfs) they write through the page cache instead, and URING falls back to
+// PWRITE where io_uring is unavailable. io_uring is driven through the raw
+// system calls so no liburing is needed.
+
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+enum class OutputBackend { STDIO, PWRITE, URING };
+
+inline bool parseOutputBackend(const std::string& name, OutputBackend& backend) {
+    if (name == "stdio")
+        backend = OutputBackend::STDIO;
+    else if (name == "pwrite")
+        backend = OutputBackend::PWRITE;
+    else if (name == "uring")
+        backend = OutputBackend::URING;
+    else
+        return false;
+    return true;
+}
+
+inline const char* outputBackendName(OutputBackend backend) {
+    switch (backend) {
+        case OutputBackend::PWRITE:
+            return "pwrite";
+        case OutputBackend::URING:
+            return "uring";
+        default:
+            return "stdio";
+    }
+}
+
+// Backend used by OutputFile objects opened without one
+inline OutputBackend& defaultOutputBackend() {
+    static OutputBackend backend = OutputBackend::STDIO;
+    return backend;
+}
+
+// Minimal io_uring: one submission and one completion ring
+class IoUring {
+  public:
+    ~IoUring() { close(); }
+
+    bool open(unsigned int entries) {
+        io_uring_params params;
+        std::memset(&params, 0, sizeof(params));
+        m_fd = (int)syscall(__NR_io_uring_setup, entries, &params);
+        if (m_fd < 0)
+            return false;
+        m_sq_len = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        m_cq_len = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        bool single = params.features & IORING_FEAT_SINGLE_MMAP;
+        if (single)
+            m_sq_len = m_cq_len = std::max(m_sq_len, m_cq_len);
+        m_sq = mmap(nullptr, m_sq_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_SQ_RING);
+        m_cq = single ? m_sq
+                      : mmap(nullptr, m_cq_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd,
+                             IORING_OFF_CQ_RING);
+        m_sqes_len = params.sq_entries * sizeof(io_uring_sqe);
+        m_sqes = mmap(nullptr, m_sqes_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_SQES);
+        if (m_sq == MAP_FAILED || m_cq == MAP_FAILED || m_sqes == MAP_FAILED) {
+            close();
+            return false;
+        }
+        char* sq = static_cast<char*>(m_sq);
+        char* cq = static_cast<char*>(m_cq);
+        m_sq_tail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+        m_sq_mask = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+        m_sq_array = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+        m_cq_head = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+        m_cq_tail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+        m_cq_mask = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+        m_cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+        return true;
+    }
+
+    void close() {
+        if (m_sqes && m_sqes != MAP_FAILED)
+            munmap(m_sqes, m_sqes_len);
+        if (m_cq && m_cq != MAP_FAILED && m_cq != m_sq)
+            munmap(m_cq, m_cq_len);
+        if (m_sq && m_sq != MAP_FAILED)
+            munmap(m_sq, m_sq_len);
+        m_sq = m_cq = m_sqes = nullptr;
+        if (m_fd >= 0)
+            ::close(m_fd);
+        m_fd = -1;
+    }
+
+    bool registerBuffers(const std::vector<iovec>& buffers) {
+        return syscall(__NR_io_uring_register, m_fd, IORING_REGISTER_BUFFERS, buffers.data(),
+                       (unsigned)buffers.size()) == 0;
+    }
+
+    // Queue and submit a write from registered buffer `index`
+    bool writeFixed(int fd, const void* data, unsigned int bytes, uint64_t offset, unsigned int index, uint64_t tag) {
+        unsigned tail = *m_sq_tail;
+        unsigned slot = tail & m_sq_mask;
+        io_uring_sqe* sqe = static_cast<io_uring_sqe*>(m_sqes) + slot;
+        std::memset(sqe, 0, sizeof(*sqe));
+        sqe->opcode = IORING_OP_WRITE_FIXED;
+        sqe->fd = fd;
+        sqe->addr = (uint64_t)(uintptr_t)data;
+        sqe->len = bytes;
+        sqe->off = offset;
+        sqe->buf_index = (uint16_t)index;
+        sqe->user_data = tag;
+        m_sq_array[slot] = slot;
+        __atomic_store_n(m_sq_tail, tail + 1, __ATOMIC_RELEASE);
+        return enter(1, 0) >= 0;
+    }
+
+    // Wait for one completion; returns false on a failed system call
+    bool wait(uint64_t& tag, int& result) {
+        while (true) {
+            unsigned head = *m_cq_head;
+            if (head != __atomic_load_n(m_cq_tail, __ATOMIC_ACQUIRE)) {
+                const io_uring_cqe& cqe = m_cqes[head & m_cq_mask];
+                tag = cqe.user_data;
+                result = cqe.res;
+                __atomic_store_n(m_cq_head, head + 1, __ATOMIC_RELEASE);
+                return true;
+            }
+            if (enter(0, 1) < 0 && errno != EINTR)
+                return false;
+        }
+    }
+
+  private:
+    int enter(unsigned int submit, unsigned int min_complete) {
+        return (int)syscall(__NR_io_uring_enter, m_fd, submit, min_complete,
+                            min_complete ? IORING_ENTER_GETEVENTS : 0, nullptr, 0);
+    }
+
+    int m_fd = -1;
+    void* m_sq = nullptr;
+    void* m_cq = nullptr;
+    void* m_sqes = nullptr;
+    size_t m_sq_len = 0, m_cq_len = 0, m_sqes_len = 0;
+    unsigned* m_sq_tail = nullptr;
+    unsigned* m_sq_array = nullptr;
+    unsigned m_sq_mask = 0;
+    unsigned* m_cq_head = nullptr;
+    unsigned* m_cq_tail = nullptr;
+    unsigned m_cq_mask = 0;
+    io_uring_cqe* m_cqes = nullptr;
+};
+
+class OutputFile {
+  public:
+    static constexpr size_t alignment = 4096;
+    static constexpr size_t block_bytes = 1 << 20;
+    static constexpr unsigned int queue_depth = 8;
+
+    OutputFile() = default;
+    ~OutputFile() { close(); }
+    OutputFile(const OutputFile&) = delete;
+    OutputFile& operator=(const OutputFile&) = delete;
+
+    bool open(const std::string& filename, OutputBackend backend = defaultOutputBackend()) {
+        close();
+        m_backend = backend;
+        m_ok = true;
+        m_offset = 0;
+        m_fill = 0;
+        if (backend == OutputBackend::STDIO) {
+            m_file = std::fopen(filename.c_str(), "wb");
+            return m_file != nullptr;
+        }
+        m_fd = ::open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_DIRECT, 0644);
+        if (m_fd < 0 && errno == EINVAL)
+            m_fd = ::open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (m_fd < 0)
+            return false;
+
+        unsigned int depth = backend == OutputBackend::URING ? queue_depth : 1;
+        m_blocks.assign(depth, nullptr);
+        for (void*& block : m_blocks)
+            if (posix_memalign(&block, alignment, block_bytes) != 0)
+                return fail();
+        m_busy.assign(depth, false);
+        m_submitted.assign(depth, 0);
+        m_current = 0;
+        if (backend == OutputBackend::URING) {
+            std::vector<iovec> buffers;
+            for (void* block : m_blocks)
+                buffers.push_back({block, block_bytes});
+            if (!m_ring.open(queue_depth * 2) || !m_ring.registerBuffers(buffers)) {
+                m_ring.close();
+                m_backend = OutputBackend::PWRITE;
+            }
+        }
+        return true;
+    }
+
+    bool isOpen() const { return m_file || m_fd >= 0; }
+
+    // Backend actually in use (URING may have fallen back to PWRITE)
+    OutputBackend backend() const { return m_backend; }
+
+    bool write(const void* data, size_t bytes) {
+        if (!m_ok)
+            return false;
+        if (m_file)
+            return m_ok = std::fwrite(data, 1, bytes, m_file) == bytes;
+        const char* src = static_cast<const char*>(data);
+        while (bytes > 0) {
+            size_t n = std::min(bytes, block_bytes - m_fill);
+            std::memcpy(static_cast<char*>(m_blocks[m_current]) + m_fill, src, n);
+            m_fill += n;
+            src += n;
+            bytes -= n;
+            if (m_fill == block_bytes && !submit(block_bytes))
+                return false;
+        }
+        return true;
+    }
+
+    // Flush and close; returns false if any write failed
+    bool close() {
+        bool ok = m_ok;
+        if (m_file) {
+            ok = std::fclose(m_file) == 0 && ok;
+            m_file = nullptr;
+        }
+        if (m_fd >= 0) {
+            // the last block goes out padded to the alignment, then the
+            // file is trimmed back
+            uint64_t size = m_offset + m_fill;
+            if (ok && m_fill > 0)
+                ok = submit((m_fill + alignment - 1) & ~(alignment - 1));
+            ok = drain() && ok;
+            ok = ftruncate(m_fd, (off_t)size) == 0 && ok;
+            ok = ::close(m_fd) == 0 && ok;
+            m_fd = -1;
+        }
+        m_ring.close();
+        for (void* block : m_blocks)
+            std::free(block);
+        m_blocks.clear();
+        m_ok = false;
+        return ok;
+    }
+
+  private:
+    bool fail() {
+        m_ok = false;
+        return false;
+    }
+
+    // Write the current block (`bytes` of it, aligned) at the file offset
+    bool submit(size_t bytes) {
+        void* block = m_blocks[m_current];
+        if (m_backend == OutputBackend::URING) {
+            m_busy[m_current] = true;
+            m_submitted[m_current] = bytes;
+            if (!m_ring.writeFixed(m_fd, block, (unsigned)bytes, m_offset, m_current, m_current))
+                return fail();
+            m_in_flight++;
+        } else {
+            size_t done = 0;
+            while (done < bytes) {
+                ssize_t n = pwrite(m_fd, static_cast<char*>(block) + done, bytes - done, (off_t)(m_offset + done));
+                if (n < 0 && errno == EINTR)
+                    continue;
+                if (n <= 0)
+                    return fail();
+                done += n;
+            }
+        }
+        m_offset += m_fill;
+        m_fill = 0;
+        // next free block, waiting for a completion if all are in flight
+        m_current = (m_current + 1) % m_blocks.size();
+        while (m_busy[m_current])
+            if (!reap())
+                return false;
+        return true;
+    }
+
+    bool reap() {
+        uint64_t tag;
+        int result;
+        if (!m_ring.wait(tag, result))
+            return fail();
+        m_in_flight--;
+        m_busy[tag] = false;
+        // short writes of an aligned block are not retried
+        if (result < 0 || (size_t)result != m_submitted[tag])
+            return fail();
+        return true;
+    }
+
+    bool drain() {
+        while (m_in_flight > 0)
+            if (!reap())
+                return false;
+        return m_ok;
+    }
+
+    OutputBackend m_backend = OutputBackend::STDIO;
+    bool m_ok = false;
+    FILE* m_file = nullptr;
+    int m_fd = -1;
+    IoUring m_ring;
+    std::vector<void*> m_blocks;
+    std::vector<bool> m_busy;
+    std::vector<size_t> m_submitted;
+    size_t m_current = 0;
+    size_t m_fill = 0;
+    uint64_t m_offset = 0;
+    unsigned int m_in_flight = 0;
+};
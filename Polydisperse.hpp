@@ -0,0 +1,336 @@
+#pragma once
+// Polydisperse particle beds on the host side: radius distributions, a
+// deposition sampler that builds beds from them, and neighbour search over
+// size bins. ChSystemGpuMesh itself stays monodisperse; these feed the host
+// tools and solvers, and checkpoints carry the radii in an "r" column.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <limits>
+#include <random>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "HostParallel.hpp"
+#include "HostSpatial.hpp"
+
+// Particle radius distribution, clipped to [min, max]
+struct RadiusDistribution {
+    enum Kind { UNIFORM, LOGNORMAL, BINS };
+    Kind kind = UNIFORM;
+    float min = 1, max = 1;
+    float median = 1, sigma = 0;                  // LOGNORMAL, sigma of ln r
+    std::vector<std::pair<float, float>> bins;    // BINS: radius, share of the particle count
+
+    // "r", "uniform:rmin,rmax", "lognormal:median,sigma[,rmin,rmax]" or
+    // "bins:r:share,r:share,..."
+    bool parse(const std::string& spec) {
+        std::string kind_name = spec.substr(0, spec.find(':'));
+        std::string values = spec.find(':') == std::string::npos ? "" : spec.substr(spec.find(':') + 1);
+        std::vector<float> v;
+        std::stringstream list(values);
+        std::string item;
+        bins.clear();
+        while (std::getline(list, item, ',')) {
+            if (kind_name == "bins") {
+                float r, share;
+                if (std::sscanf(item.c_str(), "%f:%f", &r, &share) != 2 || r <= 0 || share < 0)
+                    return false;
+                bins.push_back({r, share});
+            } else {
+                char* end;
+                v.push_back(std::strtof(item.c_str(), &end));
+                if (end == item.c_str())
+                    return false;
+            }
+        }
+        if (kind_name == "uniform" && v.size() == 2 && v[0] > 0 && v[1] >= v[0]) {
+            kind = UNIFORM;
+            min = v[0];
+            max = v[1];
+        } else if (kind_name == "lognormal" && (v.size() == 2 || v.size() == 4) && v[0] > 0 && v[1] >= 0) {
+            kind = LOGNORMAL;
+            median = v[0];
+            sigma = v[1];
+            // three sigma either side unless given
+            min = v.size() == 4 ? v[2] : median * std::exp(-3 * sigma);
+            max = v.size() == 4 ? v[3] : median * std::exp(3 * sigma);
+            if (min <= 0 || max < min)
+                return false;
+        } else if (kind_name == "bins" && !bins.empty()) {
+            kind = BINS;
+            float total = 0;
+            min = max = bins[0].first;
+            for (auto& b : bins) {
+                total += b.second;
+                min = std::min(min, b.first);
+                max = std::max(max, b.first);
+            }
+            if (total <= 0)
+                return false;
+            for (auto& b : bins)
+                b.second /= total;
+        } else if (values.empty() && std::strtof(spec.c_str(), nullptr) > 0) {
+            kind = UNIFORM;
+            min = max = std::strtof(spec.c_str(), nullptr);
+        } else {
+            return false;
+        }
+        return true;
+    }
+
+    float sample(std::mt19937& rng) const {
+        std::uniform_real_distribution<float> unit(0.f, 1.f);
+        switch (kind) {
+            case LOGNORMAL: {
+                std::normal_distribution<float> normal(std::log(median), sigma);
+                for (int attempt = 0; attempt < 100; attempt++) {
+                    float r = std::exp(normal(rng));
+                    if (r >= min && r <= max)
+                        return r;
+                }
+                return median;
+            }
+            case BINS: {
+                float u = unit(rng), sum = 0;
+                for (const auto& b : bins) {
+                    sum += b.second;
+                    if (u < sum)
+                        return b.first;
+                }
+                return bins.back().first;
+            }
+            default:
+                return min + (max - min) * unit(rng);
+        }
+    }
+};
+
+// Bed built by deposition: the particles, in order, drop at the lowest of
+// `trials` random xy spots in a box of the given footprint (centred on the
+// origin, floor at floor_z) until they rest on the floor or on a particle
+// below. Taking the lowest spot fills the hollows, giving a loose random
+// packing to settle from.
+//
+// The drop search uses a grid of xy columns of about a median diameter.
+// Each particle is listed in every column its disk covers, kept sorted by
+// top height, so a drop scans only the columns under its own disk and
+// stops at the first particle too low to be hit, whatever the size spread.
+inline void depositBed(const std::vector<float>& radii,
+                       float box_x,
+                       float box_y,
+                       float floor_z,
+                       std::vector<Vec3f>& pos,
+                       unsigned int seed = 1,
+                       int trials = 8) {
+    std::mt19937 rng(seed);
+    size_t n = radii.size();
+    std::vector<float> sorted(radii);
+    std::nth_element(sorted.begin(), sorted.begin() + n / 2, sorted.end());
+    float column = n > 0 ? 2 * sorted[n / 2] : 1;
+    int nx = std::max(1, (int)std::ceil(box_x / column));
+    int ny = std::max(1, (int)std::ceil(box_y / column));
+    std::vector<std::vector<uint32_t>> columns((size_t)nx * ny);  // by increasing top height
+    std::vector<float> top(n);
+    auto columnRange = [&](float x, float y, float r, int c0[2], int c1[2]) {
+        c0[0] = std::max(0, (int)((x - r + box_x / 2) / column));
+        c0[1] = std::max(0, (int)((y - r + box_y / 2) / column));
+        c1[0] = std::min(nx - 1, (int)((x + r + box_x / 2) / column));
+        c1[1] = std::min(ny - 1, (int)((y + r + box_y / 2) / column));
+    };
+
+    pos.resize(n);
+    std::uniform_real_distribution<float> unit(0.f, 1.f);
+    for (size_t i = 0; i < n; i++) {
+        float r = radii[i];
+        Vec3f best = {0, 0, std::numeric_limits<float>::infinity()};
+        for (int t = 0; t < trials; t++) {
+            float x = -box_x / 2 + r + (box_x - 2 * r) * unit(rng);
+            float y = -box_y / 2 + r + (box_y - 2 * r) * unit(rng);
+            float z = floor_z + r;
+            int c0[2], c1[2];
+            columnRange(x, y, r, c0, c1);
+            for (int cy = c0[1]; cy <= c1[1]; cy++)
+                for (int cx = c0[0]; cx <= c1[0]; cx++) {
+                    const std::vector<uint32_t>& list = columns[(size_t)cy * nx + cx];
+                    for (size_t k = list.size(); k-- > 0;) {
+                        uint32_t j = list[k];
+                        // a sphere resting on j has its centre at most r above j's top
+                        if (top[j] + r <= z)
+                            break;
+                        float dx = x - pos[j].x, dy = y - pos[j].y, reach = r + radii[j];
+                        float h2 = reach * reach - dx * dx - dy * dy;
+                        if (h2 > 0)
+                            z = std::max(z, pos[j].z + std::sqrt(h2));
+                    }
+                }
+            if (z < best.z)
+                best = {x, y, z};
+        }
+        pos[i] = best;
+        top[i] = best.z + r;
+        int c0[2], c1[2];
+        columnRange(best.x, best.y, r, c0, c1);
+        for (int cy = c0[1]; cy <= c1[1]; cy++)
+            for (int cx = c0[0]; cx <= c1[0]; cx++) {
+                std::vector<uint32_t>& list = columns[(size_t)cy * nx + cx];
+                auto at = std::upper_bound(list.begin(), list.end(), top[i],
+                                           [&](float t, uint32_t j) { return t < top[j]; });
+                list.insert(at, (uint32_t)i);
+            }
+    }
+}
+
+// Deposited bed of n particles with radii drawn from dist
+inline void depositPolydisperseBed(size_t n,
+                                   const RadiusDistribution& dist,
+                                   float box_x,
+                                   float box_y,
+                                   float floor_z,
+                                   std::vector<Vec3f>& pos,
+                                   std::vector<float>& radii,
+                                   unsigned int seed = 1,
+                                   int trials = 8) {
+    std::mt19937 rng(seed);
+    radii.resize(n);
+    for (float& r : radii)
+        r = std::min(dist.sample(rng), 0.5f * std::min(box_x, box_y));
+    depositBed(radii, box_x, box_y, floor_z, pos, seed + 1, trials);
+}
+
+// Neighbour search for polydisperse particles. A single cell list needs
+// cells of the largest diameter, so with a wide size spread each small
+// particle scans many small neighbours that cannot touch it. Here the
+// particles are split into size bins whose largest radii grow by bin_ratio;
+// each bin has its own cell list with cells of its largest diameter,
+// and a query against bin b covers only the cells within r_i + r_max(b) of
+// the particle. Small particles then scan small cells, and large ones a few
+// more cells of each bin.
+class SizeBinnedGrid {
+  public:
+    // skin is the largest skin forEachNeighbor will be called with; queries
+    // within a bin then cover 27 cells
+    void build(const std::vector<Vec3f>& pos, const std::vector<float>& radii, float skin = 0, float bin_ratio = 2) {
+        m_bins.clear();
+        if (pos.empty())
+            return;
+        float r_min = *std::min_element(radii.begin(), radii.end());
+        float r_max = *std::max_element(radii.begin(), radii.end());
+        size_t num_bins = 1;
+        while (num_bins < 32 && r_min * std::pow(bin_ratio, (float)num_bins) < r_max)
+            num_bins++;
+        float log_ratio = std::log(bin_ratio);
+        m_bins.resize(num_bins);
+        m_bin_of.resize(pos.size());
+        for (size_t i = 0; i < pos.size(); i++) {
+            size_t b = std::min(num_bins - 1, (size_t)(std::log(radii[i] / r_min) / log_ratio));
+            m_bin_of[i] = (uint8_t)b;
+            m_bins[b].members.push_back((uint32_t)i);
+        }
+        parallelFor(num_bins, [&](size_t b) {
+            Bin& bin = m_bins[b];
+            bin.pos.resize(bin.members.size());
+            bin.max_radius = 0;
+            for (size_t k = 0; k < bin.members.size(); k++) {
+                bin.pos[k] = pos[bin.members[k]];
+                bin.max_radius = std::max(bin.max_radius, radii[bin.members[k]]);
+            }
+        });
+        // a dense cell list per bin where it stays within a few cells per
+        // particle, hashed cells for sparse bins of small particles
+        for (Bin& bin : m_bins) {
+            if (bin.members.empty())
+                continue;
+            float cell = 2 * bin.max_radius + skin;
+            Vec3f lo, hi;
+            computeBounds(bin.pos, lo, hi);
+            bin.dense = CellGrid::cellsFor(lo, hi, cell) <= 8 * bin.members.size() + 4096;
+            if (bin.dense)
+                bin.dense_grid.build(bin.pos, cell);
+            else
+                bin.hashed_grid.build(bin.pos, cell);
+        }
+    }
+
+    // Call fn(j, dist2) for every particle j != i closer than
+    // r_i + r_j + skin to particle i
+    template <typename F>
+    void forEachNeighbor(const std::vector<Vec3f>& pos,
+                         const std::vector<float>& radii,
+                         uint32_t i,
+                         float skin,
+                         F&& fn) const {
+        search(pos, radii, i, skin, 0, false, fn);
+    }
+
+    // Half list: call fn(j, dist2) for the neighbours j of particle i whose
+    // pair it owns, those in its own bin with j > i and those in larger
+    // bins. Over all i every pair comes up once, always searched from the
+    // smaller particle, so no query scans the small cells around a large
+    // particle.
+    template <typename F>
+    void forEachPairOf(const std::vector<Vec3f>& pos,
+                       const std::vector<float>& radii,
+                       uint32_t i,
+                       float skin,
+                       F&& fn) const {
+        search(pos, radii, i, skin, m_bin_of[i], true, fn);
+    }
+
+    size_t numBins() const { return m_bins.size(); }
+    size_t binSize(size_t b) const { return m_bins[b].members.size(); }
+    float binMaxRadius(size_t b) const { return m_bins[b].max_radius; }
+    size_t memoryBytes() const {
+        size_t bytes = m_bin_of.capacity();
+        for (const Bin& bin : m_bins)
+            bytes += bin.members.capacity() * sizeof(uint32_t) + bin.pos.capacity() * sizeof(Vec3f) +
+                     (bin.dense ? bin.dense_grid.memoryBytes() : bin.hashed_grid.memoryBytes());
+        return bytes;
+    }
+
+  private:
+    template <typename F>
+    void search(const std::vector<Vec3f>& pos,
+                const std::vector<float>& radii,
+                uint32_t i,
+                float skin,
+                size_t first_bin,
+                bool half,
+                F&& fn) const {
+        const Vec3f& p = pos[i];
+        float r = radii[i] + skin;
+        for (size_t b = first_bin; b < m_bins.size(); b++) {
+            const Bin& bin = m_bins[b];
+            if (bin.members.empty())
+                continue;
+            bool own_bin = b == m_bin_of[i];
+            auto test = [&](uint32_t k) {
+                uint32_t j = bin.members[k];
+                float reach = r + radii[j];
+                float d2 = dist2(p, bin.pos[k]);
+                if ((half && own_bin ? j > i : j != i) && d2 < reach * reach)
+                    fn(j, d2);
+            };
+            if (bin.dense)
+                bin.dense_grid.forEachInRange(p, r + bin.max_radius, test);
+            else
+                bin.hashed_grid.forEachInRange(p, r + bin.max_radius, test);
+        }
+    }
+
+    struct Bin {
+        std::vector<uint32_t> members;  // particle indices
+        std::vector<Vec3f> pos;         // their positions, for locality
+        float max_radius = 0;
+        bool dense = true;
+        CellGrid dense_grid;
+        HashedCellGrid hashed_grid;
+    };
+    std::vector<Bin> m_bins;
+    std::vector<uint8_t> m_bin_of;
+};
@@ -0,0 +1,337 @@
+#pragma once
+// Static rock obstacles: a few rock shapes instanced many times. Each shape
+// has one bounding volume hierarchy over its triangles (the bottom level),
+// shared by all its instances, and a second one over the world bounds of
+// the instances (the top level) finds the instances near a query point.
+// Queries move the point into the instance frame rather than the mesh into
+// the world, so rocks never need per-step pose updates and memory grows
+// with the number of shapes, not of instances.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "HostMesh.hpp"
+#include "HostParallel.hpp"
+#include "HostSpatial.hpp"
+#include "Terrain.hpp"
+
+struct Aabb {
+    Vec3f lo = {std::numeric_limits<float>::infinity(), std::numeric_limits<float>::infinity(),
+                std::numeric_limits<float>::infinity()};
+    Vec3f hi = {-std::numeric_limits<float>::infinity(), -std::numeric_limits<float>::infinity(),
+                -std::numeric_limits<float>::infinity()};
+
+    void grow(const Vec3f& p) {
+        lo = {std::min(lo.x, p.x), std::min(lo.y, p.y), std::min(lo.z, p.z)};
+        hi = {std::max(hi.x, p.x), std::max(hi.y, p.y), std::max(hi.z, p.z)};
+    }
+    void grow(const Aabb& b) {
+        grow(b.lo);
+        grow(b.hi);
+    }
+    Vec3f centre() const { return 0.5f * (lo + hi); }
+    // squared distance from p to the box, 0 inside
+    float distance2(const Vec3f& p) const {
+        float dx = std::max(std::max(lo.x - p.x, p.x - hi.x), 0.f);
+        float dy = std::max(std::max(lo.y - p.y, p.y - hi.y), 0.f);
+        float dz = std::max(std::max(lo.z - p.z, p.z - hi.z), 0.f);
+        return dx * dx + dy * dy + dz * dz;
+    }
+};
+
+// Binary bounding volume hierarchy over boxes, split at the median centre
+// along the longest axis down to leaves of leaf_size items. Nodes are in
+// depth-first order: an inner node's left child follows it.
+class BoxTree {
+  public:
+    void build(const std::vector<Aabb>& boxes, unsigned int leaf_size = 4) {
+        m_nodes.clear();
+        m_items.resize(boxes.size());
+        for (size_t i = 0; i < boxes.size(); i++)
+            m_items[i] = (uint32_t)i;
+        if (boxes.empty())
+            return;
+        m_nodes.reserve(2 * boxes.size() / std::max(1u, leaf_size) + 1);
+        buildNode(boxes, 0, (uint32_t)boxes.size(), std::max(1u, leaf_size));
+    }
+
+    // Call fn(item) for every item whose box is closer than range to p
+    template <typename F>
+    void forEachNear(const Vec3f& p, float range, F&& fn) const {
+        if (m_nodes.empty())
+            return;
+        const float range2 = range * range;
+        // median splits keep the depth within log2(n) + 1
+        uint32_t stack[64];
+        int top = 0;
+        stack[top++] = 0;
+        while (top > 0) {
+            const Node& node = m_nodes[stack[--top]];
+            if (node.box.distance2(p) >= range2)
+                continue;
+            if (node.count > 0) {
+                for (uint32_t k = node.first; k < node.first + node.count; k++)
+                    fn(m_items[k]);
+            } else {
+                uint32_t left = (uint32_t)(&node - m_nodes.data()) + 1;
+                stack[top++] = node.first;
+                stack[top++] = left;
+            }
+        }
+    }
+
+    size_t numNodes() const { return m_nodes.size(); }
+    size_t memoryBytes() const { return m_nodes.capacity() * sizeof(Node) + m_items.capacity() * sizeof(uint32_t); }
+
+  private:
+    struct Node {
+        Aabb box;
+        uint32_t first;  // leaf: first of its items; inner: right child
+        uint32_t count;  // leaf: number of items; inner: 0
+    };
+
+    uint32_t buildNode(const std::vector<Aabb>& boxes, uint32_t begin, uint32_t end, unsigned int leaf_size) {
+        uint32_t index = (uint32_t)m_nodes.size();
+        m_nodes.push_back({});
+        Aabb box, centres;
+        for (uint32_t k = begin; k < end; k++) {
+            box.grow(boxes[m_items[k]]);
+            centres.grow(boxes[m_items[k]].centre());
+        }
+        m_nodes[index].box = box;
+        if (end - begin <= leaf_size || end - begin <= 1) {
+            m_nodes[index].first = begin;
+            m_nodes[index].count = end - begin;
+            return index;
+        }
+        Vec3f extent = centres.hi - centres.lo;
+        int axis = extent.x >= extent.y && extent.x >= extent.z ? 0 : (extent.y >= extent.z ? 1 : 2);
+        uint32_t mid = begin + (end - begin) / 2;
+        std::nth_element(m_items.begin() + begin, m_items.begin() + mid, m_items.begin() + end,
+                         [&](uint32_t a, uint32_t b) {
+                             Vec3f ca = boxes[a].centre(), cb = boxes[b].centre();
+                             return (&ca.x)[axis] < (&cb.x)[axis];
+                         });
+        buildNode(boxes, begin, mid, leaf_size);
+        uint32_t right = buildNode(boxes, mid, end, leaf_size);
+        m_nodes[index].first = right;
+        m_nodes[index].count = 0;
+        return index;
+    }
+
+    std::vector<Node> m_nodes;
+    std::vector<uint32_t> m_items;
+};
+
+// A rock shape in its own frame with its triangle hierarchy
+struct RockShape {
+    TriangleMesh mesh;
+    BoxTree tree;
+    Aabb bounds;
+
+    void build() {
+        std::vector<Aabb> boxes(mesh.numTriangles());
+        for (size_t t = 0; t < boxes.size(); t++)
+            for (int k = 0; k < 3; k++)
+                boxes[t].grow(mesh.vertices[mesh.indices[3 * t + k]]);
+        bounds = Aabb();
+        for (const Vec3f& v : mesh.vertices)
+            bounds.grow(v);
+        tree.build(boxes);
+    }
+
+    // Closest point of the surface to p if closer than range
+    bool closestPoint(const Vec3f& p, float range, Vec3f& point) const {
+        float best = range * range;
+        bool found = false;
+        tree.forEachNear(p, range, [&](uint32_t t) {
+            const Vec3f& a = mesh.vertices[mesh.indices[3 * t]];
+            const Vec3f& b = mesh.vertices[mesh.indices[3 * t + 1]];
+            const Vec3f& c = mesh.vertices[mesh.indices[3 * t + 2]];
+            Vec3f q = closestPointOnTriangle(p, a, b, c);
+            float d2 = dist2(p, q);
+            if (d2 < best) {
+                best = d2;
+                point = q;
+                found = true;
+            }
+        });
+        return found;
+    }
+};
+
+// Irregular rock of about unit radius: an icosphere pushed out to a random
+// ellipsoid and cut by random planes, so it stays convex with flat facets
+inline TriangleMesh makeRockShape(uint64_t seed, int subdivisions = 2) {
+    TriangleMesh mesh;
+    const float t = (1 + std::sqrt(5.f)) / 2;
+    mesh.vertices = {{-1, t, 0}, {1, t, 0}, {-1, -t, 0}, {1, -t, 0}, {0, -1, t}, {0, 1, t},
+                     {0, -1, -t}, {0, 1, -t}, {t, 0, -1}, {t, 0, 1}, {-t, 0, -1}, {-t, 0, 1}};
+    mesh.indices = {0, 11, 5, 0, 5, 1, 0, 1, 7, 0, 7, 10, 0, 10, 11, 1, 5, 9, 5, 11, 4, 11, 10, 2, 10, 7, 6, 7, 1, 8,
+                    3, 9, 4, 3, 4, 2, 3, 2, 6, 3, 6, 8, 3, 8, 9, 4, 9, 5, 2, 4, 11, 6, 2, 10, 8, 6, 7, 9, 8, 1};
+    for (int s = 0; s < subdivisions; s++) {
+        std::vector<uint32_t> next;
+        std::vector<std::pair<uint64_t, uint32_t>> midpoints;
+        auto midpoint = [&](uint32_t a, uint32_t b) {
+            uint64_t key = ((uint64_t)std::min(a, b) << 32) | std::max(a, b);
+            for (const auto& m : midpoints)
+                if (m.first == key)
+                    return m.second;
+            mesh.vertices.push_back(0.5f * (mesh.vertices[a] + mesh.vertices[b]));
+            midpoints.push_back({key, (uint32_t)mesh.vertices.size() - 1});
+            return midpoints.back().second;
+        };
+        for (size_t k = 0; k < mesh.indices.size(); k += 3) {
+            uint32_t a = mesh.indices[k], b = mesh.indices[k + 1], c = mesh.indices[k + 2];
+            uint32_t ab = midpoint(a, b), bc = midpoint(b, c), ca = midpoint(c, a);
+            next.insert(next.end(), {a, ab, ca, b, bc, ab, c, ca, bc, ab, bc, ca});
+        }
+        mesh.indices = std::move(next);
+    }
+
+    std::mt19937_64 rng(seed);
+    std::uniform_real_distribution<float> unit(0, 1);
+    const Vec3f axes = {1, 0.6f + 0.4f * unit(rng), 0.45f + 0.35f * unit(rng)};
+    std::vector<std::pair<Vec3f, float>> planes(6);
+    for (auto& plane : planes) {
+        Vec3f n = {2 * unit(rng) - 1, 2 * unit(rng) - 1, 2 * unit(rng) - 1};
+        plane = {n * (1 / std::max(length(n), 1e-3f)), 0.55f + 0.3f * unit(rng)};
+    }
+    float extent = 0;
+    for (Vec3f& v : mesh.vertices) {
+        Vec3f dir = v * (1 / length(v));
+        float e = dir.x * dir.x / (axes.x * axes.x) + dir.y * dir.y / (axes.y * axes.y) +
+                  dir.z * dir.z / (axes.z * axes.z);
+        float reach = 1 / std::sqrt(e);
+        for (const auto& plane : planes) {
+            float c = dot(dir, plane.first);
+            if (c > 1e-3f)
+                reach = std::min(reach, plane.second / c);
+        }
+        v = dir * reach;
+        extent = std::max(extent, reach);
+    }
+    for (Vec3f& v : mesh.vertices)
+        v = v * (1 / extent);
+    return mesh;
+}
+
+struct RockInstance {
+    uint32_t shape;
+    Vec3f pos;
+    Quatf rot;
+    float scale;
+};
+
+class RockField {
+  public:
+    size_t addShape(const TriangleMesh& mesh) {
+        m_shapes.push_back({mesh, {}, {}});
+        m_shapes.back().build();
+        return m_shapes.size() - 1;
+    }
+    size_t addInstance(const RockInstance& instance) {
+        m_instances.push_back(instance);
+        return m_instances.size() - 1;
+    }
+
+    // Top-level hierarchy over the instances; call after adding them
+    void build() {
+        std::vector<Aabb> boxes(m_instances.size());
+        parallelFor(m_instances.size(), [&](size_t i) {
+            const RockInstance& in = m_instances[i];
+            const Aabb& local = m_shapes[in.shape].bounds;
+            for (int corner = 0; corner < 8; corner++) {
+                Vec3f c = {corner & 1 ? local.hi.x : local.lo.x, corner & 2 ? local.hi.y : local.lo.y,
+                           corner & 4 ? local.hi.z : local.lo.z};
+                boxes[i].grow(in.pos + rotate(in.rot, c * in.scale));
+            }
+        });
+        m_world = Aabb();
+        for (const Aabb& b : boxes)
+            m_world.grow(b);
+        m_tree.build(boxes, 2);
+    }
+
+    // Call fn(instance, point) with the closest point of each rock surface
+    // closer than radius to p
+    template <typename F>
+    void forEachContact(const Vec3f& p, float radius, F&& fn) const {
+        if (m_instances.empty() || m_world.distance2(p) >= radius * radius)
+            return;
+        m_tree.forEachNear(p, radius, [&](uint32_t i) {
+            const RockInstance& in = m_instances[i];
+            Quatf inverse = {in.rot.w, -in.rot.x, -in.rot.y, -in.rot.z};
+            Vec3f local = rotate(inverse, p - in.pos) * (1 / in.scale);
+            Vec3f q;
+            if (m_shapes[in.shape].closestPoint(local, radius / in.scale, q))
+                fn(i, in.pos + rotate(in.rot, q * in.scale));
+        });
+    }
+
+    // All instances as one mesh in the world frame, for solvers without
+    // instancing (ChSystemGpuMesh::LoadMeshes)
+    TriangleMesh flatten() const {
+        TriangleMesh out;
+        for (const RockInstance& in : m_instances) {
+            const TriangleMesh& mesh = m_shapes[in.shape].mesh;
+            uint32_t base = (uint32_t)out.vertices.size();
+            for (const Vec3f& v : mesh.vertices)
+                out.vertices.push_back(in.pos + rotate(in.rot, v * in.scale));
+            for (uint32_t k : mesh.indices)
+                out.indices.push_back(base + k);
+        }
+        return out;
+    }
+
+    size_t numShapes() const { return m_shapes.size(); }
+    size_t numInstances() const { return m_instances.size(); }
+    const RockInstance& instance(size_t i) const { return m_instances[i]; }
+    const RockShape& shape(size_t s) const { return m_shapes[s]; }
+    size_t memoryBytes() const {
+        size_t bytes = m_instances.capacity() * sizeof(RockInstance) + m_tree.memoryBytes();
+        for (const RockShape& s : m_shapes)
+            bytes += s.mesh.vertices.capacity() * sizeof(Vec3f) + s.mesh.indices.capacity() * sizeof(uint32_t) +
+                     s.tree.memoryBytes();
+        return bytes;
+    }
+
+  private:
+    std::vector<RockShape> m_shapes;
+    std::vector<RockInstance> m_instances;
+    BoxTree m_tree;
+    Aabb m_world;
+};
+
+// Rocks of a terrain as instances of num_shapes generated shapes, or of the
+// given OBJ shapes (unit radius) when there are any; each rock picks its
+// shape by a hash of the seed and its index
+inline bool rockFieldFromRocks(const std::vector<Rock>& rocks,
+                               const std::vector<std::string>& shape_files,
+                               unsigned int num_shapes,
+                               uint64_t seed,
+                               RockField& field) {
+    field = RockField();
+    if (shape_files.empty()) {
+        for (unsigned int s = 0; s < std::max(1u, num_shapes); s++)
+            field.addShape(makeRockShape(terrainHash(seed, s, 0, 2001)));
+    } else {
+        for (const std::string& file : shape_files) {
+            TriangleMesh mesh;
+            if (!loadObjMesh(file, mesh) || mesh.numTriangles() == 0)
+                return false;
+            field.addShape(mesh);
+        }
+    }
+    for (size_t k = 0; k < rocks.size(); k++) {
+        uint32_t shape = (uint32_t)(terrainHash(seed, (int64_t)k, 0, 2002) % field.numShapes());
+        field.addInstance({shape, rocks[k].centre, quatFromAxisAngle({0, 0, 1}, rocks[k].yaw), rocks[k].radius});
+    }
+    field.build();
+    return true;
+}
@@ -0,0 +1,155 @@
+#pragma once
+// Shared-memory primitives for cooperating processes on one Linux machine:
+// an arena mapped before fork(), futex-based waiting, a sense-reversing
+// barrier and single-producer/single-consumer byte rings.
+
+#include <linux/futex.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <climits>
+#include <cstdint>
+#include <cstring>
+#include <ctime>
+
+static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t), "futex words must be plain 32-bit integers");
+
+// Block while *word == expected (or until woken). Not FUTEX_PRIVATE: the word
+// may live in memory shared between processes.
+inline void futexWait(std::atomic<uint32_t>* word, uint32_t expected, const timespec* timeout = nullptr) {
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(word), FUTEX_WAIT, expected, timeout, nullptr, 0);
+}
+
+inline void futexWake(std::atomic<uint32_t>* word, int count = INT_MAX) {
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(word), FUTEX_WAKE, count, nullptr, nullptr, 0);
+}
+
+inline void cpuRelax() {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#endif
+}
+
+// Anonymous shared mapping with a bump allocator. Map it before fork() so
+// every child sees it at the same address and pointers into it stay valid.
+class SharedArena {
+  public:
+    explicit SharedArena(size_t bytes) : m_size(bytes) {
+        void* p = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+        m_base = p == MAP_FAILED ? nullptr : static_cast<char*>(p);
+    }
+    ~SharedArena() {
+        if (m_base)
+            munmap(m_base, m_size);
+    }
+    SharedArena(const SharedArena&) = delete;
+    SharedArena& operator=(const SharedArena&) = delete;
+
+    bool valid() const { return m_base != nullptr; }
+
+    // Zeroed, 64-byte aligned block, nullptr when the arena is exhausted
+    void* allocate(size_t bytes) {
+        size_t offset = (m_used + 63) & ~size_t(63);
+        if (!m_base || offset + bytes > m_size)
+            return nullptr;
+        m_used = offset + bytes;
+        return m_base + offset;
+    }
+    template <typename T>
+    T* allocate(size_t count = 1) {
+        return static_cast<T*>(allocate(count * sizeof(T)));
+    }
+
+    size_t used() const { return m_used; }
+
+  private:
+    char* m_base = nullptr;
+    size_t m_size = 0;
+    size_t m_used = 0;
+};
+
+// Barrier for a fixed number of processes. Spins briefly, then sleeps on a
+// futex, so short waits stay off the kernel path.
+struct ShmBarrier {
+    std::atomic<uint32_t> arrived;
+    std::atomic<uint32_t> generation;
+    uint32_t count;
+
+    void init(uint32_t num_participants) {
+        arrived.store(0);
+        generation.store(0);
+        count = num_participants;
+    }
+
+    void wait() {
+        uint32_t gen = generation.load(std::memory_order_acquire);
+        if (arrived.fetch_add(1, std::memory_order_acq_rel) + 1 == count) {
+            arrived.store(0, std::memory_order_relaxed);
+            generation.fetch_add(1, std::memory_order_release);
+            futexWake(&generation);
+            return;
+        }
+        for (int spin = 0; spin < 4096; spin++) {
+            if (generation.load(std::memory_order_acquire) != gen)
+                return;
+            cpuRelax();
+        }
+        while (generation.load(std::memory_order_acquire) == gen)
+            futexWait(&generation, gen);
+    }
+};
+
+// Lock-free byte ring with one producer and one consumer process. head and
+// tail count bytes ever written/read, so head - tail is the fill level.
+struct SpscRing {
+    alignas(64) std::atomic<uint64_t> head;
+    alignas(64) std::atomic<uint64_t> tail;
+    alignas(64) uint64_t capacity;
+    char* data;
+
+    // data must point to capacity bytes of shared memory
+    void init(char* buffer, uint64_t bytes) {
+        head.store(0);
+        tail.store(0);
+        capacity = bytes;
+        data = buffer;
+    }
+
+    // Copy up to len bytes in, returns how many fit
+    size_t tryWrite(const void* src, size_t len) {
+        uint64_t h = head.load(std::memory_order_relaxed);
+        uint64_t t = tail.load(std::memory_order_acquire);
+        size_t n = (size_t)std::min<uint64_t>(len, capacity - (h - t));
+        copyIn(h, static_cast<const char*>(src), n);
+        head.store(h + n, std::memory_order_release);
+        return n;
+    }
+
+    // Copy up to len bytes out, returns how many were available
+    size_t tryRead(void* dst, size_t len) {
+        uint64_t t = tail.load(std::memory_order_relaxed);
+        uint64_t h = head.load(std::memory_order_acquire);
+        size_t n = (size_t)std::min<uint64_t>(len, h - t);
+        copyOut(t, static_cast<char*>(dst), n);
+        tail.store(t + n, std::memory_order_release);
+        return n;
+    }
+
+  private:
+    void copyIn(uint64_t at, const char* src, size_t n) {
+        size_t offset = (size_t)(at % capacity);
+        size_t first = std::min<size_t>(n, capacity - offset);
+        std::memcpy(data + offset, src, first);
+        std::memcpy(data, src + first, n - first);
+    }
+    void copyOut(uint64_t at, char* dst, size_t n) const {
+        size_t offset = (size_t)(at % capacity);
+        size_t first = std::min<size_t>(n, capacity - offset);
+        std::memcpy(dst, data + offset, first);
+        std::memcpy(dst + first, data, n - first);
+    }
+};
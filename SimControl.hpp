@@ -0,0 +1,138 @@
+#pragma once
+// In-process control of a running simulation, for the Python bindings. The
+// simulation loop runs on its own thread and pauses at step boundaries;
+// the controlling thread advances it by N steps at a time, reads the state
+// the loop published at the pause, and queues wheel motor commands that the
+// loop applies when it resumes. Nothing here depends on Chrono.
+//
+// Snapshot buffers are sized once and refilled in place, so views onto them
+// (e.g. NumPy arrays) stay valid for the life of the controller; they are
+// only written while the loop runs, never while it is paused.
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+#include "CosimChannel.hpp"
+
+struct SimSnapshot {
+    double time = 0;
+    uint64_t step = 0;
+    std::vector<CosimMeshState> bodies;  // wheels, then the chassis
+    std::vector<CosimMeshLoad> loads;    // contact load per wheel
+    std::vector<float> particle_pos;     // x,y,z per particle
+    std::vector<float> particle_vel;     // x,y,z per particle
+};
+
+// Drive one wheel's angle motor: at `speed` rad/s from its current angle,
+// or along a piecewise linear angle profile when `times` is not empty
+struct WheelMotorCommand {
+    unsigned int wheel = 0;
+    double speed = 0;
+    std::vector<double> times;   // simulation time (s)
+    std::vector<double> angles;  // rad
+};
+
+class SimController {
+  public:
+    enum State { RUNNING, PAUSED, FINISHED };
+
+    // Which particle buffers the loop fills at each pause
+    void setParticleCapture(bool positions, bool velocities) {
+        m_capture_pos = positions;
+        m_capture_vel = velocities;
+    }
+    bool capturePositions() const { return m_capture_pos; }
+    bool captureVelocities() const { return m_capture_vel; }
+
+    // --- controlling thread ---
+
+    // Wait for the loop's first pause (after startup) or its end
+    State waitPaused() {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_cv.wait(lock, [this] { return m_state != RUNNING; });
+        return m_state;
+    }
+
+    State state() {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_state;
+    }
+
+    // Run `steps` more steps; returns false once the run has ended
+    bool advance(uint64_t steps) {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (m_state == FINISHED)
+                return false;
+            m_target.store(m_snapshot.step + steps, std::memory_order_release);
+            m_state = RUNNING;
+        }
+        m_cv.notify_all();
+        return waitPaused() == PAUSED;
+    }
+
+    // End the run at the next pause
+    void requestStop() {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stop = true;
+        }
+        m_cv.notify_all();
+    }
+
+    void queueWheelCommand(const WheelMotorCommand& command) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_commands.push_back(command);
+    }
+
+    // Valid while the loop is paused or finished
+    const SimSnapshot& snapshot() const { return m_snapshot; }
+    int exitCode() const { return m_exit_code; }
+
+    // --- simulation thread ---
+
+    bool pauseDue(uint64_t step) const { return step >= m_target.load(std::memory_order_acquire); }
+
+    // Filled by the loop before pause() and finish()
+    SimSnapshot& publishBuffer() { return m_snapshot; }
+
+    // Block until advanced; false when the run should end instead
+    bool pause() {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_state = PAUSED;
+        m_cv.notify_all();
+        m_cv.wait(lock, [this] { return m_stop || m_state == RUNNING; });
+        return !m_stop;
+    }
+
+    std::vector<WheelMotorCommand> takeWheelCommands() {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        std::vector<WheelMotorCommand> commands;
+        commands.swap(m_commands);
+        return commands;
+    }
+
+    void finish(int exit_code) {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_exit_code = exit_code;
+            m_state = FINISHED;
+        }
+        m_cv.notify_all();
+    }
+
+  private:
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+    State m_state = RUNNING;
+    bool m_stop = false;
+    std::atomic<uint64_t> m_target{0};  // pause at the start of this step
+    std::vector<WheelMotorCommand> m_commands;
+    SimSnapshot m_snapshot;
+    int m_exit_code = 0;
+    bool m_capture_pos = true;
+    bool m_capture_vel = false;
+};
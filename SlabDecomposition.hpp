@@ -0,0 +1,543 @@
+#pragma once
+// Slab decomposition of the host granular solve along x, one process per
+// slab on a single Linux machine. Ranks are forked from the caller and talk
+// only through shared memory:
+//  - ghost particles within 2 * sphere_radius + skin of a slab boundary are
+//    sent to the neighbouring slab through SPSC rings; the ghost set is picked
+//    when the (globally synchronized) Verlet lists are rebuilt and only
+//    refreshed in between,
+//  - particles that left their slab migrate to the neighbour at each rebuild,
+//    taking the tangential history of their contacts along,
+//  - slab boundaries are moved every rebalance_interval steps so each rank
+//    gets the same measured force-evaluation time,
+//  - every rank sees all meshes but only evaluates those overlapping its
+//    slab; per-rank mesh loads are summed in rank order, so the totals are
+//    identical on all ranks and independent of timing.
+// Results follow a single-rank run up to rounding: each rank sums contact
+// forces in the order of its own particle layout, and so does a single rank
+// given the same particles in another order.
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "HostGranular.hpp"
+#include "ShmSync.hpp"
+
+// Prescribed mesh motion: fill poses (one per mesh) for time t
+typedef std::function<void(double t, std::vector<MeshPose>& poses)> MeshMotion;
+
+struct SlabConfig {
+    unsigned int num_ranks = 2;
+    unsigned int rebalance_interval = 2000;  // steps, 0 to keep the initial slabs
+    unsigned int report_interval = 1000;     // steps between progress/load lines
+    float skin_fraction = 0.2f;
+    size_t ring_bytes = size_t(8) << 20;  // per direction and neighbour pair
+    std::string loads_file;               // mesh loads CSV written by rank 0
+};
+
+class SlabSolve {
+  public:
+    static constexpr unsigned int max_ranks = 64;
+    static constexpr unsigned int max_meshes = 16;
+    static constexpr unsigned int hist_bins = 4096;
+
+    // Migrating and ghost particles travel as one record each
+    struct Record {
+        uint32_t id;
+        Vec3f pos, vel, omega;
+    };
+
+    SlabSolve(const GranularParams& params, const std::vector<TriangleMesh>& meshes, const SlabConfig& config)
+        : m_params(params), m_meshes(meshes), m_config(config) {}
+
+    // Run num_steps steps over config.num_ranks processes. particles holds the
+    // initial state (ids 0 .. n - 1 in any order) and receives the final one;
+    // returns false if a rank failed.
+    bool run(ParticleArrays& particles, const MeshMotion& motion, unsigned long num_steps) {
+        unsigned int num_ranks = m_config.num_ranks;
+        if (num_ranks < 1 || num_ranks > max_ranks || m_meshes.size() > max_meshes) {
+            printf("ERROR: slab solve supports 1-%u ranks and up to %u meshes\n", max_ranks, max_meshes);
+            return false;
+        }
+        // the slabs form an open chain: a periodic x would need a ring of
+        // ranks with ghosts sent across the seam
+        if (m_params.periodic_x && num_ranks > 1) {
+            printf("ERROR: slab solve supports periodic_x on a single rank only\n");
+            return false;
+        }
+        size_t n = particles.size();
+        size_t num_rings = 2 * (num_ranks - 1);
+        size_t arena_bytes = sizeof(Shared) + num_rings * (sizeof(SpscRing) + m_config.ring_bytes + 128) +
+                             n * (3 * sizeof(Vec3f)) + (size_t(1) << 16);
+        SharedArena arena(arena_bytes);
+        m_shared = arena.allocate<Shared>();
+        if (!m_shared) {
+            printf("ERROR: could not map %zu bytes of shared memory\n", arena_bytes);
+            return false;
+        }
+        m_rings.assign(num_rings, nullptr);
+        for (auto& ring : m_rings) {
+            ring = arena.allocate<SpscRing>();
+            ring->init(static_cast<char*>(arena.allocate(m_config.ring_bytes)), m_config.ring_bytes);
+        }
+        m_out_pos = arena.allocate<Vec3f>(n);
+        m_out_vel = arena.allocate<Vec3f>(n);
+        m_out_omega = arena.allocate<Vec3f>(n);
+
+        m_shared->barrier.init(num_ranks);
+        m_shared->failed.store(0);
+        m_shared->num_ranks = num_ranks;
+        initialBounds(particles);
+
+        // Each rank runs threads of its own, share the cores between them
+        unsigned int num_threads = hostThreadCount();
+        setHostThreadCount(std::max(1u, num_threads / num_ranks));
+
+        std::vector<pid_t> children;
+        fflush(stdout);
+        for (unsigned int rank = 0; rank < num_ranks; rank++) {
+            pid_t pid = fork();
+            if (pid == 0) {
+                int status = runRank(rank, particles, motion, num_steps) ? 0 : 1;
+                if (status)
+                    m_shared->failed.store(1);
+                fflush(stdout);
+                _exit(status);
+            }
+            if (pid < 0) {
+                perror("fork");
+                m_shared->failed.store(1);
+                break;
+            }
+            children.push_back(pid);
+        }
+
+        bool ok = children.size() == num_ranks;
+        if (!ok) {
+            for (pid_t child : children)
+                kill(child, SIGTERM);
+        }
+        for (size_t waited = 0; waited < children.size(); waited++) {
+            int status;
+            pid_t pid = wait(&status);
+            if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+                // a dead rank would leave the others waiting forever
+                printf("ERROR: slab rank process %d failed\n", (int)pid);
+                ok = false;
+                for (pid_t child : children)
+                    kill(child, SIGTERM);
+            }
+        }
+        setHostThreadCount(num_threads);
+        if (!ok)
+            return false;
+
+        for (size_t i = 0; i < n; i++) {
+            uint32_t id = particles.id[i];
+            particles.pos[i] = m_out_pos[id];
+            particles.vel[i] = m_out_vel[id];
+            particles.omega[i] = m_out_omega[id];
+        }
+        return true;
+    }
+
+  private:
+    struct Shared {
+        ShmBarrier barrier;
+        std::atomic<int> failed;
+        unsigned int num_ranks;
+        double bounds[max_ranks + 1];
+        float max_disp[max_ranks];
+        uint64_t out_of_range[2][max_ranks];
+        uint64_t owned[max_ranks];
+        uint64_t ghosts[max_ranks];
+        float hist[max_ranks][hist_bins];
+        MeshPose mesh_pose[max_meshes];
+        float mesh_load[max_ranks][max_meshes][6];
+    };
+
+    // Split the initial particles into slabs of equal count
+    void initialBounds(const ParticleArrays& particles) {
+        unsigned int num_ranks = m_shared->num_ranks;
+        std::vector<float> x(particles.pos.size());
+        for (size_t i = 0; i < x.size(); i++)
+            x[i] = particles.pos[i].x;
+        std::sort(x.begin(), x.end());
+        m_shared->bounds[0] = -1e30;
+        m_shared->bounds[num_ranks] = 1e30;
+        for (unsigned int k = 1; k < num_ranks; k++)
+            m_shared->bounds[k] = x.empty() ? 0 : x[x.size() * k / num_ranks];
+    }
+
+    float halo() const { return (2 + m_config.skin_fraction) * m_params.sphere_radius; }
+
+    SpscRing* ringTo(unsigned int from, unsigned int to) const {
+        // ring 2k carries k -> k + 1, ring 2k + 1 carries k + 1 -> k
+        return to > from ? m_rings[2 * from] : m_rings[2 * to + 1];
+    }
+
+    // Send out[0] to the left and out[1] to the right neighbour and receive
+    // one message from each, progressing all transfers together so full rings
+    // cannot deadlock
+    template <typename T>
+    bool exchange(unsigned int rank, const std::vector<T> out[2], std::vector<T> in[2]) {
+        struct Transfer {
+            SpscRing* ring = nullptr;
+            uint64_t count = 0;
+            size_t done = 0;  // bytes of header + payload moved so far
+        };
+        Transfer send[2], recv[2];
+        for (int side = 0; side < 2; side++) {
+            in[side].clear();
+            bool exists = side == 0 ? rank > 0 : rank + 1 < m_shared->num_ranks;
+            if (!exists)
+                continue;
+            unsigned int peer = side == 0 ? rank - 1 : rank + 1;
+            send[side].ring = ringTo(rank, peer);
+            send[side].count = out[side].size();
+            recv[side].ring = ringTo(peer, rank);
+        }
+
+        const size_t header = sizeof(uint64_t);
+        bool pending = true;
+        while (pending) {
+            pending = false;
+            bool progress = false;
+            for (int side = 0; side < 2; side++) {
+                Transfer& s = send[side];
+                if (s.ring) {
+                    size_t total = header + s.count * sizeof(T);
+                    if (s.done < header) {
+                        size_t k = s.ring->tryWrite(reinterpret_cast<const char*>(&s.count) + s.done, header - s.done);
+                        s.done += k;
+                        progress |= k > 0;
+                    }
+                    if (s.done >= header && s.done < total) {
+                        size_t k = s.ring->tryWrite(reinterpret_cast<const char*>(out[side].data()) + s.done - header,
+                                                    total - s.done);
+                        s.done += k;
+                        progress |= k > 0;
+                    }
+                    pending |= s.done < total;
+                }
+                Transfer& r = recv[side];
+                if (r.ring) {
+                    if (r.done < header) {
+                        size_t k = r.ring->tryRead(reinterpret_cast<char*>(&r.count) + r.done, header - r.done);
+                        r.done += k;
+                        progress |= k > 0;
+                        if (r.done == header)
+                            in[side].resize(r.count);
+                    }
+                    size_t total = header + r.count * sizeof(T);
+                    if (r.done >= header && r.done < total) {
+                        size_t k = r.ring->tryRead(reinterpret_cast<char*>(in[side].data()) + r.done - header,
+                                                   total - r.done);
+                        r.done += k;
+                        progress |= k > 0;
+                    }
+                    pending |= r.done < header || r.done < total;
+                }
+            }
+            if (pending && !progress) {
+                if (m_shared->failed.load(std::memory_order_relaxed))
+                    return false;
+                sched_yield();
+            }
+        }
+        return true;
+    }
+
+    Record record(const ParticleArrays& p, size_t k) const { return {p.id[k], p.pos[k], p.vel[k], p.omega[k]}; }
+
+    // Move owned particles outside [lo, hi) towards their slab until every
+    // particle is home (boundaries may have moved by more than one slab). The
+    // contact history of a particle moves with it, so friction carries on as
+    // if it had stayed on one rank.
+    bool migrate(unsigned int rank, ParticleArrays& local, ContactHistoryTable& history) {
+        double lo = m_shared->bounds[rank], hi = m_shared->bounds[rank + 1];
+        for (unsigned int round = 0;; round++) {
+            std::vector<Record> out[2], in[2];
+            for (size_t k = 0; k < local.size();) {
+                float x = local.pos[k].x;
+                if (x < lo || x >= hi) {
+                    int side = x < lo ? 0 : 1;
+                    out[side].push_back(record(local, k));
+                    m_moving[local.id[k]] = (int8_t)side;
+                    local.set(k, local, local.size() - 1);
+                    local.resize(local.size() - 1);
+                } else {
+                    k++;
+                }
+            }
+            std::vector<ContactHistoryTable::KeyedEntry> leaving, history_out[2], history_in[2];
+            if (!out[0].empty() || !out[1].empty()) {
+                history.extract([&](uint32_t id) { return id < m_moving.size() && m_moving[id] >= 0; }, leaving);
+                for (const auto& e : leaving)
+                    history_out[m_moving[e.key >> 32]].push_back(e);
+                for (int side = 0; side < 2; side++)
+                    for (const Record& rec : out[side])
+                        m_moving[rec.id] = -1;
+            }
+            if (!exchange(rank, out, in) || !exchange(rank, history_out, history_in))
+                return false;
+            uint64_t stray = 0;
+            for (int side = 0; side < 2; side++) {
+                for (const Record& rec : in[side]) {
+                    local.push(rec.id, rec.pos, rec.vel, rec.omega);
+                    stray += rec.pos.x < lo || rec.pos.x >= hi;
+                }
+                history.insert(history_in[side]);
+            }
+            m_shared->out_of_range[round % 2][rank] = stray;
+            m_shared->barrier.wait();
+            uint64_t total = 0;
+            for (unsigned int r = 0; r < m_shared->num_ranks; r++)
+                total += m_shared->out_of_range[round % 2][r];
+            if (total == 0)
+                return true;
+        }
+    }
+
+    // Move the slab boundaries so that every rank gets the same share of the
+    // measured force-evaluation time, estimated per particle on each rank
+    void rebalance(unsigned int rank, const ParticleArrays& local, size_t num_owned) {
+        unsigned int num_ranks = m_shared->num_ranks;
+        float x0 = -m_params.box_X / 2;
+        float bin_width = m_params.box_X / hist_bins;
+        double cost = num_owned > 0 && m_busy_seconds > 0 ? m_busy_seconds / num_owned : 1.0;
+        float* hist = m_shared->hist[rank];
+        std::fill(hist, hist + hist_bins, 0.f);
+        for (size_t k = 0; k < num_owned; k++) {
+            int bin = std::min<int>(hist_bins - 1, std::max(0, (int)((local.pos[k].x - x0) / bin_width)));
+            hist[bin] += (float)cost;
+        }
+        m_busy_seconds = 0;
+        m_shared->barrier.wait();
+
+        // every rank computes the same boundaries from the same histograms
+        std::vector<double> weight(hist_bins, 0.0);
+        double total = 0;
+        for (unsigned int r = 0; r < num_ranks; r++)
+            for (unsigned int b = 0; b < hist_bins; b++)
+                weight[b] += m_shared->hist[r][b];
+        for (double w : weight)
+            total += w;
+        std::vector<double> bounds(num_ranks + 1);
+        bounds[0] = -1e30;
+        bounds[num_ranks] = 1e30;
+        double cumulative = 0;
+        unsigned int b = 0;
+        for (unsigned int k = 1; k < num_ranks; k++) {
+            double target = total * k / num_ranks;
+            while (b < hist_bins && cumulative + weight[b] < target)
+                cumulative += weight[b++];
+            bounds[k] = x0 + b * bin_width;
+        }
+        // slabs must stay at least one halo wide for single-hop ghosts
+        float min_width = halo();
+        for (unsigned int k = 1; k < num_ranks; k++) {
+            double floor = k == 1 ? x0 + min_width : bounds[k - 1] + min_width;
+            double ceiling = -x0 - (num_ranks - k) * min_width;
+            bounds[k] = std::min(std::max(bounds[k], floor), ceiling);
+        }
+        if (rank == 0)
+            std::copy(bounds.begin(), bounds.end(), m_shared->bounds);
+        m_shared->barrier.wait();
+    }
+
+    // Pick the particles the neighbours need as ghosts and exchange them
+    bool sendGhosts(unsigned int rank, ParticleArrays& local, size_t num_owned) {
+        double lo = m_shared->bounds[rank], hi = m_shared->bounds[rank + 1];
+        float h = halo();
+        std::vector<Record> out[2], in[2];
+        for (int side = 0; side < 2; side++)
+            m_send[side].clear();
+        for (size_t k = 0; k < num_owned; k++) {
+            if (local.pos[k].x < lo + h)
+                m_send[0].push_back((uint32_t)k);
+            if (local.pos[k].x >= hi - h)
+                m_send[1].push_back((uint32_t)k);
+        }
+        for (int side = 0; side < 2; side++)
+            for (uint32_t k : m_send[side])
+                out[side].push_back(record(local, k));
+        if (!exchange(rank, out, in))
+            return false;
+        local.resize(num_owned);
+        for (int side = 0; side < 2; side++) {
+            m_num_ghosts[side] = in[side].size();
+            for (const Record& rec : in[side])
+                local.push(rec.id, rec.pos, rec.vel, rec.omega);
+        }
+        return true;
+    }
+
+    // Refresh the state of the ghosts picked by the last sendGhosts()
+    bool updateGhosts(unsigned int rank, ParticleArrays& local, size_t num_owned) {
+        std::vector<Record> out[2], in[2];
+        for (int side = 0; side < 2; side++)
+            for (uint32_t k : m_send[side])
+                out[side].push_back(record(local, k));
+        if (!exchange(rank, out, in))
+            return false;
+        size_t k = num_owned;
+        for (int side = 0; side < 2; side++) {
+            if (in[side].size() != m_num_ghosts[side]) {
+                printf("ERROR: rank %u expected %zu ghosts, got %zu\n", rank, m_num_ghosts[side], in[side].size());
+                return false;
+            }
+            for (const Record& rec : in[side]) {
+                local.pos[k] = rec.pos;
+                local.vel[k] = rec.vel;
+                local.omega[k] = rec.omega;
+                k++;
+            }
+        }
+        return true;
+    }
+
+    bool runRank(unsigned int rank, const ParticleArrays& all, const MeshMotion& motion, unsigned long num_steps) {
+        unsigned int num_ranks = m_shared->num_ranks;
+        size_t num_meshes = m_meshes.size();
+
+        ParticleArrays local;
+        for (size_t i = 0; i < all.size(); i++) {
+            float x = all.pos[i].x;
+            if (x >= m_shared->bounds[rank] && x < m_shared->bounds[rank + 1])
+                local.push(all.id[i], all.pos[i], all.vel[i], all.omega[i]);
+        }
+        size_t num_owned = local.size();
+        m_moving.assign(all.size(), -1);
+
+        HostGranularSolver solver(m_params, m_config.skin_fraction);
+        for (const auto& mesh : m_meshes)
+            solver.addMesh(mesh);
+
+        FILE* loads = nullptr;
+        if (rank == 0 && !m_config.loads_file.empty()) {
+            loads = std::fopen(m_config.loads_file.c_str(), "w");
+            if (loads)
+                std::fprintf(loads, "step,time,mesh,fx,fy,fz,tx,ty,tz\n");
+        }
+
+        std::vector<MeshPose> poses(num_meshes);
+        unsigned long last_rebalance = 0;
+        unsigned int num_rebuilds = 0;
+        auto wall_start = std::chrono::steady_clock::now();
+        for (unsigned long step = 0; step < num_steps; step++) {
+            double t = step * (double)m_params.step_size;
+
+            // publish displacement and mesh motion, then agree on a rebuild
+            m_shared->max_disp[rank] = step == 0 ? 0.f : solver.maxDisplacement(local);
+            if (rank == 0 && num_meshes > 0) {
+                for (size_t m = 0; m < num_meshes; m++)
+                    poses[m] = m_shared->mesh_pose[m];
+                motion(t, poses);
+                std::copy(poses.begin(), poses.end(), m_shared->mesh_pose);
+            }
+            m_shared->barrier.wait();
+            bool rebuild = step == 0;
+            for (unsigned int r = 0; r < num_ranks; r++)
+                rebuild |= 2 * m_shared->max_disp[r] > m_config.skin_fraction * m_params.sphere_radius;
+
+            if (rebuild) {
+                local.resize(num_owned);
+                if (m_config.rebalance_interval > 0 && step - last_rebalance >= m_config.rebalance_interval) {
+                    rebalance(rank, local, num_owned);
+                    last_rebalance = step;
+                }
+                if (!migrate(rank, local, solver.history()))
+                    return false;
+                num_owned = local.size();
+                if (!sendGhosts(rank, local, num_owned))
+                    return false;
+                num_rebuilds++;
+            } else if (!updateGhosts(rank, local, num_owned)) {
+                return false;
+            }
+
+            // meshes go to every slab they overlap
+            double lo = m_shared->bounds[rank], hi = m_shared->bounds[rank + 1];
+            for (size_t m = 0; m < num_meshes; m++) {
+                solver.setMeshPose(m, m_shared->mesh_pose[m]);
+                Vec3f mesh_lo, mesh_hi;
+                solver.meshWorldBounds(m, mesh_lo, mesh_hi);
+                solver.setMeshActive(m, mesh_hi.x + halo() >= lo && mesh_lo.x - halo() < hi);
+            }
+
+            auto busy_start = std::chrono::steady_clock::now();
+            solver.computeForces(local, num_owned, rebuild);
+            solver.integrate(local, num_owned);
+            m_busy_seconds +=
+                std::chrono::duration<double>(std::chrono::steady_clock::now() - busy_start).count();
+
+            for (size_t m = 0; m < num_meshes; m++) {
+                const Vec3f& f = solver.getMeshForce(m);
+                const Vec3f& tq = solver.getMeshTorque(m);
+                float* slot = m_shared->mesh_load[rank][m];
+                slot[0] = f.x, slot[1] = f.y, slot[2] = f.z;
+                slot[3] = tq.x, slot[4] = tq.y, slot[5] = tq.z;
+            }
+            m_shared->owned[rank] = num_owned;
+            m_shared->ghosts[rank] = local.size() - num_owned;
+            m_shared->barrier.wait();
+
+            bool report = m_config.report_interval > 0 && (step + 1) % m_config.report_interval == 0;
+            if (rank == 0 && (report || step + 1 == num_steps)) {
+                for (size_t m = 0; m < num_meshes; m++) {
+                    // fixed rank order, so every rank would get the same sum
+                    double load[6] = {0, 0, 0, 0, 0, 0};
+                    for (unsigned int r = 0; r < num_ranks; r++)
+                        for (int c = 0; c < 6; c++)
+                            load[c] += m_shared->mesh_load[r][m][c];
+                    if (loads)
+                        std::fprintf(loads, "%lu,%g,%zu,%g,%g,%g,%g,%g,%g\n", step + 1, t + m_params.step_size, m,
+                                     load[0], load[1], load[2], load[3], load[4], load[5]);
+                    printf("  mesh %zu force (%g, %g, %g) torque (%g, %g, %g)\n", m, load[0], load[1], load[2],
+                           load[3], load[4], load[5]);
+                }
+                double elapsed =
+                    std::chrono::duration<double>(std::chrono::steady_clock::now() - wall_start).count();
+                printf("step %lu: %.3f ms/step, %u rebuilds, owned/ghosts per rank:", step + 1,
+                       1000 * elapsed / (step + 1), num_rebuilds);
+                for (unsigned int r = 0; r < num_ranks; r++)
+                    printf(" %lu/%lu", (unsigned long)m_shared->owned[r], (unsigned long)m_shared->ghosts[r]);
+                printf("\n");
+                fflush(stdout);
+            }
+        }
+        if (loads)
+            std::fclose(loads);
+
+        for (size_t k = 0; k < num_owned; k++) {
+            m_out_pos[local.id[k]] = local.pos[k];
+            m_out_vel[local.id[k]] = local.vel[k];
+            m_out_omega[local.id[k]] = local.omega[k];
+        }
+        return true;
+    }
+
+    GranularParams m_params;
+    std::vector<TriangleMesh> m_meshes;
+    SlabConfig m_config;
+
+    Shared* m_shared = nullptr;
+    std::vector<SpscRing*> m_rings;
+    Vec3f* m_out_pos = nullptr;
+    Vec3f* m_out_vel = nullptr;
+    Vec3f* m_out_omega = nullptr;
+
+    // per-rank state, valid inside the forked rank process
+    std::vector<uint32_t> m_send[2];
+    std::vector<int8_t> m_moving;  // by particle id: side it is migrating to, -1 if staying
+    size_t m_num_ghosts[2] = {0, 0};
+    double m_busy_seconds = 0;
+};
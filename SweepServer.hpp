@@ -0,0 +1,238 @@
+#pragma once
+// Parameter sweeps from one pre-loaded parent process. The parent loads the
+// assets every case shares (e.g. the settled checkpoint) once, then forks a
+// worker per case; workers inherit the assets copy-on-write and only apply
+// their own overrides. Nothing that creates a GPU context may run in the
+// parent before the fork.
+
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "HostJson.hpp"
+
+// Copy of an array in its own mapping, made read-only once filled so that
+// a stray write in a worker faults instead of silently copying pages
+template <typename T>
+class ReadOnlyBuffer {
+    static_assert(std::is_trivially_destructible<T>::value, "elements are never destroyed");
+
+  public:
+    explicit ReadOnlyBuffer(const std::vector<T>& values) : m_size(values.size()) {
+        m_bytes = std::max<size_t>(1, m_size * sizeof(T));
+        void* p = mmap(nullptr, m_bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (p == MAP_FAILED)
+            return;
+        m_data = static_cast<T*>(p);
+        std::uninitialized_copy(values.begin(), values.end(), m_data);
+        mprotect(p, m_bytes, PROT_READ);
+    }
+    ~ReadOnlyBuffer() {
+        if (m_data)
+            munmap(m_data, m_bytes);
+    }
+    ReadOnlyBuffer(const ReadOnlyBuffer&) = delete;
+    ReadOnlyBuffer& operator=(const ReadOnlyBuffer&) = delete;
+
+    bool valid() const { return m_data != nullptr; }
+    const T* begin() const { return m_data; }
+    const T* end() const { return m_data + m_size; }
+    size_t size() const { return m_size; }
+    size_t memoryBytes() const { return m_bytes; }
+
+  private:
+    T* m_data = nullptr;
+    size_t m_size = 0;
+    size_t m_bytes = 0;
+};
+
+// One sweep case: a name and parameter overrides as flat key/value strings
+struct SweepCase {
+    std::string name;
+    std::map<std::string, std::string> overrides;
+};
+
+// Read a sweep file:
+//   { "max_parallel": 1,
+//     "cases": [ { "name": "slope10", "gravity_angle": 10 }, ... ] }
+// Every key of a case except "name" is an override. Cases without a name
+// are called case<N>.
+inline bool loadSweepFile(const std::string& filename, std::vector<SweepCase>& cases, unsigned int& max_parallel) {
+    HostJson json;
+    if (!json.parseFile(filename))
+        return false;
+    max_parallel = (unsigned int)std::max(1., json.getNumber("max_parallel", 1));
+    cases.clear();
+    for (const auto& kv : json.values()) {
+        const std::string& key = kv.first;
+        if (key.compare(0, 6, "cases.") != 0)
+            continue;
+        size_t dot = key.find('.', 6);
+        if (dot == std::string::npos)
+            continue;
+        size_t index = std::stoul(key.substr(6, dot - 6));
+        if (index >= cases.size())
+            cases.resize(index + 1);
+        std::string field = key.substr(dot + 1);
+        if (field == "name")
+            cases[index].name = kv.second;
+        else
+            cases[index].overrides[field] = kv.second;
+    }
+    for (size_t i = 0; i < cases.size(); i++)
+        if (cases[i].name.empty())
+            cases[i].name = "case" + std::to_string(i);
+    return !cases.empty();
+}
+
+class SweepServer {
+  public:
+    // Called by a worker once its case is set up and about to simulate
+    static void workerReady() {
+        if (currentSlot())
+            currentSlot()->ready = now();
+    }
+
+    // Called by a worker to hand a result (at most result_bytes) back to
+    // the server. Returns false outside a worker or if it does not fit.
+    static bool setWorkerResult(const void* data, size_t bytes) {
+        Slot* slot = currentSlot();
+        if (!slot || bytes > slot->result_bytes)
+            return false;
+        std::memcpy(reinterpret_cast<char*>(slot) + sizeof(Slot), data, bytes);
+        slot->has_result = 1;
+        return true;
+    }
+
+    explicit SweepServer(unsigned int max_parallel = 1, size_t result_bytes = 0)
+        : m_max_parallel(std::max(1u, max_parallel)), m_result_bytes(result_bytes) {}
+
+    // Result the worker of case i handed back, nullptr if none
+    const void* result(size_t i) const {
+        return m_slots[i].has_result ? &m_results[i * m_result_bytes] : nullptr;
+    }
+
+    // Fork a worker for every case, at most max_parallel at a time. The
+    // worker's return value is its exit status. Returns the number of cases
+    // that failed.
+    size_t run(const std::vector<SweepCase>& cases, const std::function<int(const SweepCase&, size_t)>& worker) {
+        m_cases = cases;
+        // one slot per case, each followed by its result area
+        size_t stride = (sizeof(Slot) + m_result_bytes + 63) & ~size_t(63);
+        size_t bytes = std::max<size_t>(1, cases.size()) * stride;
+        void* p = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+        if (p == MAP_FAILED)
+            return cases.size();
+        auto slotOf = [p, stride](size_t i) { return reinterpret_cast<Slot*>(static_cast<char*>(p) + i * stride); };
+        m_slots.assign(cases.size(), Slot());
+
+        std::map<pid_t, size_t> running;
+        size_t next = 0;
+        while (next < cases.size() || !running.empty()) {
+            if (next < cases.size() && running.size() < m_max_parallel) {
+                Slot* slot = slotOf(next);
+                *slot = Slot();
+                slot->result_bytes = m_result_bytes;
+                slot->forked = now();
+                fflush(stdout);
+                pid_t pid = fork();
+                if (pid == 0) {
+                    currentSlot() = slot;
+                    int status = worker(cases[next], next);
+                    fflush(stdout);
+                    _exit(status);
+                }
+                if (pid < 0) {
+                    slot->status = -1;
+                    slot->finished = now();
+                } else {
+                    running[pid] = next;
+                }
+                next++;
+                continue;
+            }
+            int status = 0;
+            pid_t pid = wait(&status);
+            if (pid < 0)
+                break;
+            auto it = running.find(pid);
+            if (it == running.end())
+                continue;
+            Slot& slot = *slotOf(it->second);
+            slot.finished = now();
+            slot.status = WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+            printf("Sweep case %s finished with status %d after %.3f s\n", cases[it->second].name.c_str(),
+                   slot.status, slot.finished - slot.forked);
+            running.erase(it);
+        }
+        m_results.assign(cases.size() * m_result_bytes, 0);
+        for (size_t i = 0; i < cases.size(); i++) {
+            m_slots[i] = *slotOf(i);
+            std::memcpy(&m_results[i * m_result_bytes], slotOf(i) + 1, m_result_bytes);
+        }
+        munmap(p, bytes);
+
+        size_t failed = 0;
+        for (const Slot& slot : m_slots)
+            failed += slot.status != 0;
+        return failed;
+    }
+
+    // Per-case startup (fork to workerReady), measured, against a cold start
+    // that is not run but estimated as the parent's shared-asset load time
+    // plus the same per-case setup
+    void printReport(double shared_load_seconds, FILE* out = stdout) const {
+        std::fprintf(out, "Sweep report (%zu cases, shared assets loaded once in %.3f s):\n", m_cases.size(),
+                     shared_load_seconds);
+        std::fprintf(out, "  %-20s %7s %12s %16s %10s\n", "case", "status", "startup (s)", "est. cold (s)*",
+                     "total (s)");
+        double saved = 0;
+        for (size_t i = 0; i < m_cases.size(); i++) {
+            const Slot& slot = m_slots[i];
+            double startup = slot.ready > 0 ? slot.ready - slot.forked : 0;
+            if (slot.ready > 0)
+                saved += shared_load_seconds;
+            std::fprintf(out, "  %-20s %7d %12.3f %16.3f %10.3f\n", m_cases[i].name.c_str(), slot.status, startup,
+                         startup + shared_load_seconds, slot.finished - slot.forked);
+        }
+        std::fprintf(out, "  * estimated, not timed: startup plus the shared asset load\n");
+        std::fprintf(out, "  estimated startup time saved over cold starts: %.3f s\n", saved);
+    }
+
+  private:
+    struct Slot {
+        double forked = 0;
+        double ready = 0;
+        double finished = 0;
+        int status = 0;
+        int has_result = 0;
+        size_t result_bytes = 0;
+    };
+
+    // steady_clock is CLOCK_MONOTONIC, comparable across processes
+    static double now() {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+    static Slot*& currentSlot() {
+        static Slot* slot = nullptr;
+        return slot;
+    }
+
+    unsigned int m_max_parallel;
+    size_t m_result_bytes;
+    std::vector<SweepCase> m_cases;
+    std::vector<Slot> m_slots;
+    std::vector<char> m_results;
+};
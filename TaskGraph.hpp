@@ -0,0 +1,202 @@
+#pragma once
+// Small dependency graph of coarse tasks (startup stages) run on a pool of
+// host threads. Tasks can be pinned to the calling thread, for work that
+// must stay on it (e.g. anything that creates or uses the GPU context).
+// Every task is timed so the run can be reported as total work against the
+// critical path.
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "HostParallel.hpp"
+
+class TaskGraph {
+  public:
+    using TaskId = size_t;
+
+    TaskId add(const std::string& name,
+               std::function<void()> fn,
+               const std::vector<TaskId>& deps = {},
+               bool on_calling_thread = false) {
+        TaskId id = m_tasks.size();
+        Task task;
+        task.name = name;
+        task.fn = std::move(fn);
+        task.deps = deps;
+        task.on_calling_thread = on_calling_thread;
+        m_tasks.push_back(std::move(task));
+        for (TaskId dep : deps)
+            m_tasks[dep].dependents.push_back(id);
+        return id;
+    }
+
+    // Run every task once its dependencies are done, on the calling thread
+    // plus num_threads - 1 helpers. If a task throws, its dependents are
+    // skipped, the rest of the graph finishes and the first exception is
+    // rethrown here.
+    void run(unsigned int num_threads = hostThreadCount()) {
+        m_start = Clock::now();
+        m_remaining = m_tasks.size();
+        for (TaskId id = 0; id < m_tasks.size(); id++) {
+            m_tasks[id].pending = m_tasks[id].deps.size();
+            if (m_tasks[id].pending == 0)
+                enqueue(id);
+        }
+        std::vector<std::thread> helpers;
+        unsigned int num_helpers = std::max(1u, num_threads) - 1;
+        for (unsigned int t = 1; t <= num_helpers; t++)
+            helpers.emplace_back([this, t] { work(t); });
+        work(0);
+        for (auto& helper : helpers)
+            helper.join();
+        m_wall = seconds(m_start, Clock::now());
+        if (m_error)
+            std::rethrow_exception(m_error);
+    }
+
+    double wallSeconds() const { return m_wall; }
+
+    // Sum of all task durations
+    double totalWork() const {
+        double total = 0;
+        for (const auto& task : m_tasks)
+            total += task.duration;
+        return total;
+    }
+
+    // Longest chain of dependent task durations, and the tasks on it
+    double criticalPath(std::vector<TaskId>* path = nullptr) const {
+        // tasks are added after their dependencies, so ids are a topological order
+        std::vector<double> finish(m_tasks.size(), 0);
+        std::vector<TaskId> via(m_tasks.size(), m_tasks.size());
+        TaskId last = 0;
+        for (TaskId id = 0; id < m_tasks.size(); id++) {
+            for (TaskId dep : m_tasks[id].deps) {
+                if (finish[dep] > finish[id]) {
+                    finish[id] = finish[dep];
+                    via[id] = dep;
+                }
+            }
+            finish[id] += m_tasks[id].duration;
+            if (finish[id] > finish[last])
+                last = id;
+        }
+        if (path) {
+            path->clear();
+            for (TaskId id = last; id < m_tasks.size(); id = via[id])
+                path->insert(path->begin(), id);
+        }
+        return m_tasks.empty() ? 0 : finish[last];
+    }
+
+    void printReport(FILE* out = stdout) const {
+        std::vector<TaskId> path;
+        double critical = criticalPath(&path);
+        std::fprintf(out, "Startup timing (%zu tasks):\n", m_tasks.size());
+        std::fprintf(out, "  %-28s %7s %10s %10s\n", "task", "thread", "start (s)", "time (s)");
+        for (TaskId id = 0; id < m_tasks.size(); id++) {
+            const Task& task = m_tasks[id];
+            bool on_path = std::find(path.begin(), path.end(), id) != path.end();
+            std::fprintf(out, "  %-28s %7u %10.3f %10.3f%s%s\n", task.name.c_str(), task.thread, task.start,
+                         task.duration, on_path ? "  *" : "", task.skipped ? "  (skipped)" : "");
+        }
+        double work = totalWork();
+        std::fprintf(out, "  total work %.3f s, critical path (*) %.3f s, wall %.3f s, parallelism %.2f\n", work,
+                     critical, m_wall, m_wall > 0 ? work / m_wall : 0.0);
+    }
+
+  private:
+    using Clock = std::chrono::steady_clock;
+
+    struct Task {
+        std::string name;
+        std::function<void()> fn;
+        std::vector<TaskId> deps;
+        std::vector<TaskId> dependents;
+        bool on_calling_thread = false;
+        size_t pending = 0;
+        bool skipped = false;
+        unsigned int thread = 0;
+        double start = 0;
+        double duration = 0;
+    };
+
+    static double seconds(Clock::time_point a, Clock::time_point b) {
+        return std::chrono::duration<double>(b - a).count();
+    }
+
+    // Caller holds m_mutex (or no other thread is running yet)
+    void enqueue(TaskId id) {
+        if (m_tasks[id].on_calling_thread)
+            m_pinned.push_back(id);
+        else
+            m_ready.push_back(id);
+    }
+
+    void work(unsigned int thread) {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        while (true) {
+            std::deque<TaskId>* queue = nullptr;
+            if (thread == 0 && !m_pinned.empty())
+                queue = &m_pinned;
+            else if (!m_ready.empty())
+                queue = &m_ready;
+            if (!queue) {
+                if (m_remaining == 0)
+                    break;
+                m_changed.wait(lock);
+                continue;
+            }
+            TaskId id = queue->front();
+            queue->pop_front();
+            Task& task = m_tasks[id];
+            bool skip = task.skipped;
+            lock.unlock();
+
+            auto start = Clock::now();
+            std::exception_ptr error;
+            if (!skip) {
+                try {
+                    task.fn();
+                } catch (...) {
+                    error = std::current_exception();
+                }
+            }
+            auto end = Clock::now();
+
+            lock.lock();
+            task.thread = thread;
+            task.start = seconds(m_start, start);
+            task.duration = seconds(start, end);
+            if (error && !m_error)
+                m_error = error;
+            for (TaskId next : task.dependents) {
+                if (error || skip)
+                    m_tasks[next].skipped = true;
+                if (--m_tasks[next].pending == 0)
+                    enqueue(next);
+            }
+            m_remaining--;
+            m_changed.notify_all();
+        }
+    }
+
+    std::vector<Task> m_tasks;
+    std::deque<TaskId> m_ready;
+    std::deque<TaskId> m_pinned;
+    size_t m_remaining = 0;
+    std::exception_ptr m_error;
+    std::mutex m_mutex;
+    std::condition_variable m_changed;
+    Clock::time_point m_start;
+    double m_wall = 0;
+};
@@ -0,0 +1,231 @@
+#pragma once
+// Early termination of a run once its outcome is decided. The rover state is
+// reduced to a small probe (chassis pose and speed, wheel slip) that the
+// rules are evaluated on every few steps; each run records the rule that
+// stopped it.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <string>
+
+enum class StopReason : int {
+    END_TIME = 0,      // ran to time_end
+    IMMOBILIZED = 1,   // slip above the threshold for too long
+    DISTANCE = 2,      // travelled the requested distance
+    TIP_OVER = 3,      // chassis tilted past the limit
+    WALL = 4,          // rover footprint too close to a box wall
+    STEADY_STATE = 5,  // speed and slip stopped changing
+    FAILED = 6         // run ended with an error
+};
+
+inline const char* stopReasonName(StopReason reason) {
+    switch (reason) {
+        case StopReason::IMMOBILIZED:
+            return "immobilized";
+        case StopReason::DISTANCE:
+            return "distance";
+        case StopReason::TIP_OVER:
+            return "tip_over";
+        case StopReason::WALL:
+            return "wall";
+        case StopReason::STEADY_STATE:
+            return "steady_state";
+        case StopReason::FAILED:
+            return "failed";
+        default:
+            return "end_time";
+    }
+}
+
+// Rule thresholds. A value of 0 disables the rule, and all rules are off
+// unless the run's JSON file sets them under the keys below (e.g.
+// "stop_slip": 0.95), so a run lasts its full time by default.
+struct TerminationSettings {
+    unsigned int check_steps = 1000;  // evaluate every this many steps
+    double slip = 0;                  // immobilized: slip at or above this (e.g. 0.95)...
+    double immobilized_time = 1.0;    // ...for this long (s)
+    double distance = 0;              // travelled distance in the ground plane
+    double tilt_deg = 0;              // angle between chassis up and the bed normal (e.g. 60)
+    double wall_clearance = 0;        // gap left between footprint and wall (e.g. 5)
+    double steady_window = 0;         // steady state: two consecutive windows (s, e.g. 2)...
+    double steady_tolerance = 0.02;   // ...whose mean speed and slip agree within this
+
+    bool set(const std::string& key, double value) {
+        if (key == "stop_check_steps")
+            check_steps = (unsigned int)std::max(1., value);
+        else if (key == "stop_slip")
+            slip = value;
+        else if (key == "stop_immobilized_time")
+            immobilized_time = value;
+        else if (key == "stop_distance")
+            distance = value;
+        else if (key == "stop_tilt_deg")
+            tilt_deg = value;
+        else if (key == "stop_wall_clearance")
+            wall_clearance = value;
+        else if (key == "stop_steady_window")
+            steady_window = value;
+        else if (key == "stop_steady_tolerance")
+            steady_tolerance = value;
+        else
+            return false;
+        return true;
+    }
+};
+
+// Rover state the rules look at, in the simulation frame (box centred on the
+// origin, z up)
+struct RoverProbe {
+    double time;
+    double pos[3];      // chassis position
+    double up[3];       // chassis z axis
+    double speed;       // chassis speed along its x axis
+    double slip;        // mean wheel slip, 1 - speed / (wheel rate * radius)
+};
+
+// How a run ended, plain data so a forked sweep worker can hand it back
+struct TerminationRecord {
+    int32_t reason;  // StopReason
+    double time;
+    double distance;
+    double slip;
+    double tilt_deg;
+};
+
+class TerminationMonitor {
+  public:
+    // box_half: half extents of the box in x and y; footprint: distance from
+    // the chassis origin to the outermost wheel edge
+    TerminationMonitor(const TerminationSettings& settings, double box_half_x, double box_half_y, double footprint)
+        : m_settings(settings), m_box_half{box_half_x, box_half_y}, m_footprint(footprint) {
+        m_record = TerminationRecord();
+    }
+
+    const TerminationSettings& settings() const { return m_settings; }
+    bool stopped() const { return m_stopped; }
+    const TerminationRecord& record() const { return m_record; }
+
+    // Evaluate the rules on a new probe. Returns true once a rule fires;
+    // later calls keep the first reason.
+    bool check(const RoverProbe& probe) {
+        if (m_stopped)
+            return true;
+        if (!m_started) {
+            m_started = true;
+            m_start[0] = probe.pos[0];
+            m_start[1] = probe.pos[1];
+        }
+        double dx = probe.pos[0] - m_start[0], dy = probe.pos[1] - m_start[1];
+        m_record.time = probe.time;
+        m_record.distance = std::sqrt(dx * dx + dy * dy);
+        m_record.slip = probe.slip;
+        m_record.tilt_deg = tiltDeg(probe);
+
+        if (m_settings.slip > 0 && m_settings.immobilized_time > 0) {
+            if (probe.slip < m_settings.slip)
+                m_slipping_since = -1;
+            else if (m_slipping_since < 0)
+                m_slipping_since = probe.time;
+            if (m_slipping_since >= 0 && probe.time - m_slipping_since >= m_settings.immobilized_time)
+                return stop(StopReason::IMMOBILIZED);
+        }
+        if (m_settings.distance > 0 && m_record.distance >= m_settings.distance)
+            return stop(StopReason::DISTANCE);
+        if (m_settings.tilt_deg > 0 && m_record.tilt_deg >= m_settings.tilt_deg)
+            return stop(StopReason::TIP_OVER);
+        if (m_settings.wall_clearance > 0) {
+            double reach = m_footprint + m_settings.wall_clearance;
+            if (std::abs(probe.pos[0]) + reach >= m_box_half[0] || std::abs(probe.pos[1]) + reach >= m_box_half[1])
+                return stop(StopReason::WALL);
+        }
+        if (m_settings.steady_window > 0 && steady(probe))
+            return stop(StopReason::STEADY_STATE);
+        return false;
+    }
+
+    // End a run no rule stopped
+    void finish(double time, bool failed = false) {
+        if (m_stopped)
+            return;
+        m_record.time = time;
+        stop(failed ? StopReason::FAILED : StopReason::END_TIME);
+    }
+
+    void print(FILE* out = stdout) const {
+        std::fprintf(out, "Stopped at t = %.4f s: %s (distance %.3f, slip %.3f, tilt %.1f deg)\n", m_record.time,
+                     stopReasonName((StopReason)m_record.reason), m_record.distance, m_record.slip, m_record.tilt_deg);
+    }
+
+    bool writeJson(const std::string& filename) const {
+        FILE* out = std::fopen(filename.c_str(), "w");
+        if (!out)
+            return false;
+        std::fprintf(out,
+                     "{\n  \"stop_reason\": \"%s\",\n  \"time\": %.9g,\n  \"distance\": %.9g,\n  \"slip\": %.9g,\n"
+                     "  \"tilt_deg\": %.9g\n}\n",
+                     stopReasonName((StopReason)m_record.reason), m_record.time, m_record.distance, m_record.slip,
+                     m_record.tilt_deg);
+        return std::fclose(out) == 0;
+    }
+
+  private:
+    struct Sample {
+        double time, speed, slip;
+    };
+
+    bool stop(StopReason reason) {
+        m_stopped = true;
+        m_record.reason = (int32_t)reason;
+        return true;
+    }
+
+    // Slopes are modelled by tilting gravity, so the bed normal stays +z
+    static double tiltDeg(const RoverProbe& probe) {
+        double un = std::sqrt(probe.up[0] * probe.up[0] + probe.up[1] * probe.up[1] + probe.up[2] * probe.up[2]);
+        if (un == 0)
+            return 0;
+        double c = probe.up[2] / un;
+        return std::acos(std::max(-1., std::min(1., c))) * 180 / M_PI;
+    }
+
+    // Mean speed and slip over the last window against the window before
+    bool steady(const RoverProbe& probe) {
+        m_samples.push_back({probe.time, probe.speed, probe.slip});
+        double window = m_settings.steady_window;
+        while (m_samples.size() > 2 && probe.time - m_samples[1].time >= 2 * window)
+            m_samples.pop_front();
+        if (probe.time - m_samples.front().time < 2 * window)
+            return false;
+        double speed[2] = {0, 0}, slip[2] = {0, 0};
+        size_t count[2] = {0, 0};
+        for (const Sample& s : m_samples) {
+            int w = probe.time - s.time < window ? 1 : 0;
+            speed[w] += s.speed;
+            slip[w] += s.slip;
+            count[w]++;
+        }
+        if (count[0] == 0 || count[1] == 0)
+            return false;
+        for (int w = 0; w < 2; w++) {
+            speed[w] /= count[w];
+            slip[w] /= count[w];
+        }
+        double tol = m_settings.steady_tolerance;
+        // speeds below 1% of the footprint per second count as standing still
+        double speed_scale = std::max(std::abs(speed[1]), 0.01 * m_footprint);
+        return std::abs(speed[1] - speed[0]) <= tol * speed_scale && std::abs(slip[1] - slip[0]) <= tol;
+    }
+
+    TerminationSettings m_settings;
+    double m_box_half[2];
+    double m_footprint;
+    bool m_started = false;
+    bool m_stopped = false;
+    double m_start[2] = {0, 0};
+    double m_slipping_since = -1;
+    std::deque<Sample> m_samples;
+    TerminationRecord m_record;
+};
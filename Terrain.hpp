@@ -0,0 +1,522 @@
+#pragma once
+// Procedural terrain: a heightfield of fractal noise, craters and rocks drawn
+// from size-frequency distributions and a slope ramp, generated in parallel
+// tiles from a seed, and granular beds filled under it by tiling a settled
+// template bed, so a new terrain needs no settling from scratch.
+//
+// Noise and crater heights at a grid point depend only on the seed and the
+// point, and craters and rocks are drawn serially before the tiles run, so
+// a terrain is the same for any tile size and thread count.
+//
+// A periodic_x terrain repeats along x with period size_x, for the periodic
+// bins of HostGranularSolver: each noise octave fits a whole number of
+// lattice cells in the period, craters near one end are repeated past the
+// other, and the bed is filled across the seam. The slope ramp is not
+// periodic and rocks stay clear of the ends.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <limits>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "CheckpointTransform.hpp"
+#include "HostMesh.hpp"
+#include "HostParallel.hpp"
+#include "HostSpatial.hpp"
+
+// Power-law size-frequency distribution: the number per unit area with
+// diameter at least D is density * (D / d_min)^-exponent, for d_min <= D <=
+// d_max (the cumulative form used for crater and rock counts)
+struct SizeFrequency {
+    float density = 0;  // per unit area, of diameter d_min and up
+    float exponent = 2;
+    float d_min = 1, d_max = 10;
+
+    // "density,exponent,d_min,d_max"
+    bool parse(const std::string& spec) {
+        float v[4];
+        if (std::sscanf(spec.c_str(), "%f,%f,%f,%f", &v[0], &v[1], &v[2], &v[3]) != 4 || v[0] < 0 || v[1] <= 0 ||
+            v[2] <= 0 || v[3] < v[2])
+            return false;
+        density = v[0];
+        exponent = v[1];
+        d_min = v[2];
+        d_max = v[3];
+        return true;
+    }
+
+    // expected count over an area, up to d_max
+    double expected(double area) const {
+        return density * area * (1 - std::pow((double)d_min / d_max, (double)exponent));
+    }
+
+    // inverse of the cumulative distribution truncated to [d_min, d_max]
+    float sample(std::mt19937_64& rng) const {
+        std::uniform_real_distribution<double> unit(0, 1);
+        double tail = std::pow((double)d_min / d_max, (double)exponent);
+        return (float)(d_min * std::pow(1 - unit(rng) * (1 - tail), -1.0 / exponent));
+    }
+};
+
+struct TerrainSettings {
+    float size_x = 400, size_y = 200;  // footprint, centred on the origin
+    float cell = 1;                    // grid spacing
+    float base_height = 0;             // ground height before noise, craters and slope
+    uint64_t seed = 1;
+
+    // fractal noise: octaves of gradient noise, the first of `wavelength`
+    // and `amplitude`, each next one lacunarity times shorter and
+    // persistence times lower
+    float amplitude = 2, wavelength = 100, persistence = 0.5f, lacunarity = 2;
+    int octaves = 6;
+
+    // bowl craters, depth and rim height as shares of the diameter
+    SizeFrequency craters = {0, 2, 10, 60};
+    float crater_depth = 0.2f, crater_rim = 0.04f;
+
+    // spherical rocks, buried to rock_burial of their diameter
+    SizeFrequency rocks = {0, 2.5f, 4, 20};
+    float rock_burial = 0.5f;
+
+    // ramp rising at slope_deg along x from slope_x0 to slope_x1, level beyond
+    float slope_deg = 0, slope_x0 = 0, slope_x1 = 0;
+
+    int tile = 64;  // grid points per tile side
+    bool periodic_x = false;
+};
+
+struct Crater {
+    float x, y, diameter;
+};
+
+struct Rock {
+    Vec3f centre;
+    float radius;
+    float yaw;  // about the vertical, for instancing rock shapes
+};
+
+struct Terrain {
+    Heightfield ground;   // the granular surface
+    Heightfield surface;  // ground with the rocks on it
+    std::vector<Crater> craters;
+    std::vector<Rock> rocks;
+};
+
+inline uint64_t terrainHash(uint64_t seed, int64_t a, int64_t b, uint64_t salt) {
+    // splitmix64 finaliser over the mixed inputs
+    uint64_t z = seed * 0x9E3779B97F4A7C15ULL ^ (uint64_t)a * 0xD1B54A32D192ED03ULL ^
+                 (uint64_t)b * 0xABC98388FB8FAC03ULL ^ (salt + 1) * 0x8CB92BA72F3D8DD7ULL;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+// 2D gradient noise on the unit lattice, in about [-1, 1], with one of eight
+// gradients per lattice point and quintic fades. A period_x > 0 repeats the
+// lattice along x every period_x cells.
+inline float gradientNoise(float x, float y, uint64_t seed, uint64_t octave, int64_t period_x = 0) {
+    static const float gx[8] = {1, -1, 0, 0, 0.70710678f, -0.70710678f, 0.70710678f, -0.70710678f};
+    static const float gy[8] = {0, 0, 1, -1, 0.70710678f, 0.70710678f, -0.70710678f, -0.70710678f};
+    float fx = std::floor(x), fy = std::floor(y);
+    int64_t ix = (int64_t)fx, iy = (int64_t)fy;
+    float dx = x - fx, dy = y - fy;
+    auto corner = [&](int64_t cx, int64_t cy, float ox, float oy) {
+        int64_t lx = period_x > 0 ? ((ix + cx) % period_x + period_x) % period_x : ix + cx;
+        unsigned int g = (unsigned int)(terrainHash(seed, lx, iy + cy, octave) & 7);
+        return gx[g] * ox + gy[g] * oy;
+    };
+    auto fade = [](float t) { return t * t * t * (t * (t * 6 - 15) + 10); };
+    float u = fade(dx), v = fade(dy);
+    float a = corner(0, 0, dx, dy) + u * (corner(1, 0, dx - 1, dy) - corner(0, 0, dx, dy));
+    float b = corner(0, 1, dx, dy - 1) + u * (corner(1, 1, dx - 1, dy - 1) - corner(0, 1, dx, dy - 1));
+    return 1.41421356f * (a + v * (b - a));
+}
+
+inline float fractalNoise(float x, float y, const TerrainSettings& s) {
+    float h = 0, amplitude = s.amplitude, frequency = 1 / s.wavelength;
+    for (int o = 0; o < s.octaves; o++) {
+        if (s.periodic_x) {
+            // the nearest whole number of cells over the period, counted
+            // from its low end
+            int64_t cells = std::max<int64_t>(1, std::lround(s.size_x * frequency));
+            h += amplitude * gradientNoise((x / s.size_x + 0.5f) * cells, y * frequency, s.seed, (uint64_t)o, cells);
+        } else {
+            h += amplitude * gradientNoise(x * frequency, y * frequency, s.seed, (uint64_t)o);
+        }
+        amplitude *= s.persistence;
+        frequency *= s.lacunarity;
+    }
+    return h;
+}
+
+// Height change of a simple crater at distance dist from its centre: a
+// parabolic bowl `depth` deep inside the rim, and an ejecta blanket falling
+// off as (R / r)^3 from the rim height to zero at three radii
+inline float craterProfile(float dist, float diameter, float depth, float rim) {
+    float s = dist / (diameter / 2);
+    if (s < 1)
+        return rim - (depth + rim) * (1 - s * s);
+    if (s < 3)
+        return rim * (1 / (s * s * s) - 1 / 27.f) / (1 - 1 / 27.f);
+    return 0;
+}
+
+inline float slopeRamp(float x, const TerrainSettings& s) {
+    if (s.slope_deg == 0 || s.slope_x1 <= s.slope_x0)
+        return 0;
+    return std::tan(s.slope_deg * (float)M_PI / 180) * std::min(std::max(x - s.slope_x0, 0.f), s.slope_x1 - s.slope_x0);
+}
+
+inline Terrain generateTerrain(const TerrainSettings& s) {
+    Terrain terrain;
+    Heightfield& ground = terrain.ground;
+    ground.size_x = s.size_x;
+    ground.size_y = s.size_y;
+    ground.nx = std::max(2, (int)std::lround(s.size_x / s.cell) + 1);
+    ground.ny = std::max(2, (int)std::lround(s.size_y / s.cell) + 1);
+    ground.heights.assign((size_t)ground.nx * ground.ny, 0);
+    const float step_x = s.size_x / (ground.nx - 1), step_y = s.size_y / (ground.ny - 1);
+    const int tile = std::max(1, s.tile);
+    const int tiles_x = (ground.nx + tile - 1) / tile, tiles_y = (ground.ny + tile - 1) / tile;
+    const double area = (double)s.size_x * s.size_y;
+
+    // craters may be centred up to a blanket radius outside the footprint
+    // (along y only when periodic in x)
+    std::mt19937_64 crater_rng(terrainHash(s.seed, 0, 0, 1001));
+    if (s.craters.density > 0) {
+        float reach = 1.5f * s.craters.d_max, reach_x = s.periodic_x ? 0 : reach;
+        double wide = ((double)s.size_x + 2 * reach_x) * ((double)s.size_y + 2 * reach);
+        std::poisson_distribution<long> count(s.craters.expected(wide));
+        std::uniform_real_distribution<float> ux(-s.size_x / 2 - reach_x, s.size_x / 2 + reach_x);
+        std::uniform_real_distribution<float> uy(-s.size_y / 2 - reach, s.size_y / 2 + reach);
+        for (long n = count(crater_rng); n > 0; n--) {
+            float d = s.craters.sample(crater_rng);
+            float x = ux(crater_rng), y = uy(crater_rng);
+            if (std::abs(x) < s.size_x / 2 + 1.5f * d && std::abs(y) < s.size_y / 2 + 1.5f * d)
+                terrain.craters.push_back({x, y, d});
+        }
+    }
+    // the craters shaping the ground: with a periodic x, also the images of
+    // those whose blanket crosses an end
+    std::vector<Crater> shapes = terrain.craters;
+    if (s.periodic_x) {
+        for (const Crater& c : terrain.craters) {
+            if (c.x - 1.5f * c.diameter < -s.size_x / 2)
+                shapes.push_back({c.x + s.size_x, c.y, c.diameter});
+            if (c.x + 1.5f * c.diameter > s.size_x / 2)
+                shapes.push_back({c.x - s.size_x, c.y, c.diameter});
+        }
+    }
+
+    // items (craters, then rocks) listed in every tile their reach overlaps
+    auto binToTiles = [&](float x, float y, float reach, uint32_t index, std::vector<std::vector<uint32_t>>& lists) {
+        int x0 = std::max(0, (int)std::floor((x - reach + s.size_x / 2) / step_x) / tile);
+        int x1 = std::min(tiles_x - 1, (int)std::ceil((x + reach + s.size_x / 2) / step_x) / tile);
+        int y0 = std::max(0, (int)std::floor((y - reach + s.size_y / 2) / step_y) / tile);
+        int y1 = std::min(tiles_y - 1, (int)std::ceil((y + reach + s.size_y / 2) / step_y) / tile);
+        for (int ty = y0; ty <= y1; ty++)
+            for (int tx = x0; tx <= x1; tx++)
+                lists[(size_t)ty * tiles_x + tx].push_back(index);
+    };
+    std::vector<std::vector<uint32_t>> tile_items((size_t)tiles_x * tiles_y);
+    for (size_t c = 0; c < shapes.size(); c++)
+        binToTiles(shapes[c].x, shapes[c].y, 1.5f * shapes[c].diameter, (uint32_t)c, tile_items);
+
+    auto forEachTilePoint = [&](size_t t, auto&& fn) {
+        int tx = (int)(t % tiles_x), ty = (int)(t / tiles_x);
+        for (int iy = ty * tile; iy < std::min(ground.ny, (ty + 1) * tile); iy++)
+            for (int ix = tx * tile; ix < std::min(ground.nx, (tx + 1) * tile); ix++)
+                fn((size_t)iy * ground.nx + ix, -s.size_x / 2 + ix * step_x, -s.size_y / 2 + iy * step_y);
+    };
+    parallelFor(tile_items.size(), [&](size_t t) {
+        forEachTilePoint(t, [&](size_t k, float x, float y) {
+            float h = s.base_height + slopeRamp(x, s);
+            if (s.amplitude != 0)
+                h += fractalNoise(x, y, s);
+            for (uint32_t c : tile_items[t]) {
+                const Crater& crater = shapes[c];
+                float dist = std::sqrt((x - crater.x) * (x - crater.x) + (y - crater.y) * (y - crater.y));
+                h += craterProfile(dist, crater.diameter, s.crater_depth * crater.diameter,
+                                   s.crater_rim * crater.diameter);
+            }
+            ground.heights[k] = h;
+        });
+    });
+    ground.periodic_x = s.periodic_x;
+
+    // rocks rest on the ground at their burial depth; a rock overlapping an
+    // earlier one is left out
+    std::mt19937_64 rock_rng(terrainHash(s.seed, 0, 0, 1002));
+    if (s.rocks.density > 0) {
+        std::poisson_distribution<long> count(s.rocks.expected(area));
+        std::uniform_real_distribution<float> unit(0, 1);
+        const float bucket = s.rocks.d_max;
+        std::unordered_map<uint64_t, std::vector<uint32_t>> buckets;
+        auto key = [&](float x, float y) {
+            return ((uint64_t)(uint32_t)(int)std::floor(x / bucket) << 32) | (uint32_t)(int)std::floor(y / bucket);
+        };
+        for (long n = count(rock_rng); n > 0; n--) {
+            float r = std::min(s.rocks.sample(rock_rng), 0.5f * std::min(s.size_x, s.size_y)) / 2;
+            float x = (unit(rock_rng) - 0.5f) * (s.size_x - 2 * r), y = (unit(rock_rng) - 0.5f) * (s.size_y - 2 * r);
+            Rock rock = {{x, y, ground.sample(x, y) + r - s.rock_burial * 2 * r}, r, 2 * (float)M_PI * unit(rock_rng)};
+            bool clear = true;
+            for (int dy = -1; dy <= 1 && clear; dy++)
+                for (int dx = -1; dx <= 1 && clear; dx++) {
+                    auto it = buckets.find(key(x + dx * bucket, y + dy * bucket));
+                    if (it == buckets.end())
+                        continue;
+                    for (uint32_t other : it->second) {
+                        float reach = r + terrain.rocks[other].radius;
+                        if (dist2(rock.centre, terrain.rocks[other].centre) < reach * reach)
+                            clear = false;
+                    }
+                }
+            if (!clear)
+                continue;
+            buckets[key(x, y)].push_back((uint32_t)terrain.rocks.size());
+            terrain.rocks.push_back(rock);
+        }
+    }
+
+    terrain.surface = ground;
+    for (auto& items : tile_items)
+        items.clear();
+    for (size_t k = 0; k < terrain.rocks.size(); k++)
+        binToTiles(terrain.rocks[k].centre.x, terrain.rocks[k].centre.y, terrain.rocks[k].radius, (uint32_t)k,
+                   tile_items);
+    parallelFor(tile_items.size(), [&](size_t t) {
+        if (tile_items[t].empty())
+            return;
+        forEachTilePoint(t, [&](size_t k, float x, float y) {
+            float& h = terrain.surface.heights[k];
+            for (uint32_t i : tile_items[t]) {
+                const Rock& rock = terrain.rocks[i];
+                float d2 = (x - rock.centre.x) * (x - rock.centre.x) + (y - rock.centre.y) * (y - rock.centre.y);
+                if (d2 < rock.radius * rock.radius)
+                    h = std::max(h, rock.centre.z + std::sqrt(rock.radius * rock.radius - d2));
+            }
+        });
+    });
+    return terrain;
+}
+
+// Two triangles per grid cell, in the coordinates of the heightfield
+inline TriangleMesh heightfieldMesh(const Heightfield& field) {
+    TriangleMesh mesh;
+    mesh.vertices.resize((size_t)field.nx * field.ny);
+    parallelFor((size_t)field.ny, [&](size_t iy) {
+        for (int ix = 0; ix < field.nx; ix++) {
+            size_t k = iy * field.nx + ix;
+            mesh.vertices[k] = {field.size_x * ((float)ix / (field.nx - 1) - 0.5f),
+                                field.size_y * ((float)iy / (field.ny - 1) - 0.5f), field.heights[k]};
+        }
+    });
+    mesh.indices.reserve((size_t)6 * (field.nx - 1) * (field.ny - 1));
+    for (int iy = 0; iy + 1 < field.ny; iy++)
+        for (int ix = 0; ix + 1 < field.nx; ix++) {
+            uint32_t a = (uint32_t)(iy * field.nx + ix), b = a + 1, c = a + field.nx, d = c + 1;
+            mesh.indices.insert(mesh.indices.end(), {a, b, d, a, d, c});
+        }
+    return mesh;
+}
+
+inline bool writeRocks(const std::string& filename, const std::vector<Rock>& rocks) {
+    FILE* out = std::fopen(filename.c_str(), "w");
+    if (!out)
+        return false;
+    bool ok = std::fputs("x,y,z,r,yaw\n", out) >= 0;
+    for (size_t i = 0; i < rocks.size() && ok; i++)
+        ok = std::fprintf(out, "%.6f,%.6f,%.6f,%.6f,%.6f\n", rocks[i].centre.x, rocks[i].centre.y, rocks[i].centre.z,
+                          rocks[i].radius, rocks[i].yaw) > 0;
+    return std::fclose(out) == 0 && ok;
+}
+
+// The inverse of writeRocks
+inline bool loadRocks(const std::string& filename, std::vector<Rock>& rocks) {
+    std::ifstream in(filename);
+    if (!in.is_open())
+        return false;
+    rocks.clear();
+    std::string line;
+    std::getline(in, line);  // header
+    while (std::getline(in, line)) {
+        Rock rock;
+        if (std::sscanf(line.c_str(), "%f,%f,%f,%f,%f", &rock.centre.x, &rock.centre.y, &rock.centre.z, &rock.radius,
+                        &rock.yaw) == 5)
+            rocks.push_back(rock);
+        else if (!line.empty())
+            return false;
+    }
+    return true;
+}
+
+// A periodic block of particles: positions in [0, period) that tile space
+// without overlaps across the block faces
+struct BedTemplate {
+    std::vector<Vec3f> pos;
+    Vec3f period = {0, 0, 0};
+};
+
+// Offset square layers, spacing 2.02 r as PDLayerSampler_BOX uses, with the
+// layer spacing set for the given packing fraction (at most about 0.72)
+inline BedTemplate latticeTemplate(float r, float packing) {
+    const float a = 2.02f * r;
+    float c = std::max(a / std::sqrt(2.f), (float)(4. / 3. * M_PI * r * r * r / (packing * a * a)));
+    BedTemplate block;
+    block.period = {a, a, 2 * c};
+    block.pos = {{a / 4, a / 4, c / 2}, {3 * a / 4, 3 * a / 4, 3 * c / 2}};
+    return block;
+}
+
+// Periodic block cut from the bulk of a settled bed: `margin` in from the
+// walls and floor, and below its lowest column top less a diameter. Where a
+// particle overlaps the image of another across a face by more than the
+// tolerance (a share of the diameter), the later one is dropped.
+inline BedTemplate templateFromBed(const std::vector<Vec3f>& pos, float r, float margin, float tolerance) {
+    BedTemplate block;
+    if (pos.empty())
+        return block;
+    Vec3f lo, hi;
+    computeBounds(pos, lo, hi);
+    Vec3f blo = {lo.x + margin, lo.y + margin, lo.z + margin};
+    Vec3f bhi = {hi.x - margin, hi.y - margin, hi.z};
+
+    // lowest top over columns of two diameters inside the block footprint
+    const float column = 4 * r;
+    int nx = std::max(1, (int)((bhi.x - blo.x) / column)), ny = std::max(1, (int)((bhi.y - blo.y) / column));
+    std::vector<float> tops((size_t)nx * ny, -std::numeric_limits<float>::infinity());
+    for (const Vec3f& p : pos) {
+        if (p.x < blo.x || p.x >= bhi.x || p.y < blo.y || p.y >= bhi.y)
+            continue;
+        int cx = std::min((int)((p.x - blo.x) / column), nx - 1), cy = std::min((int)((p.y - blo.y) / column), ny - 1);
+        float& t = tops[(size_t)cy * nx + cx];
+        t = std::max(t, p.z);
+    }
+    bhi.z = *std::min_element(tops.begin(), tops.end()) - 2 * r;
+    block.period = bhi - blo;
+    if (block.period.x < 4 * r || block.period.y < 4 * r || block.period.z < 4 * r) {
+        block.period = {0, 0, 0};
+        return block;
+    }
+    for (const Vec3f& p : pos)
+        if (p.x >= blo.x && p.x < bhi.x && p.y >= blo.y && p.y < bhi.y && p.z >= blo.z && p.z < bhi.z)
+            block.pos.push_back(p - blo);
+
+    // overlaps across the faces, each pair found from its later particle
+    const float d = 2 * r, limit = d * (1 - tolerance);
+    CellGrid grid;
+    grid.build(block.pos, d);
+    std::vector<uint8_t> keep(block.pos.size(), 1);
+    const Vec3f& P = block.period;
+    parallelFor(block.pos.size(), [&](size_t i) {
+        const Vec3f& p = block.pos[i];
+        int range[3][2];
+        const float c[3] = {p.x, p.y, p.z}, period[3] = {P.x, P.y, P.z};
+        for (int k = 0; k < 3; k++) {
+            range[k][0] = c[k] > period[k] - d ? -1 : 0;
+            range[k][1] = c[k] < d ? 1 : 0;
+        }
+        for (int sz = range[2][0]; sz <= range[2][1]; sz++)
+            for (int sy = range[1][0]; sy <= range[1][1]; sy++)
+                for (int sx = range[0][0]; sx <= range[0][1]; sx++) {
+                    if (sx == 0 && sy == 0 && sz == 0)
+                        continue;
+                    Vec3f q = {p.x + sx * P.x, p.y + sy * P.y, p.z + sz * P.z};
+                    grid.forEachInRange(q, limit, [&](uint32_t j) {
+                        if (j < i && dist2(q, block.pos[j]) < limit * limit)
+                            keep[i] = 0;
+                    });
+                }
+    });
+    size_t n = 0;
+    for (size_t i = 0; i < block.pos.size(); i++)
+        if (keep[i])
+            block.pos[n++] = block.pos[i];
+    block.pos.resize(n);
+    return block;
+}
+
+// Fill the footprint of the ground heightfield with copies of the block,
+// from floor_z up to the ground, leaving out particles that cross the
+// walls, the floor or the ground, or overlap a rock. Runs over xy tiles of
+// `tile` on all host threads; the result is in tile order. A periodic_x
+// ground has no x walls: the fill runs up to the ends and the particles
+// overlapping across the seam are dropped.
+inline void fillTerrainBed(const Heightfield& ground,
+                           float floor_z,
+                           float r,
+                           const BedTemplate& block,
+                           const std::vector<Rock>& rocks,
+                           float tile,
+                           std::vector<Vec3f>& out) {
+    out.clear();
+    const Vec3f& P = block.period;
+    if (block.pos.empty() || P.x <= 0 || P.y <= 0 || P.z <= 0)
+        return;
+    const float x_lo = -ground.size_x / 2, y_lo = -ground.size_y / 2;
+    const int tiles_x = std::max(1, (int)std::ceil(ground.size_x / tile));
+    const int tiles_y = std::max(1, (int)std::ceil(ground.size_y / tile));
+    const float top = *std::max_element(ground.heights.begin(), ground.heights.end());
+
+    std::vector<std::vector<uint32_t>> tile_rocks((size_t)tiles_x * tiles_y);
+    for (size_t k = 0; k < rocks.size(); k++) {
+        const Rock& rock = rocks[k];
+        float reach = rock.radius + r;
+        int x0 = std::max(0, (int)((rock.centre.x - reach - x_lo) / tile));
+        int x1 = std::min(tiles_x - 1, (int)((rock.centre.x + reach - x_lo) / tile));
+        int y0 = std::max(0, (int)((rock.centre.y - reach - y_lo) / tile));
+        int y1 = std::min(tiles_y - 1, (int)((rock.centre.y + reach - y_lo) / tile));
+        for (int ty = y0; ty <= y1; ty++)
+            for (int tx = x0; tx <= x1; tx++)
+                tile_rocks[(size_t)ty * tiles_x + tx].push_back((uint32_t)k);
+    }
+
+    std::vector<std::vector<Vec3f>> tiles(tile_rocks.size());
+    parallelFor(tiles.size(), [&](size_t t) {
+        int tx = (int)(t % tiles_x), ty = (int)(t / tiles_x);
+        const float wall_x = ground.periodic_x ? 0 : r;
+        float x0 = x_lo + tx * tile, x1 = std::min(x0 + tile, ground.size_x / 2 - wall_x);
+        float y0 = y_lo + ty * tile, y1 = std::min(y0 + tile, ground.size_y / 2 - r);
+        x0 = std::max(x0, x_lo + wall_x);
+        y0 = std::max(y0, y_lo + r);
+        std::vector<Vec3f>& kept = tiles[t];
+        long ix0 = (long)std::floor((x0 - x_lo) / P.x), ix1 = (long)std::floor((x1 - x_lo) / P.x);
+        long iy0 = (long)std::floor((y0 - y_lo) / P.y), iy1 = (long)std::floor((y1 - y_lo) / P.y);
+        long iz1 = (long)std::floor((top - floor_z) / P.z);
+        for (long iz = 0; iz <= iz1; iz++)
+            for (long iy = iy0; iy <= iy1; iy++)
+                for (long ix = ix0; ix <= ix1; ix++)
+                    for (const Vec3f& q : block.pos) {
+                        Vec3f p = {x_lo + ix * P.x + q.x, y_lo + iy * P.y + q.y, floor_z + iz * P.z + q.z};
+                        if (p.x < x0 || p.x >= x1 || p.y < y0 || p.y >= y1 || p.z - r < floor_z ||
+                            p.z + r > ground.sample(p.x, p.y))
+                            continue;
+                        bool clear = true;
+                        for (uint32_t k : tile_rocks[t]) {
+                            float reach = rocks[k].radius + r;
+                            clear = clear && dist2(p, rocks[k].centre) >= reach * reach;
+                        }
+                        if (clear)
+                            kept.push_back(p);
+                    }
+    });
+    size_t total = 0;
+    for (const auto& kept : tiles)
+        total += kept.size();
+    out.reserve(total);
+    for (const auto& kept : tiles)
+        out.insert(out.end(), kept.begin(), kept.end());
+    if (ground.periodic_x) {
+        ParticleBed bed;
+        bed.radius = r;
+        bed.pos.swap(out);
+        removeSeamOverlaps(bed, periodicBoxX(ground.size_x), 0);
+        out.swap(bed.pos);
+    }
+}
@@ -0,0 +1,203 @@
+#pragma once
+// Single-wheel testbed: one wheel on a carriage that is towed along a narrow
+// soil bin at the speed its commanded slip gives, free to sink under a fixed
+// vertical load. One run per slip gives the drawbar pull, torque and
+// sinkage curves. This header holds the parts that need no Chrono: the
+// settings, the surface the sinkage is measured from and the reduction of
+// each run to one point of the curves.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "HostJson.hpp"
+
+// Read from the run's JSON file under the keys below. Sizes of 0 are set
+// from the wheel by resolve().
+struct TestbedSettings {
+    double length = 0;            // bin length along x, 0 for 6 wheel diameters
+    double width = 0;             // bin width, 0 for 3 wheel widths
+    double load = 0;              // vertical load on the wheel (dyn), 0 for a sixth of the rover weight
+    double wheel_speed = M_PI;    // wheel angular speed (rad/s)
+    double steady_share = 0.5;    // last share of the towed time averaged into the curves
+    unsigned int max_parallel = 1;
+    std::vector<double> slips = {0.1, 0.2, 0.3, 0.4, 0.5, 0.6, 0.7};
+
+    // testbed_length, testbed_width, testbed_load, testbed_wheel_speed,
+    // testbed_steady_share, testbed_parallel and testbed_slips (an array)
+    void read(const HostJson& json) {
+        length = json.getNumber("testbed_length", length);
+        width = json.getNumber("testbed_width", width);
+        load = json.getNumber("testbed_load", load);
+        wheel_speed = json.getNumber("testbed_wheel_speed", wheel_speed);
+        steady_share = std::max(0.05, std::min(1., json.getNumber("testbed_steady_share", steady_share)));
+        max_parallel = (unsigned int)std::max(1., json.getNumber("testbed_parallel", max_parallel));
+        if (json.has("testbed_slips.0")) {
+            slips.clear();
+            for (size_t i = 0; json.has("testbed_slips." + std::to_string(i)); i++)
+                slips.push_back(json.getNumber("testbed_slips." + std::to_string(i), 0));
+        }
+    }
+
+    // Returns false if the load does not exceed the weight of the wheel
+    // alone under gravity_z, i.e. no carriage could press it down with it.
+    bool resolve(double wheel_radius, double wheel_width, double default_load, double gravity_z, double wheel_mass) {
+        if (length <= 0)
+            length = 12 * wheel_radius;
+        if (width <= 0)
+            width = 3 * wheel_width;
+        if (load <= 0)
+            load = default_load;
+        return carriageMass(gravity_z, wheel_mass) > 0;
+    }
+
+    // Carriage mass that, with the wheel, weighs the load under gravity_z,
+    // positive for settings resolve() accepted
+    double carriageMass(double gravity_z, double wheel_mass) const { return load / std::abs(gravity_z) - wheel_mass; }
+
+    // The wheel starts two radii from the rear wall and stops two radii
+    // short of the front wall
+    double startX(double wheel_radius) const { return -length / 2 + 2 * wheel_radius; }
+    double travel(double wheel_radius) const { return std::max(0., length - 4 * wheel_radius); }
+};
+
+// Carriage speed for a slip, 1 - v / (wheel speed * radius)
+inline double carriageSpeed(double slip, double wheel_speed, double wheel_radius) {
+    return (1 - slip) * wheel_speed * wheel_radius;
+}
+
+// Height of the bed surface along the wheel track: the mean over a row of
+// cells of the highest particle top in each
+class TrackSurface {
+  public:
+    TrackSurface(double x0, double x1, double half_width, double cell)
+        : m_x0(x0), m_half_width(half_width), m_cell(cell),
+          m_top(std::max<size_t>(1, (size_t)std::ceil((x1 - x0) / cell)), -INFINITY) {}
+
+    void add(double x, double y, double z, double r) {
+        if (std::abs(y) > m_half_width || x < m_x0)
+            return;
+        size_t c = (size_t)((x - m_x0) / m_cell);
+        if (c < m_top.size())
+            m_top[c] = std::max(m_top[c], z + r);
+    }
+
+    // NaN if no particle fell in the track
+    double height() const {
+        double sum = 0;
+        size_t n = 0;
+        for (double top : m_top) {
+            if (std::isfinite(top)) {
+                sum += top;
+                n++;
+            }
+        }
+        return n ? sum / n : NAN;
+    }
+
+  private:
+    double m_x0, m_half_width, m_cell;
+    std::vector<double> m_top;
+};
+
+// One point of the curves, plain data so a forked worker can hand it back
+struct TestbedPoint {
+    double slip;           // commanded
+    double measured_slip;  // from the carriage speed and wheel rate
+    double drawbar_pull;   // soil force on the wheel along the direction of travel
+    double torque;         // soil torque against the wheel's rotation
+    double sinkage;        // initial surface height less the wheel's lowest point
+    double load;           // soil force on the wheel along +z
+    uint32_t samples;      // output samples averaged
+};
+
+// Time series of one run. Loads are averaged over every step between two
+// samples, since the soil forces are noisy at the step scale.
+class TestbedLog {
+  public:
+    TestbedLog(double slip, double release_time, double steady_share)
+        : m_slip(slip), m_release(release_time), m_steady_share(steady_share) {}
+
+    void accumulate(double drawbar_pull, double torque, double load) {
+        m_sum[0] += drawbar_pull;
+        m_sum[1] += torque;
+        m_sum[2] += load;
+        m_count++;
+    }
+
+    // Close the current sample with the loads accumulated since the last one
+    void addSample(double time, double x, double z, double sinkage, double measured_slip) {
+        Sample s = {time, x, z, sinkage, measured_slip, 0, 0, 0};
+        if (m_count) {
+            s.drawbar_pull = m_sum[0] / m_count;
+            s.torque = m_sum[1] / m_count;
+            s.load = m_sum[2] / m_count;
+        }
+        m_samples.push_back(s);
+        m_sum[0] = m_sum[1] = m_sum[2] = 0;
+        m_count = 0;
+    }
+
+    // Means over the last steady_share of the time after release
+    TestbedPoint point() const {
+        TestbedPoint p = {m_slip, 0, 0, 0, 0, 0, 0};
+        if (m_samples.empty() || m_samples.back().time <= m_release)
+            return p;
+        double from = m_release + (1 - m_steady_share) * (m_samples.back().time - m_release);
+        for (const Sample& s : m_samples) {
+            if (s.time < from)
+                continue;
+            p.measured_slip += s.measured_slip;
+            p.drawbar_pull += s.drawbar_pull;
+            p.torque += s.torque;
+            p.sinkage += s.sinkage;
+            p.load += s.load;
+            p.samples++;
+        }
+        if (p.samples) {
+            p.measured_slip /= p.samples;
+            p.drawbar_pull /= p.samples;
+            p.torque /= p.samples;
+            p.sinkage /= p.samples;
+            p.load /= p.samples;
+        }
+        return p;
+    }
+
+    bool writeCsv(const std::string& filename) const {
+        FILE* out = std::fopen(filename.c_str(), "w");
+        if (!out)
+            return false;
+        std::fprintf(out, "t,x,z,slip,drawbar_pull,torque,sinkage,load\n");
+        for (const Sample& s : m_samples)
+            std::fprintf(out, "%.6f,%.6g,%.6g,%.6g,%.6g,%.6g,%.6g,%.6g\n", s.time, s.x, s.z, s.measured_slip,
+                         s.drawbar_pull, s.torque, s.sinkage, s.load);
+        return std::fclose(out) == 0;
+    }
+
+  private:
+    struct Sample {
+        double time, x, z, sinkage, measured_slip;
+        double drawbar_pull, torque, load;
+    };
+
+    double m_slip, m_release, m_steady_share;
+    double m_sum[3] = {0, 0, 0};
+    size_t m_count = 0;
+    std::vector<Sample> m_samples;
+};
+
+// The curves, one row per slip; dp_ratio is drawbar pull over load
+inline bool writeTestbedCurves(const std::string& filename, const std::vector<TestbedPoint>& points) {
+    FILE* out = std::fopen(filename.c_str(), "w");
+    if (!out)
+        return false;
+    std::fprintf(out, "slip,measured_slip,drawbar_pull,dp_ratio,torque,sinkage,load,samples\n");
+    for (const TestbedPoint& p : points)
+        std::fprintf(out, "%.6g,%.6g,%.6g,%.6g,%.6g,%.6g,%.6g,%u\n", p.slip, p.measured_slip, p.drawbar_pull,
+                     p.load != 0 ? p.drawbar_pull / p.load : 0., p.torque, p.sinkage, p.load, p.samples);
+    return std::fclose(out) == 0;
+}
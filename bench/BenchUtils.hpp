@@ -0,0 +1,53 @@
+#pragma once
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+#include "HostSpatial.hpp"
+
+// Wall clock stopwatch in seconds
+class BenchTimer {
+  public:
+    BenchTimer() : m_start(std::chrono::steady_clock::now()) {}
+    void reset() { m_start = std::chrono::steady_clock::now(); }
+    double seconds() const {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - m_start).count();
+    }
+
+  private:
+    std::chrono::steady_clock::time_point m_start;
+};
+
+// Stand-in for a settled bed: spheres on a lattice with spacing
+// 2 * radius * 1.01 (as PDLayerSampler_BOX does for our settling runs),
+// jittered slightly and filled bottom-up in a box of the given footprint.
+inline std::vector<Vec3f> makeSettledBed(size_t n, float radius, float box_x, float box_y, unsigned int seed = 1) {
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<float> jitter(-0.005f * radius, 0.005f * radius);
+    float spacing = 2.f * radius * 1.01f;
+    int nx = std::max(1, (int)(box_x / spacing));
+    int ny = std::max(1, (int)(box_y / spacing));
+    std::vector<Vec3f> pos;
+    pos.reserve(n);
+    for (size_t k = 0; k < n; k++) {
+        size_t layer = k / ((size_t)nx * ny);
+        size_t in_layer = k % ((size_t)nx * ny);
+        float x = -box_x / 2 + radius + (in_layer % nx) * spacing + jitter(rng);
+        float y = -box_y / 2 + radius + (in_layer / nx) * spacing + jitter(rng);
+        float z = radius + layer * spacing + jitter(rng);
+        pos.push_back({x, y, z});
+    }
+    return pos;
+}
+
+// Positive integer command line argument with a default
+inline long benchArg(int argc, char* argv[], int index, long default_value) {
+    return argc > index ? std::atol(argv[index]) : default_value;
+}
+
+inline double benchArg(int argc, char* argv[], int index, double default_value) {
+    return argc > index ? std::atof(argv[index]) : default_value;
+}
@@ -0,0 +1,117 @@
+// =============================================================================
+// Simulation to dataframe time for one particle frame: CSV as WriteFile
+// writes it versus Parquet written from the position and speed buffers.
+// The write side is timed here; when python3 with pandas (and pyarrow for
+// Parquet) is on the path, the time to load each file into a DataFrame is
+// timed too. Also writes a telemetry stream of the same number of frames
+// to show the cost of the Arrow IPC writer.
+//
+// usage: bench_columnar_export [num_particles] [directory]
+// =============================================================================
+
+#include <unistd.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "BenchUtils.hpp"
+#include "CheckpointIO.hpp"
+#include "ColumnarExport.hpp"
+
+// Seconds for pandas to load the file, or a negative value if it cannot
+static double pandasLoadSeconds(const std::string& filename, bool parquet) {
+    std::string command = "python3 -c \"import time, pandas as pd; t = time.perf_counter(); d = pd.";
+    command += parquet ? "read_parquet" : "read_csv";
+    command += "('" + filename + "'); print(time.perf_counter() - t)\" 2>/dev/null";
+    FILE* pipe = popen(command.c_str(), "r");
+    if (!pipe)
+        return -1;
+    double seconds = -1;
+    if (std::fscanf(pipe, "%lf", &seconds) != 1)
+        seconds = -1;
+    return pclose(pipe) == 0 ? seconds : -1;
+}
+
+static void printRow(const char* name, double write, double load, const std::string& filename) {
+    FILE* f = std::fopen(filename.c_str(), "rb");
+    long bytes = 0;
+    if (f) {
+        std::fseek(f, 0, SEEK_END);
+        bytes = std::ftell(f);
+        std::fclose(f);
+    }
+    if (load >= 0)
+        printf("%-8s %10.1f %10.3f %10.3f %10.3f\n", name, bytes / 1e6, write, load, write + load);
+    else
+        printf("%-8s %10.1f %10.3f %10s %10s\n", name, bytes / 1e6, write, "n/a", "n/a");
+}
+
+int main(int argc, char* argv[]) {
+    size_t n = (size_t)benchArg(argc, argv, 1, 2000000L);
+    std::string dir = argc > 2 ? argv[2] : "/tmp";
+
+    std::vector<Vec3f> pos = makeSettledBed(n, 1.f, 400.f, 200.f);
+    std::vector<Vec3f> vel(pos.size());
+    std::vector<float> absv(pos.size());
+    std::mt19937 rng(3);
+    std::normal_distribution<float> speed(0.f, 5.f);
+    for (size_t i = 0; i < pos.size(); i++) {
+        vel[i] = {speed(rng), speed(rng), speed(rng)};
+        absv[i] = length(vel[i]);
+    }
+    std::vector<int32_t> ids(pos.size());
+    for (size_t i = 0; i < ids.size(); i++)
+        ids[i] = (int32_t)i;
+
+    std::string prefix = dir + "/bench_columnar_" + std::to_string(getpid());
+    std::string csv = prefix + ".csv", parquet = prefix + ".parquet", arrows = prefix + ".arrows";
+    printf("%zu particles\n", pos.size());
+    printf("%-8s %10s %10s %10s %10s\n", "format", "MB", "write (s)", "load (s)", "total (s)");
+
+    BenchTimer timer;
+    bool ok = writeCheckpointCSV(csv, pos, &vel);
+    double write_csv = timer.seconds();
+    printRow("csv", ok ? write_csv : -1, pandasLoadSeconds(csv, false), csv);
+
+    timer.reset();
+    // the same data as the CSV columns, plus the particle index
+    ok = writeParquet(parquet, pos.size(),
+                      {{"id", ParquetColumn::INT32, ParquetColumn::DELTA_BINARY_PACKED, ids.data(), sizeof(int32_t)},
+                       {"x", ParquetColumn::FLOAT, ParquetColumn::PLAIN, &pos[0].x, sizeof(Vec3f)},
+                       {"y", ParquetColumn::FLOAT, ParquetColumn::PLAIN, &pos[0].y, sizeof(Vec3f)},
+                       {"z", ParquetColumn::FLOAT, ParquetColumn::PLAIN, &pos[0].z, sizeof(Vec3f)},
+                       {"absv", ParquetColumn::FLOAT, ParquetColumn::PLAIN, absv.data(), sizeof(float)}});
+    double write_parquet = timer.seconds();
+    printRow("parquet", ok ? write_parquet : -1, pandasLoadSeconds(parquet, true), parquet);
+
+    // telemetry: 7 bodies per frame, one record batch per frame
+    const int frames = 10000;
+    ArrowStreamWriter telemetry;
+    telemetry.addColumn("frame", ArrowStreamWriter::INT32);
+    telemetry.addColumn("t", ArrowStreamWriter::FLOAT64);
+    telemetry.addColumn("body", ArrowStreamWriter::DICTIONARY,
+                        {"wheel0", "wheel1", "wheel2", "wheel3", "wheel4", "wheel5", "chassis"});
+    for (const char* name : {"x", "y", "z", "fx", "fy", "fz"})
+        telemetry.addColumn(name, ArrowStreamWriter::FLOAT64);
+    timer.reset();
+    ok = telemetry.open(arrows);
+    for (int f = 0; f < frames && ok; f++) {
+        for (int b = 0; b < 7; b++) {
+            telemetry.push(0, f);
+            telemetry.push(1, f * 1e-3);
+            telemetry.push(2, b);
+            for (int k = 0; k < 6; k++)
+                telemetry.push(3 + k, pos[(f * 7 + b) % pos.size()].x + k);
+        }
+        ok = telemetry.writeBatch();
+    }
+    ok = telemetry.close() && ok;
+    printf("telemetry: %d frames as Arrow IPC batches in %.3f s%s\n", frames, timer.seconds(), ok ? "" : " (failed)");
+
+    std::remove(csv.c_str());
+    std::remove(parquet.c_str());
+    std::remove(arrows.c_str());
+    return 0;
+}
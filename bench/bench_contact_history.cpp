@@ -0,0 +1,112 @@
+// =============================================================================
+// Benchmark of the open-addressing contact-history table against
+// std::unordered_map at the contact densities of a settled bed (about three
+// contacts per particle). Each step a fraction of the contacts break and the
+// same number of new contacts form; every live contact is looked up and its
+// tangential displacement updated. The table drops stale contacts in bulk
+// when it fills up, the map erases them every step.
+//
+// usage: bench_contact_history [num_particles] [num_steps] [churn_percent]
+// =============================================================================
+
+#include <cstdio>
+#include <random>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "BenchUtils.hpp"
+#include "ContactHistory.hpp"
+#include "NeighborList.hpp"
+
+constexpr float sphere_radius = 1;
+
+int main(int argc, char* argv[]) {
+    size_t num_particles = benchArg(argc, argv, 1, 1000000L);
+    long num_steps = benchArg(argc, argv, 2, 50L);
+    double churn = benchArg(argc, argv, 3, 2.0) / 100;
+
+    // Lattice neighbours of the settled bed stand in for the contacts
+    std::vector<Vec3f> pos = makeSettledBed(num_particles, sphere_radius, 400, 200);
+    VerletNeighborList list(sphere_radius, 0.1f);
+    list.build(pos);
+    std::vector<std::pair<uint32_t, uint32_t>> contacts;
+    contacts.reserve(list.numPairs());
+    for (size_t row = 0; row < pos.size(); row++)
+        for (uint32_t k = list.offsets()[row]; k < list.offsets()[row + 1]; k++)
+            contacts.push_back({list.order()[row], list.neighbors()[k]});
+    size_t num_contacts = contacts.size();
+    printf("%zu particles, %zu contacts (%.2f per particle), %ld steps, %.1f%% churn, %u threads\n", num_particles,
+           num_contacts, (double)num_contacts / num_particles, num_steps, 100 * churn, hostThreadCount());
+
+    // Precompute the contact set of every step so both containers see the
+    // same sequence
+    std::mt19937 rng(3);
+    std::uniform_int_distribution<uint32_t> any_particle(0, (uint32_t)num_particles - 1);
+    std::uniform_int_distribution<size_t> any_contact(0, num_contacts - 1);
+    std::vector<std::vector<std::pair<uint32_t, uint32_t>>> steps(num_steps);
+    for (auto& step : steps) {
+        for (size_t c = 0; c < (size_t)(churn * num_contacts); c++) {
+            uint32_t i = any_particle(rng);
+            uint32_t j = any_particle(rng);
+            contacts[any_contact(rng)] = {i, j == i ? (j + 1) % (uint32_t)num_particles : j};
+        }
+        step = contacts;
+    }
+
+    // Open addressing: parallel acquire, bulk compaction
+    ContactHistoryTable table(num_contacts);
+    double acquire_s = 0, compact_s = 0;
+    unsigned int num_compactions = 0;
+    for (auto& step : steps) {
+        BenchTimer timer;
+        if (table.needsCompact()) {
+            table.compact();
+            num_compactions++;
+        }
+        compact_s += timer.seconds();
+        table.beginStep();
+        timer.reset();
+        parallelFor(step.size(), [&](size_t c) {
+            ContactHistoryTable::Entry* e = table.acquire(step[c].first, step[c].second);
+            e->displacement.x += 1e-3f;
+        });
+        acquire_s += timer.seconds();
+    }
+    double table_ns = 1e9 * acquire_s / (num_steps * num_contacts);
+    printf("open addressing: %7.2f ns/lookup, compact %7.3f ms/step (%u compactions), %.1f MB\n", table_ns,
+           1000 * compact_s / num_steps, num_compactions, table.memoryBytes() / 1e6);
+
+    // std::unordered_map: serial lookups, erase stale entries by a full scan
+    struct MapEntry {
+        Vec3f displacement;
+        uint32_t generation;
+    };
+    std::unordered_map<uint64_t, MapEntry> map;
+    map.reserve(num_contacts);
+    double map_lookup_s = 0, map_erase_s = 0;
+    uint32_t generation = 0;
+    for (auto& step : steps) {
+        generation++;
+        BenchTimer timer;
+        for (auto& c : step) {
+            MapEntry& e = map[ContactHistoryTable::pairKey(c.first, c.second)];
+            e.displacement.x += 1e-3f;
+            e.generation = generation;
+        }
+        map_lookup_s += timer.seconds();
+        timer.reset();
+        for (auto it = map.begin(); it != map.end();)
+            it = it->second.generation != generation ? map.erase(it) : std::next(it);
+        map_erase_s += timer.seconds();
+    }
+    double map_ns = 1e9 * map_lookup_s / (num_steps * num_contacts);
+    printf("unordered_map:   %7.2f ns/lookup, erase   %7.3f ms/step, %zu live\n", map_ns,
+           1000 * map_erase_s / num_steps, map.size());
+    printf("speedup per step: %.2fx\n", (map_lookup_s + map_erase_s) / (acquire_s + compact_s));
+
+    table.compact();
+    if (map.size() != table.size())
+        printf("WARNING: %zu live contacts in the table, %zu in the map\n", table.size(), map.size());
+    return 0;
+}
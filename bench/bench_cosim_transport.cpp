@@ -0,0 +1,127 @@
+// =============================================================================
+// Latency and throughput of the terrain/rover co-simulation exchange. A
+// forked rover process sends mesh states and waits for the loads, the terrain
+// process answers immediately, so each round trip is pure transport
+// overhead. Runs the shared-memory channel and the Unix socket fallback for
+// the rover's 6 wheels and for larger mesh counts.
+//
+// usage: bench_cosim_transport [num_exchanges] [transport: shm|unix|both]
+// =============================================================================
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "BenchUtils.hpp"
+#include "CosimChannel.hpp"
+
+// Terrain side: echo a load for every state until the rover is done
+static bool serveTerrain(CosimChannel& channel) {
+    CosimHeader header;
+    std::vector<CosimMeshState> states;
+    std::vector<CosimMeshLoad> loads;
+    while (channel.receiveStates(header, states)) {
+        loads.resize(states.size());
+        for (size_t i = 0; i < states.size(); i++)
+            for (int k = 0; k < 3; k++) {
+                loads[i].force[k] = states[i].lin_vel[k];
+                loads[i].torque[k] = states[i].ang_vel[k];
+            }
+        if (!channel.sendLoads(header, loads))
+            return false;
+        if (header.flags & COSIM_DONE)
+            return true;
+    }
+    return false;
+}
+
+// Rover side: timed round trips, written to the pipe as microseconds
+static int runRover(const std::string& spec, unsigned int num_meshes, long num_exchanges, int result_fd) {
+    auto channel = openCosimChannel(spec, CosimRole::ROVER, num_meshes, 10);
+    if (!channel)
+        return 1;
+    std::vector<CosimMeshState> states(num_meshes);
+    for (unsigned int i = 0; i < num_meshes; i++)
+        states[i] = {{0, 0, 1.0 * i}, {1, 0, 0, 0}, {1, 0, 0}, {0, 1, 0}};
+    std::vector<CosimMeshLoad> loads;
+    std::vector<double> round_trip_us(num_exchanges);
+    long warmup = std::min(1000L, num_exchanges);
+    for (long step = -warmup; step < num_exchanges; step++) {
+        CosimHeader header = {(uint64_t)(step + warmup), 0, step + 1 == num_exchanges ? COSIM_DONE : 0u, 0, 0};
+        BenchTimer timer;
+        if (!channel->sendStates(header, states) || !channel->receiveLoads(header, loads) ||
+            loads.size() != num_meshes)
+            return 1;
+        if (step >= 0)
+            round_trip_us[step] = 1e6 * timer.seconds();
+    }
+    ssize_t bytes = num_exchanges * sizeof(double);
+    return write(result_fd, round_trip_us.data(), bytes) == bytes ? 0 : 1;
+}
+
+static void benchmark(const std::string& spec, unsigned int num_meshes, long num_exchanges) {
+    int fds[2];
+    if (pipe(fds) != 0)
+        return;
+    std::string scratch = spec + "_" + std::to_string(getpid());
+    pid_t rover = fork();
+    if (rover == 0) {
+        close(fds[0]);
+        _exit(runRover(scratch, num_meshes, num_exchanges, fds[1]));
+    }
+    close(fds[1]);
+
+    BenchTimer timer;
+    bool ok = false;
+    if (auto channel = openCosimChannel(scratch, CosimRole::TERRAIN, num_meshes, 10))
+        ok = serveTerrain(*channel);
+    double wall = timer.seconds();
+
+    std::vector<double> us(num_exchanges);
+    char* dst = reinterpret_cast<char*>(us.data());
+    size_t remaining = us.size() * sizeof(double);
+    while (remaining > 0) {
+        ssize_t n = read(fds[0], dst, remaining);
+        if (n <= 0)
+            break;
+        dst += n;
+        remaining -= n;
+    }
+    close(fds[0]);
+    int status = 0;
+    waitpid(rover, &status, 0);
+    if (!ok || remaining > 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        printf("%-5s %6u meshes: exchange failed\n", spec.substr(0, spec.find(':')).c_str(), num_meshes);
+        return;
+    }
+
+    std::sort(us.begin(), us.end());
+    double mean = 0;
+    for (double v : us)
+        mean += v;
+    mean /= us.size();
+    double bytes = num_meshes * (double)(sizeof(CosimMeshState) + sizeof(CosimMeshLoad)) + 2 * sizeof(CosimHeader);
+    printf("%-5s %6u meshes: round trip mean %7.2f us  p50 %7.2f  p99 %7.2f  max %8.1f | %8.0f exchanges/s  %7.1f MB/s\n",
+           spec.substr(0, spec.find(':')).c_str(), num_meshes, mean, us[us.size() / 2], us[us.size() * 99 / 100],
+           us.back(), num_exchanges / wall, num_exchanges * bytes / wall / 1e6);
+}
+
+int main(int argc, char* argv[]) {
+    long num_exchanges = benchArg(argc, argv, 1, 100000L);
+    std::string transport = argc > 2 ? argv[2] : "both";
+
+    printf("%ld exchanges per case, header %zu B, state %zu B, load %zu B per mesh\n", num_exchanges,
+           sizeof(CosimHeader), sizeof(CosimMeshState), sizeof(CosimMeshLoad));
+    fflush(stdout);
+    for (unsigned int num_meshes : {6u, 64u, 1024u}) {
+        if (transport == "shm" || transport == "both")
+            benchmark("shm:rovertest_bench", num_meshes, num_exchanges);
+        if (transport == "unix" || transport == "both")
+            benchmark("unix:/tmp/rovertest_bench", num_meshes, num_exchanges);
+    }
+    return 0;
+}
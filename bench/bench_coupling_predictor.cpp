@@ -0,0 +1,126 @@
+// =============================================================================
+// How far each load predictor lets the co-simulation exchange interval grow.
+// A driven wheel carrying its share of the rover drops onto a stand-in
+// terrain (Hunt-Crossley normal force, slip-dependent traction) that is only
+// evaluated at exchanges, for the state sent at the start of the interval,
+// as the terrain process does. Every predictor runs at increasing intervals
+// against an exchange-every-step reference; the table lists the trajectory
+// errors, the coupling energy drift, and the largest interval that stays
+// within the tolerance.
+//
+// usage: bench_coupling_predictor [tolerance=0.02] [duration=2]
+// =============================================================================
+
+#include <cmath>
+#include <cstdio>
+#include <vector>
+
+#include "BenchUtils.hpp"
+#include "CouplingPredictor.hpp"
+
+constexpr double dt = 1e-4;
+constexpr double gravity = 370;
+constexpr double wheel_radius = 13;
+constexpr double carried_mass = 4000 + 161000 / 6.;
+constexpr double terrain_stiffness = 3.9e6;  // about 2 cm static sinkage
+constexpr double terrain_damping = 0.02;     // Hunt-Crossley, s/cm
+constexpr double traction_coeff = 0.5;
+constexpr double slip_scale = 0.2;
+constexpr double wheel_omega_max = 2;  // rad/s, reached after 0.5 s as the motors ramp
+
+// Load from the stand-in terrain for wheel centre height z and velocities
+static void terrainLoad(double z, const double vel[6], double load[6]) {
+    for (int d = 0; d < 6; d++)
+        load[d] = 0;
+    double sinkage = wheel_radius - z;
+    if (sinkage <= 0)
+        return;
+    double fz = terrain_stiffness * std::pow(sinkage, 1.5) * (1 - terrain_damping * vel[2]);
+    fz = std::max(fz, 0.0);
+    double surface_speed = vel[4] * wheel_radius;
+    double slip = (surface_speed - vel[0]) / std::max({std::abs(surface_speed), std::abs(vel[0]), 1.0});
+    load[0] = traction_coeff * fz * std::tanh(slip / slip_scale);
+    load[2] = fz;
+    load[4] = -load[0] * wheel_radius;
+}
+
+struct RunResult {
+    std::vector<double> x, z;
+    double energy_drift;
+};
+
+static RunResult run(PredictorType type, long interval, double duration) {
+    long num_steps = (long)std::lround(duration / dt);
+    double x = 0, z = wheel_radius + 1;
+    double vel[6] = {0, 0, 0, 0, 0, 0};
+    LoadPredictor predictor(type);
+    CouplingEnergyMonitor monitor;
+    double sent_z = z, sent_vel[6] = {}, sent_time = 0;
+    RunResult result;
+    result.x.reserve(num_steps);
+    result.z.reserve(num_steps);
+    for (long step = 0; step < num_steps; step++) {
+        double t = step * dt;
+        vel[4] = wheel_omega_max * std::min(1.0, t / 0.5);
+        if (step % interval == 0) {
+            sent_time = t;
+            sent_z = z;
+            for (int d = 0; d < 6; d++)
+                sent_vel[d] = vel[d];
+        }
+
+        double applied[6];
+        predictor.predict(t, z, vel, applied);
+        monitor.addRoverStep(applied, vel, dt);
+        vel[0] += dt * applied[0] / carried_mass;
+        vel[2] += dt * (applied[2] / carried_mass - gravity);
+        x += dt * vel[0];
+        z += dt * vel[2];
+
+        if ((step + 1) % interval == 0 || step + 1 == num_steps) {
+            double load[6];
+            terrainLoad(sent_z, sent_vel, load);
+            predictor.addSample(sent_time, load, sent_z, sent_vel);
+            monitor.addExchange(load);
+        }
+        result.x.push_back(x);
+        result.z.push_back(z);
+    }
+    result.energy_drift = monitor.drift();
+    return result;
+}
+
+int main(int argc, char* argv[]) {
+    double tolerance = benchArg(argc, argv, 1, 0.02);
+    double duration = benchArg(argc, argv, 2, 2.0);
+
+    RunResult reference = run(PredictorType::HOLD, 1, duration);
+    double static_sinkage = std::pow(carried_mass * gravity / terrain_stiffness, 1 / 1.5);
+    double weight_work = carried_mass * gravity * static_sinkage;
+    printf("dt %g s, %g s simulated, static sinkage %.2f cm, tolerance %g (rms z error / sinkage, final x error)\n", dt, duration,
+           static_sinkage, tolerance);
+    printf("%-10s %8s %12s %12s %14s\n", "predictor", "interval", "rms z err", "final x err", "energy drift");
+
+    const PredictorType types[] = {PredictorType::HOLD, PredictorType::LINEAR, PredictorType::QUADRATIC,
+                                   PredictorType::STIFFNESS};
+    long best[4] = {0, 0, 0, 0};
+    for (int p = 0; p < 4; p++) {
+        for (long interval = 1; interval <= 256; interval *= 2) {
+            RunResult r = run(types[p], interval, duration);
+            double sum = 0;
+            for (size_t k = 0; k < r.z.size(); k++)
+                sum += (r.z[k] - reference.z[k]) * (r.z[k] - reference.z[k]);
+            double z_err = std::sqrt(sum / r.z.size()) / static_sinkage;
+            double x_err = std::abs(r.x.back() - reference.x.back()) / std::max(std::abs(reference.x.back()), 1e-9);
+            bool ok = std::isfinite(z_err) && z_err <= tolerance && x_err <= tolerance;
+            if (ok && best[p] == interval / 2)
+                best[p] = interval;
+            printf("%-10s %8ld %12.3e %12.3e %14.3e%s\n", predictorName(types[p]), interval, z_err, x_err,
+                   r.energy_drift / weight_work, ok ? "" : "  *");
+        }
+    }
+    printf("\nlargest interval within tolerance (energy drift in units of weight x sinkage):\n");
+    for (int p = 0; p < 4; p++)
+        printf("  %-10s %4ld steps (%g s)\n", predictorName(types[p]), best[p], best[p] * dt);
+    return 0;
+}
@@ -0,0 +1,87 @@
+// =============================================================================
+// Benchmark of the Verlet neighbour list against a fresh cell-list search
+// every step. Particles start as a settled bed and drift with a constant
+// random velocity per particle, moving at most step_disp * sphere_radius per
+// step.
+//
+// usage: bench_neighbor_list [num_particles] [num_steps] [step_disp]
+// =============================================================================
+
+#include <cstdio>
+#include <random>
+#include <vector>
+
+#include "BenchUtils.hpp"
+#include "NeighborList.hpp"
+
+constexpr float sphere_radius = 1;
+
+void drift(std::vector<Vec3f>& pos, const std::vector<Vec3f>& vel) {
+    parallelFor(pos.size(), [&](size_t i) {
+        pos[i].x += vel[i].x;
+        pos[i].y += vel[i].y;
+        pos[i].z += vel[i].z;
+    });
+}
+
+int main(int argc, char* argv[]) {
+    size_t num_particles = benchArg(argc, argv, 1, 1000000L);
+    long num_steps = benchArg(argc, argv, 2, 200L);
+    double step_disp = benchArg(argc, argv, 3, 0.002);
+
+    std::vector<Vec3f> start = makeSettledBed(num_particles, sphere_radius, 400, 200);
+    std::vector<Vec3f> vel(num_particles);
+    std::mt19937 rng(7);
+    std::uniform_real_distribution<float> unit(-1, 1);
+    float amplitude = (float)(step_disp * sphere_radius / std::sqrt(3.));
+    for (auto& v : vel)
+        v = {unit(rng) * amplitude, unit(rng) * amplitude, unit(rng) * amplitude};
+
+    printf("%zu particles, %ld steps, max step displacement %g r, %u threads\n", num_particles, num_steps,
+           step_disp, hostThreadCount());
+
+    // Reference: fresh cell-list search every step
+    float cutoff2 = 4 * sphere_radius * sphere_radius;
+    std::vector<Vec3f> pos = start;
+    CellGrid grid;
+    size_t ref_contacts = 0;
+    BenchTimer timer;
+    for (long step = 0; step < num_steps; step++) {
+        drift(pos, vel);
+        grid.build(pos, 2 * sphere_radius);
+        ref_contacts = 0;
+        for (size_t i = 0; i < pos.size(); i++) {
+            grid.forEachCandidate(pos[i], [&](uint32_t j) {
+                if (j > i && dist2(pos[i], pos[j]) < cutoff2)
+                    ref_contacts++;
+            });
+        }
+    }
+    double cell_list_ms = 1000 * timer.seconds() / num_steps;
+    printf("cell list:  %8.3f ms/step, %zu contacts\n", cell_list_ms, ref_contacts);
+
+    printf("%6s %8s %12s %12s %12s %10s %8s\n", "skin", "builds", "steps/build", "ms/build", "ms/step", "pairs",
+           "speedup");
+    for (float skin_fraction : {0.05f, 0.1f, 0.2f, 0.4f}) {
+        pos = start;
+        VerletNeighborList list(sphere_radius, skin_fraction);
+        double build_s = 0;
+        size_t contacts = 0;
+        timer.reset();
+        for (long step = 0; step < num_steps; step++) {
+            drift(pos, vel);
+            BenchTimer build_timer;
+            if (list.update(pos))
+                build_s += build_timer.seconds();
+            contacts = 0;
+            list.forEachContact(pos, [&](uint32_t, uint32_t, float) { contacts++; });
+        }
+        double step_ms = 1000 * timer.seconds() / num_steps;
+        if (contacts != ref_contacts)
+            printf("WARNING: %zu contacts with skin %g, expected %zu\n", contacts, skin_fraction, ref_contacts);
+        printf("%6.2f %8u %12.1f %12.3f %12.3f %10zu %7.2fx\n", skin_fraction, list.numBuilds(),
+               (double)num_steps / list.numBuilds(), 1000 * build_s / list.numBuilds(), step_ms, list.numPairs(),
+               cell_list_ms / step_ms);
+    }
+    return 0;
+}
@@ -0,0 +1,110 @@
+// =============================================================================
+// Frame and checkpoint output throughput. Writes a run's worth of frames,
+// each one a contiguous block of particle data, through std::ofstream (the
+// path WriteFile-style output takes), buffered stdio, and the OutputFile
+// pwrite and io_uring backends with O_DIRECT. Each file is fsync'ed before
+// the clock stops, so page-cache backends pay for their writeback too.
+// Point it at the disk you care about (e.g. local NVMe); tmpfs refuses
+// O_DIRECT and only shows the copy overhead.
+//
+// usage: bench_output_writer [directory] [frame MB] [num_frames]
+// =============================================================================
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "BenchUtils.hpp"
+#include "OutputFile.hpp"
+
+static bool syncFile(const std::string& filename) {
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;
+    bool ok = fsync(fd) == 0;
+    close(fd);
+    return ok;
+}
+
+// Seconds to write all frames, or a negative value on failure
+static double writeOfstream(const std::string& prefix, const std::vector<char>& frame, int num_frames) {
+    BenchTimer timer;
+    for (int f = 0; f < num_frames; f++) {
+        std::string filename = prefix + std::to_string(f);
+        {
+            std::ofstream out(filename, std::ios::binary);
+            out.write(frame.data(), frame.size());
+            if (!out)
+                return -1;
+        }
+        if (!syncFile(filename))
+            return -1;
+    }
+    return timer.seconds();
+}
+
+static double writeBackend(const std::string& prefix,
+                           const std::vector<char>& frame,
+                           int num_frames,
+                           OutputBackend backend,
+                           OutputBackend& used) {
+    // frames arrive in pieces, as the writers in the run produce them
+    const size_t piece = 256 * 1024 + 16;
+    BenchTimer timer;
+    for (int f = 0; f < num_frames; f++) {
+        std::string filename = prefix + std::to_string(f);
+        OutputFile out;
+        if (!out.open(filename, backend))
+            return -1;
+        used = out.backend();
+        for (size_t offset = 0; offset < frame.size(); offset += piece)
+            if (!out.write(frame.data() + offset, std::min(piece, frame.size() - offset)))
+                return -1;
+        if (!out.close() || !syncFile(filename))
+            return -1;
+    }
+    return timer.seconds();
+}
+
+int main(int argc, char* argv[]) {
+    std::string dir = argc > 1 ? argv[1] : "/tmp";
+    double frame_mb = argc > 2 ? std::atof(argv[2]) : 64;
+    int num_frames = argc > 3 ? std::atoi(argv[3]) : 8;
+
+    // stand-in for particle data: float coordinates of a settled bed
+    size_t frame_bytes = (size_t)(frame_mb * (1 << 20));
+    std::vector<Vec3f> bed = makeSettledBed(frame_bytes / sizeof(Vec3f), 1.f, 400.f, 200.f);
+    std::vector<char> frame(frame_bytes);
+    std::memcpy(frame.data(), bed.data(), std::min(frame_bytes, bed.size() * sizeof(Vec3f)));
+
+    std::string prefix = dir + "/bench_output_writer_" + std::to_string(getpid()) + "_";
+    double total_mb = frame_mb * num_frames;
+    printf("%d frames of %.1f MB in %s\n", num_frames, frame_mb, dir.c_str());
+    printf("%-10s %-10s %10s %10s\n", "writer", "in use", "time (s)", "MB/s");
+
+    double seconds = writeOfstream(prefix, frame, num_frames);
+    if (seconds < 0)
+        printf("%-10s failed\n", "ofstream");
+    else
+        printf("%-10s %-10s %10.3f %10.1f\n", "ofstream", "ofstream", seconds, total_mb / seconds);
+
+    for (OutputBackend backend : {OutputBackend::STDIO, OutputBackend::PWRITE, OutputBackend::URING}) {
+        OutputBackend used = backend;
+        seconds = writeBackend(prefix, frame, num_frames, backend, used);
+        if (seconds < 0)
+            printf("%-10s failed\n", outputBackendName(backend));
+        else
+            printf("%-10s %-10s %10.3f %10.1f\n", outputBackendName(backend), outputBackendName(used), seconds,
+                   total_mb / seconds);
+    }
+
+    for (int f = 0; f < num_frames; f++)
+        std::remove((prefix + std::to_string(f)).c_str());
+    return 0;
+}
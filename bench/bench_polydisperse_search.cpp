@@ -0,0 +1,86 @@
+// =============================================================================
+// Neighbour search cost against the spread in particle radius: a single cell
+// list with cells of the largest diameter versus the size-binned grid, on
+// deposited beds of radius 1 with a share of particles up to `spread` times
+// larger. Both find every pair within r_i + r_j + skin; the counts must
+// agree.
+//
+// usage: bench_polydisperse_search [num_particles] [large_share]
+// =============================================================================
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "BenchUtils.hpp"
+#include "Polydisperse.hpp"
+
+constexpr float skin = 0.05f;
+
+// Contacts found (each pair once) and the time of the search
+template <typename Search>
+static size_t countPairs(size_t n, Search&& search, double& seconds) {
+    std::vector<size_t> partial(hostThreadCount(), 0);
+    BenchTimer timer;
+    parallelForChunks(n, [&](size_t begin, size_t end, unsigned int tid) {
+        size_t count = 0;
+        for (size_t i = begin; i < end; i++)
+            search((uint32_t)i, count);
+        partial[tid] = count;
+    });
+    seconds = timer.seconds();
+    size_t total = 0;
+    for (size_t c : partial)
+        total += c;
+    return total;
+}
+
+int main(int argc, char* argv[]) {
+    size_t n = (size_t)benchArg(argc, argv, 1, 200000L);
+    double large_share = benchArg(argc, argv, 2, 0.05);
+
+    printf("%zu particles, %u threads; radius 1, or uniform in [1, spread] for %.0f%% of them\n", n,
+           hostThreadCount(), 100 * large_share);
+    printf("%7s %5s | %10s %10s %10s | %10s %10s %10s | %8s\n", "spread", "bins", "cell build", "cell query",
+           "cell MB", "bin build", "bin query", "bin MB", "speedup");
+
+    for (float spread : {1.f, 2.f, 4.f, 8.f, 16.f}) {
+        std::vector<float> radii(n, 1.f);
+        std::mt19937 rng(11);
+        std::uniform_real_distribution<float> unit(0.f, 1.f);
+        for (float& r : radii)
+            if (unit(rng) < large_share)
+                r = 1 + (spread - 1) * unit(rng);
+        std::vector<Vec3f> pos;
+        depositBed(radii, 400, 200, 0, pos);
+        float r_max = *std::max_element(radii.begin(), radii.end());
+
+        // single cell list, cells of the largest reach
+        BenchTimer timer;
+        CellGrid cells;
+        cells.build(pos, 2 * r_max + skin);
+        double cell_build = timer.seconds(), cell_query;
+        size_t cell_pairs = countPairs(n, [&](uint32_t i, size_t& count) {
+            cells.forEachCandidate(pos[i], [&](uint32_t j) {
+                float reach = radii[i] + radii[j] + skin;
+                if (j > i && dist2(pos[i], pos[j]) < reach * reach)
+                    count++;
+            });
+        }, cell_query);
+
+        timer.reset();
+        SizeBinnedGrid binned;
+        binned.build(pos, radii, skin);
+        double bin_build = timer.seconds(), bin_query;
+        size_t bin_pairs = countPairs(n, [&](uint32_t i, size_t& count) {
+            binned.forEachPairOf(pos, radii, i, skin, [&](uint32_t, float) { count++; });
+        }, bin_query);
+
+        printf("%7g %5zu | %10.1f %10.1f %10.1f | %10.1f %10.1f %10.1f | %7.2fx%s\n", spread, binned.numBins(),
+               1000 * cell_build, 1000 * cell_query, cells.memoryBytes() / 1e6, 1000 * bin_build, 1000 * bin_query,
+               binned.memoryBytes() / 1e6, (cell_build + cell_query) / (bin_build + bin_query),
+               cell_pairs == bin_pairs ? "" : "  (pair counts differ)");
+    }
+    printf("times in ms\n");
+    return 0;
+}
@@ -0,0 +1,163 @@
+// =============================================================================
+// Rock obstacles as one mesh per rock, the way the host solver's addMesh and
+// ChSystemGpuMesh::LoadMeshes take them, against the instanced rock field:
+// a few shapes with one triangle hierarchy each and a top-level hierarchy
+// over the instances. Times the per-step pose update the meshes need and
+// the particle contact queries, and compares memory. Both must find the
+// same contacts, matched per particle and rock: the field measures in each
+// rock's own frame and the meshes in world space, so distances may differ by
+// rounding, and a contact grazing the radius may be found by one path only.
+//
+// usage: bench_rock_obstacles [num_particles] [num_shapes]
+// =============================================================================
+
+#include <algorithm>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+#include "BenchUtils.hpp"
+#include "RockObstacles.hpp"
+
+constexpr float sphere_radius = 1;
+// allowed rounding in a contact distance, relative to the sphere radius
+constexpr float distance_tolerance = 1e-4f;
+
+struct Hit {
+    uint32_t particle, rock;
+    float distance;
+    bool operator<(const Hit& other) const {
+        return particle != other.particle ? particle < other.particle : rock < other.rock;
+    }
+};
+
+// True if the two paths found the same contacts: distances of contacts in
+// both agree within tol, and contacts in one only are within tol of r
+static bool sameContacts(std::vector<std::vector<Hit>>& per_thread_a, std::vector<std::vector<Hit>>& per_thread_b,
+                         float r, float tol, size_t& num_grazing) {
+    std::vector<Hit> a, b;
+    for (const auto& hits : per_thread_a)
+        a.insert(a.end(), hits.begin(), hits.end());
+    for (const auto& hits : per_thread_b)
+        b.insert(b.end(), hits.begin(), hits.end());
+    std::sort(a.begin(), a.end());
+    std::sort(b.begin(), b.end());
+    bool same = true;
+    num_grazing = 0;
+    size_t i = 0, j = 0;
+    while (i < a.size() || j < b.size()) {
+        if (j == b.size() || (i < a.size() && a[i] < b[j])) {
+            same &= a[i].distance >= r - tol;
+            num_grazing++, i++;
+        } else if (i == a.size() || b[j] < a[i]) {
+            same &= b[j].distance >= r - tol;
+            num_grazing++, j++;
+        } else {
+            same &= std::abs(a[i].distance - b[j].distance) <= tol;
+            i++, j++;
+        }
+    }
+    return same;
+}
+
+int main(int argc, char* argv[]) {
+    size_t num_particles = (size_t)benchArg(argc, argv, 1, 200000L);
+    unsigned int num_shapes = (unsigned int)benchArg(argc, argv, 2, 4L);
+
+    // particles in a layer around the rocks, which sit half buried at z = 0
+    std::vector<Vec3f> pos(num_particles);
+    std::mt19937 rng(5);
+    std::uniform_real_distribution<float> unit(0, 1);
+    for (auto& p : pos)
+        p = {400 * unit(rng) - 200, 200 * unit(rng) - 100, 20 * unit(rng) - 10};
+
+    printf("%zu particles, %u rock shapes of %zu triangles, %u threads\n", num_particles, num_shapes,
+           makeRockShape(0, 3).numTriangles(), hostThreadCount());
+    printf("%7s | %10s %10s %10s | %10s %10s %10s | %8s\n", "rocks", "pose ms", "query ms", "mesh MB", "build ms",
+           "query ms", "field MB", "speedup");
+
+    for (size_t num_rocks : {10, 100, 1000, 4000}) {
+        std::vector<Rock> rocks(num_rocks);
+        for (Rock& rock : rocks)
+            rock = {{396 * unit(rng) - 198, 196 * unit(rng) - 98, 0}, 2 + 6 * unit(rng), 6.2831853f * unit(rng)};
+
+        BenchTimer timer;
+        std::vector<TriangleMesh> shapes;
+        for (unsigned int s = 0; s < std::max(1u, num_shapes); s++)
+            shapes.push_back(makeRockShape(s + 1, 3));
+        RockField field;
+        for (const TriangleMesh& shape : shapes)
+            field.addShape(shape);
+        for (size_t k = 0; k < rocks.size(); k++)
+            field.addInstance({(uint32_t)(k % shapes.size()), rocks[k].centre,
+                               quatFromAxisAngle({0, 0, 1}, rocks[k].yaw), rocks[k].radius});
+        field.build();
+        double field_build = timer.seconds();
+
+        // one mesh per rock: world vertices and bounds refreshed every step,
+        // then every mesh's bounds and triangles tested per particle
+        struct PerRock {
+            std::vector<Vec3f> world;
+            Vec3f lo, hi;
+        };
+        std::vector<PerRock> meshes(num_rocks);
+        timer.reset();
+        parallelFor(num_rocks, [&](size_t k) {
+            const RockInstance& in = field.instance(k);
+            const TriangleMesh& local = shapes[in.shape];
+            meshes[k].world.resize(local.vertices.size());
+            for (size_t v = 0; v < local.vertices.size(); v++)
+                meshes[k].world[v] = in.pos + rotate(in.rot, local.vertices[v] * in.scale);
+            computeBounds(meshes[k].world, meshes[k].lo, meshes[k].hi);
+        });
+        double pose_update = timer.seconds();
+
+        const float r = sphere_radius;
+        std::vector<std::vector<Hit>> mesh_hits(hostThreadCount()), field_hits(hostThreadCount());
+        timer.reset();
+        parallelForChunks(num_particles, [&](size_t begin, size_t end, unsigned int tid) {
+            for (size_t i = begin; i < end; i++) {
+                const Vec3f& x = pos[i];
+                for (size_t k = 0; k < num_rocks; k++) {
+                    const PerRock& m = meshes[k];
+                    if (x.x < m.lo.x - r || x.x > m.hi.x + r || x.y < m.lo.y - r || x.y > m.hi.y + r ||
+                        x.z < m.lo.z - r || x.z > m.hi.z + r)
+                        continue;
+                    const auto& idx = shapes[field.instance(k).shape].indices;
+                    float best = r * r;
+                    for (size_t t = 0; t + 2 < idx.size(); t += 3)
+                        best = std::min(best, dist2(x, closestPointOnTriangle(x, m.world[idx[t]], m.world[idx[t + 1]],
+                                                                               m.world[idx[t + 2]])));
+                    if (best < r * r)
+                        mesh_hits[tid].push_back({(uint32_t)i, (uint32_t)k, std::sqrt(best)});
+                }
+            }
+        });
+        double mesh_query = timer.seconds();
+
+        timer.reset();
+        parallelForChunks(num_particles, [&](size_t begin, size_t end, unsigned int tid) {
+            for (size_t i = begin; i < end; i++)
+                field.forEachContact(pos[i], r, [&](uint32_t k, const Vec3f& point) {
+                    field_hits[tid].push_back({(uint32_t)i, k, std::sqrt(dist2(pos[i], point))});
+                });
+        });
+        double field_query = timer.seconds();
+
+        size_t mesh_bytes = 0;
+        for (const PerRock& m : meshes)
+            mesh_bytes += m.world.size() * sizeof(Vec3f) + shapes[0].indices.size() * sizeof(uint32_t);
+        size_t num_grazing;
+        bool same = sameContacts(mesh_hits, field_hits, r, distance_tolerance * r, num_grazing);
+        printf("%7zu | %10.2f %10.1f %10.2f | %10.2f %10.1f %10.2f | %7.1fx", num_rocks, 1000 * pose_update,
+               1000 * mesh_query, mesh_bytes / 1e6, 1000 * field_build, 1000 * field_query,
+               field.memoryBytes() / 1e6, (pose_update + mesh_query) / field_query);
+        if (!same)
+            printf("  (contacts differ)");
+        else if (num_grazing > 0)
+            printf("  (%zu grazing contacts found by one path)", num_grazing);
+        printf("\n");
+    }
+    printf("one mesh per rock pays the pose update every step; the field is built once\n");
+    return 0;
+}
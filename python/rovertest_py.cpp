@@ -0,0 +1,197 @@
+// =============================================================================
+// Python bindings (pybind11) for driving a run in-process:
+//
+//   import rovertest_py
+//   sim = rovertest_py.Simulation(config, "checkpoint_base", gravity_angle=0)
+//   while sim.step(100):
+//       sim.set_wheel_speed(0, 2.0)
+//       z = sim.particles[:, 2]        # NumPy view, no copy
+//
+// `config` is the run's JSON file as a dict (or the path of one). The run
+// (mode 1, single process) executes on a worker thread that pauses every
+// step() call; the state published at the pause is exposed as read-only
+// NumPy arrays viewing the snapshot buffers, which step() refreshes in
+// place (copy() them to keep a frame). One Simulation per process, since
+// the rover model lives in globals.
+// =============================================================================
+
+#include <pybind11/numpy.h>
+#include <pybind11/pybind11.h>
+#include <pybind11/stl.h>
+
+#include <cstdio>
+#include <stdexcept>
+#include <thread>
+#include <unistd.h>
+
+#include "rovertest.cpp"
+
+namespace py = pybind11;
+
+class PySimulation {
+  public:
+    PySimulation(py::object config,
+                 const std::string& checkpoint_file_base,
+                 double gravity_angle,
+                 bool particles,
+                 bool particle_velocities,
+                 const std::string& data_path) {
+        if (s_active)
+            throw std::runtime_error("only one Simulation can exist per process");
+        gpu::SetDataPath(data_path);
+
+        std::string json_file;
+        if (py::isinstance<py::str>(config)) {
+            json_file = gpu::GetDataFile(config.cast<std::string>());
+        } else {
+            // ParseJSON and HostJson read files, so the dict goes through one
+            char name[] = "/tmp/rovertest_py_XXXXXX";
+            int fd = mkstemp(name);
+            if (fd < 0)
+                throw std::runtime_error("cannot create a temporary JSON file");
+            std::string text = py::module_::import("json").attr("dumps")(config).cast<std::string>();
+            bool written = ::write(fd, text.data(), text.size()) == (ssize_t)text.size();
+            ::close(fd);
+            m_temp_file = json_file = name;
+            if (!written) {
+                close();
+                throw std::runtime_error("cannot write the temporary JSON file");
+            }
+        }
+
+        RunOptions options;
+        HostJson extra_params;
+        if (!loadRunOptions(json_file, options, extra_params)) {
+            close();
+            throw std::invalid_argument("invalid run configuration");
+        }
+        options.run_mode = RUN_MODE::TESTING;
+        options.checkpoint_file_base = checkpoint_file_base;
+        options.grav_angle_deg = gravity_angle;
+        options.controller = &m_controller;
+        m_controller.setParticleCapture(particles, particle_velocities);
+
+        s_active = true;
+        m_thread = std::thread([this, options]() { m_controller.finish(runSimulation(options, nullptr)); });
+        py::gil_scoped_release release;
+        m_controller.waitPaused();
+    }
+
+    ~PySimulation() { close(); }
+
+    // Stop the run and wait for its thread
+    void close() {
+        if (m_thread.joinable()) {
+            m_controller.requestStop();
+            py::gil_scoped_release release;
+            m_thread.join();
+        }
+        if (!m_temp_file.empty()) {
+            std::remove(m_temp_file.c_str());
+            m_temp_file.clear();
+        }
+        s_active = m_thread.joinable();
+    }
+
+    bool step(uint64_t steps) {
+        py::gil_scoped_release release;
+        return m_controller.advance(steps);
+    }
+
+    void setWheelSpeed(unsigned int wheel, double speed) {
+        checkWheel(wheel);
+        WheelMotorCommand command;
+        command.wheel = wheel;
+        command.speed = speed;
+        m_controller.queueWheelCommand(command);
+    }
+
+    void setWheelProfile(unsigned int wheel, const std::vector<double>& times, const std::vector<double>& angles) {
+        checkWheel(wheel);
+        if (times.empty() || times.size() != angles.size())
+            throw std::invalid_argument("times and angles must be non-empty and of equal length");
+        WheelMotorCommand command;
+        command.wheel = wheel;
+        command.times = times;
+        command.angles = angles;
+        m_controller.queueWheelCommand(command);
+    }
+
+    const SimSnapshot& snapshot() const { return m_controller.snapshot(); }
+    int exitCode() const { return m_controller.exitCode(); }
+    bool finished() const { return !m_thread.joinable() || m_controller.state() == SimController::FINISHED; }
+
+    // Read-only view of `rows` x `cols` values at data, kept alive by owner
+    template <typename T>
+    static py::array view(const T* data, size_t rows, size_t cols, py::handle owner) {
+        if (rows == 0)
+            return py::array_t<T>(std::vector<size_t>{0, cols});
+        py::array_t<T> array({rows, cols}, {cols * sizeof(T), sizeof(T)}, data, owner);
+        array.attr("flags").attr("writeable") = false;
+        return array;
+    }
+
+  private:
+    void checkWheel(unsigned int wheel) const {
+        if (wheel + 1 >= snapshot().bodies.size())
+            throw py::index_error("no wheel " + std::to_string(wheel));
+    }
+
+    static bool s_active;
+    mutable SimController m_controller;
+    std::thread m_thread;
+    std::string m_temp_file;
+};
+
+bool PySimulation::s_active = false;
+
+PYBIND11_MODULE(rovertest_py, m) {
+    m.doc() = "In-process control of rovertest co-simulation runs";
+
+    py::class_<PySimulation>(m, "Simulation")
+        .def(py::init<py::object, const std::string&, double, bool, bool, const std::string&>(), py::arg("config"),
+             py::arg("checkpoint_file_base"), py::arg("gravity_angle") = 0.0, py::arg("particles") = true,
+             py::arg("particle_velocities") = false, py::arg("data_path") = "../data/",
+             "Start a run (mode 1) from a JSON dict or file and pause before its first step")
+        .def("step", &PySimulation::step, py::arg("steps") = 1,
+             "Advance by `steps` steps; False once the run has ended")
+        .def("set_wheel_speed", &PySimulation::setWheelSpeed, py::arg("wheel"), py::arg("speed"),
+             "Drive a wheel at `speed` rad/s from its current angle")
+        .def("set_wheel_profile", &PySimulation::setWheelProfile, py::arg("wheel"), py::arg("times"),
+             py::arg("angles"), "Drive a wheel along a piecewise linear angle profile (s, rad)")
+        .def("close", &PySimulation::close, "Stop the run and release its thread")
+        .def_property_readonly("time", [](const PySimulation& s) { return s.snapshot().time; })
+        .def_property_readonly("step_count", [](const PySimulation& s) { return s.snapshot().step; })
+        .def_property_readonly("finished", &PySimulation::finished)
+        .def_property_readonly("exit_code", &PySimulation::exitCode)
+        .def_property_readonly(
+            "bodies",
+            [](py::object self) {
+                const SimSnapshot& s = self.cast<const PySimulation&>().snapshot();
+                return PySimulation::view(s.bodies.empty() ? nullptr : s.bodies[0].pos, s.bodies.size(),
+                                          sizeof(CosimMeshState) / sizeof(double), self);
+            },
+            "Wheels then chassis: x, y, z, e0..e3, vx, vy, vz, wx, wy, wz")
+        .def_property_readonly(
+            "wheel_loads",
+            [](py::object self) {
+                const SimSnapshot& s = self.cast<const PySimulation&>().snapshot();
+                return PySimulation::view(s.loads.empty() ? nullptr : s.loads[0].force, s.loads.size(),
+                                          sizeof(CosimMeshLoad) / sizeof(double), self);
+            },
+            "Contact force and torque per wheel: fx, fy, fz, tx, ty, tz")
+        .def_property_readonly(
+            "particles",
+            [](py::object self) {
+                const SimSnapshot& s = self.cast<const PySimulation&>().snapshot();
+                return PySimulation::view(s.particle_pos.data(), s.particle_pos.size() / 3, 3, self);
+            },
+            "Particle positions (n, 3)")
+        .def_property_readonly(
+            "particle_velocities",
+            [](py::object self) {
+                const SimSnapshot& s = self.cast<const PySimulation&>().snapshot();
+                return PySimulation::view(s.particle_vel.data(), s.particle_vel.size() / 3, 3, self);
+            },
+            "Particle velocities (n, 3), when enabled");
+}
@@ -15,13 +15,20 @@
 // Chrono::Granular for granular terrain.
 // =============================================================================
 
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
 #include <iostream>
+#include <memory>
 #include <string>
+#include <type_traits>
 #include <vector>
 
 #include "chrono/core/ChTimer.h"
 #include "chrono/physics/ChBody.h"
 #include "chrono/physics/ChForce.h"
+#include "chrono/physics/ChLinkMotorLinearSpeed.h"
 #include "chrono/physics/ChLinkMotorRotationAngle.h"
 #include "chrono/physics/ChLinkMotorRotationSpeed.h"
 #include "chrono/physics/ChLinkMotorRotationTorque.h"
@@ -34,6 +41,24 @@
 #include "chrono_gpu/utils/ChGpuJsonParser.h"
 #include "chrono_thirdparty/filesystem/path.h"
 
+#include "CosimChannel.hpp"
+#include "Autotuner.hpp"
+#include "ColumnarExport.hpp"
+#include "CouplingPredictor.hpp"
+#include "FlightRecorder.hpp"
+#include "HostGranular.hpp"
+#include "HostJson.hpp"
+#include "IoGovernor.hpp"
+#include "LazyFrames.hpp"
+#include "MultiresSnapshot.hpp"
+#include "OutputFile.hpp"
+#include "RockObstacles.hpp"
+#include "SimControl.hpp"
+#include "SweepServer.hpp"
+#include "TaskGraph.hpp"
+#include "TerminationRules.hpp"
+#include "WheelTestbed.hpp"
+
 using namespace chrono;
 using namespace chrono::gpu;
 
@@ -41,6 +66,8 @@ constexpr double mars_grav_mag = 370;
 
 constexpr double time_settling = 1.0; // TODO
 constexpr double time_running = 10.0; // TODO
+// the chassis (or testbed carriage) is held above the bed until then
+constexpr double time_release = 0.5;
 
 constexpr double METERS_TO_CM = 100;
 constexpr double KG_TO_GRAM = 1000;
@@ -83,7 +110,23 @@ unsigned int out_fps = 50;
 
 double terrain_height_offset = 0;
 
-enum RUN_MODE { SETTLING = 0, TESTING = 1 };
+// TERRAIN_COSIM and ROVER_COSIM split TESTING into two processes that
+// exchange wheel states and contact loads every step over a CosimChannel
+// SWEEP runs the cases of a sweep file (in TESTING mode) from one process
+// that has loaded the checkpoint already; CALIBRATE does the same for short
+// trials that pick step_size and coupling_interval. REGENERATE re-simulates
+// frames of a lazy-output run from its sparse checkpoints. TESTBED runs one
+// wheel on a towed carriage in a narrow bin, once per slip (WheelTestbed.hpp).
+enum RUN_MODE {
+  SETTLING = 0,
+  TESTING = 1,
+  TERRAIN_COSIM = 2,
+  ROVER_COSIM = 3,
+  SWEEP = 4,
+  CALIBRATE = 5,
+  REGENERATE = 6,
+  TESTBED = 7
+};
 
 enum ROVER_BODY_ID {
   WHEEL_FRONT_LEFT,
@@ -93,6 +136,7 @@ enum ROVER_BODY_ID {
 };
 
 std::vector<std::shared_ptr<chrono::ChBody>> wheel_bodies;
+std::vector<std::shared_ptr<ChLinkMotorRotationAngle>> wheel_motors;
 
 std::vector<string> mesh_filenames;
 std::vector<ChMatrix33<float>> mesh_rotscales;
@@ -104,9 +148,13 @@ std::vector<float> mesh_masses;
 
 void ShowUsage(std::string name) {
   std::cout << "usage: " + name +
-                   " <json_file> <run_mode: 0-settling, 1-running> "
-                   "<checkpoint_file_base> <gravity "
-                   "angle (deg)>"
+                   " <json_file> <run_mode: 0-settling, 1-running, "
+                   "2-running terrain (co-sim), 3-running rover (co-sim), "
+                   "4-sweep, 5-calibrate, 6-regenerate, 7-single wheel "
+                   "testbed> "
+                   "<checkpoint_file_base> <gravity angle (deg)> [co-sim "
+                   "channel: name, shm:name or unix:path | sweep file | "
+                   "trial duration (s) | time or t0:t1 to regenerate]"
             << std::endl;
 }
 
@@ -173,6 +221,7 @@ void addWheelBody(ChSystemNSC &rover_sys, std::shared_ptr<ChBody> chassis_body,
 
   motor->SetMotorFunction(std::make_shared<ChFunction_Ramp>(0, CH_C_PI));
   rover_sys.AddLink(motor);
+  wheel_motors.push_back(motor);
 
   mesh_masses.push_back(wheel_mass);
   mesh_rotscales.push_back(wheel_scaling);
@@ -181,6 +230,147 @@ void addWheelBody(ChSystemNSC &rover_sys, std::shared_ptr<ChBody> chassis_body,
   wheel_bodies.push_back(wheel_body);
 }
 
+// Single-wheel testbed rig: a sled that the returned motor drives along x,
+// a carriage on a vertical prismatic joint to the sled, and the wheel on the
+// carriage. Wheel and carriage weigh the vertical load together.
+std::shared_ptr<ChLinkMotorLinearSpeed>
+addTestbedCarriage(ChSystemNSC &rover_sys, std::shared_ptr<ChBody> carriage,
+                   std::string wheel_filename, const ChVector<> &pos,
+                   double carriage_mass) {
+  ChVector<> inertia = carriage_mass * wheel_rad * wheel_rad / 6 *
+                       ChVector<>(1, 1, 1); // a wheel-sized cube
+  std::shared_ptr<ChBody> ground(rover_sys.NewBody());
+  ground->SetBodyFixed(true);
+  rover_sys.AddBody(ground);
+
+  std::shared_ptr<ChBody> sled(rover_sys.NewBody());
+  sled->SetMass(carriage_mass);
+  sled->SetInertiaXX(inertia);
+  sled->SetPos(pos);
+  rover_sys.AddBody(sled);
+
+  carriage->SetMass(carriage_mass);
+  carriage->SetInertiaXX(inertia);
+  carriage->SetPos(pos);
+  rover_sys.AddBody(carriage);
+
+  // the motor moves along the x axis of its frame and guides the sled
+  // like a prismatic joint; the prismatic joint slides along z
+  auto sled_motor = std::make_shared<ChLinkMotorLinearSpeed>();
+  sled_motor->Initialize(sled, ground, ChFrame<>(pos));
+  sled_motor->SetMotorFunction(std::make_shared<ChFunction_Const>(0));
+  rover_sys.AddLink(sled_motor);
+
+  auto slide = std::make_shared<ChLinkLockPrismatic>();
+  slide->Initialize(carriage, sled, ChCoordsys<>(pos, QUNIT));
+  rover_sys.AddLink(slide);
+
+  addWheelBody(rover_sys, carriage, wheel_filename, ChVector<>(0, 0, 0));
+  return sled_motor;
+}
+
+CosimMeshState packMeshState(const ChBody &body) {
+  const ChVector<> &pos = body.GetPos();
+  const ChQuaternion<> &rot = body.GetRot();
+  const ChVector<> &lin_vel = body.GetPos_dt();
+  const ChVector<> &ang_vel = body.GetWvel_par();
+  return {{pos.x(), pos.y(), pos.z()},
+          {rot.e0(), rot.e1(), rot.e2(), rot.e3()},
+          {lin_vel.x(), lin_vel.y(), lin_vel.z()},
+          {ang_vel.x(), ang_vel.y(), ang_vel.z()}};
+}
+
+// Linear then angular velocity, the layout LoadPredictor works with
+void meshVelocity(const CosimMeshState &state, double vel[6]) {
+  for (int k = 0; k < 3; k++) {
+    vel[k] = state.lin_vel[k];
+    vel[3 + k] = state.ang_vel[k];
+  }
+}
+
+void applyMeshState(ChSystemGpuMesh &gpu_sys, unsigned int mesh,
+                    const CosimMeshState &state) {
+  gpu_sys.ApplyMeshMotion(
+      mesh, ChVector<>(state.pos[0], state.pos[1], state.pos[2]),
+      ChQuaternion<>(state.rot[0], state.rot[1], state.rot[2], state.rot[3]),
+      ChVector<>(state.lin_vel[0], state.lin_vel[1], state.lin_vel[2]),
+      ChVector<>(state.ang_vel[0], state.ang_vel[1], state.ang_vel[2]));
+}
+
+CosimMeshLoad collectMeshLoad(ChSystemGpuMesh &gpu_sys, unsigned int mesh) {
+  ChVector<> force;
+  ChVector<> torque;
+  gpu_sys.CollectMeshContactForces(mesh, force, torque);
+  return {{force.x(), force.y(), force.z()},
+          {torque.x(), torque.y(), torque.z()}};
+}
+
+void applyMeshLoad(ChBody &body, const CosimMeshLoad &load) {
+  body.Empty_forces_accumulators();
+  body.Accumulate_force(
+      ChVector<>(load.force[0], load.force[1], load.force[2]), body.GetPos(),
+      false);
+  body.Accumulate_torque(
+      ChVector<>(load.torque[0], load.torque[1], load.torque[2]), false);
+}
+
+// Chassis pose and speed and the mean wheel slip, for the termination rules
+RoverProbe probeRover(const ChBody &chassis, double time) {
+  RoverProbe probe = {};
+  probe.time = time;
+  ChVector<> pos = chassis.GetPos();
+  ChVector<> up = chassis.GetRot().GetZaxis();
+  ChVector<> forward = chassis.GetRot().GetXaxis();
+  for (int k = 0; k < 3; k++) {
+    probe.pos[k] = pos[k];
+    probe.up[k] = up[k];
+  }
+  probe.speed = chassis.GetPos_dt() ^ forward;
+
+  // the axles are the body y axes of the wheels and the chassis
+  double chassis_rate = chassis.GetWvel_loc().y();
+  double slip = 0;
+  for (const auto &wheel : wheel_bodies) {
+    double rim_speed =
+        std::abs(wheel->GetWvel_loc().y() - chassis_rate) * wheel_rad;
+    if (rim_speed > 1e-9)
+      slip += std::max(0., std::min(1., 1 - std::abs(probe.speed) / rim_speed));
+  }
+  probe.slip = wheel_bodies.empty() ? 0 : slip / wheel_bodies.size();
+  return probe;
+}
+
+void restoreBodyState(ChBody &body, const CosimMeshState &state) {
+  body.SetPos(ChVector<>(state.pos[0], state.pos[1], state.pos[2]));
+  body.SetRot(
+      ChQuaternion<>(state.rot[0], state.rot[1], state.rot[2], state.rot[3]));
+  body.SetPos_dt(
+      ChVector<>(state.lin_vel[0], state.lin_vel[1], state.lin_vel[2]));
+  body.SetWvel_par(
+      ChVector<>(state.ang_vel[0], state.ang_vel[1], state.ang_vel[2]));
+}
+
+// Replace a wheel's motor function, keeping its angle continuous at `time`
+// for a constant speed command
+bool applyWheelCommand(const WheelMotorCommand &command, double time) {
+  if (command.wheel >= wheel_motors.size()) {
+    std::cout << "ERROR no wheel " << command.wheel << std::endl;
+    return false;
+  }
+  ChLinkMotorRotationAngle &motor = *wheel_motors[command.wheel];
+  if (command.times.empty()) {
+    double angle = motor.GetMotorFunction()->Get_y(time);
+    motor.SetMotorFunction(std::make_shared<ChFunction_Ramp>(
+        angle - command.speed * time, command.speed));
+  } else {
+    auto profile = std::make_shared<ChFunction_Recorder>();
+    for (size_t i = 0; i < command.times.size(); i++)
+      profile->AddPoint(command.times[i], command.angles[i]);
+    motor.SetMotorFunction(profile);
+  }
+  return true;
+}
+
 void writeMeshFrames(std::ostringstream &outstream,
                      std::shared_ptr<ChBody> body, std::string obj_name,
                      ChMatrix33<float> mesh_scaling) {
@@ -224,23 +414,151 @@ void writeMeshFrames(std::ostringstream &outstream,
   outstream << "\n";
 }
 
-int main(int argc, char *argv[]) {
-  gpu::SetDataPath("../data/");
+// Predictor and energy monitor state, for lazy checkpoints
+std::vector<char>
+packCouplingState(const std::vector<LoadPredictor> &predictors,
+                  const std::vector<CouplingEnergyMonitor> &monitors) {
+  static_assert(std::is_trivially_copyable<LoadPredictor>::value &&
+                    std::is_trivially_copyable<CouplingEnergyMonitor>::value,
+                "coupling state is stored as raw bytes");
+  size_t predictor_bytes = predictors.size() * sizeof(LoadPredictor);
+  size_t monitor_bytes = monitors.size() * sizeof(CouplingEnergyMonitor);
+  std::vector<char> bytes(predictor_bytes + monitor_bytes);
+  std::memcpy(bytes.data(), predictors.data(), predictor_bytes);
+  std::memcpy(bytes.data() + predictor_bytes, monitors.data(), monitor_bytes);
+  return bytes;
+}
+
+bool unpackCouplingState(const std::vector<char> &bytes,
+                         std::vector<LoadPredictor> &predictors,
+                         std::vector<CouplingEnergyMonitor> &monitors) {
+  size_t predictor_bytes = predictors.size() * sizeof(LoadPredictor);
+  size_t monitor_bytes = monitors.size() * sizeof(CouplingEnergyMonitor);
+  if (bytes.size() != predictor_bytes + monitor_bytes)
+    return false;
+  std::memcpy(predictors.data(), bytes.data(), predictor_bytes);
+  std::memcpy(monitors.data(), bytes.data() + predictor_bytes, monitor_bytes);
+  return true;
+}
 
+// Everything one run needs from the command line and the JSON file
+struct RunOptions {
   ChGpuSimulationParameters params;
-  if (argc != 5 || ParseJSON(gpu::GetDataFile(argv[1]), params) == false) {
-    ShowUsage(argv[0]);
-    return 1;
+  RUN_MODE run_mode;
+  std::string checkpoint_file_base;
+  double grav_angle_deg;
+  std::string cosim_channel;
+  // Coupling settings that ChGpuSimulationParameters has no field for
+  unsigned int coupling_interval;
+  PredictorType coupling_predictor;
+  // Calibration trials: a shorter run without frame output that hands a
+  // TrialReport back to the calibration process
+  double time_end = 0; // 0 for the run mode's default
+  bool calibration_trial = false;
+  // The chassis is held fixed until this time
+  double release_time = time_release;
+  // Early termination rules (stop_* keys)
+  TerminationSettings termination;
+  // Event-triggered high-rate capture (recorder_* keys)
+  RecorderSettings recorder;
+  // Lazy frame output: full-state checkpoints every lazy_checkpoint_interval
+  // seconds instead of particle frames
+  bool lazy_frames = false;
+  double lazy_checkpoint_interval = 1.0;
+  // Particle frames in octree-level order (MultiresSnapshot.hpp) instead of
+  // WriteFile output
+  bool multires_frames = false;
+  // Particle frames as Parquet, and rover telemetry as an Arrow IPC stream
+  bool parquet_frames = false;
+  bool arrow_telemetry = false;
+  // Regeneration of frames [regen_first_frame, regen_last_frame] from a
+  // lazy checkpoint
+  const LazyCheckpoint *regen_state = nullptr;
+  unsigned int regen_first_frame = 0;
+  unsigned int regen_last_frame = 0;
+  // Particle output limits (io_* keys)
+  IoBudget io_budget;
+  // In-process control (Python bindings): the loop pauses when the
+  // controller asks and publishes its state (run mode 1 only)
+  SimController *controller = nullptr;
+  // Static rocks (rocks_file, as terrain_gen writes it), instances of
+  // rock_shapes generated shapes
+  std::string rocks_file;
+  unsigned int rock_shapes = 4;
+  // Single-wheel testbed (testbed_* keys); the slip of this run
+  TestbedSettings testbed;
+  double testbed_slip = 0;
+};
+
+// Apply one sweep-case override by JSON key name
+bool applyOverride(RunOptions &options, const std::string &key,
+                   const std::string &value) {
+  ChGpuSimulationParameters &params = options.params;
+  double number = std::atof(value.c_str());
+#define OVERRIDE_PARAM(name)                                                   \
+  if (key == #name) {                                                          \
+    params.name = number;                                                      \
+    return true;                                                               \
+  }
+  OVERRIDE_PARAM(step_size)
+  OVERRIDE_PARAM(normalStiffS2S)
+  OVERRIDE_PARAM(normalStiffS2W)
+  OVERRIDE_PARAM(normalStiffS2M)
+  OVERRIDE_PARAM(normalDampS2S)
+  OVERRIDE_PARAM(normalDampS2W)
+  OVERRIDE_PARAM(normalDampS2M)
+  OVERRIDE_PARAM(tangentStiffS2S)
+  OVERRIDE_PARAM(tangentStiffS2W)
+  OVERRIDE_PARAM(tangentStiffS2M)
+  OVERRIDE_PARAM(tangentDampS2S)
+  OVERRIDE_PARAM(tangentDampS2W)
+  OVERRIDE_PARAM(tangentDampS2M)
+  OVERRIDE_PARAM(static_friction_coeffS2S)
+  OVERRIDE_PARAM(static_friction_coeffS2W)
+  OVERRIDE_PARAM(static_friction_coeffS2M)
+  OVERRIDE_PARAM(cohesion_ratio)
+  OVERRIDE_PARAM(adhesion_ratio_s2w)
+  OVERRIDE_PARAM(adhesion_ratio_s2m)
+#undef OVERRIDE_PARAM
+  if (options.termination.set(key, number) ||
+      options.recorder.set(key, number) || options.io_budget.set(key, number))
+    return true;
+  if (key == "output_dir") {
+    params.output_dir = value;
+  } else if (key == "gravity_angle") {
+    options.grav_angle_deg = number;
+  } else if (key == "coupling_interval") {
+    options.coupling_interval = (unsigned int)std::max(1., number);
+  } else if (key == "coupling_predictor") {
+    return parsePredictorType(value, options.coupling_predictor);
+  } else {
+    return false;
   }
+  return true;
+}
+
+// One simulation. preloaded_bed, when given, replaces reading the checkpoint.
+int runSimulation(RunOptions options,
+                  const ReadOnlyBuffer<ChVector<float>> *preloaded_bed) {
+  ChGpuSimulationParameters &params = options.params;
   std::string chassis_filename =
       gpu::GetDataFile("meshes/MER_body.obj"); // For output only
   std::string wheel_filename = gpu::GetDataFile("meshes/wheel_scaled.obj");
 
-  RUN_MODE run_mode = (RUN_MODE)std::atoi(argv[2]);
-  std::string checkpoint_file_base = std::string(argv[3]);
+  RUN_MODE run_mode = options.run_mode;
+  const std::string &checkpoint_file_base = options.checkpoint_file_base;
+  const std::string &cosim_channel = options.cosim_channel;
+  unsigned int coupling_interval = options.coupling_interval;
+  PredictorType coupling_predictor = options.coupling_predictor;
+
+  // Which halves of the co-simulation run in this process
+  bool runs_terrain = run_mode != RUN_MODE::ROVER_COSIM;
+  bool runs_rover = run_mode != RUN_MODE::TERRAIN_COSIM;
+  bool settling = run_mode == RUN_MODE::SETTLING;
+  bool testbed = run_mode == RUN_MODE::TESTBED;
 
   // Rotates gravity about +Y axis
-  double input_grav_angle_deg = std::stod(argv[4]);
+  double input_grav_angle_deg = options.grav_angle_deg;
   double grav_angle = 2.0 * CH_C_PI * input_grav_angle_deg / 360.0;
 
   double Gx = -mars_grav_mag * std::sin(grav_angle);
@@ -252,221 +570,905 @@ int main(int argc, char *argv[]) {
 
   double iteration_step = params.step_size;
 
-  // Setup granular simulation
-  ChSystemGpuMesh gpu_sys(
-      params.sphere_radius, params.sphere_density,
-      make_float3(params.box_X, params.box_Y, params.box_Z));
-
-  double fill_bottom = 0; // TODO
-  double fill_top = params.box_Z / 2.0;
-
-  // leave a 4cm margin at edges of sampling
-  ChVector<> hdims(params.box_X / 2 - 2.0, params.box_Y / 2 - 2.0,
-                   std::abs((fill_bottom - fill_top) / 2.) - 2.0);
-  ChVector<> center(0, 0, (fill_bottom + fill_top) / 2.);
+  // Startup runs as a task graph: reading the checkpoint (or sampling the
+  // bed), building the rover model and opening the co-sim channel overlap
+  // with setting up the granular system. Tasks that touch gpu_sys form one
+  // chain, and creating and initializing it stays on this thread.
+  TaskGraph startup;
 
+  // Setup granular simulation (not needed by the rover co-sim process)
+  std::unique_ptr<ChSystemGpuMesh> gpu_sys;
   std::vector<ChVector<float>> body_points;
-  if (run_mode == RUN_MODE::SETTLING) {
-    body_points = utils::PDLayerSampler_BOX<float>(
-        center, hdims, 2. * params.sphere_radius, 1.01);
-  } else if (run_mode == RUN_MODE::TESTING) {
-    body_points = loadCheckpointFile(checkpoint_file_base + ".csv");
+  TaskGraph::TaskId create_terrain = 0, read_bed = 0;
+  if (runs_terrain) {
+    create_terrain = startup.add(
+        "create granular system",
+        [&]() {
+          gpu_sys.reset(new ChSystemGpuMesh(
+              params.sphere_radius, params.sphere_density,
+              make_float3(params.box_X, params.box_Y, params.box_Z)));
+
+          gpu_sys->SetBDFixed(true);
+
+          gpu_sys->SetKn_SPH2SPH(params.normalStiffS2S);
+          gpu_sys->SetKn_SPH2WALL(params.normalStiffS2W);
+          gpu_sys->SetKn_SPH2MESH(params.normalStiffS2M);
+
+          gpu_sys->SetGn_SPH2SPH(params.normalDampS2S);
+          gpu_sys->SetGn_SPH2WALL(params.normalDampS2W);
+          gpu_sys->SetGn_SPH2MESH(params.normalDampS2M);
+
+          gpu_sys->SetKt_SPH2SPH(params.tangentStiffS2S);
+          gpu_sys->SetKt_SPH2WALL(params.tangentStiffS2W);
+          gpu_sys->SetKt_SPH2MESH(params.tangentStiffS2M);
+
+          gpu_sys->SetGt_SPH2SPH(params.tangentDampS2S);
+          gpu_sys->SetGt_SPH2WALL(params.tangentDampS2W);
+          gpu_sys->SetGt_SPH2MESH(params.tangentDampS2M);
+
+          gpu_sys->SetCohesionRatio(params.cohesion_ratio);
+          gpu_sys->SetAdhesionRatio_SPH2MESH(params.adhesion_ratio_s2m);
+          gpu_sys->SetAdhesionRatio_SPH2WALL(params.adhesion_ratio_s2w);
+          gpu_sys->SetGravitationalAcceleration(ChVector<>(Gx, Gy, Gz));
+
+          gpu_sys->SetFixedStepSize(params.step_size);
+          gpu_sys->SetFrictionMode(CHGPU_FRICTION_MODE::MULTI_STEP);
+          gpu_sys->SetTimeIntegrator(
+              CHGPU_TIME_INTEGRATOR::CENTERED_DIFFERENCE);
+          gpu_sys->SetStaticFrictionCoeff_SPH2SPH(
+              params.static_friction_coeffS2S);
+          gpu_sys->SetStaticFrictionCoeff_SPH2WALL(
+              params.static_friction_coeffS2W);
+          gpu_sys->SetStaticFrictionCoeff_SPH2MESH(
+              params.static_friction_coeffS2M);
+        },
+        {}, true);
+
+    read_bed = startup.add(
+        settling               ? "sample bed"
+        : options.regen_state  ? "copy lazy checkpoint"
+        : preloaded_bed        ? "copy preloaded checkpoint"
+                               : "read checkpoint",
+        [&]() {
+          double fill_bottom = 0; // TODO
+          double fill_top = params.box_Z / 2.0;
+
+          // leave a 4cm margin at edges of sampling
+          ChVector<> hdims(params.box_X / 2 - 2.0, params.box_Y / 2 - 2.0,
+                           std::abs((fill_bottom - fill_top) / 2.) - 2.0);
+          ChVector<> center(0, 0, (fill_bottom + fill_top) / 2.);
+
+          if (settling) {
+            body_points = utils::PDLayerSampler_BOX<float>(
+                center, hdims, 2. * params.sphere_radius, 1.01);
+          } else if (options.regen_state) {
+            const std::vector<float> &pos = options.regen_state->pos;
+            for (size_t i = 0; i + 2 < pos.size(); i += 3)
+              body_points.emplace_back(pos[i], pos[i + 1], pos[i + 2]);
+          } else if (preloaded_bed) {
+            body_points.assign(preloaded_bed->begin(), preloaded_bed->end());
+          } else {
+            body_points = loadCheckpointFile(checkpoint_file_base + ".csv");
+          }
+        });
   }
 
-  gpu_sys.SetParticlePositions(body_points);
-
-  gpu_sys.SetBDFixed(true);
-
-  gpu_sys.SetKn_SPH2SPH(params.normalStiffS2S);
-  gpu_sys.SetKn_SPH2WALL(params.normalStiffS2W);
-  gpu_sys.SetKn_SPH2MESH(params.normalStiffS2M);
-
-  gpu_sys.SetGn_SPH2SPH(params.normalDampS2S);
-  gpu_sys.SetGn_SPH2WALL(params.normalDampS2W);
-  gpu_sys.SetGn_SPH2MESH(params.normalDampS2M);
-
-  gpu_sys.SetKt_SPH2SPH(params.tangentStiffS2S);
-  gpu_sys.SetKt_SPH2WALL(params.tangentStiffS2W);
-  gpu_sys.SetKt_SPH2MESH(params.tangentStiffS2M);
-
-  gpu_sys.SetGt_SPH2SPH(params.tangentDampS2S);
-  gpu_sys.SetGt_SPH2WALL(params.tangentDampS2W);
-  gpu_sys.SetGt_SPH2MESH(params.tangentDampS2M);
-
-  gpu_sys.SetCohesionRatio(params.cohesion_ratio);
-  gpu_sys.SetAdhesionRatio_SPH2MESH(params.adhesion_ratio_s2m);
-  gpu_sys.SetAdhesionRatio_SPH2WALL(params.adhesion_ratio_s2w);
-  gpu_sys.SetGravitationalAcceleration(ChVector<>(Gx, Gy, Gz));
-
-  gpu_sys.SetFixedStepSize(params.step_size);
-  gpu_sys.SetFrictionMode(CHGPU_FRICTION_MODE::MULTI_STEP);
-  gpu_sys.SetTimeIntegrator(CHGPU_TIME_INTEGRATOR::CENTERED_DIFFERENCE);
-  gpu_sys.SetStaticFrictionCoeff_SPH2SPH(params.static_friction_coeffS2S);
-  gpu_sys.SetStaticFrictionCoeff_SPH2WALL(params.static_friction_coeffS2W);
-  gpu_sys.SetStaticFrictionCoeff_SPH2MESH(params.static_friction_coeffS2M);
-
-  // Create rigid wheel simulation
+  // Create rigid wheel simulation. The terrain co-sim process builds it too,
+  // for the mesh list, but never steps it.
   ChSystemNSC rover_sys;
-
-  // rover_sys.SetMaxItersSolverSpeed(200);
-
-  // rover_sys.SetContactForceModel(ChSystemNSC::ContactForceModel::Hooke);
-  // rover_sys.SetTimestepperType(ChTimestepper::Type::EULER_EXPLICIT);
-  rover_sys.Set_G_acc(ChVector<>(Gx, Gy, Gz));
-
-  std::shared_ptr<ChBody> chassis_body(rover_sys.NewBody());
+  std::shared_ptr<ChBody> chassis_body;
 
   double height_offset_chassis_to_bottom =
       std::abs(wheel_offset_z) + 2 * wheel_rad; // TODO
   double init_offset_x = -params.box_X / 4;
-  // start well above the terrain
-  terrain_height_offset = params.box_Z + height_offset_chassis_to_bottom;
+  // start well above the terrain. The testbed rig is placed on the bed in
+  // the terrain frame already, so its frames need no offset.
+  terrain_height_offset =
+      testbed ? 0 : params.box_Z + height_offset_chassis_to_bottom;
 
   bool chassis_fixed = true;
-  chassis_body->SetMass(chassis_mass);
-  // assume it's a solid box inertially
-  chassis_body->SetInertiaXX(ChVector<>((chassis_length_y * chassis_length_y +
-                                         chassis_length_z * chassis_length_z) *
-                                            chassis_mass / 12,
-                                        (chassis_length_x * chassis_length_x +
-                                         chassis_length_z * chassis_length_z) *
-                                            chassis_mass / 12,
-                                        (chassis_length_x * chassis_length_x +
-                                         chassis_length_y * chassis_length_y) *
-                                            chassis_mass / 12));
-  chassis_body->SetPos(ChVector<>(init_offset_x, 0, 0));
-  rover_sys.AddBody(chassis_body);
-
-  chassis_body->SetBodyFixed(true);
-
-  // NOTE these must happen before the gran system loads meshes!!!
-  // two wheels at front
-  addWheelBody(
-      rover_sys, chassis_body, wheel_filename,
-      ChVector<>(front_wheel_offset_x, front_wheel_offset_y, wheel_offset_z));
-  addWheelBody(
-      rover_sys, chassis_body, wheel_filename,
-      ChVector<>(front_wheel_offset_x, -front_wheel_offset_y, wheel_offset_z));
-
-  // two wheels at back
-  addWheelBody(
-      rover_sys, chassis_body, wheel_filename,
-      ChVector<>(middle_wheel_offset_x, middle_wheel_offset_y, wheel_offset_z));
-  addWheelBody(rover_sys, chassis_body, wheel_filename,
-               ChVector<>(middle_wheel_offset_x, -middle_wheel_offset_y,
-                          wheel_offset_z));
-
-  // two wheels in middle of chassis
-  addWheelBody(
-      rover_sys, chassis_body, wheel_filename,
-      ChVector<>(rear_wheel_offset_x, rear_wheel_offset_y, wheel_offset_z));
-  addWheelBody(
-      rover_sys, chassis_body, wheel_filename,
-      ChVector<>(rear_wheel_offset_x, -rear_wheel_offset_y, wheel_offset_z));
-
-  // Load in meshes
-  gpu_sys.LoadMeshes(mesh_filenames, mesh_rotscales, mesh_translations,
-                     mesh_masses);
-
-  gpu_sys.SetOutputMode(params.write_mode);
-  gpu_sys.SetVerbosity(params.verbose);
-
-  // change the output directory
-  std::string out_dir = "../";
-  filesystem::create_directory(filesystem::path(out_dir));
-  out_dir = out_dir + params.output_dir;
-  filesystem::create_directory(filesystem::path(out_dir));
 
-  unsigned int nSoupFamilies = gpu_sys.GetNumMeshes();
-  std::cout << nSoupFamilies << " soup families" << std::endl;
+  TaskGraph::TaskId build_rover = startup.add("build rover model", [&]() {
+    // rover_sys.SetMaxItersSolverSpeed(200);
+
+    // rover_sys.SetContactForceModel(ChSystemNSC::ContactForceModel::Hooke);
+    // rover_sys.SetTimestepperType(ChTimestepper::Type::EULER_EXPLICIT);
+    rover_sys.Set_G_acc(ChVector<>(Gx, Gy, Gz));
+
+    chassis_body.reset(rover_sys.NewBody());
+    if (testbed)
+      return; // the testbed rig is built once the bed is read
+
+    chassis_body->SetMass(chassis_mass);
+    // assume it's a solid box inertially
+    chassis_body->SetInertiaXX(
+        ChVector<>((chassis_length_y * chassis_length_y +
+                    chassis_length_z * chassis_length_z) *
+                       chassis_mass / 12,
+                   (chassis_length_x * chassis_length_x +
+                    chassis_length_z * chassis_length_z) *
+                       chassis_mass / 12,
+                   (chassis_length_x * chassis_length_x +
+                    chassis_length_y * chassis_length_y) *
+                       chassis_mass / 12));
+    chassis_body->SetPos(ChVector<>(init_offset_x, 0, 0));
+    rover_sys.AddBody(chassis_body);
+
+    chassis_body->SetBodyFixed(true);
+
+    // NOTE these must happen before the gran system loads meshes!!!
+    // two wheels at front
+    addWheelBody(
+        rover_sys, chassis_body, wheel_filename,
+        ChVector<>(front_wheel_offset_x, front_wheel_offset_y, wheel_offset_z));
+    addWheelBody(rover_sys, chassis_body, wheel_filename,
+                 ChVector<>(front_wheel_offset_x, -front_wheel_offset_y,
+                            wheel_offset_z));
+
+    // two wheels at back
+    addWheelBody(rover_sys, chassis_body, wheel_filename,
+                 ChVector<>(middle_wheel_offset_x, middle_wheel_offset_y,
+                            wheel_offset_z));
+    addWheelBody(rover_sys, chassis_body, wheel_filename,
+                 ChVector<>(middle_wheel_offset_x, -middle_wheel_offset_y,
+                            wheel_offset_z));
+
+    // two wheels in middle of chassis
+    addWheelBody(
+        rover_sys, chassis_body, wheel_filename,
+        ChVector<>(rear_wheel_offset_x, rear_wheel_offset_y, wheel_offset_z));
+    addWheelBody(
+        rover_sys, chassis_body, wheel_filename,
+        ChVector<>(rear_wheel_offset_x, -rear_wheel_offset_y, wheel_offset_z));
+  });
+
+  // Testbed rig: the chassis body is the carriage, placed so the wheel starts
+  // a particle diameter above the bed surface along its track
+  TestbedLog testbed_log(options.testbed_slip, options.release_time,
+                         options.testbed.steady_share);
+  std::shared_ptr<ChLinkMotorLinearSpeed> sled_motor;
+  double surface_z = 0;
+  double carriage_speed = carriageSpeed(
+      options.testbed_slip, options.testbed.wheel_speed, wheel_rad);
+  if (testbed) {
+    build_rover = startup.add(
+        "build testbed rig",
+        [&]() {
+          double x0 = options.testbed.startX(wheel_rad);
+          TrackSurface surface(x0 - wheel_rad,
+                               x0 + options.testbed.travel(wheel_rad) +
+                                   wheel_rad,
+                               wheel_width / 2, 2 * params.sphere_radius);
+          for (const auto &p : body_points)
+            surface.add(p.x(), p.y(), p.z(), params.sphere_radius);
+          surface_z = surface.height();
+          ChVector<> pos(x0, 0,
+                         surface_z + wheel_rad + 2 * params.sphere_radius);
+          sled_motor = addTestbedCarriage(
+              rover_sys, chassis_body, wheel_filename, pos,
+              options.testbed.carriageMass(Gz, wheel_mass));
+          wheel_motors.back()->SetMotorFunction(
+              std::make_shared<ChFunction_Ramp>(
+                  0, options.testbed.wheel_speed));
+          chassis_body->SetBodyFixed(true);
+        },
+        {read_bed, build_rover});
+  }
 
-  gpu_sys.Initialize();
+  // Static rocks: the wheels collide with the instanced field on the host,
+  // and the granular system gets all rocks as one extra mesh after the
+  // wheels, placed once and never moved
+  RockField rocks;
+  TriangleMesh wheel_local;
+  std::string rocks_mesh_file;
+  bool rocks_failed = false;
+  TaskGraph::TaskId build_rocks = startup.add("build rock field", [&]() {
+    if (options.rocks_file.empty())
+      return;
+    std::vector<Rock> rock_list;
+    if (!loadRocks(options.rocks_file, rock_list) ||
+        !rockFieldFromRocks(rock_list, {}, options.rock_shapes, 1, rocks) ||
+        !loadObjMesh(wheel_filename, wheel_local)) {
+      rocks_failed = true;
+      return;
+    }
+    // the scaling LoadMeshes applies to the wheels
+    const float d = (float)(2 * wheel_rad), w = (float)wheel_width;
+    const float wheel_rotscale[9] = {d, 0, 0, 0, w, 0, 0, 0, d};
+    transformMesh(wheel_local, wheel_rotscale, {0, 0, 0});
+    if (runs_terrain) {
+      rocks_mesh_file = checkpoint_file_base + "_rocks.obj";
+      rocks_failed = !writeObjMesh(rocks_mesh_file, rocks.flatten());
+    }
+  });
+
+  startup.add("create output directories", [&]() {
+    // change the output directory, one level at a time
+    std::string out_dir = "../";
+    filesystem::create_directory(filesystem::path(out_dir));
+    size_t level = 0;
+    do {
+      level = params.output_dir.find('/', level + 1);
+      filesystem::create_directory(
+          filesystem::path(out_dir + params.output_dir.substr(0, level)));
+    } while (level != std::string::npos);
+  });
+
+  if (runs_terrain) {
+    TaskGraph::TaskId load_meshes = startup.add(
+        "load meshes",
+        [&]() {
+          if (!rocks_mesh_file.empty()) {
+            mesh_filenames.push_back(rocks_mesh_file);
+            mesh_rotscales.push_back(
+                ChMatrix33<float>(ChVector<float>(1, 1, 1)));
+            mesh_translations.push_back(make_float3(0, 0, 0));
+            mesh_masses.push_back(1);
+          }
+          gpu_sys->LoadMeshes(mesh_filenames, mesh_rotscales,
+                              mesh_translations, mesh_masses);
+        },
+        {create_terrain, build_rover, build_rocks});
+
+    TaskGraph::TaskId set_positions = startup.add(
+        "set particle positions",
+        [&]() {
+          if (!options.regen_state) {
+            gpu_sys->SetParticlePositions(body_points);
+            return;
+          }
+          // resume with the checkpointed velocities too
+          const LazyCheckpoint &state = *options.regen_state;
+          std::vector<ChVector<float>> vel, ang_vel;
+          for (size_t i = 0; i + 2 < state.vel.size(); i += 3) {
+            vel.emplace_back(state.vel[i], state.vel[i + 1], state.vel[i + 2]);
+            ang_vel.emplace_back(state.ang_vel[i], state.ang_vel[i + 1],
+                                 state.ang_vel[i + 2]);
+          }
+          gpu_sys->SetParticlePositions(body_points, vel, ang_vel);
+        },
+        {read_bed, load_meshes});
+
+    startup.add(
+        "initialize granular system",
+        [&]() {
+          gpu_sys->SetOutputMode(params.write_mode);
+          gpu_sys->SetVerbosity(params.verbose);
+
+          unsigned int nSoupFamilies = gpu_sys->GetNumMeshes();
+          std::cout << nSoupFamilies << " soup families" << std::endl;
+
+          gpu_sys->Initialize();
+          // the rock mesh keeps this pose for the whole run
+          if (!rocks_mesh_file.empty())
+            gpu_sys->ApplyMeshMotion(
+                (unsigned int)wheel_bodies.size(), ChVector<>(0, 0, 0),
+                ChQuaternion<>(1, 0, 0, 0), ChVector<>(0, 0, 0),
+                ChVector<>(0, 0, 0));
+        },
+        {set_positions}, true);
+  }
+
+  std::unique_ptr<CosimChannel> channel;
+  if (run_mode == RUN_MODE::TERRAIN_COSIM ||
+      run_mode == RUN_MODE::ROVER_COSIM) {
+    // waits for the peer process, so let it overlap the rest of startup
+    startup.add(
+        "open co-sim channel",
+        [&]() {
+          CosimRole role =
+              runs_terrain ? CosimRole::TERRAIN : CosimRole::ROVER;
+          channel = openCosimChannel(cosim_channel, role, wheel_bodies.size());
+        },
+        {build_rover});
+  }
+
+  // at least one thread per independent branch, even on a small machine:
+  // the branches mostly wait on files and the peer process
+  startup.run(std::max(hostThreadCount(), 4u));
+  startup.printReport();
+
+  if (testbed && !std::isfinite(surface_z)) {
+    std::cout << "ERROR no bed under the testbed wheel track" << std::endl;
+    return 1;
+  }
+  if (rocks_failed) {
+    std::cout << "ERROR reading rocks file " << options.rocks_file
+              << std::endl;
+    return 1;
+  }
+  if (rocks.numInstances() > 0)
+    printf("%zu rocks, instances of %zu shapes (%.2f MB)\n",
+           rocks.numInstances(), rocks.numShapes(),
+           rocks.memoryBytes() / 1e6);
+  const ContactCoefficients rock_contact = {
+      (float)params.normalStiffS2M, (float)params.normalDampS2M,
+      (float)params.tangentStiffS2M, (float)params.tangentDampS2M,
+      (float)params.static_friction_coeffS2M};
+
+  if (channel) {
+    std::cout << "Co-simulating over " << channel->name() << " channel "
+              << cosim_channel << std::endl;
+  } else if (run_mode == RUN_MODE::TERRAIN_COSIM ||
+             run_mode == RUN_MODE::ROVER_COSIM) {
+    std::cout << "ERROR opening co-sim channel " << cosim_channel << std::endl;
+    return 1;
+  }
 
   std::cout << "Rendering at " << out_fps << "FPS" << std::endl;
+  std::cout << "Exchanging loads every " << coupling_interval
+            << " steps, " << predictorName(coupling_predictor)
+            << " predictor" << std::endl;
 
   unsigned int out_steps = 1 / (out_fps * iteration_step);
 
   int currframe = 0;
   unsigned int curr_step = 0;
 
-  if (run_mode == RUN_MODE::SETTLING) {
-    gpu_sys.EnableMeshCollision(false);
+  if (settling) {
+    gpu_sys->EnableMeshCollision(false);
     params.time_end = time_settling;
-  } else if (run_mode == RUN_MODE::TESTING) {
-    gpu_sys.EnableMeshCollision(true);
+  } else {
+    if (gpu_sys)
+      gpu_sys->EnableMeshCollision(true);
     params.time_end = time_running;
   }
+  if (options.time_end > 0)
+    params.time_end = options.time_end;
+
+  if (testbed) {
+    printf("Testbed: slip %.3f, carriage at %f cm/s, wheel load %f "
+           "(carriage mass %f g)\n",
+           options.testbed_slip, carriage_speed, options.testbed.load,
+           options.testbed.carriageMass(Gz, wheel_mass));
+  } else {
+    printf("Chassis mass: %f g, each wheel mass: %f g\n", chassis_mass,
+           wheel_mass);
+    printf("Total Chassis Mars weight in CGS: %f\n",
+           std::abs((chassis_mass + 4 * wheel_mass) * mars_grav_mag));
+  }
 
-  printf("Chassis mass: %f g, each wheel mass: %f g\n", chassis_mass,
-         wheel_mass);
-  printf("Total Chassis Mars weight in CGS: %f\n",
-         std::abs((chassis_mass + 4 * wheel_mass) * mars_grav_mag));
+  // Number of steps the time loop below takes
+  unsigned int num_steps = 0;
+  for (float t = 0; t < params.time_end; t += iteration_step)
+    num_steps++;
+
+  SweepServer::workerReady();
+
+  std::vector<CosimMeshState> mesh_states(wheel_bodies.size());
+  std::vector<CosimMeshLoad> mesh_loads(wheel_bodies.size());
+  std::vector<LoadPredictor> load_predictors(wheel_bodies.size(),
+                                             LoadPredictor(coupling_predictor));
+  std::vector<CouplingEnergyMonitor> coupling_energy(wheel_bodies.size());
+  CosimHeader header = {};
+  bool query_terrain_top = false;
+
+  // Lazy output needs the whole coupled state in one process. Checkpoints
+  // fall on frame steps that start an exchange, so a regenerated segment
+  // replays the same exchanges and writes the same frame numbers; it
+  // differs from the original run only through the tangential contact
+  // history, which ChSystemGpu cannot restore.
+  const LazyCheckpoint *regen = options.regen_state;
+  bool lazy = options.lazy_frames && run_mode == RUN_MODE::TESTING &&
+              !options.calibration_trial && !regen;
+  if (options.lazy_frames && !lazy && !regen && !settling)
+    std::cout << "Lazy frame output needs run mode 1, writing all frames"
+              << std::endl;
+  std::string lazy_dir = "../" + params.output_dir + "/lazy";
+  float next_checkpoint_time = 0;
+  if (lazy) {
+    filesystem::create_directory(filesystem::path(lazy_dir));
+    std::remove((lazy_dir + "/index.csv").c_str());
+  }
+
+  float start_time = 0;
+  if (regen) {
+    if (regen->bodies.size() != wheel_bodies.size() + 1 ||
+        regen->numParticles() != gpu_sys->GetNumParticles() ||
+        !unpackCouplingState(regen->coupling, load_predictors,
+                             coupling_energy)) {
+      std::cout << "ERROR lazy checkpoint does not match this setup"
+                << std::endl;
+      return 1;
+    }
+    for (unsigned int i = 0; i < wheel_bodies.size(); i++)
+      restoreBodyState(*wheel_bodies[i], regen->bodies[i]);
+    restoreBodyState(*chassis_body, regen->bodies.back());
+    chassis_fixed = regen->flags & LAZY_CHASSIS_FIXED;
+    chassis_body->SetBodyFixed(chassis_fixed);
+    query_terrain_top = regen->flags & LAZY_QUERY_TERRAIN_TOP;
+    terrain_height_offset = regen->terrain_height_offset;
+    rover_sys.SetChTime(regen->time);
+    start_time = regen->time;
+    curr_step = regen->step;
+    currframe = regen->frame;
+    std::cout << "Regenerating frames " << options.regen_first_frame << " to "
+              << options.regen_last_frame << " from t = " << start_time
+              << std::endl;
+  }
+
+  // Evaluated by the process that steps the rover; a decided run finishes
+  // its current exchange interval and tells the terrain it is done
+  TerminationMonitor termination(
+      options.termination, params.box_X / 2, params.box_Y / 2,
+      testbed ? wheel_rad
+              : std::max(front_wheel_offset_x, -rear_wheel_offset_x) +
+                    wheel_rad);
+  bool stop_requested = false;
+
+  // Wheels then chassis, the order of the mesh frame files
+  RecorderSettings recorder_settings = options.recorder;
+  if (!runs_rover || settling || options.calibration_trial || regen)
+    recorder_settings.fps = 0;
+  FlightRecorder recorder(recorder_settings, wheel_bodies.size() + 1,
+                          "../" + params.output_dir + "/event");
+  unsigned int capture_steps = recorder.captureSteps(iteration_step);
+  std::vector<CosimMeshState> recorder_states(wheel_bodies.size() + 1);
+  std::vector<float> roi_particles;
+  if (recorder.enabled()) {
+    FlightRecorder::installSignalHandler();
+    std::cout << "Flight recorder at " << options.recorder.fps
+              << " FPS, last " << options.recorder.frames
+              << " frames (SIGUSR1 for an event)" << std::endl;
+  }
+
+  // Governed particle output replaces WriteFile with a reduced binary
+  // format whenever the bandwidth or storage budget calls for it
+  std::unique_ptr<OutputGovernor> io_governor;
+  if (options.io_budget.enabled() && runs_terrain && !settling && !lazy &&
+      !regen && !options.calibration_trial) {
+    io_governor.reset(new OutputGovernor(
+        options.io_budget, gpu_sys->GetNumParticles(),
+        num_steps / out_steps + 1, params.box_X * params.box_Y));
+    std::cout << "Particle output governed to "
+              << options.io_budget.bandwidth_mb_s << " MB/s, "
+              << options.io_budget.storage_mb << " MB" << std::endl;
+  }
+  std::vector<Vec3f> frame_particles;
+  const float box_min[3] = {-params.box_X / 2, -params.box_Y / 2,
+                            -params.box_Z / 2};
+  const float box_max[3] = {params.box_X / 2, params.box_Y / 2,
+                            params.box_Z / 2};
+
+  // One row per body and frame, streamed as the run goes
+  ArrowStreamWriter telemetry;
+  if (options.arrow_telemetry && runs_rover && !regen &&
+      !options.calibration_trial) {
+    std::vector<std::string> body_names;
+    for (unsigned int i = 0; i < wheel_bodies.size(); i++)
+      body_names.push_back("wheel" + std::to_string(i));
+    body_names.push_back("chassis");
+    telemetry.addColumn("frame", ArrowStreamWriter::INT32);
+    telemetry.addColumn("t", ArrowStreamWriter::FLOAT64);
+    telemetry.addColumn("body", ArrowStreamWriter::DICTIONARY, body_names);
+    for (const char *name : {"x", "y", "z", "e0", "e1", "e2", "e3", "vx",
+                             "vy", "vz", "wx", "wy", "wz", "fx", "fy", "fz",
+                             "tx", "ty", "tz"})
+      telemetry.addColumn(name, ArrowStreamWriter::FLOAT64);
+    if (!telemetry.open("../" + params.output_dir + "/telemetry.arrows")) {
+      std::cout << "ERROR opening telemetry stream" << std::endl;
+      return 1;
+    }
+  }
+  std::vector<int32_t> particle_ids;
+  std::vector<float> particle_speeds;
+
+  TrialReport trial = {};
+  double trial_sample_dt = params.time_end / TrialReport::max_samples;
+  auto wall_start = std::chrono::steady_clock::now();
+
+  // State for the controller, published before each pause
+  SimController *controller =
+      run_mode == RUN_MODE::TESTING ? options.controller : nullptr;
+  auto publish_snapshot = [&](double time) {
+    SimSnapshot &snapshot = controller->publishBuffer();
+    snapshot.time = time;
+    snapshot.step = curr_step;
+    snapshot.bodies.resize(wheel_bodies.size() + 1);
+    for (size_t i = 0; i < wheel_bodies.size(); i++)
+      snapshot.bodies[i] = packMeshState(*wheel_bodies[i]);
+    snapshot.bodies.back() = packMeshState(*chassis_body);
+    snapshot.loads = mesh_loads;
+    size_t n = gpu_sys->GetNumParticles();
+    snapshot.particle_pos.resize(controller->capturePositions() ? 3 * n : 0);
+    snapshot.particle_vel.resize(controller->captureVelocities() ? 3 * n : 0);
+    for (size_t i = 0; i < n; i++) {
+      if (controller->capturePositions()) {
+        ChVector<float> p = gpu_sys->GetParticlePosition(i);
+        for (int k = 0; k < 3; k++)
+          snapshot.particle_pos[3 * i + k] = p[k];
+      }
+      if (controller->captureVelocities()) {
+        ChVector<float> v = gpu_sys->GetParticleVelocity(i);
+        for (int k = 0; k < 3; k++)
+          snapshot.particle_vel[3 * i + k] = v[k];
+      }
+    }
+  };
 
   clock_t start = std::clock();
-  for (float t = 0; t < params.time_end; t += iteration_step, curr_step++) {
-    if (chassis_fixed && t >= 0.5) {
+  for (float t = start_time; t < params.time_end;
+       t += iteration_step, curr_step++) {
+    if (controller && controller->pauseDue(curr_step)) {
+      publish_snapshot(t);
+      if (!controller->pause())
+        break;
+      for (const WheelMotorCommand &command :
+           controller->takeWheelCommands())
+        applyWheelCommand(command, t);
+    }
+    if (lazy && curr_step % out_steps == 0 &&
+        curr_step % coupling_interval == 0 && t >= next_checkpoint_time) {
+      LazyCheckpoint state;
+      state.step = curr_step;
+      state.time = t;
+      state.frame = currframe;
+      state.flags = (chassis_fixed ? LAZY_CHASSIS_FIXED : 0) |
+                    (query_terrain_top ? LAZY_QUERY_TERRAIN_TOP : 0);
+      state.terrain_height_offset = terrain_height_offset;
+      size_t n = gpu_sys->GetNumParticles();
+      state.pos.resize(3 * n);
+      state.vel.resize(3 * n);
+      state.ang_vel.resize(3 * n);
+      for (size_t i = 0; i < n; i++) {
+        ChVector<float> p = gpu_sys->GetParticlePosition(i);
+        ChVector<float> v = gpu_sys->GetParticleVelocity(i);
+        ChVector<float> w = gpu_sys->GetParticleAngVelocity(i);
+        for (int k = 0; k < 3; k++) {
+          state.pos[3 * i + k] = p[k];
+          state.vel[3 * i + k] = v[k];
+          state.ang_vel[3 * i + k] = w[k];
+        }
+      }
+      for (const auto &wheel : wheel_bodies)
+        state.bodies.push_back(packMeshState(*wheel));
+      state.bodies.push_back(packMeshState(*chassis_body));
+      state.coupling = packCouplingState(load_predictors, coupling_energy);
+      std::string file = lazyCheckpointName(currframe);
+      if (!state.write(lazy_dir + "/" + file) ||
+          !appendLazyIndex(lazy_dir, {state.step, t, state.frame, file})) {
+        std::cout << "ERROR writing lazy checkpoint " << file << std::endl;
+        return 1;
+      }
+      std::cout << "Lazy checkpoint at frame " << currframe << std::endl;
+      next_checkpoint_time = t + options.lazy_checkpoint_interval;
+    }
+
+    if (chassis_fixed && t >= options.release_time) {
       printf("Setting wheel free!\n");
       chassis_fixed = false;
       chassis_body->SetBodyFixed(false);
-      float max_terrain_z = gpu_sys.GetMaxParticleZ();
-      printf("terrain max is %f\n", max_terrain_z);
-      // put terrain just below bottom of wheels
-      terrain_height_offset = max_terrain_z + height_offset_chassis_to_bottom;
+      if (sled_motor)
+        sled_motor->SetMotorFunction(
+            std::make_shared<ChFunction_Const>(carriage_speed));
+      query_terrain_top = !testbed;
+      recorder.trigger("release");
     }
-    for (unsigned int i = 0; i < wheel_bodies.size(); i++) {
-      auto curr_body = wheel_bodies.at(i);
 
-      gpu_sys.ApplyMeshMotion(i, curr_body->GetPos(), curr_body->GetRot(),
-                              curr_body->GetPos_dt(), curr_body->GetWvel_par());
+    // The terrain advances a whole coupling interval per exchange, from the
+    // wheel states at its start; the rover steps through it with predicted
+    // loads and gets the terrain's loads at its end.
+    bool exchange_start = curr_step % coupling_interval == 0;
+    bool exchange_end = (curr_step + 1) % coupling_interval == 0 ||
+                        curr_step + 1 == num_steps;
+
+    if (exchange_start) {
+      unsigned int interval_steps =
+          std::min(coupling_interval, num_steps - curr_step);
+      header = {curr_step, t, 0, 0, 0};
+      if (runs_rover) {
+        for (unsigned int i = 0; i < wheel_bodies.size(); i++)
+          mesh_states[i] = packMeshState(*wheel_bodies.at(i));
+        if (query_terrain_top)
+          header.flags |= COSIM_QUERY_TERRAIN_TOP;
+        query_terrain_top = false;
+        if (curr_step + interval_steps >= num_steps || stop_requested)
+          header.flags |= COSIM_DONE;
+      }
+
+      if (run_mode == RUN_MODE::ROVER_COSIM) {
+        if (!channel->sendStates(header, mesh_states)) {
+          std::cout << "ERROR terrain process went away" << std::endl;
+          return 1;
+        }
+      } else {
+        if (run_mode == RUN_MODE::TERRAIN_COSIM) {
+          if (!channel->receiveStates(header, mesh_states) ||
+              mesh_states.size() != wheel_bodies.size() ||
+              header.step != curr_step) {
+            std::cout << "ERROR rover process went away" << std::endl;
+            return 1;
+          }
+        }
+        for (unsigned int i = 0; i < wheel_bodies.size(); i++)
+          applyMeshState(*gpu_sys, i, mesh_states[i]);
+
+        gpu_sys->AdvanceSimulation(interval_steps * iteration_step);
+
+        for (unsigned int i = 0; i < wheel_bodies.size(); i++)
+          mesh_loads[i] = collectMeshLoad(*gpu_sys, i);
+        if (header.flags & COSIM_QUERY_TERRAIN_TOP)
+          header.value = gpu_sys->GetMaxParticleZ();
+
+        if (run_mode == RUN_MODE::TERRAIN_COSIM &&
+            !channel->sendLoads(header, mesh_loads)) {
+          std::cout << "ERROR rover process went away" << std::endl;
+          return 1;
+        }
+      }
     }
 
-    gpu_sys.AdvanceSimulation(iteration_step);
-    rover_sys.DoStepDynamics(iteration_step);
+    if (runs_rover) {
+      // in the co-sim rover process this overlaps the terrain's advance
+      for (unsigned int i = 0; i < wheel_bodies.size(); i++) {
+        auto curr_body = wheel_bodies.at(i);
+        double vel[6];
+        double applied[6];
+        meshVelocity(packMeshState(*curr_body), vel);
+        load_predictors[i].predict(t, curr_body->GetPos().z(), vel, applied);
+        coupling_energy[i].addRoverStep(applied, vel, iteration_step);
+        applyMeshLoad(*curr_body, {{applied[0], applied[1], applied[2]},
+                                   {applied[3], applied[4], applied[5]}});
+        if (rocks.numInstances() > 0) {
+          CosimMeshState state = packMeshState(*curr_body);
+          MeshPose pose = {
+              {(float)state.pos[0], (float)state.pos[1], (float)state.pos[2]},
+              {(float)state.rot[0], (float)state.rot[1], (float)state.rot[2],
+               (float)state.rot[3]},
+              {(float)state.lin_vel[0], (float)state.lin_vel[1],
+               (float)state.lin_vel[2]},
+              {(float)state.ang_vel[0], (float)state.ang_vel[1],
+               (float)state.ang_vel[2]}};
+          std::vector<Vec3f> world(wheel_local.vertices.size());
+          for (size_t v = 0; v < world.size(); v++)
+            world[v] = pose.pos + rotate(pose.rot, wheel_local.vertices[v]);
+          Vec3f force, torque;
+          meshRockLoad(rocks, world, pose, rock_contact, params.sphere_radius,
+                       wheel_mass, iteration_step, force, torque);
+          curr_body->Accumulate_force(ChVector<>(force.x, force.y, force.z),
+                                      curr_body->GetPos(), false);
+          curr_body->Accumulate_torque(
+              ChVector<>(torque.x, torque.y, torque.z), false);
+        }
+      }
+      rover_sys.DoStepDynamics(iteration_step);
+
+      if (testbed && !chassis_fixed) {
+        // the soil torque about the axle, positive against the rotation
+        const CosimMeshLoad &load = mesh_loads[0];
+        ChVector<> spin = wheel_bodies[0]->GetWvel_par();
+        double rate = spin.Length();
+        ChVector<> torque(load.torque[0], load.torque[1], load.torque[2]);
+        testbed_log.accumulate(load.force[0],
+                               rate > 0 ? -(torque ^ spin) / rate : 0,
+                               load.force[2]);
+      }
+
+      if (recorder.enabled() && curr_step % capture_steps == 0) {
+        for (unsigned int i = 0; i < wheel_bodies.size(); i++)
+          recorder_states[i] = packMeshState(*wheel_bodies[i]);
+        recorder_states.back() = packMeshState(*chassis_body);
+        bool with_roi = gpu_sys && recorder.roiDue();
+        if (with_roi) {
+          // particles around the chassis in the ground plane
+          double r2 = recorder.roiRadius() * recorder.roiRadius();
+          const ChVector<> &center = chassis_body->GetPos();
+          roi_particles.clear();
+          for (size_t i = 0; i < gpu_sys->GetNumParticles(); i++) {
+            ChVector<float> p = gpu_sys->GetParticlePosition(i);
+            double dx = p.x() - center.x(), dy = p.y() - center.y();
+            if (dx * dx + dy * dy <= r2) {
+              roi_particles.push_back(p.x());
+              roi_particles.push_back(p.y());
+              roi_particles.push_back(p.z());
+            }
+          }
+        }
+        double pitch = std::asin(std::max(
+            -1., std::min(1., chassis_body->GetRot().GetXaxis().z())));
+        recorder.capture(t + iteration_step, recorder_states, mesh_loads,
+                         pitch, with_roi ? &roi_particles : nullptr);
+      }
 
-    ChVector<> wheel_force;
-    ChVector<> wheel_torque;
-    for (unsigned int i = 0; i < wheel_bodies.size(); i++) {
-      auto curr_body = wheel_bodies.at(i);
+      if (!regen && !chassis_fixed && !stop_requested &&
+          curr_step % options.termination.check_steps == 0 &&
+          termination.check(probeRover(*chassis_body, t + iteration_step))) {
+        stop_requested = true;
+        termination.print();
+      }
+    }
 
-      gpu_sys.CollectMeshContactForces(i, wheel_force, wheel_torque);
+    if (exchange_end) {
+      if (run_mode == RUN_MODE::ROVER_COSIM) {
+        if (!channel->receiveLoads(header, mesh_loads) ||
+            mesh_loads.size() != wheel_bodies.size()) {
+          std::cout << "ERROR terrain process went away" << std::endl;
+          return 1;
+        }
+      }
+      if (runs_rover) {
+        for (unsigned int i = 0; i < wheel_bodies.size(); i++) {
+          const CosimMeshLoad &load = mesh_loads[i];
+          double returned[6] = {load.force[0],  load.force[1],
+                                load.force[2],  load.torque[0],
+                                load.torque[1], load.torque[2]};
+          double sent_vel[6];
+          meshVelocity(mesh_states[i], sent_vel);
+          load_predictors[i].addSample(header.time, returned,
+                                       mesh_states[i].pos[2], sent_vel);
+          coupling_energy[i].addExchange(returned);
+        }
+      }
+      if (header.flags & COSIM_QUERY_TERRAIN_TOP) {
+        float max_terrain_z = header.value;
+        printf("terrain max is %f\n", max_terrain_z);
+        // put terrain just below bottom of wheels
+        terrain_height_offset = max_terrain_z + height_offset_chassis_to_bottom;
+      }
+    }
 
-      curr_body->Empty_forces_accumulators();
-      curr_body->Accumulate_force(wheel_force, curr_body->GetPos(), false);
-      curr_body->Accumulate_torque(wheel_torque, false);
+    if (options.calibration_trial &&
+        trial.num_samples < TrialReport::max_samples &&
+        t >= trial.num_samples * trial_sample_dt) {
+      double *sample = trial.load_trace[trial.num_samples++];
+      for (const auto &load : mesh_loads)
+        for (int k = 0; k < 3; k++)
+          sample[k] += load.force[k];
     }
 
-    if (curr_step % out_steps == 0) {
+    if (!options.calibration_trial && curr_step % out_steps == 0) {
       std::cout << "Rendering frame " << currframe << std::endl;
-      printf("Wheel forces: %f, %f, %f\n", wheel_force.x(), wheel_force.y(),
-             wheel_force.z());
-      printf("Wheel torques: %f, %f, %f\n", wheel_torque.x(), wheel_torque.y(),
-             wheel_torque.z());
+      const CosimMeshLoad &last_load = mesh_loads.back();
+      printf("Wheel forces: %f, %f, %f\n", last_load.force[0],
+             last_load.force[1], last_load.force[2]);
+      printf("Wheel torques: %f, %f, %f\n", last_load.torque[0],
+             last_load.torque[1], last_load.torque[2]);
+      if (runs_rover) {
+        double drift = 0;
+        double terrain_work = 0;
+        for (const auto &monitor : coupling_energy) {
+          drift += monitor.drift();
+          terrain_work += std::abs(monitor.terrainWork());
+        }
+        printf("Coupling energy drift: %e (terrain work %e)\n", drift,
+               terrain_work);
+      }
+      if (testbed && !chassis_fixed) {
+        const ChBody &wheel = *wheel_bodies[0];
+        double rim_speed = wheel.GetWvel_par().Length() * wheel_rad;
+        double speed = chassis_body->GetPos_dt().x();
+        testbed_log.addSample(
+            t + iteration_step, wheel.GetPos().x(), wheel.GetPos().z(),
+            surface_z - (wheel.GetPos().z() - wheel_rad),
+            rim_speed > 1e-9 ? 1 - speed / rim_speed : 0);
+      }
+      int frame = currframe++;
       char filename[100];
-      sprintf(filename, "%s/step%06d", params.output_dir.c_str(), currframe++);
-      gpu_sys.WriteFile(std::string(filename));
-      std::string mesh_output = std::string(filename) + "_meshframes.csv";
-      std::ofstream meshfile(mesh_output);
-      std::ostringstream outstream;
-      outstream << "mesh_name,dx,dy,dz,x1,x2,x3,y1,y2,y3,z1,z2,z3,sx,sy,sz\n";
-      // if the wheel is free, output its mesh, otherwise leave file empty
-      // if (!wheel_fixed) {
-      for (unsigned int i = 0; i < wheel_bodies.size(); i++) {
-        writeMeshFrames(outstream, wheel_bodies.at(i), wheel_filename,
-                        wheel_scaling);
+      sprintf(filename, "%s/step%06d", params.output_dir.c_str(), frame);
+      // lazy runs keep the rover frames only; regeneration adds the
+      // particle frames back
+      bool write_particles =
+          runs_terrain && !lazy &&
+          (!regen || (frame >= (int)options.regen_first_frame &&
+                      frame <= (int)options.regen_last_frame));
+      if (write_particles && io_governor) {
+        const ParticleOutputLevel *level = io_governor->plan();
+        if (level) {
+          frame_particles.resize(gpu_sys->GetNumParticles());
+          for (size_t i = 0; i < frame_particles.size(); i++) {
+            ChVector<float> p = gpu_sys->GetParticlePosition(i);
+            frame_particles[i] = {p.x(), p.y(), p.z()};
+          }
+          // the wheels, as the terrain process sees them
+          float roi_center[2] = {0, 0};
+          for (const auto &state : mesh_states)
+            for (int k = 0; k < 2; k++)
+              roi_center[k] += state.pos[k] / mesh_states.size();
+          auto write_start = std::chrono::steady_clock::now();
+          size_t bytes = writeParticleFrame(
+              std::string(filename) + "_particles.bin", frame_particles,
+              *level, roi_center, box_min, box_max);
+          io_governor->recordWrite(
+              bytes, std::chrono::duration<double>(
+                         std::chrono::steady_clock::now() - write_start)
+                         .count());
+          if (bytes == 0)
+            std::cout << "ERROR writing particles of frame " << frame
+                      << std::endl;
+        }
+      } else if (write_particles && options.multires_frames) {
+        frame_particles.resize(gpu_sys->GetNumParticles());
+        for (size_t i = 0; i < frame_particles.size(); i++) {
+          ChVector<float> p = gpu_sys->GetParticlePosition(i);
+          frame_particles[i] = {p.x(), p.y(), p.z()};
+        }
+        if (!writeMultiresSnapshot(std::string(filename) + "_particles.mrs",
+                                   frame_particles))
+          std::cout << "ERROR writing particles of frame " << frame
+                    << std::endl;
+      } else if (write_particles && options.parquet_frames) {
+        size_t n = gpu_sys->GetNumParticles();
+        frame_particles.resize(n);
+        particle_speeds.resize(n);
+        particle_ids.resize(n);
+        for (size_t i = 0; i < n; i++) {
+          ChVector<float> p = gpu_sys->GetParticlePosition(i);
+          frame_particles[i] = {p.x(), p.y(), p.z()};
+          particle_speeds[i] = gpu_sys->GetParticleVelocity(i).Length();
+          particle_ids[i] = (int32_t)i;
+        }
+        typedef ParquetColumn PC;
+        const size_t stride = sizeof(Vec3f);
+        if (!writeParquet(
+                std::string(filename) + "_particles.parquet", n,
+                {{"id", PC::INT32, PC::DELTA_BINARY_PACKED,
+                  particle_ids.data(), sizeof(int32_t)},
+                 {"x", PC::FLOAT, PC::PLAIN, &frame_particles[0].x, stride},
+                 {"y", PC::FLOAT, PC::PLAIN, &frame_particles[0].y, stride},
+                 {"z", PC::FLOAT, PC::PLAIN, &frame_particles[0].z, stride},
+                 {"absv", PC::FLOAT, PC::PLAIN, particle_speeds.data(),
+                  sizeof(float)}}))
+          std::cout << "ERROR writing particles of frame " << frame
+                    << std::endl;
+      } else if (write_particles) {
+        gpu_sys->WriteFile(std::string(filename));
+      }
+      if (runs_rover && !regen) {
+        std::string mesh_output = std::string(filename) + "_meshframes.csv";
+        std::ofstream meshfile(mesh_output);
+        std::ostringstream outstream;
+        outstream
+            << "mesh_name,dx,dy,dz,x1,x2,x3,y1,y2,y3,z1,z2,z3,sx,sy,sz\n";
+        // if the wheel is free, output its mesh, otherwise leave file empty
+        // if (!wheel_fixed) {
+        for (unsigned int i = 0; i < wheel_bodies.size(); i++) {
+          writeMeshFrames(outstream, wheel_bodies.at(i), wheel_filename,
+                          wheel_scaling);
+        }
+
+        if (!testbed)
+          writeMeshFrames(outstream, chassis_body, chassis_filename,
+                          {METERS_TO_CM, METERS_TO_CM, METERS_TO_CM});
+
+        meshfile << outstream.str();
+        // }
+      }
+      if (telemetry.numColumns() > 0) {
+        for (unsigned int b = 0; b <= wheel_bodies.size(); b++) {
+          CosimMeshState state = packMeshState(
+              b < wheel_bodies.size() ? *wheel_bodies[b] : *chassis_body);
+          CosimMeshLoad load = b < mesh_loads.size() ? mesh_loads[b]
+                                                     : CosimMeshLoad();
+          const double values[] = {
+              state.pos[0],     state.pos[1],     state.pos[2],
+              state.rot[0],     state.rot[1],     state.rot[2],
+              state.rot[3],     state.lin_vel[0], state.lin_vel[1],
+              state.lin_vel[2], state.ang_vel[0], state.ang_vel[1],
+              state.ang_vel[2], load.force[0],    load.force[1],
+              load.force[2],    load.torque[0],   load.torque[1],
+              load.torque[2]};
+          telemetry.push(0, frame);
+          telemetry.push(1, t + iteration_step);
+          telemetry.push(2, b);
+          for (size_t k = 0; k < sizeof(values) / sizeof(double); k++)
+            telemetry.push(3 + k, values[k]);
+        }
+        if (!telemetry.writeBatch())
+          std::cout << "ERROR writing telemetry of frame " << frame
+                    << std::endl;
       }
-
-      writeMeshFrames(outstream, chassis_body, chassis_filename,
-                      {METERS_TO_CM, METERS_TO_CM, METERS_TO_CM});
-
-      meshfile << outstream.str();
-      // }
     }
+
+    if (exchange_end && (header.flags & COSIM_DONE))
+      break;
+    if (regen && currframe > (int)options.regen_last_frame)
+      break;
   }
 
-  if (run_mode == RUN_MODE::SETTLING) {
-    gpu_sys.SetOutputMode(CHGPU_OUTPUT_MODE::CSV);
+  if (settling) {
+    gpu_sys->SetOutputMode(CHGPU_OUTPUT_MODE::CSV);
 
-    gpu_sys.WriteFile(checkpoint_file_base);
+    gpu_sys->WriteFile(checkpoint_file_base);
   }
 
   clock_t end = std::clock();
@@ -474,5 +1476,434 @@ int main(int argc, char *argv[]) {
 
   std::cout << "Time: " << total_time << " seconds" << std::endl;
 
+  recorder.flush();
+  telemetry.close();
+  if (io_governor)
+    io_governor->printReport();
+
+  double time_reached = std::min(curr_step + 1, num_steps) * iteration_step;
+  if (controller)
+    publish_snapshot(time_reached);
+  if (runs_rover && !settling && !options.calibration_trial && !regen) {
+    termination.finish(time_reached);
+    termination.print();
+    std::string record_file =
+        "../" + params.output_dir + "/termination.json";
+    if (!termination.writeJson(record_file))
+      std::cout << "ERROR writing " << record_file << std::endl;
+    if (!testbed)
+      SweepServer::setWorkerResult(&termination.record(),
+                                   sizeof(TerminationRecord));
+  }
+  if (testbed) {
+    std::string log_file = "../" + params.output_dir + "/testbed.csv";
+    if (!testbed_log.writeCsv(log_file))
+      std::cout << "ERROR writing " << log_file << std::endl;
+    TestbedPoint point = testbed_log.point();
+    SweepServer::setWorkerResult(&point, sizeof(point));
+  }
+
+  if (options.calibration_trial) {
+    trial.sim_seconds = time_reached;
+    trial.wall_seconds = std::chrono::duration<double>(
+                             std::chrono::steady_clock::now() - wall_start)
+                             .count();
+    double drift = 0;
+    double exchanged = 0;
+    for (const auto &monitor : coupling_energy) {
+      drift += monitor.drift();
+      exchanged += std::abs(monitor.terrainWork());
+    }
+    trial.energy_drift = drift / std::max(exchanged, 1e-30);
+    std::vector<Vec3f> final_positions(gpu_sys->GetNumParticles());
+    for (size_t i = 0; i < final_positions.size(); i++) {
+      ChVector<float> p = gpu_sys->GetParticlePosition(i);
+      final_positions[i] = {p.x(), p.y(), p.z()};
+    }
+    trial.max_overlap =
+        maxRelativeOverlap(final_positions, params.sphere_radius);
+    bool finite = std::isfinite(trial.energy_drift);
+    for (unsigned int k = 0; k < trial.num_samples; k++)
+      for (int d = 0; d < 3; d++)
+        finite = finite && std::isfinite(trial.load_trace[k][d]);
+    trial.completed = finite;
+    SweepServer::setWorkerResult(&trial, sizeof(trial));
+  }
+
+  return 0;
+}
+
+// Sweep server: read the settled checkpoint once, then fork one worker per
+// case. Workers inherit the bed copy-on-write and apply only their overrides.
+int runSweep(const RunOptions &base, const std::string &sweep_file) {
+  std::vector<SweepCase> cases;
+  unsigned int max_parallel = 1;
+  if (!loadSweepFile(sweep_file, cases, max_parallel)) {
+    std::cout << "ERROR reading sweep file " << sweep_file << std::endl;
+    return 1;
+  }
+
+  // No GPU calls before the fork: CUDA state does not survive it
+  auto load_start = std::chrono::steady_clock::now();
+  ReadOnlyBuffer<ChVector<float>> bed(
+      loadCheckpointFile(base.checkpoint_file_base + ".csv"));
+  double load_seconds = std::chrono::duration<double>(
+                            std::chrono::steady_clock::now() - load_start)
+                            .count();
+  if (!bed.valid()) {
+    std::cout << "ERROR mapping the shared checkpoint" << std::endl;
+    return 1;
+  }
+  std::cout << "Sweep of " << cases.size() << " cases, " << max_parallel
+            << " at a time, sharing " << bed.size() << " particles ("
+            << bed.memoryBytes() / (1 << 20) << " MiB)" << std::endl;
+
+  SweepServer server(max_parallel, sizeof(TerminationRecord));
+  size_t failed = server.run(cases, [&](const SweepCase &sweep_case, size_t) {
+    RunOptions options = base;
+    options.run_mode = RUN_MODE::TESTING;
+    options.params.output_dir = base.params.output_dir + "/" + sweep_case.name;
+    for (const auto &kv : sweep_case.overrides) {
+      if (!applyOverride(options, kv.first, kv.second)) {
+        std::cout << "ERROR case " << sweep_case.name << ": bad override "
+                  << kv.first << " = " << kv.second << std::endl;
+        return 1;
+      }
+    }
+    return runSimulation(options, &bed);
+  });
+  server.printReport(load_seconds);
+  for (size_t i = 0; i < cases.size(); i++) {
+    const TerminationRecord *record =
+        static_cast<const TerminationRecord *>(server.result(i));
+    printf("  %-20s %s at t = %.4f s\n", cases[i].name.c_str(),
+           record ? stopReasonName((StopReason)record->reason) : "failed",
+           record ? record->time : 0.0);
+  }
+  return failed == 0 ? 0 : 1;
+}
+
+// Calibration: short trials from the checkpoint with candidate step sizes
+// and coupling intervals, each in a forked worker sharing the bed and with
+// the chassis free from the start. The fastest settings that pass are
+// written to <output_dir>/autotune.json.
+int runCalibration(const RunOptions &base, double trial_duration,
+                   const TuningCriteria &criteria) {
+  auto load_start = std::chrono::steady_clock::now();
+  ReadOnlyBuffer<ChVector<float>> bed(
+      loadCheckpointFile(base.checkpoint_file_base + ".csv"));
+  double load_seconds = std::chrono::duration<double>(
+                            std::chrono::steady_clock::now() - load_start)
+                            .count();
+  if (!bed.valid()) {
+    std::cout << "ERROR mapping the shared checkpoint" << std::endl;
+    return 1;
+  }
+  std::cout << "Calibrating with " << trial_duration << " s trials from "
+            << bed.size() << " particles (read in " << load_seconds << " s)"
+            << std::endl;
+
+  CouplingAutotuner tuner(base.params.step_size, base.coupling_interval,
+                          criteria);
+  bool ok = tuner.run([&](const TuningCandidate &candidate,
+                          TrialReport &report) {
+    SweepCase trial_case;
+    trial_case.name = "trial";
+    SweepServer server(1, sizeof(TrialReport));
+    server.run({trial_case}, [&](const SweepCase &, size_t) {
+      RunOptions options = base;
+      options.run_mode = RUN_MODE::TESTING;
+      options.params.step_size = candidate.step_size;
+      options.coupling_interval = candidate.coupling_interval;
+      options.time_end = trial_duration;
+      options.calibration_trial = true;
+      // trials are far shorter than the hold, release the chassis at once
+      // so they cover the free rover the coupling settings act on
+      options.release_time = 0;
+      return runSimulation(options, &bed);
+    });
+    const void *result = server.result(0);
+    if (!result)
+      return false;
+    std::memcpy(&report, result, sizeof(report));
+    return true;
+  });
+  if (!ok) {
+    std::cout << "ERROR the reference trial failed" << std::endl;
+    return 1;
+  }
+  tuner.printReport();
+
+  std::string out_dir = "../" + base.params.output_dir;
+  filesystem::create_directory(filesystem::path("../"));
+  filesystem::create_directory(filesystem::path(out_dir));
+  std::string settings_file = out_dir + "/autotune.json";
+  if (!tuner.writeSettings(settings_file,
+                           predictorName(base.coupling_predictor))) {
+    std::cout << "ERROR writing " << settings_file << std::endl;
+    return 1;
+  }
+  std::cout << "Wrote " << settings_file << std::endl;
   return 0;
 }
+
+// Regeneration: find the lazy checkpoints whose segments hold the frames
+// for time t (or t0:t1) and re-simulate each segment in a forked worker
+int runRegenerate(const RunOptions &base, const std::string &range,
+                  unsigned int max_parallel) {
+  size_t colon = range.find(':');
+  double t0 = std::stod(range.substr(0, colon));
+  double t1 =
+      colon == std::string::npos ? t0 : std::stod(range.substr(colon + 1));
+  // frames are written every out_steps steps, as in runSimulation
+  unsigned int out_steps = 1 / (out_fps * base.params.step_size);
+  double frame_dt = out_steps * base.params.step_size;
+  unsigned int first_frame = (unsigned int)std::ceil(t0 / frame_dt - 1e-6);
+  unsigned int last_frame =
+      std::max(first_frame, (unsigned int)std::floor(t1 / frame_dt + 1e-6));
+
+  std::string lazy_dir = "../" + base.params.output_dir + "/lazy";
+  std::vector<LazySegment> segments;
+  if (!readLazyIndex(lazy_dir, segments)) {
+    std::cout << "ERROR reading " << lazy_dir << "/index.csv" << std::endl;
+    return 1;
+  }
+  std::vector<LazyJob> jobs = planLazyJobs(segments, first_frame, last_frame);
+  if (jobs.empty()) {
+    std::cout << "ERROR no lazy checkpoint covers frames " << first_frame
+              << " to " << last_frame << std::endl;
+    return 1;
+  }
+
+  std::vector<SweepCase> cases(jobs.size());
+  for (size_t i = 0; i < jobs.size(); i++)
+    cases[i].name = segments[jobs[i].segment].file;
+  std::cout << "Regenerating frames " << first_frame << " to " << last_frame
+            << " from " << jobs.size() << " segments, " << max_parallel
+            << " at a time" << std::endl;
+
+  SweepServer server(max_parallel);
+  size_t failed = server.run(cases, [&](const SweepCase &, size_t i) {
+    const LazyJob &job = jobs[i];
+    LazyCheckpoint state;
+    std::string file = lazy_dir + "/" + segments[job.segment].file;
+    if (!state.read(file)) {
+      std::cout << "ERROR reading lazy checkpoint " << file << std::endl;
+      return 1;
+    }
+    RunOptions options = base;
+    options.run_mode = RUN_MODE::TESTING;
+    options.regen_state = &state;
+    options.regen_first_frame = job.first_frame;
+    options.regen_last_frame = job.last_frame;
+    return runSimulation(options, nullptr);
+  });
+  server.printReport(0);
+  return failed == 0 ? 0 : 1;
+}
+
+// Single-wheel testbed: crop the settled checkpoint to a bin sized to the
+// wheel, then run the slips from it, each in a forked worker sharing the
+// bin's bed. Every run gives one point of the drawbar pull, torque and
+// sinkage curves, written to <output_dir>/testbed_curves.csv.
+int runTestbed(const RunOptions &base) {
+  RunOptions bin = base;
+  TestbedSettings &settings = bin.testbed;
+  double grav_z =
+      mars_grav_mag * std::cos(base.grav_angle_deg * CH_C_PI / 180);
+  bool load_ok = settings.resolve(
+      wheel_rad, wheel_width,
+      (chassis_mass + 6 * wheel_mass) * mars_grav_mag / 6, grav_z, wheel_mass);
+  bool slips_ok = !settings.slips.empty();
+  for (double slip : settings.slips)
+    slips_ok = slips_ok && slip <= 1;
+  if (settings.length > base.params.box_X ||
+      settings.width > base.params.box_Y || settings.width < wheel_width ||
+      settings.travel(wheel_rad) <= 0) {
+    std::cout << "ERROR the testbed bin must hold the wheel and fit in the "
+                 "checkpoint's box"
+              << std::endl;
+    return 1;
+  }
+  if (!load_ok || !slips_ok) {
+    std::cout << "ERROR testbed_load must exceed the wheel's weight and "
+                 "testbed_slips must be at most 1"
+              << std::endl;
+    return 1;
+  }
+  bin.params.box_X = settings.length;
+  bin.params.box_Y = settings.width;
+  // speed and slip are imposed, so only the distance and wall rules apply
+  bin.termination.slip = 0;
+  bin.termination.steady_window = 0;
+
+  // No GPU calls before the fork: CUDA state does not survive it
+  auto load_start = std::chrono::steady_clock::now();
+  std::vector<ChVector<float>> points =
+      loadCheckpointFile(base.checkpoint_file_base + ".csv");
+  size_t num_settled = points.size();
+  float half_x = settings.length / 2 - base.params.sphere_radius;
+  float half_y = settings.width / 2 - base.params.sphere_radius;
+  points.erase(std::remove_if(points.begin(), points.end(),
+                              [&](const ChVector<float> &p) {
+                                return std::abs(p.x()) > half_x ||
+                                       std::abs(p.y()) > half_y;
+                              }),
+               points.end());
+  ReadOnlyBuffer<ChVector<float>> bed(points);
+  double load_seconds = std::chrono::duration<double>(
+                            std::chrono::steady_clock::now() - load_start)
+                            .count();
+  if (!bed.valid()) {
+    std::cout << "ERROR mapping the shared checkpoint" << std::endl;
+    return 1;
+  }
+  printf("Testbed bin %.1f x %.1f: %zu of %zu particles (%.1f%%), wheel "
+         "load %f\n",
+         settings.length, settings.width, bed.size(), num_settled,
+         100. * bed.size() / std::max<size_t>(1, num_settled), settings.load);
+  std::cout << settings.slips.size() << " slips, " << settings.max_parallel
+            << " at a time" << std::endl;
+
+  std::vector<SweepCase> cases(settings.slips.size());
+  for (size_t i = 0; i < cases.size(); i++) {
+    char name[32];
+    snprintf(name, sizeof(name), "slip%.3f", settings.slips[i]);
+    cases[i].name = name;
+  }
+  SweepServer server(settings.max_parallel, sizeof(TestbedPoint));
+  size_t failed = server.run(cases, [&](const SweepCase &slip_case, size_t i) {
+    RunOptions options = bin;
+    options.params.output_dir = base.params.output_dir + "/" + slip_case.name;
+    options.testbed_slip = settings.slips[i];
+    // tow the wheel across the bin, or spin it in place at slip 1
+    double speed =
+        carriageSpeed(options.testbed_slip, settings.wheel_speed, wheel_rad);
+    double tow_time =
+        speed > 0 ? settings.travel(wheel_rad) / speed : time_running;
+    options.time_end =
+        std::min(time_running, options.release_time + tow_time);
+    return runSimulation(options, &bed);
+  });
+  server.printReport(load_seconds);
+
+  std::vector<TestbedPoint> curves;
+  printf("  %8s %8s %14s %14s %10s %14s\n", "slip", "measured",
+         "drawbar pull", "torque", "sinkage", "load");
+  for (size_t i = 0; i < cases.size(); i++) {
+    const TestbedPoint *point =
+        static_cast<const TestbedPoint *>(server.result(i));
+    if (!point) {
+      printf("  %8.3f failed\n", settings.slips[i]);
+      continue;
+    }
+    curves.push_back(*point);
+    printf("  %8.3f %8.3f %14.6g %14.6g %10.4f %14.6g\n", point->slip,
+           point->measured_slip, point->drawbar_pull, point->torque,
+           point->sinkage, point->load);
+  }
+
+  std::string out_dir = "../" + base.params.output_dir;
+  filesystem::create_directory(filesystem::path("../"));
+  filesystem::create_directory(filesystem::path(out_dir));
+  std::string curves_file = out_dir + "/testbed_curves.csv";
+  if (!writeTestbedCurves(curves_file, curves)) {
+    std::cout << "ERROR writing " << curves_file << std::endl;
+    return 1;
+  }
+  std::cout << "Wrote " << curves_file << std::endl;
+  return failed == 0 ? 0 : 1;
+}
+
+// Options from a run's JSON file: the simulation parameters, then the keys
+// ChGpuSimulationParameters has no field for
+bool loadRunOptions(const std::string &json_file, RunOptions &options,
+                    HostJson &extra_params) {
+  if (!ParseJSON(json_file, options.params))
+    return false;
+  extra_params.parseFile(json_file);
+  options.coupling_interval = (unsigned int)std::max(
+      1., extra_params.getNumber("coupling_interval", 1));
+  std::string predictor_name =
+      extra_params.getString("coupling_predictor", "hold");
+  if (!parsePredictorType(predictor_name, options.coupling_predictor)) {
+    std::cout << "ERROR unknown coupling_predictor " << predictor_name
+              << " (hold, linear, quadratic or stiffness)" << std::endl;
+    return false;
+  }
+
+  std::string backend_name = extra_params.getString("output_backend", "stdio");
+  if (!parseOutputBackend(backend_name, defaultOutputBackend())) {
+    std::cout << "ERROR unknown output_backend " << backend_name
+              << " (stdio, pwrite or uring)" << std::endl;
+    return false;
+  }
+
+  for (const auto &kv : extra_params.values())
+    if (!options.termination.set(kv.first, std::atof(kv.second.c_str())) &&
+        !options.recorder.set(kv.first, std::atof(kv.second.c_str())))
+      options.io_budget.set(kv.first, std::atof(kv.second.c_str()));
+
+  std::string frame_output = extra_params.getString("frame_output", "full");
+  options.lazy_frames = frame_output == "lazy";
+  options.multires_frames = frame_output == "multires";
+  options.parquet_frames = frame_output == "parquet";
+  options.arrow_telemetry =
+      extra_params.getString("telemetry_output", "none") == "arrow";
+  options.lazy_checkpoint_interval =
+      extra_params.getNumber("lazy_checkpoint_interval", 1.0);
+  options.rocks_file = extra_params.getString("rocks_file", "");
+  options.rock_shapes =
+      (unsigned int)std::max(1., extra_params.getNumber("rock_shapes", 4));
+  options.testbed.read(extra_params);
+  return true;
+}
+
+#ifndef ROVERTEST_NO_MAIN
+int main(int argc, char *argv[]) {
+  gpu::SetDataPath("../data/");
+
+  RunOptions options;
+  HostJson extra_params;
+  if (argc < 5 || argc > 6 ||
+      !loadRunOptions(gpu::GetDataFile(argv[1]), options, extra_params)) {
+    ShowUsage(argv[0]);
+    return 1;
+  }
+  options.run_mode = (RUN_MODE)std::atoi(argv[2]);
+  options.checkpoint_file_base = std::string(argv[3]);
+  options.grav_angle_deg = std::stod(argv[4]);
+  options.cosim_channel = argc > 5 ? argv[5] : "rovertest_cosim";
+
+  if (options.run_mode == RUN_MODE::REGENERATE) {
+    if (argc != 6) {
+      ShowUsage(argv[0]);
+      return 1;
+    }
+    unsigned int max_parallel =
+        (unsigned int)std::max(1., extra_params.getNumber("lazy_parallel", 1));
+    return runRegenerate(options, argv[5], max_parallel);
+  }
+  if (options.run_mode == RUN_MODE::CALIBRATE) {
+    TuningCriteria criteria;
+    criteria.max_overlap = extra_params.getNumber("calibration_max_overlap",
+                                                  criteria.max_overlap);
+    criteria.max_energy_drift = extra_params.getNumber(
+        "calibration_max_energy_drift", criteria.max_energy_drift);
+    criteria.max_force_deviation = extra_params.getNumber(
+        "calibration_max_force_deviation", criteria.max_force_deviation);
+    double trial_duration = argc > 5 ? std::stod(argv[5]) : 0.01;
+    return runCalibration(options, trial_duration, criteria);
+  }
+  if (options.run_mode == RUN_MODE::SWEEP) {
+    if (argc != 6) {
+      ShowUsage(argv[0]);
+      return 1;
+    }
+    return runSweep(options, argv[5]);
+  }
+  if (options.run_mode == RUN_MODE::TESTBED)
+    return runTestbed(options);
+  return runSimulation(options, nullptr);
+}
+#endif
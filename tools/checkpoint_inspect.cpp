@@ -0,0 +1,103 @@
+// =============================================================================
+// Inspect a particle checkpoint before starting a run from it: count and
+// bounds, packing fraction by depth, free-surface height statistics and the
+// minimum pair separation against the sphere diameter. Reads CSV
+// checkpoints, lazy checkpoints (.bin) and multiresolution snapshots (.mrs);
+// CSV checkpoints with an "r" column are checked with their own radii.
+// Exits with 2 when particles overlap or penetrate the box walls by more
+// than the tolerance, or have non-finite positions; 1 on errors.
+// =============================================================================
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "CheckpointInspect.hpp"
+#include "HostArgs.hpp"
+#include "HostGranular.hpp"
+
+void ShowUsage(std::string name) {
+    std::cout << "usage: " + name +
+                     " <json_file> <checkpoint_file> [--tolerance fraction] [--bin cm] [--column cm] [--threads N]"
+              << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+    HostArgs args(argc, argv);
+    GranularParams params;
+    if (args.numPositional() != 2 || !loadGranularParams(args.positional(0), params)) {
+        ShowUsage(argv[0]);
+        return 1;
+    }
+    if (args.has("threads"))
+        setHostThreadCount((unsigned int)args.getNumber("threads", hostThreadCount()));
+
+    InspectSettings settings;
+    settings.sphere_radius = params.sphere_radius;
+    settings.box[0] = params.box_X;
+    settings.box[1] = params.box_Y;
+    settings.box[2] = params.box_Z;
+    settings.tolerance = (float)args.getNumber("tolerance", settings.tolerance);
+    settings.depth_bin = (float)args.getNumber("bin", 4 * params.sphere_radius);
+    settings.column = (float)args.getNumber("column", 4 * params.sphere_radius);
+
+    auto seconds_since = [](std::chrono::steady_clock::time_point t) {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - t).count();
+    };
+    auto start = std::chrono::steady_clock::now();
+    std::vector<Vec3f> pos;
+    std::vector<float> radii;
+    if (!readAnyCheckpoint(args.positional(1), pos, nullptr, &radii)) {
+        std::cout << "ERROR reading checkpoint file" << std::endl;
+        return 1;
+    }
+    double read_seconds = seconds_since(start);
+    start = std::chrono::steady_clock::now();
+    CheckpointReport report = inspectCheckpoint(pos, settings, radii);
+    double inspect_seconds = seconds_since(start);
+
+    printf("particles:        %zu (read in %.2f s, inspected in %.2f s on %u threads)\n", report.count, read_seconds,
+           inspect_seconds, hostThreadCount());
+    if (!radii.empty())
+        printf("radii:            %.4f to %.4f (per particle)\n", *std::min_element(radii.begin(), radii.end()),
+               *std::max_element(radii.begin(), radii.end()));
+    printf("bounds:           x [%.3f, %.3f]  y [%.3f, %.3f]  z [%.3f, %.3f]\n", report.lo.x, report.hi.x, report.lo.y,
+           report.hi.y, report.lo.z, report.hi.z);
+    printf("non-finite:       %zu\n", report.non_finite);
+    printf("outside the box:  %zu (box %g x %g x %g)\n", report.outside_box, settings.box[0], settings.box[1],
+           settings.box[2]);
+    if (report.min_separation >= 0)
+        printf("min separation:   %.4f = %.4f contact distances (particles %u and %u)\n", report.min_separation,
+               report.min_separation / report.min_contact, report.min_pair[0], report.min_pair[1]);
+    else
+        printf("min separation:   no pair within contact plus half the smallest radius\n");
+    printf("overlapping pairs: %zu (deeper than %.1f%% of the smaller diameter)\n", report.overlapping_pairs,
+           100 * settings.tolerance);
+
+    printf("free surface:     mean %.3f  std %.3f  min %.3f  p05 %.3f  p50 %.3f  p95 %.3f  max %.3f\n",
+           report.surface_mean, report.surface_std, report.surface_min, report.surface_p05, report.surface_p50,
+           report.surface_p95, report.surface_max);
+    printf("                  %zu columns of %g x %g, %zu empty\n", report.columns, settings.column, settings.column,
+           report.empty_columns);
+
+    // packing fraction from the floor up to the highest occupied bin
+    size_t top = report.packing.size();
+    while (top > 0 && report.packing[top - 1] == 0)
+        top--;
+    printf("packing fraction by depth (bins of %g):\n", settings.depth_bin);
+    printf("%10s %10s %10s\n", "z from", "z to", "fraction");
+    for (size_t b = 0; b < top; b++) {
+        float z0 = -settings.box[2] / 2 + b * settings.depth_bin;
+        printf("%10.3f %10.3f %10.4f\n", z0, z0 + settings.depth_bin, report.packing[b]);
+    }
+
+    if (report.violations()) {
+        std::cout << "FAILED: checkpoint has overlapping, out-of-box or non-finite particles" << std::endl;
+        return 2;
+    }
+    std::cout << "OK" << std::endl;
+    return 0;
+}
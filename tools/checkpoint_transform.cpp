@@ -0,0 +1,180 @@
+// =============================================================================
+// Build composite beds from checkpoints: read one, apply a pipeline of
+// transforms in command line order, and write the result in the format of
+// the output's extension (.csv, .mrs, .parquet or .bin). Other checkpoints
+// read by --merge and --stack have the sphere radius of the JSON file.
+//
+// e.g. crop a settled bed to a strip, centre it under the rover start of a
+// 400 x 200 box (init_offset_x = -box_X / 4) and stack a second bed on it:
+//   checkpoint_transform rovertest.json bed.csv strip.csv
+//       --crop -100,-50,-25,100,50,25 --recenter -100,0 --stack top.csv
+// or close a 60 long cut of it into a periodic bin (periodic_x runs):
+//   checkpoint_transform rovertest.json bed.csv bin.csv
+//       --crop -30,-100,-25,30,100,25 --wrap-x 60
+// =============================================================================
+
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "CheckpointTransform.hpp"
+#include "HostArgs.hpp"
+#include "HostGranular.hpp"
+
+void ShowUsage(std::string name) {
+    std::cout << "usage: " + name +
+                     " <json_file> <checkpoint_file> <out_file> [transforms...] [--tolerance fraction] "
+                     "[--seed n] [--threads N]\n"
+                     "transforms, applied in order:\n"
+                     "  --crop x0,y0,z0,x1,y1,z1   keep centres inside the box\n"
+                     "  --crop-height file|height  keep spheres below a heightfield CSV over the box "
+                     "footprint, or a flat height (periodic in x with periodic_x)\n"
+                     "  --translate x,y,z\n"
+                     "  --rotate deg               about the vertical axis through the origin\n"
+                     "  --affine m00,...,m22,tx,ty,tz\n"
+                     "  --recenter x,y             move the centre of the xy bounds there\n"
+                     "  --scale-radius r           new radius, positions scaled about the box floor centre\n"
+                     "  --merge file               add its particles, dropping those that overlap\n"
+                     "  --stack file               place it on top, then merge\n"
+                     "  --subsample fraction       keep a random fraction\n"
+                     "  --wrap-x length            fold x into a periodic bin of that length centred on the "
+                     "origin, dropping overlaps across the seam\n"
+                     "  --tile-x n[,period]        n copies period apart along x (default box_X), centred"
+              << std::endl;
+}
+
+// Comma separated numbers, exactly count of them
+static bool parseNumbers(const std::string& text, size_t count, std::vector<float>& values) {
+    values.clear();
+    const char* s = text.c_str();
+    while (*s) {
+        char* end;
+        values.push_back(std::strtof(s, &end));
+        if (end == s)
+            return false;
+        s = *end == ',' ? end + 1 : end;
+        if (*end && *end != ',')
+            return false;
+    }
+    return values.size() == count;
+}
+
+int main(int argc, char* argv[]) {
+    HostArgs args(argc, argv);
+    GranularParams params;
+    if (args.numPositional() != 3 || !loadGranularParams(args.positional(0), params)) {
+        ShowUsage(argv[0]);
+        return 1;
+    }
+    if (args.has("threads"))
+        setHostThreadCount((unsigned int)args.getNumber("threads", hostThreadCount()));
+    float tolerance = (float)args.getNumber("tolerance", 0.05);
+    uint64_t seed = (uint64_t)args.getNumber("seed", 1);
+
+    ParticleBed bed;
+    if (!readBed(args.positional(1), params.sphere_radius, bed)) {
+        std::cout << "ERROR reading checkpoint file" << std::endl;
+        return 1;
+    }
+    printf("%-28s %12zu particles\n", args.positional(1).c_str(), bed.size());
+    if (params.periodic_x)
+        printf("periodic_x: heightfields repeat along x\n");
+
+    std::vector<float> v;
+    for (const auto& option : args.ordered()) {
+        const std::string& name = option.first;
+        const std::string& value = option.second;
+        if (name == "tolerance" || name == "seed" || name == "threads")
+            continue;
+        bool ok = true;
+        if (name == "crop") {
+            ok = parseNumbers(value, 6, v);
+            if (ok)
+                cropBox(bed, {v[0], v[1], v[2]}, {v[3], v[4], v[5]});
+        } else if (name == "crop-height") {
+            Heightfield field;
+            if (parseNumbers(value, 1, v))
+                field.heights = {v[0]};
+            else
+                ok = loadHeightfield(value, params.box_X, params.box_Y, field);
+            field.periodic_x = params.periodic_x;
+            if (ok)
+                cropBelow(bed, field);
+        } else if (name == "translate") {
+            ok = parseNumbers(value, 3, v);
+            if (ok)
+                translateBed(bed, {v[0], v[1], v[2]});
+        } else if (name == "rotate") {
+            ok = parseNumbers(value, 1, v);
+            if (ok)
+                rotateBedZ(bed, v[0]);
+        } else if (name == "affine") {
+            ok = parseNumbers(value, 12, v);
+            if (ok)
+                applyAffine(bed, v.data(), {v[9], v[10], v[11]});
+        } else if (name == "recenter") {
+            ok = parseNumbers(value, 2, v);
+            if (ok && bed.size() > 0) {
+                Vec3f lo, hi;
+                computeBounds(bed.pos, lo, hi);
+                translateBed(bed, {v[0] - (lo.x + hi.x) / 2, v[1] - (lo.y + hi.y) / 2, 0});
+            }
+        } else if (name == "scale-radius") {
+            ok = parseNumbers(value, 1, v) && v[0] > 0;
+            if (ok)
+                scaleRadius(bed, v[0], {0, 0, -params.box_Z / 2});
+        } else if (name == "merge" || name == "stack") {
+            ParticleBed other;
+            if (!readBed(value, params.sphere_radius, other)) {
+                std::cout << "ERROR reading checkpoint file " << value << std::endl;
+                return 1;
+            }
+            if (bed.polydisperse() || other.polydisperse() ||
+                std::abs(other.radius - bed.radius) > 1e-6f * bed.radius) {
+                std::cout << "ERROR --" << name << " needs monodisperse beds of equal radii; rescale after merging"
+                          << std::endl;
+                return 1;
+            }
+            size_t dropped = name == "merge" ? mergeBeds(bed, other, tolerance) : stackBeds(bed, other, 0, tolerance);
+            printf("  %s %s: %zu added, %zu overlapping dropped\n", name.c_str(), value.c_str(),
+                   other.size() - dropped, dropped);
+        } else if (name == "subsample") {
+            ok = parseNumbers(value, 1, v);
+            if (ok)
+                subsampleBed(bed, v[0], seed);
+        } else if (name == "wrap-x") {
+            ok = parseNumbers(value, 1, v) && v[0] > 4 * bed.radius;
+            if (ok) {
+                size_t dropped = removeSeamOverlaps(bed, periodicBoxX(v[0]), tolerance);
+                printf("  wrap-x %s: %zu overlapping the seam dropped\n", value.c_str(), dropped);
+            }
+        } else if (name == "tile-x") {
+            if (parseNumbers(value, 1, v))
+                v.push_back(params.box_X);
+            else
+                ok = parseNumbers(value, 2, v);
+            ok = ok && v[0] >= 1 && v[1] > 0;
+            if (ok)
+                tileBedX(bed, v[1], (int)v[0]);
+        } else {
+            std::cout << "ERROR unknown transform --" << name << std::endl;
+            ShowUsage(argv[0]);
+            return 1;
+        }
+        if (!ok) {
+            std::cout << "ERROR bad value for --" << name << ": " << value << std::endl;
+            return 1;
+        }
+        printf("%-28s %12zu particles\n", ("--" + name).c_str(), bed.size());
+    }
+
+    if (!writeBed(args.positional(2), bed)) {
+        std::cout << "ERROR writing " << args.positional(2) << std::endl;
+        return 1;
+    }
+    if (bed.radius != params.sphere_radius)
+        printf("sphere radius is now %g: set sphere_radius in the JSON file to match\n", bed.radius);
+    printf("wrote %zu particles to %s\n", bed.size(), args.positional(2).c_str());
+    return 0;
+}
@@ -0,0 +1,90 @@
+// =============================================================================
+// Replace the far field of a bed with coarse particles: outside a corridor
+// along the wheel path, fine particles become `factor` times larger spheres
+// packed to the same bulk density. Writes a polydisperse checkpoint (CSV
+// with an "r" column, or Parquet) and the input-to-output particle mapping.
+// =============================================================================
+
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "CoarseGrain.hpp"
+#include "HostArgs.hpp"
+#include "HostGranular.hpp"
+
+void ShowUsage(std::string name) {
+    std::cout << "usage: " + name +
+                     " <json_file> <checkpoint_file> <out_file> [--corridor y0,y1] [--corridor-x x0,x1] "
+                     "[--factor k] [--packing fraction] [--tolerance fraction] [--mapping file] [--threads N]"
+              << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+    HostArgs args(argc, argv);
+    GranularParams params;
+    if (args.numPositional() != 3 || !loadGranularParams(args.positional(0), params)) {
+        ShowUsage(argv[0]);
+        return 1;
+    }
+    if (args.has("threads"))
+        setHostThreadCount((unsigned int)args.getNumber("threads", hostThreadCount()));
+
+    CoarseGrainSettings settings;
+    // by default a corridor of a quarter of the box width along the centre line
+    settings.corridor_y[0] = -params.box_Y / 8;
+    settings.corridor_y[1] = params.box_Y / 8;
+    if (args.has("corridor") &&
+        std::sscanf(args.getString("corridor", "").c_str(), "%f,%f", &settings.corridor_y[0],
+                    &settings.corridor_y[1]) != 2) {
+        std::cout << "ERROR: --corridor expects y0,y1" << std::endl;
+        return 1;
+    }
+    if (args.has("corridor-x") &&
+        std::sscanf(args.getString("corridor-x", "").c_str(), "%f,%f", &settings.corridor_x[0],
+                    &settings.corridor_x[1]) != 2) {
+        std::cout << "ERROR: --corridor-x expects x0,x1" << std::endl;
+        return 1;
+    }
+    settings.factor = (float)args.getNumber("factor", settings.factor);
+    settings.packing = (float)args.getNumber("packing", settings.packing);
+    settings.tolerance = (float)args.getNumber("tolerance", settings.tolerance);
+    if (settings.factor <= 1) {
+        std::cout << "ERROR: --factor must be greater than 1" << std::endl;
+        return 1;
+    }
+
+    ParticleBed fine;
+    if (!readBed(args.positional(1), params.sphere_radius, fine)) {
+        std::cout << "ERROR reading checkpoint file" << std::endl;
+        return 1;
+    }
+    if (fine.polydisperse()) {
+        std::cout << "ERROR the checkpoint is already polydisperse" << std::endl;
+        return 1;
+    }
+
+    CoarseGrainResult result = coarseGrain(fine, settings);
+    printf("fine particles in:    %zu (radius %g, packing %.4f)\n", fine.size(), fine.radius, result.packing_fine);
+    printf("fine particles kept:  %zu\n", result.fine_kept);
+    printf("coarse particles:     %zu (radius %g, spacing %.3f, layers %.3f apart, packing %.4f)\n", result.coarse,
+           fine.radius * settings.factor, result.spacing, result.layer_spacing, result.packing_coarse);
+    printf("replaced:             %zu (%zu absorbed at the corridor edge, %zu dropped at the surface)\n",
+           result.replaced, result.absorbed, result.dropped);
+    printf("solid volume:         %.6g replaced by %.6g (%+.2f%%)\n", result.volume_replaced, result.volume_coarse,
+           result.volume_replaced > 0 ? 100 * (result.volume_coarse / result.volume_replaced - 1) : 0.);
+    printf("particles out:        %zu (%.1f%% of the input)\n", result.bed.size(),
+           fine.size() ? 100.0 * result.bed.size() / fine.size() : 0.);
+
+    if (!writeBed(args.positional(2), result.bed)) {
+        std::cout << "ERROR writing " << args.positional(2) << " (polydisperse beds need .csv or .parquet)"
+                  << std::endl;
+        return 1;
+    }
+    if (args.has("mapping") && !writeCoarseMapping(args.getString("mapping", ""), result.mapping)) {
+        std::cout << "ERROR writing the mapping" << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,98 @@
+// =============================================================================
+// Host granular solve of a checkpoint split into slab processes along x, with
+// an optional wheel mesh driven at constant forward speed and spin.
+// =============================================================================
+
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "CheckpointIO.hpp"
+#include "HostArgs.hpp"
+#include "HostGranular.hpp"
+#include "SlabDecomposition.hpp"
+
+constexpr double mars_grav_mag = 370;
+constexpr double wheel_rad = 13;    // cm, as in rovertest
+constexpr double wheel_width = 16;  // cm
+
+void ShowUsage(std::string name) {
+    std::cout << "usage: " + name +
+                     " <json_file> <checkpoint_file> <num_steps> [--ranks N] [--rebalance steps] "
+                     "[--report steps] [--out checkpoint_file] [--loads loads_csv] [--wheel obj_file] "
+                     "[--wheel-pos x,y,z] [--wheel-vel cm/s] [--wheel-omega rad/s] [--gravity-angle deg]"
+              << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+    HostArgs args(argc, argv);
+    GranularParams params;
+    if (args.numPositional() != 3 || !loadGranularParams(args.positional(0), params)) {
+        ShowUsage(argv[0]);
+        return 1;
+    }
+    double grav_angle = 2.0 * 3.14159265358979 * args.getNumber("gravity-angle", 0) / 360.0;
+    params.gravity = {(float)(-mars_grav_mag * std::sin(grav_angle)), 0,
+                      (float)(-mars_grav_mag * std::cos(grav_angle))};
+
+    std::vector<Vec3f> positions;
+    if (!readCheckpointCSV(args.positional(1), positions)) {
+        std::cout << "ERROR reading checkpoint file" << std::endl;
+        return 1;
+    }
+    ParticleArrays particles;
+    float max_z = -1e30f;
+    for (size_t i = 0; i < positions.size(); i++) {
+        particles.push((uint32_t)i, positions[i], {0, 0, 0}, {0, 0, 0});
+        max_z = std::max(max_z, positions[i].z);
+    }
+    unsigned long num_steps = std::stoul(args.positional(2));
+
+    SlabConfig config;
+    config.num_ranks = (unsigned int)args.getNumber("ranks", 2);
+    config.rebalance_interval = (unsigned int)args.getNumber("rebalance", config.rebalance_interval);
+    config.report_interval = (unsigned int)args.getNumber("report", config.report_interval);
+    config.loads_file = args.getString("loads", "");
+
+    std::vector<TriangleMesh> meshes;
+    MeshMotion motion = [](double, std::vector<MeshPose>&) {};
+    if (args.has("wheel")) {
+        TriangleMesh wheel;
+        if (!loadObjMesh(args.getString("wheel", ""), wheel)) {
+            std::cout << "ERROR reading wheel mesh" << std::endl;
+            return 1;
+        }
+        const float wheel_scaling[9] = {(float)(2 * wheel_rad), 0, 0, 0, (float)wheel_width, 0,
+                                        0, 0, (float)(2 * wheel_rad)};
+        transformMesh(wheel, wheel_scaling, {0, 0, 0});
+        meshes.push_back(wheel);
+
+        // start resting on the bed a quarter of the way along the box
+        Vec3f start = args.getVec3("wheel-pos", {-params.box_X / 4, 0, max_z + params.sphere_radius + (float)wheel_rad});
+        float speed = (float)args.getNumber("wheel-vel", 0);
+        float spin = (float)args.getNumber("wheel-omega", 0);
+        motion = [start, speed, spin](double t, std::vector<MeshPose>& poses) {
+            poses[0].pos = {start.x + speed * (float)t, start.y, start.z};
+            poses[0].rot = quatFromAxisAngle({0, 1, 0}, spin * (float)t);
+            poses[0].lin_vel = {speed, 0, 0};
+            poses[0].ang_vel = {0, spin, 0};
+        };
+    }
+
+    printf("%zu particles, %u slab processes, %lu steps of %g s%s\n", particles.size(), config.num_ranks, num_steps,
+           params.step_size, params.periodic_x ? ", periodic in x" : "");
+    SlabSolve solve(params, meshes, config);
+    auto start = std::chrono::steady_clock::now();
+    if (!solve.run(particles, motion, num_steps))
+        return 1;
+    double total_time = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "Time: " << total_time << " seconds" << std::endl;
+
+    if (args.has("out") && !writeCheckpointCSV(args.getString("out", ""), particles.pos, &particles.vel)) {
+        std::cout << "ERROR writing checkpoint file" << std::endl;
+        return 1;
+    }
+    return 0;
+}
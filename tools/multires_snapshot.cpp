@@ -0,0 +1,80 @@
+// =============================================================================
+// Multiresolution particle snapshots: convert a CSV particle frame into the
+// octree-level layout of MultiresSnapshot.hpp, or read a preview back from
+// the first levels (or first bytes) of a snapshot.
+//
+// usage: multires_snapshot <frame.csv> <snapshot.mrs> [--levels N]
+//        multires_snapshot <snapshot.mrs> [--level L | --bytes N] [--out preview.csv]
+// =============================================================================
+
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "CheckpointIO.hpp"
+#include "HostArgs.hpp"
+#include "MultiresSnapshot.hpp"
+
+void ShowUsage(std::string name) {
+    std::cout << "usage: " + name + " <frame.csv> <snapshot.mrs> [--levels N]\n"
+              << "       " + name + " <snapshot.mrs> [--level L | --bytes N] [--out preview.csv]" << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+    HostArgs args(argc, argv);
+    if (args.numPositional() == 2) {
+        std::vector<Vec3f> pos;
+        if (!readCheckpointCSV(args.positional(0), pos)) {
+            std::cout << "ERROR reading particle frame" << std::endl;
+            return 1;
+        }
+        if (!writeMultiresSnapshot(args.positional(1), pos, (unsigned int)args.getNumber("levels", 12))) {
+            std::cout << "ERROR writing snapshot" << std::endl;
+            return 1;
+        }
+        std::cout << "Wrote " << pos.size() << " particles to " << args.positional(1) << std::endl;
+        return 0;
+    }
+    if (args.numPositional() != 1) {
+        ShowUsage(argv[0]);
+        return 1;
+    }
+
+    MultiresHeader header;
+    std::vector<uint64_t> level_counts;
+    std::vector<MultiresRecord> records;
+    if (!readMultiresSnapshot(args.positional(0), sizeof(MultiresHeader), header, level_counts, records)) {
+        std::cout << "ERROR reading snapshot" << std::endl;
+        return 1;
+    }
+    size_t max_bytes = (size_t)args.getNumber("bytes", 0);
+    if (args.has("level"))
+        max_bytes = multiresLevelBytes(level_counts, (size_t)args.getNumber("level", 0) + 1);
+    if (!readMultiresSnapshot(args.positional(0), max_bytes, header, level_counts, records)) {
+        std::cout << "ERROR reading snapshot" << std::endl;
+        return 1;
+    }
+
+    printf("%llu particles in %u levels\n", (unsigned long long)header.count, header.num_levels);
+    printf("%-6s %12s %12s %14s\n", "level", "cell size", "particles", "bytes to read");
+    uint64_t total = 0;
+    for (size_t l = 0; l < level_counts.size(); l++) {
+        total += level_counts[l];
+        printf("%-6zu %12.4g %12llu %14zu%s\n", l, header.octree_size / (float)(2 << l),
+               (unsigned long long)level_counts[l], multiresLevelBytes(level_counts, l + 1),
+               total <= records.size() ? " *" : "");
+    }
+    printf("read %zu particles (%.1f%%)\n", records.size(), header.count ? 100. * records.size() / header.count : 0.);
+
+    if (args.has("out")) {
+        std::vector<Vec3f> pos(records.size());
+        for (size_t i = 0; i < records.size(); i++)
+            pos[i] = {records[i].pos[0], records[i].pos[1], records[i].pos[2]};
+        if (!writeCheckpointCSV(args.getString("out", ""), pos)) {
+            std::cout << "ERROR writing preview" << std::endl;
+            return 1;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,141 @@
+// =============================================================================
+// Generate a test terrain over the footprint of the JSON box from a seed:
+// fractal noise, craters and rocks from size-frequency distributions and a
+// slope ramp. Writes, for an output prefix,
+//   <prefix>_height.csv   ground heights (checkpoint_transform --crop-height)
+//   <prefix>_rocks.csv    rock centres, radii and yaw
+//   <prefix>.obj          the surface with the rocks, with --obj
+//   <prefix>_bed.<ext>    a bed filling the box floor up to the ground
+// The bed tiles the bulk of a settled checkpoint (--template), or a loose
+// lattice without one, so it is ready to run after a short settle.
+// With --periodic-x (or periodic_x in the JSON file) the terrain and bed
+// repeat along x over box_X, for periodic bins.
+//
+// e.g. craters and rocks on a 10 degree ramp, bed from a settled flat bed:
+//   terrain_gen rovertest.json mars --seed 7 --craters 2,2,10,60
+//       --rocks 20,2.5,4,16 --slope 10,0,100 --template settled.csv
+// =============================================================================
+
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "HostArgs.hpp"
+#include "HostGranular.hpp"
+#include "Terrain.hpp"
+
+void ShowUsage(std::string name) {
+    std::cout << "usage: " + name +
+                     " <json_file> <out_prefix> [--seed n] [--cell h] [--height z] [--amplitude a] "
+                     "[--wavelength l] [--octaves n] [--persistence p] [--craters spec] [--crater-depth f] "
+                     "[--rocks spec] [--burial f] [--slope deg,x0,x1] [--template checkpoint] [--packing f] "
+                     "[--bed-format csv|parquet|mrs|bin] [--no-bed] [--obj] [--tile n] [--periodic-x] [--threads N]\n"
+                     "crater and rock specs are density,exponent,d_min,d_max: the count per 100 x 100 area "
+                     "of diameter d_min and up, falling as D^-exponent up to d_max"
+              << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+    HostArgs args(argc, argv, {"no-bed", "obj", "periodic-x"});
+    GranularParams params;
+    if (args.numPositional() != 2 || !loadGranularParams(args.positional(0), params)) {
+        ShowUsage(argv[0]);
+        return 1;
+    }
+    if (args.has("threads"))
+        setHostThreadCount((unsigned int)args.getNumber("threads", hostThreadCount()));
+    const std::string prefix = args.positional(1);
+    const float r = params.sphere_radius;
+
+    TerrainSettings s;
+    s.size_x = params.box_X;
+    s.size_y = params.box_Y;
+    s.seed = (uint64_t)args.getNumber("seed", 1);
+    s.cell = (float)args.getNumber("cell", 2 * r);
+    s.base_height = (float)args.getNumber("height", 0);
+    s.amplitude = (float)args.getNumber("amplitude", 2 * r);
+    s.wavelength = (float)args.getNumber("wavelength", params.box_Y / 2);
+    s.octaves = (int)args.getNumber("octaves", s.octaves);
+    s.persistence = (float)args.getNumber("persistence", s.persistence);
+    s.crater_depth = (float)args.getNumber("crater-depth", s.crater_depth);
+    s.rock_burial = (float)args.getNumber("burial", s.rock_burial);
+    s.tile = (int)args.getNumber("tile", s.tile);
+    s.periodic_x = params.periodic_x || args.has("periodic-x");
+    if ((args.has("craters") && !s.craters.parse(args.getString("craters", ""))) ||
+        (args.has("rocks") && !s.rocks.parse(args.getString("rocks", "")))) {
+        std::cout << "ERROR --craters and --rocks expect density,exponent,d_min,d_max" << std::endl;
+        return 1;
+    }
+    s.craters.density /= 1e4f;
+    s.rocks.density /= 1e4f;
+    if (args.has("slope") && std::sscanf(args.getString("slope", "").c_str(), "%f,%f,%f", &s.slope_deg, &s.slope_x0,
+                                         &s.slope_x1) != 3) {
+        std::cout << "ERROR --slope expects deg,x0,x1" << std::endl;
+        return 1;
+    }
+    if (s.periodic_x && s.slope_deg != 0) {
+        std::cout << "ERROR --slope does not repeat along x: leave it out of periodic terrains" << std::endl;
+        return 1;
+    }
+    if (s.cell <= 0 || s.wavelength <= 0) {
+        std::cout << "ERROR --cell and --wavelength must be positive" << std::endl;
+        return 1;
+    }
+
+    auto seconds_since = [](std::chrono::steady_clock::time_point t) {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - t).count();
+    };
+    auto start = std::chrono::steady_clock::now();
+    Terrain terrain = generateTerrain(s);
+    const std::vector<float>& h = terrain.ground.heights;
+    printf("terrain:  %d x %d heights in %.2f s on %u threads, ground %.3f to %.3f\n", terrain.ground.nx,
+           terrain.ground.ny, seconds_since(start), hostThreadCount(), *std::min_element(h.begin(), h.end()),
+           *std::max_element(h.begin(), h.end()));
+    printf("craters:  %zu\n", terrain.craters.size());
+    printf("rocks:    %zu\n", terrain.rocks.size());
+    if (*std::max_element(h.begin(), h.end()) > params.box_Z / 2)
+        printf("warning: the ground rises above the box top at %g\n", params.box_Z / 2);
+
+    if (!writeHeightfield(prefix + "_height.csv", terrain.ground) ||
+        !writeRocks(prefix + "_rocks.csv", terrain.rocks) ||
+        (args.has("obj") && !writeObjMesh(prefix + ".obj", heightfieldMesh(terrain.surface)))) {
+        std::cout << "ERROR writing the terrain files" << std::endl;
+        return 1;
+    }
+    if (args.has("no-bed"))
+        return 0;
+
+    start = std::chrono::steady_clock::now();
+    BedTemplate block;
+    if (args.has("template")) {
+        ParticleBed settled;
+        if (!readBed(args.getString("template", ""), r, settled) || settled.polydisperse()) {
+            std::cout << "ERROR reading the template checkpoint (monodisperse, sphere_radius)" << std::endl;
+            return 1;
+        }
+        block = templateFromBed(settled.pos, r, 8 * r, 0.05f);
+        if (block.pos.empty()) {
+            std::cout << "ERROR the template bed is too small for a periodic block" << std::endl;
+            return 1;
+        }
+        printf("template: %zu particles in a %.2f x %.2f x %.2f block, packing %.4f\n", block.pos.size(),
+               block.period.x, block.period.y, block.period.z,
+               block.pos.size() * (4. / 3. * M_PI * r * r * r) / (block.period.x * block.period.y * block.period.z));
+    } else {
+        block = latticeTemplate(r, (float)args.getNumber("packing", 0.58));
+    }
+    ParticleBed bed;
+    bed.radius = r;
+    fillTerrainBed(terrain.ground, -params.box_Z / 2, r, block, terrain.rocks, s.tile * s.cell, bed.pos);
+    printf("bed:      %zu particles in %.2f s%s\n", bed.size(), seconds_since(start),
+           s.periodic_x ? ", periodic in x" : "");
+
+    std::string bed_file = prefix + "_bed." + args.getString("bed-format", "csv");
+    if (!writeBed(bed_file, bed)) {
+        std::cout << "ERROR writing " << bed_file << std::endl;
+        return 1;
+    }
+    return 0;
+}